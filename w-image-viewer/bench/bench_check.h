@@ -0,0 +1,34 @@
+#pragma once
+
+#include "pch.h"
+#include <iostream>
+
+// Expectations of a check, every failed one is printed prefixed with the name of the check.
+class Bench_check
+{
+public:
+    explicit Bench_check(const char* name) noexcept :
+        name(name)
+    {}
+
+    // Returns the condition, so the expectations that depend on it can be skipped.
+    bool expect(bool condition, std::string_view what)
+    {
+        if (!condition) {
+            std::cerr << name << ": " << what << '\n';
+            is_ok = false;
+        }
+        return condition;
+    }
+
+    // Prints the result, returns true if no expectation failed.
+    bool finish() const
+    {
+        std::cerr << name << ": " << (is_ok ? "ok" : "failed") << '\n';
+        return is_ok;
+    }
+
+    const char* const name;
+private:
+    bool is_ok = true;
+};
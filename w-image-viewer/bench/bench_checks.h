@@ -0,0 +1,83 @@
+#pragma once
+
+#include "pch.h"
+
+// Benches and checks of the components, each one next to the component it covers in check_<component>.cpp.
+// Checks return true if every expectation held.
+
+// check_image.cpp
+void bench_decode(const std::filesystem::path& path, int iterations);
+void bench_expand_channels(int iterations);
+void bench_navigation(const std::filesystem::path& directory, int iterations);
+void bench_raw(const std::filesystem::path& path, int iterations);
+bool check_image_move(const std::filesystem::path& directory);
+bool check_image_cache_mip(const std::filesystem::path& directory);
+#ifdef __linux__
+bool check_read_syscalls(const std::filesystem::path& directory);
+#endif
+
+// check_half.cpp
+void bench_float_to_half(int iterations);
+bool check_float_to_half();
+
+// check_icc.cpp
+void bench_cms_lut(int iterations);
+void bench_cms_apply_lut(int iterations);
+void bench_cms_open(const std::filesystem::path& path, int iterations);
+bool check_cms_apply_lut();
+bool check_matrix_shaper();
+bool check_adaptive_lut();
+
+// check_mapped_file.cpp
+void bench_mapped_file(const std::filesystem::path& directory, int iterations);
+bool check_mapped_file(const std::filesystem::path& directory);
+
+// check_file_manager.cpp
+void bench_directory_scan(const std::filesystem::path& directory, int iterations);
+void bench_key_repeat(const std::filesystem::path& directory, int iterations);
+
+// check_font_atlas.cpp
+#ifdef WIV_IMGUI
+void bench_font_atlas(const std::filesystem::path& directory, int iterations);
+bool check_font_atlas(const std::filesystem::path& directory);
+#endif
+
+// check_ipc.cpp
+bool check_ipc(int iterations);
+
+// check_thumbnail_store.cpp
+bool check_thumbnail_store(const std::filesystem::path& directory, int iterations);
+
+// check_animation.cpp
+bool check_animation(const std::filesystem::path& directory);
+
+// check_metadata_cache.cpp
+bool check_metadata_cache(const std::filesystem::path& directory);
+
+// check_render_cache.cpp
+bool check_render_cache();
+
+// check_quality_governor.cpp
+bool check_quality_governor();
+
+// check_lru_cache.cpp
+bool check_lru_cache();
+
+// check_tiled_image.cpp
+bool check_tiled_image(const std::filesystem::path& directory);
+
+// check_buffer_pool.cpp
+bool check_buffer_pool();
+
+// check_frame_scheduler.cpp
+bool check_frame_scheduler();
+bool check_idle_cpu();
+
+// check_slideshow.cpp
+bool check_slideshow(const std::filesystem::path& directory);
+
+// check_gpu_profiler.cpp
+bool check_gpu_profiler();
+
+// check_metrics.cpp
+bool check_metrics(const std::filesystem::path& directory);
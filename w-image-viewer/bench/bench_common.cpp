@@ -0,0 +1,30 @@
+#include "pch.h"
+#include "bench_common.h"
+
+bool decode(Image& image)
+{
+    switch (image.get_basetype()) {
+        case OIIO::TypeDesc::UINT8:
+            return image.get_image_data<uint8_t>() != nullptr;
+        case OIIO::TypeDesc::UINT16:
+        case OIIO::TypeDesc::HALF:
+            return image.get_image_data<uint16_t>() != nullptr;
+        case OIIO::TypeDesc::FLOAT:
+            return image.get_image_data_half() != nullptr;
+    }
+    return false;
+}
+
+std::chrono::nanoseconds get_cpu_time() noexcept
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+    const auto to_100ns = [](const FILETIME& time) { return (static_cast<int64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime; };
+    return std::chrono::nanoseconds((to_100ns(kernel) + to_100ns(user)) * 100);
+#else
+    timespec time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec);
+#endif
+}
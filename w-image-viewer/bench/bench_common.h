@@ -0,0 +1,33 @@
+#pragma once
+
+#include "pch.h"
+#include "image.h"
+
+// Dims of the generated test images.
+inline constexpr int WIV_BENCH_WIDTH = 4000;
+inline constexpr int WIV_BENCH_HEIGHT = 3000;
+
+// Decodes the image the way the loader does, returns false if the read failed.
+bool decode(Image& image);
+
+// CPU time of the process.
+std::chrono::nanoseconds get_cpu_time() noexcept;
+
+// Image with the pixels from get_pixel(x, y, c), written as 4 channels of format.
+template<typename F>
+bool write_pattern(const std::filesystem::path& path, int width, int height, OIIO::TypeDesc format, F get_pixel)
+{
+    auto output = OIIO::ImageOutput::create(path.string());
+    if (!output || !output->open(path.string(), OIIO::ImageSpec(width, height, 4, format))) {
+        return false;
+    }
+    std::vector<float> pixels(static_cast<size_t>(width) * height * 4);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < 4; ++c) {
+                pixels[(static_cast<size_t>(y) * width + x) * 4 + c] = get_pixel(x, y, c);
+            }
+        }
+    }
+    return output->write_image(OIIO::TypeDesc::FLOAT, pixels.data()) && output->close();
+}
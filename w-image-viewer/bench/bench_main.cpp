@@ -0,0 +1,141 @@
+#include "pch.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "include/bench.h"
+#include <iostream>
+#include <random>
+
+// Usage: wiv_bench [iterations] [output directory] [RAW files]
+// Generates test images into a temporary directory, then benches decode (also through stdio against the mapped file),
+// float to half conversion, color management (also opening an image with and without the matrix-shaper fast path), directory scan
+// navigating back and forth with and without the image cache, holding a key to navigate,
+// and opening the given RAW files (like CR2, NEF, ARW samples) from the thumbnail, at half size and at full size.
+// Also checks the float to half conversion, the matrix-shaper CMS transform against lcms, the CPU LUT applicator against its scalar path,
+// checks the single instance IPC (also with concurrent clients), the thumbnail store, the animation playback, the rendered view cache policy,
+// the quality governor decisions, moving images, reducing through the image cache from a MIP level, the LRU cache, the tiled image pyramid, the metadata cache (cold and warm),
+// that decoding opens a file once without read syscalls (Linux), reading mapped files that got truncated,
+// reusing pooled buffers, the frame scheduler, the CPU used by an idle render loop, the slideshow period error with the file manager and its loader,
+// the GPU profiler with a fake clock, the metrics, the auto sized CMS LUTs against their error budget,
+// and if ImGui is found benches building the font atlas against loading it from the cache, and checks the cache.
+// Results are written as CSV to stdout, and into the output directory if one is given.
+
+namespace
+{
+    constexpr int WIV_BENCH_SCAN_FILES = 1000;
+
+    bool write_image(const std::filesystem::path& path, int nchannels, OIIO::TypeDesc format)
+    {
+        auto output = OIIO::ImageOutput::create(path.string());
+        if (!output) {
+            return false;
+        }
+        const OIIO::ImageSpec spec(WIV_BENCH_WIDTH, WIV_BENCH_HEIGHT, nchannels, format);
+        if (!output->open(path.string(), spec)) {
+            return false;
+        }
+
+        // Gradient with some noise, so the encoders can't compress it to nothing.
+        std::vector<float> pixels(static_cast<size_t>(WIV_BENCH_WIDTH) * WIV_BENCH_HEIGHT * nchannels);
+        std::minstd_rand rng(42);
+        std::uniform_real_distribution<float> noise(0.0f, 0.05f);
+        for (int y = 0; y < WIV_BENCH_HEIGHT; ++y) {
+            for (int x = 0; x < WIV_BENCH_WIDTH; ++x) {
+                for (int c = 0; c < nchannels; ++c) {
+                    const float gradient = c % 2 ? static_cast<float>(x) / WIV_BENCH_WIDTH : static_cast<float>(y) / WIV_BENCH_HEIGHT;
+                    pixels[(static_cast<size_t>(y) * WIV_BENCH_WIDTH + x) * nchannels + c] = gradient * 0.95f + noise(rng);
+                }
+            }
+        }
+        return output->write_image(OIIO::TypeDesc::FLOAT, pixels.data()) && output->close();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 5;
+    const std::filesystem::path output_directory = argc > 2 ? argv[2] : "";
+
+    const auto directory = std::filesystem::temp_directory_path() / "wiv_bench";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    const std::array<std::tuple<const char*, int, OIIO::TypeDesc>, 4> inputs = { {
+        { "rgb8.png", 3, OIIO::TypeDesc::UINT8 },
+        { "grey16.png", 1, OIIO::TypeDesc::UINT16 },
+        { "rgba16.tif", 4, OIIO::TypeDesc::UINT16 },
+        { "rgba32f.exr", 4, OIIO::TypeDesc::FLOAT },
+    } };
+    for (const auto& [name, nchannels, format] : inputs) {
+        if (!write_image(directory / name, nchannels, format)) {
+            std::cerr << "Failed to write " << name << ": " << OIIO::geterror() << '\n';
+            return 1;
+        }
+    }
+
+    // Empty files are enough for the scan, half of them have extensions we don't support.
+    const auto scan_directory = directory / "scan";
+    std::filesystem::create_directories(scan_directory);
+    for (int i = 0; i < WIV_BENCH_SCAN_FILES; ++i) {
+        std::ofstream(scan_directory / (std::to_string(i) + (i % 2 ? ".JPG" : ".txt")));
+    }
+
+    Bench::is_enabled = true;
+    for (const auto& [name, nchannels, format] : inputs) {
+        bench_decode(directory / name, iterations);
+    }
+    bench_mapped_file(directory, iterations);
+    bench_expand_channels(iterations);
+    bench_float_to_half(iterations);
+    bench_cms_lut(iterations);
+    bench_cms_open(directory / "rgb8.png", iterations);
+    bench_cms_apply_lut(iterations);
+#ifdef WIV_IMGUI
+    bench_font_atlas(directory, iterations);
+#endif
+    bench_directory_scan(scan_directory, iterations);
+    bench_navigation(directory, iterations);
+    bench_key_repeat(directory, iterations);
+    for (int i = 3; i < argc; ++i) {
+        bench_raw(argv[i], iterations);
+    }
+    const bool is_ipc_ok = check_ipc(iterations);
+    const bool is_thumbnail_store_ok = check_thumbnail_store(directory, iterations);
+    const bool is_animation_ok = check_animation(directory);
+    const bool is_metadata_cache_ok = check_metadata_cache(directory);
+    Bench::is_enabled = false;
+    const bool is_float_to_half_ok = check_float_to_half();
+    const bool is_render_cache_ok = check_render_cache();
+    const bool is_quality_governor_ok = check_quality_governor();
+    const bool is_image_move_ok = check_image_move(directory);
+    const bool is_image_cache_mip_ok = check_image_cache_mip(directory);
+    const bool is_lru_cache_ok = check_lru_cache();
+    const bool is_tiled_image_ok = check_tiled_image(directory);
+    const bool is_mapped_file_ok = check_mapped_file(directory);
+    const bool is_buffer_pool_ok = check_buffer_pool();
+    const bool is_frame_scheduler_ok = check_frame_scheduler();
+    const bool is_idle_cpu_ok = check_idle_cpu();
+    const bool is_slideshow_ok = check_slideshow(directory);
+    const bool is_gpu_profiler_ok = check_gpu_profiler();
+    const bool is_metrics_ok = check_metrics(directory);
+#ifdef __linux__
+    const bool is_read_syscalls_ok = check_read_syscalls(directory);
+#else
+    const bool is_read_syscalls_ok = true;
+#endif
+    const bool is_matrix_shaper_ok = check_matrix_shaper();
+    const bool is_apply_lut_ok = check_cms_apply_lut();
+    const bool is_adaptive_lut_ok = check_adaptive_lut();
+#ifdef WIV_IMGUI
+    const bool is_font_atlas_ok = check_font_atlas(directory);
+#else
+    const bool is_font_atlas_ok = true;
+#endif
+
+    Bench::write_csv(std::cout);
+    if (!output_directory.empty()) {
+        std::filesystem::create_directories(output_directory);
+        Bench::write_files(output_directory);
+    }
+    std::filesystem::remove_all(directory);
+    return is_float_to_half_ok && is_matrix_shaper_ok && is_apply_lut_ok && is_ipc_ok && is_thumbnail_store_ok && is_animation_ok && is_render_cache_ok && is_quality_governor_ok && is_image_move_ok && is_image_cache_mip_ok && is_lru_cache_ok && is_tiled_image_ok && is_metadata_cache_ok && is_read_syscalls_ok && is_mapped_file_ok && is_buffer_pool_ok && is_frame_scheduler_ok && is_idle_cpu_ok && is_slideshow_ok && is_gpu_profiler_ok && is_metrics_ok && is_adaptive_lut_ok && is_font_atlas_ok ? 0 : 1;
+}
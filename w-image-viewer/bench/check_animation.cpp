@@ -0,0 +1,135 @@
+#include "pch.h"
+#include "animation.h"
+#include "include/metrics.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+#include <iostream>
+
+namespace
+{
+
+    // 4K animation, played in real time for a few loops.
+    constexpr int WIV_BENCH_ANIMATION_WIDTH = 3840;
+    constexpr int WIV_BENCH_ANIMATION_HEIGHT = 2160;
+    constexpr int WIV_BENCH_ANIMATION_FRAMES = 12;
+    constexpr int WIV_BENCH_ANIMATION_FPS = 10;
+    constexpr int WIV_BENCH_ANIMATION_LOOPS = 3;
+
+    // Animated WebP if the WebP writer can write animations, otherwise animated GIF.
+    // Bands moving across the frame, so every frame differs.
+    std::filesystem::path write_animation(const std::filesystem::path& directory)
+    {
+        auto path = directory / "animation.webp";
+        auto output = OIIO::ImageOutput::create(path.string());
+        if (!output || !output->supports("multiimage") || !output->supports("appendsubimage")) {
+            path = directory / "animation.gif";
+            output = OIIO::ImageOutput::create(path.string());
+        }
+        if (!output) {
+            return {};
+        }
+        OIIO::ImageSpec spec(WIV_BENCH_ANIMATION_WIDTH, WIV_BENCH_ANIMATION_HEIGHT, 3, OIIO::TypeDesc::UINT8);
+        const int fps[2] = { WIV_BENCH_ANIMATION_FPS, 1 };
+        spec.attribute("FramesPerSecond", OIIO::TypeRational, fps);
+        spec.attribute("oiio:Movie", 1);
+        std::vector<uint8_t> pixels(static_cast<size_t>(WIV_BENCH_ANIMATION_WIDTH) * WIV_BENCH_ANIMATION_HEIGHT * 3);
+        for (int i = 0; i < WIV_BENCH_ANIMATION_FRAMES; ++i) {
+            if (!output->open(path.string(), spec, i ? OIIO::ImageOutput::AppendSubimage : OIIO::ImageOutput::Create)) {
+                return {};
+            }
+            for (int y = 0; y < WIV_BENCH_ANIMATION_HEIGHT; ++y) {
+                for (int x = 0; x < WIV_BENCH_ANIMATION_WIDTH; ++x) {
+                    const auto pixel = pixels.data() + (static_cast<size_t>(y) * WIV_BENCH_ANIMATION_WIDTH + x) * 3;
+                    pixel[0] = static_cast<uint8_t>((x + i * 64) / 16);
+                    pixel[1] = static_cast<uint8_t>(y / 9);
+                    pixel[2] = static_cast<uint8_t>(i * 255 / WIV_BENCH_ANIMATION_FRAMES);
+                }
+            }
+            if (!output->write_image(OIIO::TypeDesc::UINT8, pixels.data())) {
+                return {};
+            }
+        }
+        return output->close() ? path : std::filesystem::path();
+    }
+}
+
+// Plays the animation like the message loop does, sleeping until the next frame is due.
+// The budget fits only a few frames, so every frame gets decoded while playing.
+// Checks the frame delays come from the file, that no frame is late and that frames are shown on time.
+// Also checks that the animation doesn't start with a first frame of other dims,
+// and that with a budget that fits all frames the loops show the passed first frame instead of decoding it again.
+bool check_animation(const std::filesystem::path& directory)
+{
+    const auto path = write_animation(directory);
+    if (path.empty()) {
+        std::cerr << "animation: failed to write: " << OIIO::geterror() << '\n';
+        return false;
+    }
+    const size_t frame_size = static_cast<size_t>(WIV_BENCH_ANIMATION_WIDTH) * WIV_BENCH_ANIMATION_HEIGHT * 4;
+    const auto late_before = Metrics::animation_frames_late.get();
+    const std::chrono::microseconds delay(1'000'000 / WIV_BENCH_ANIMATION_FPS);
+    Image image;
+    std::shared_ptr<const uint8_t[]> first_frame;
+    if (image.open(path, false, true)) {
+        first_frame = image.get_image_data<uint8_t>();
+    }
+    image.close();
+    Animation animation;
+    bool is_ok = !animation.start(path, first_frame, WIV_BENCH_ANIMATION_WIDTH / 2, WIV_BENCH_ANIMATION_HEIGHT, frame_size * 4, Animation::Clock::now(), [] {});
+    if (!is_ok) {
+        std::cerr << "animation: started with a first frame of other dims\n";
+    }
+    auto due = Animation::Clock::now();
+    if (!animation.start(path, first_frame, WIV_BENCH_ANIMATION_WIDTH, WIV_BENCH_ANIMATION_HEIGHT, frame_size * 4, due, [] {})) {
+        std::cerr << "animation: " << path.filename() << " didn't open as an animation\n";
+        return false;
+    }
+    due += delay;
+    double error_sum = 0.0;
+    double error_max = 0.0;
+    int nshown = 0;
+    int index_expected = 1;
+    const int nframes = WIV_BENCH_ANIMATION_FRAMES * WIV_BENCH_ANIMATION_LOOPS;
+    while (nshown < nframes) {
+        const auto deadline = animation.get_deadline();
+        std::this_thread::sleep_until(deadline ? *deadline : Animation::Clock::now() + std::chrono::milliseconds(1));
+        const auto now = Animation::Clock::now();
+        const auto frame = animation.update(now);
+        if (!frame) {
+            continue;
+        }
+        if (frame->index != index_expected || frame->delay != delay) {
+            std::cerr << "animation: frame " << frame->index << " with delay " << frame->delay.count() << " us, expected frame " << index_expected << " with delay " << delay.count() << " us\n";
+            is_ok = false;
+        }
+        index_expected = (frame->index + 1) % WIV_BENCH_ANIMATION_FRAMES;
+        const double error = std::abs(std::chrono::duration<double, std::milli>(now - due).count());
+        error_sum += error;
+        error_max = std::max(error_max, error);
+        due += frame->delay;
+        ++nshown;
+    }
+    const auto late = Metrics::animation_frames_late.get() - late_before;
+    std::cerr << "animation: " << path.filename() << ' ' << nshown << " frames, " << late << " late, timing error mean " << error_sum / nshown << " ms, max " << error_max << " ms\n";
+
+    // Not in real time, every frame is due once it's decoded.
+    auto now = Animation::Clock::now();
+    bool is_first_frame_cached = false;
+    const bool is_started = animation.start(path, first_frame, WIV_BENCH_ANIMATION_WIDTH, WIV_BENCH_ANIMATION_HEIGHT, frame_size * WIV_BENCH_ANIMATION_FRAMES, now, [] {});
+    for (int i = 0; is_started && i < WIV_BENCH_ANIMATION_FRAMES; ) {
+        now += delay;
+        const auto frame = animation.update(now);
+        if (!frame) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        is_first_frame_cached = frame->index == 0 && frame->data == first_frame;
+        ++i;
+    }
+    animation.stop();
+    if (!is_first_frame_cached) {
+        std::cerr << "animation: the first frame was decoded again\n";
+    }
+    return is_ok && is_first_frame_cached && late == 0 && error_max < 5.0;
+}
@@ -0,0 +1,31 @@
+#include "pch.h"
+#include "buffer_pool.h"
+#include "include/global.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+
+// A reused buffer larger than requested goes back to the pool with its real size.
+bool check_buffer_pool()
+{
+    Bench_check check("buffer pool");
+    constexpr size_t mib = 1024 * 1024;
+    const int buffer_pool_size = g_config.buffer_pool_size.val;
+    g_config.buffer_pool_size.val = 64;
+    trim_pixel_buffers();
+    auto buffer = make_pixel_buffer(20 * mib);
+    const auto data = buffer.get();
+    buffer.reset();
+    check.expect(get_pooled_pixel_buffers_size() == 20 * mib, "the released buffer wasn't pooled");
+
+    // Rounded up to 18 MiB, close enough to reuse the 20 MiB one.
+    buffer = make_pixel_buffer(17 * mib);
+    check.expect(buffer.get() == data && get_pooled_pixel_buffers_size() == 0, "the pooled buffer wasn't reused");
+    check.expect(buffer.get_deleter().size == 20 * mib, "the reused buffer has the requested size instead of its own");
+    buffer.reset();
+    check.expect(get_pooled_pixel_buffers_size() == 20 * mib, "the reused buffer got pooled with the wrong size");
+    trim_pixel_buffers();
+    check.expect(get_pooled_pixel_buffers_size() == 0, "trimming kept buffers");
+    g_config.buffer_pool_size.val = buffer_pool_size;
+    return check.finish();
+}
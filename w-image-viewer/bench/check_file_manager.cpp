@@ -0,0 +1,95 @@
+#include "pch.h"
+#include "file_manager.h"
+#include "include/global.h"
+#include "include/helpers.h"
+#include "include/supported_extensions.h"
+#include "include/bench.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+#include <iostream>
+
+namespace
+{
+    // Holding a key at the usual key repeat rate.
+    constexpr int WIV_BENCH_KEY_REPEAT_PRESSES = 30;
+    constexpr auto WIV_BENCH_KEY_REPEAT_INTERVAL = std::chrono::milliseconds(33);
+}
+
+// Holding Next on a folder of large images at the key repeat rate, through File_manager::file_next() and its loader:
+// the latest request replaces the pending one and cancels the decode in progress.
+// Times file_next() itself, it opens the file on the UI thread, and from the last key press to its image being decoded.
+// The loader's on_decoded stands in for posting WIV_WM_OPEN_FILE.
+void bench_key_repeat(const std::filesystem::path& directory, int iterations)
+{
+    const auto key_repeat_directory = directory / "key_repeat";
+    std::filesystem::create_directories(key_repeat_directory);
+    for (const char* name : { "rgba16.tif", "rgba32f.exr", "rgb8.png" }) {
+        std::filesystem::copy_file(directory / name, key_repeat_directory / name, std::filesystem::copy_options::overwrite_existing);
+    }
+    const bool cycle_files = std::exchange(g_config.cycle_files.val, true);
+    const bool metadata_cache = std::exchange(g_config.metadata_cache.val, false);
+
+    // Declared before the file manager, so they outlive its loader.
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool is_decoded = false;
+    Bench::Clock::time_point decoded_time;
+    File_manager file_manager;
+    file_manager.loader.set_on_decoded([&] {
+        {
+            std::scoped_lock lock(mutex);
+            is_decoded = true;
+            decoded_time = Bench::Clock::now();
+        }
+        Bench::count("key repeat decodes");
+        cv.notify_one();
+    });
+    file_manager.file_open_startup(key_repeat_directory / "rgb8.png");
+    for (int i = 0; i < iterations; ++i) {
+        Bench::Clock::time_point last_key;
+        for (int press = 0; press < WIV_BENCH_KEY_REPEAT_PRESSES; ++press) {
+            last_key = Bench::Clock::now();
+            {
+                WIV_BENCH_SCOPE("key repeat file_next");
+                file_manager.file_next();
+            }
+            std::this_thread::sleep_until(last_key + WIV_BENCH_KEY_REPEAT_INTERVAL);
+        }
+
+        // Images of earlier presses get dropped, like WIV_WM_OPEN_FILE does.
+        std::unique_lock lock(mutex);
+        while (true) {
+            if (!cv.wait_for(lock, std::chrono::seconds(30), [&] { return is_decoded; })) {
+                std::cerr << "key repeat: the last image didn't decode\n";
+                g_config.cycle_files.val = cycle_files;
+                g_config.metadata_cache.val = metadata_cache;
+                return;
+            }
+            is_decoded = false;
+            const auto decoded_image = file_manager.loader.take();
+            if (decoded_image && !decoded_image->is_preview && decoded_image->path == file_manager.file_current) {
+                break;
+            }
+        }
+        Bench::record("key repeat settle", last_key, decoded_time);
+    }
+    g_config.cycle_files.val = cycle_files;
+    g_config.metadata_cache.val = metadata_cache;
+}
+
+// Same filtering the file manager does when looking for the next file.
+void bench_directory_scan(const std::filesystem::path& directory, int iterations)
+{
+    for (int i = 0; i < iterations; ++i) {
+        WIV_BENCH_SCOPE("directory scan");
+        std::vector<std::filesystem::path> files;
+        for (const auto& file : std::filesystem::directory_iterator(directory)) {
+            if (!file.is_directory() && path_match_spec(file.path(), WIV_SUPPORTED_EXTENSIONS)) {
+                files.push_back(file.path());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        Bench::count("directory scan files", static_cast<int64_t>(files.size()));
+    }
+}
@@ -0,0 +1,70 @@
+#include "pch.h"
+#include "font_atlas.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+
+#ifdef WIV_IMGUI
+// The UI font at startup, built like with the cache disabled and loaded from the cache.
+// Recorded by the profiled stages as "Font atlas build" and "Font atlas load".
+void bench_font_atlas(const std::filesystem::path& directory, int iterations)
+{
+    const auto path = directory / "font_atlas.dat";
+    {
+        ImFontAtlas atlas;
+        font_atlas_create(atlas, path, true);
+    }
+    for (int i = 0; i < iterations; ++i) {
+        {
+            ImFontAtlas atlas;
+            font_atlas_create(atlas, path, false);
+        }
+        {
+            ImFontAtlas atlas;
+            font_atlas_create(atlas, path, true);
+        }
+    }
+}
+
+// The loaded atlas should be the built one, and a damaged cache should get built again.
+bool check_font_atlas(const std::filesystem::path& directory)
+{
+    Bench_check check("font atlas");
+    const auto path = directory / "font_atlas_check.dat";
+    std::filesystem::remove(path);
+    ImFontAtlas built;
+    check.expect(!font_atlas_create(built, path, true), "loaded a missing cache");
+    ImFontAtlas loaded;
+    const bool is_loaded = font_atlas_create(loaded, path, true);
+#if IMGUI_VERSION_NUM < 19200
+    if (check.expect(is_loaded, "cache not loaded")) {
+        const size_t pixels_size = static_cast<size_t>(built.TexWidth) * built.TexHeight;
+        check.expect(loaded.TexWidth == built.TexWidth && loaded.TexHeight == built.TexHeight && std::memcmp(loaded.TexPixelsAlpha8, built.TexPixelsAlpha8, pixels_size) == 0, "pixels differ");
+        const ImFont* font_built = built.Fonts[0];
+        const ImFont* font_loaded = loaded.Fonts[0];
+        check.expect(font_loaded->Glyphs.Size == font_built->Glyphs.Size && font_loaded->FontSize == font_built->FontSize && font_loaded->Ascent == font_built->Ascent && font_loaded->Descent == font_built->Descent, "font differs");
+        for (const ImWchar c : std::array<ImWchar, 4>{ 'A', 'g', '\t', 0x0161 }) {
+            const ImFontGlyph* glyph_built = font_built->FindGlyphNoFallback(c);
+            const ImFontGlyph* glyph_loaded = font_loaded->FindGlyphNoFallback(c);
+            check.expect(glyph_built && glyph_loaded && glyph_loaded->AdvanceX == glyph_built->AdvanceX && glyph_loaded->X0 == glyph_built->X0 && glyph_loaded->Y1 == glyph_built->Y1 && glyph_loaded->U0 == glyph_built->U0 && glyph_loaded->V1 == glyph_built->V1, "glyph differs");
+        }
+    }
+
+    // Flip a pixel byte.
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekg(-1, std::ios::end);
+        const char byte = static_cast<char>(file.get() ^ 0xff);
+        file.seekp(-1, std::ios::end);
+        file.put(byte);
+    }
+    ImFontAtlas rebuilt;
+    check.expect(!font_atlas_create(rebuilt, path, true), "loaded a damaged cache");
+    ImFontAtlas reloaded;
+    check.expect(font_atlas_create(reloaded, path, true), "damaged cache not rewritten");
+#else
+    check.expect(!is_loaded, "loaded a cache under ImGui 1.92+");
+#endif
+    return check.finish();
+}
+#endif
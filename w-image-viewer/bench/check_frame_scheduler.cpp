@@ -0,0 +1,87 @@
+#include "pch.h"
+#include "frame_scheduler.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+#include <iostream>
+
+namespace
+{
+    // How long the render loop is left idle after a change.
+    constexpr auto WIV_BENCH_IDLE_DURATION = std::chrono::seconds(2);
+}
+
+// Dirty frames after a change, the settle frame, and scheduled frames, with the time given.
+bool check_frame_scheduler()
+{
+    Bench_check check("frame scheduler");
+    const auto draws = [](Frame_scheduler& frame_scheduler, Frame_scheduler::Clock::time_point now) {
+        int count = 0;
+        while (frame_scheduler.should_draw(now)) {
+            ++count;
+        }
+        return count;
+    };
+    const Frame_scheduler::Clock::time_point start;
+    Frame_scheduler frame_scheduler;
+    check.expect(draws(frame_scheduler, start) == WIV_DIRTY_FRAMES && !frame_scheduler.get_wait(start), "startup frames");
+
+    frame_scheduler.invalidate(start);
+    check.expect(frame_scheduler.get_wait(start) == Frame_scheduler::Clock::duration::zero(), "a dirty frame has to be drawn right away");
+    check.expect(draws(frame_scheduler, start) == WIV_DIRTY_FRAMES, "dirty frames after a change");
+    check.expect(frame_scheduler.get_wait(start) == WIV_SETTLE_DELAY, "the settle frame isn't due after the settle delay");
+    check.expect(draws(frame_scheduler, start + WIV_SETTLE_DELAY / 2) == 0, "drew before the settle frame");
+    check.expect(draws(frame_scheduler, start + WIV_SETTLE_DELAY) == 1 && !frame_scheduler.get_wait(start + WIV_SETTLE_DELAY), "the settle frame");
+
+    // The earliest request is kept.
+    const auto later = start + std::chrono::seconds(10);
+    frame_scheduler.schedule(later + std::chrono::seconds(2));
+    frame_scheduler.schedule(later + std::chrono::seconds(1));
+    frame_scheduler.schedule(later + std::chrono::seconds(3));
+    check.expect(frame_scheduler.get_wait(later) == std::chrono::seconds(1), "the earliest scheduled frame isn't next");
+    check.expect(draws(frame_scheduler, later) == 0, "drew before the scheduled frame");
+    check.expect(frame_scheduler.get_wait(later + std::chrono::seconds(5)) == Frame_scheduler::Clock::duration::zero(), "an overdue frame has to be drawn right away");
+    check.expect(draws(frame_scheduler, later + std::chrono::seconds(5)) == 1 && !frame_scheduler.get_wait(later + std::chrono::seconds(5)), "the scheduled frame");
+
+    // A change before the scheduled frame doesn't drop it.
+    const auto change = later + std::chrono::seconds(5);
+    frame_scheduler.schedule(change + std::chrono::seconds(1));
+    frame_scheduler.invalidate(change);
+    draws(frame_scheduler, change);
+    draws(frame_scheduler, change + WIV_SETTLE_DELAY);
+    check.expect(frame_scheduler.get_wait(change + WIV_SETTLE_DELAY) == std::chrono::seconds(1) - WIV_SETTLE_DELAY, "a change dropped the scheduled frame");
+    return check.finish();
+}
+
+// Runs the render loop like Window::message_loop() does, without messages, after one change.
+// Idle it should only draw the frames of the change and sleep the rest of the time.
+bool check_idle_cpu()
+{
+    Bench_check check("idle CPU");
+    Frame_scheduler frame_scheduler;
+    const auto cpu_start = get_cpu_time();
+    const auto start = Frame_scheduler::Clock::now();
+    const auto end = start + WIV_BENCH_IDLE_DURATION;
+    frame_scheduler.invalidate(start);
+    int nframes = 0;
+    while (true) {
+        const auto now = Frame_scheduler::Clock::now();
+        if (now >= end) {
+            break;
+        }
+        if (frame_scheduler.should_draw(now)) {
+            ++nframes;
+            continue;
+        }
+
+        // No messages arrive, so with no frame due we sleep until the end.
+        const auto wait = frame_scheduler.get_wait(now);
+        std::this_thread::sleep_until(wait ? std::min(now + *wait, end) : end);
+    }
+    const auto cpu = std::chrono::duration<double, std::milli>(get_cpu_time() - cpu_start).count();
+    const auto wall = std::chrono::duration<double, std::milli>(Frame_scheduler::Clock::now() - start).count();
+    std::cerr << "idle CPU: " << cpu << " ms in " << wall << " ms, " << nframes << " frames\n";
+    check.expect(nframes == WIV_DIRTY_FRAMES + 1, "drew " + std::to_string(nframes) + " frames instead of the dirty frames and the settle frame");
+    check.expect(cpu < wall / 100.0, "used more than 1% of a core");
+    return check.finish();
+}
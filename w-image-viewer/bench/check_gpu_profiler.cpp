@@ -0,0 +1,128 @@
+#include "pch.h"
+#include "include/profiler.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+
+namespace
+{
+    // Gpu_clock with timestamps set by the test, frames are ready once the test says so.
+    class Fake_gpu_clock : public Gpu_clock
+    {
+    public:
+        struct State
+        {
+            uint64_t now = 0; // In ticks, what the next timestamp reads.
+            uint64_t frequency = 1000; // Ticks are ms.
+            std::array<bool, WIV_GPU_PROFILER_FRAMES> is_ready = {};
+            std::array<std::array<uint64_t, WIV_GPU_PROFILER_QUERIES>, WIV_GPU_PROFILER_FRAMES> ticks = {};
+        };
+
+        explicit Fake_gpu_clock(State& state) noexcept :
+            state(state)
+        {}
+
+        void begin_frame(int frame) override
+        {
+            state.is_ready[frame] = false;
+        }
+
+        void end_frame(int) override
+        {}
+
+        void timestamp(int frame, int query) override
+        {
+            state.ticks[frame][query] = state.now;
+        }
+
+        bool read_frame(int frame, int count, uint64_t* ticks, uint64_t& frequency) override
+        {
+            if (!state.is_ready[frame]) {
+                return false;
+            }
+            std::copy_n(state.ticks[frame].begin(), count, ticks);
+            frequency = state.frequency;
+            return true;
+        }
+    private:
+        State& state;
+    };
+}
+
+// Scopes get summed by name, frames are read back in order once ready, a full ring skips frames instead of waiting,
+// and frames with unreliable timestamps are dropped.
+bool check_gpu_profiler()
+{
+    Bench_check check("GPU profiler");
+    Fake_gpu_clock::State state;
+    Gpu_profiler profiler;
+    profiler.set_clock(std::make_unique<Fake_gpu_clock>(state));
+    std::vector<std::pair<double, double>> frames; // Work and ms, as passed to the callback.
+    profiler.set_frame_callback([&frames](double work, double ms) { frames.emplace_back(work, ms); });
+    Profiler::gpu.clear();
+    const auto get_last = [](const char* name) {
+        for (const auto& timing : Profiler::gpu.get()) {
+            if (std::strcmp(timing.name, name) == 0) {
+                return timing.last;
+            }
+        }
+        return -1.0;
+    };
+    const auto scope = [&](const char* name, uint64_t ticks) {
+        const Gpu_profiler_scope gpu_profiler_scope(profiler, name);
+        state.now += ticks;
+    };
+
+    // "B" twice, summed.
+    profiler.begin_frame();
+    scope("A", 10);
+    scope("B", 3);
+    scope("B", 4);
+    profiler.end_frame(1.0);
+    profiler.collect();
+    check.expect(profiler.is_pending() && frames.empty(), "read a frame before it was ready");
+    state.is_ready.fill(true);
+    profiler.collect();
+    check.expect(!profiler.is_pending(), "the ready frame is still pending");
+    check.expect(get_last("A") == 10.0 && get_last("B") == 7.0, "wrong scope times");
+    check.expect(frames.size() == 1 && frames[0] == std::pair(1.0, 17.0), "wrong frame callback");
+
+    // Every slot in flight, the next frame isn't timed.
+    frames.clear();
+    for (int i = 0; i < WIV_GPU_PROFILER_FRAMES + 1; ++i) {
+        profiler.begin_frame();
+        scope("A", i + 1);
+        profiler.end_frame(i + 1.0);
+    }
+    check.expect(profiler.is_pending() && frames.empty(), "read frames before they were ready");
+    state.is_ready.fill(true);
+    profiler.collect();
+    bool is_in_order = frames.size() == WIV_GPU_PROFILER_FRAMES;
+    for (int i = 0; is_in_order && i < WIV_GPU_PROFILER_FRAMES; ++i) {
+        is_in_order = frames[i] == std::pair(i + 1.0, i + 1.0);
+    }
+    check.expect(is_in_order, "the frames in flight weren't read back in order, or the frame over the ring got timed");
+
+    // Scopes over the queries of a frame aren't timed.
+    frames.clear();
+    profiler.begin_frame();
+    for (int i = 0; i < WIV_GPU_PROFILER_QUERIES; ++i) {
+        scope("C", 1);
+    }
+    profiler.end_frame(1.0);
+    state.is_ready.fill(true);
+    profiler.collect();
+    check.expect(get_last("C") == WIV_GPU_PROFILER_QUERIES / 2 && frames.size() == 1, "wrong scopes over the queries of a frame");
+
+    // Unreliable timestamps.
+    frames.clear();
+    state.frequency = 0;
+    profiler.begin_frame();
+    scope("D", 1);
+    profiler.end_frame(1.0);
+    state.is_ready.fill(true);
+    profiler.collect();
+    check.expect(get_last("D") < 0.0 && frames.empty() && !profiler.is_pending(), "a frame with unreliable timestamps wasn't dropped");
+    Profiler::gpu.clear();
+    return check.finish();
+}
@@ -0,0 +1,121 @@
+#include "pch.h"
+#include "include/half.h"
+#include "include/helpers.h"
+#include "include/bench.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+#include <iostream>
+#include <limits>
+#include <random>
+
+namespace
+{
+    // Exact, every half is a float. Slow, the reference for half_to_float().
+    float half_to_float_reference(uint16_t h) noexcept
+    {
+        const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+        const int exponent = (h >> 10) & 0x1f;
+        const uint32_t mantissa = h & 0x3ff;
+        if (exponent == 0x1f) {
+            return std::bit_cast<float>(sign | 0x7f800000u | mantissa << 13);
+        }
+        const float magnitude = exponent ? std::ldexp(static_cast<float>(mantissa | 0x400), exponent - 25) : std::ldexp(static_cast<float>(mantissa), -24);
+        return std::bit_cast<float>(std::bit_cast<uint32_t>(magnitude) | sign);
+    }
+}
+
+// Half to float has to be exact, every half has to survive the round trip through float, the scalar and F16C paths have to agree bit for bit
+// (ties, subnormals, overflow and NaN included), and other floats have to round to the nearest half.
+bool check_float_to_half()
+{
+    Bench_check check("float to half");
+    for (uint32_t h = 0; h <= 0xffff; ++h) {
+        const float f = half_to_float_reference(static_cast<uint16_t>(h));
+        if (!check.expect(std::bit_cast<uint32_t>(half_to_float(static_cast<uint16_t>(h))) == std::bit_cast<uint32_t>(f), "half to float isn't exact")) {
+            break;
+        }
+    }
+    for (uint32_t h = 0; h <= 0xffff; ++h) {
+        const float f = half_to_float(static_cast<uint16_t>(h));
+        const uint16_t result = float_to_half(f);
+        if (std::isnan(f)) {
+            if (!check.expect((result & 0x7c00) == 0x7c00 && (result & 0x3ff), "NaN didn't stay NaN")) {
+                break;
+            }
+        }
+        else if (!check.expect(result == h, "half didn't survive the round trip")) {
+            break;
+        }
+    }
+
+    std::vector<float> src;
+    std::minstd_rand rng(42);
+    std::uniform_real_distribution<float> dist(-70000.0f, 70000.0f);
+    for (int i = 0; i < 1 << 20; ++i) {
+        src.push_back(i % 2 ? dist(rng) : std::bit_cast<float>(static_cast<uint32_t>(rng()) << 1 ^ static_cast<uint32_t>(rng())));
+    }
+
+    // Exactly halfway between two halves, in the normal and subnormal ranges.
+    for (uint32_t h = 0; h < 0x7bff; h += 7) {
+        src.push_back((half_to_float(static_cast<uint16_t>(h)) + half_to_float(static_cast<uint16_t>(h + 1))) / 2.0f);
+    }
+    for (const float f : { 0.0f, -0.0f, 65504.0f, 65519.0f, 65520.0f, 1e-8f, -1e-8f, std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::quiet_NaN() }) {
+        src.push_back(f);
+    }
+    std::vector<uint16_t> dst(src.size());
+    float_to_half(src.data(), dst.data(), src.size());
+    size_t mismatches = 0;
+    size_t misrounded = 0;
+    for (size_t i = 0; i < src.size(); ++i) {
+        const uint16_t scalar = float_to_half(src[i]);
+        mismatches += scalar != dst[i];
+        if (std::isnan(src[i]) || std::abs(src[i]) >= 65520.0f) {
+            continue;
+        }
+
+        // Neither neighbour of the result may be closer.
+        const double error = std::abs(static_cast<double>(half_to_float(scalar)) - src[i]);
+        const auto magnitude = static_cast<uint16_t>(scalar & 0x7fff);
+        for (const int step : { -1, 1 }) {
+            const int neighbour = magnitude + step;
+            if (neighbour < 0 || neighbour > 0x7bff) {
+                continue;
+            }
+            const double neighbour_error = std::abs(static_cast<double>(half_to_float(static_cast<uint16_t>(neighbour | (scalar & 0x8000)))) - src[i]);
+            misrounded += neighbour_error < error || (neighbour_error == error && (scalar & 1));
+        }
+    }
+    check.expect(!mismatches, std::to_string(mismatches) + " mismatches between the scalar and the vector path");
+    check.expect(!misrounded, std::to_string(misrounded) + " floats not rounded to the nearest even half");
+    return check.finish();
+}
+
+// Converting a full RGBA float image, with the path the CPU supports and with the scalar path,
+// throughput in float bytes read is printed to stderr.
+void bench_float_to_half(int iterations)
+{
+    const size_t nfloats = static_cast<size_t>(WIV_BENCH_WIDTH) * WIV_BENCH_HEIGHT * 4;
+    std::vector<float> src(nfloats);
+    std::minstd_rand rng(42);
+    std::uniform_real_distribution<float> dist(0.0f, 4.0f);
+    std::generate(src.begin(), src.end(), [&] { return dist(rng); });
+    std::vector<uint16_t> dst(nfloats);
+    for (int i = 0; i < iterations; ++i) {
+        {
+            WIV_BENCH_SCOPE("float_to_half");
+            float_to_half(src.data(), dst.data(), nfloats);
+        }
+        {
+            WIV_BENCH_SCOPE("float_to_half scalar");
+            for (size_t j = 0; j < nfloats; ++j) {
+                dst[j] = float_to_half(src[j]);
+            }
+        }
+    }
+    for (const auto& stats : Bench::get_stats()) {
+        if (std::strcmp(stats.name, "float_to_half") == 0 || std::strcmp(stats.name, "float_to_half scalar") == 0) {
+            std::cerr << stats.name << (cpu_has_f16c() ? "" : " (no F16C)") << ": " << nfloats * sizeof(float) / (stats.median * 1e6) << " GB/s\n";
+        }
+    }
+}
@@ -0,0 +1,283 @@
+#include "pch.h"
+#include "icc.h"
+#include "include/global.h"
+#include "include/helpers.h"
+#include "include/bench.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+#include <iostream>
+#include <limits>
+#include <random>
+
+namespace
+{
+    // Max difference of the matrix-shaper transform from lcms, in 16 bit steps.
+    constexpr double WIV_BENCH_MATRIX_SHAPER_MAX_ERROR = 16.0;
+
+    // Max dE2000 of the LUT against lcms, on random colors rather than the validation set of cms_create_lut_adaptive().
+    double get_lut_error(cmsHPROFILE profile_in, cmsHPROFILE profile_out, int intent, const uint16_t* lut, unsigned int lut_size)
+    {
+        using Profile = std::unique_ptr<std::remove_pointer_t<cmsHPROFILE>, decltype(&cmsCloseProfile)>;
+        const Profile profile_lab(cmsCreateLab4Profile(nullptr), cmsCloseProfile);
+        const auto htransform = cmsCreateTransform(profile_in, TYPE_RGB_FLT, profile_out, TYPE_RGB_FLT, intent, cmsFLAGS_NOOPTIMIZE);
+        const auto htransform_lab = cmsCreateTransform(profile_out, TYPE_RGB_FLT, profile_lab.get(), TYPE_Lab_DBL, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE);
+        std::mt19937 engine(1);
+        std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+        double error = 0.0;
+        for (int i = 0; i < 4096; ++i) {
+            const std::array<float, 3> rgb = { distribution(engine), distribution(engine), distribution(engine) };
+            std::array<float, 3> expected;
+            std::array<float, 3> result;
+            cmsDoTransform(htransform, rgb.data(), expected.data(), 1);
+
+            // The LUT can't hold out of range values.
+            for (auto& val : expected) {
+                val = std::clamp(val, 0.0f, 1.0f);
+            }
+            cms_apply_lut(lut, lut_size, rgb.data(), result.data());
+            cmsCIELab lab_expected;
+            cmsCIELab lab_result;
+            cmsDoTransform(htransform_lab, expected.data(), &lab_expected, 1);
+            cmsDoTransform(htransform_lab, result.data(), &lab_result, 1);
+            error = std::max(error, cmsCIE2000DeltaE(&lab_expected, &lab_result, 1.0, 1.0, 1.0));
+        }
+        cmsDeleteTransform(htransform_lab);
+        cmsDeleteTransform(htransform);
+        return error;
+    }
+}
+
+void bench_cms_lut(int iterations)
+{
+    const std::unique_ptr<std::remove_pointer_t<cmsHPROFILE>, decltype(&cmsCloseProfile)> profile_in(cmsCreate_sRGBProfile(), cmsCloseProfile);
+    const std::unique_ptr<std::remove_pointer_t<cmsHPROFILE>, decltype(&cmsCloseProfile)> profile_out(cms_create_profile_adobe_rgb(), cmsCloseProfile);
+    for (int i = 0; i < iterations; ++i) {
+        {
+            WIV_BENCH_SCOPE("cms_create_lut 33");
+            cms_create_lut(profile_in.get(), profile_out.get(), INTENT_PERCEPTUAL, false, 33);
+        }
+        {
+            WIV_BENCH_SCOPE("cms_create_lut 49");
+            cms_create_lut(profile_in.get(), profile_out.get(), INTENT_PERCEPTUAL, false, 49);
+        }
+        {
+            WIV_BENCH_SCOPE("cms_create_lut 65");
+            cms_create_lut(profile_in.get(), profile_out.get(), INTENT_PERCEPTUAL, false, 65);
+        }
+        {
+            cms_clear_adaptive_lut_cache();
+            WIV_BENCH_SCOPE("cms_create_lut_adaptive");
+            unsigned int lut_size;
+            float error;
+            cms_create_lut_adaptive(profile_in.get(), profile_out.get(), INTENT_PERCEPTUAL, false, 0.5f, lut_size, error);
+        }
+        {
+            WIV_BENCH_SCOPE("cms_create_lut_adaptive cached");
+            unsigned int lut_size;
+            float error;
+            cms_create_lut_adaptive(profile_in.get(), profile_out.get(), INTENT_PERCEPTUAL, false, 0.5f, lut_size, error);
+        }
+        {
+            WIV_BENCH_SCOPE("cms_create_matrix_shaper");
+            cms_create_matrix_shaper(profile_in.get(), profile_out.get(), INTENT_PERCEPTUAL, false);
+        }
+    }
+}
+
+// Applying a 33 LUT to a full RGBA float image against lcms doing the same transform, throughput is printed to stderr.
+void bench_cms_apply_lut(int iterations)
+{
+    const std::unique_ptr<std::remove_pointer_t<cmsHPROFILE>, decltype(&cmsCloseProfile)> profile_in(cmsCreate_sRGBProfile(), cmsCloseProfile);
+    const std::unique_ptr<std::remove_pointer_t<cmsHPROFILE>, decltype(&cmsCloseProfile)> profile_out(cms_create_profile_adobe_rgb(), cmsCloseProfile);
+    const auto lut = cms_create_lut(profile_in.get(), profile_out.get(), INTENT_PERCEPTUAL, false, 33);
+    const auto htransform = cmsCreateTransform(profile_in.get(), TYPE_RGBA_FLT, profile_out.get(), TYPE_RGBA_FLT, INTENT_PERCEPTUAL, cmsFLAGS_COPY_ALPHA);
+    const size_t npixels = static_cast<size_t>(WIV_BENCH_WIDTH) * WIV_BENCH_HEIGHT;
+    std::vector<float> src(npixels * 4);
+    std::minstd_rand rng(42);
+    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+    std::generate(src.begin(), src.end(), [&] { return dist(rng); });
+    std::vector<float> dst(src.size());
+    for (int i = 0; i < iterations; ++i) {
+        {
+            WIV_BENCH_SCOPE("cms_apply_lut 33");
+            cms_apply_lut(lut.get(), 33, src.data(), dst.data(), WIV_BENCH_WIDTH, WIV_BENCH_HEIGHT);
+        }
+        {
+            WIV_BENCH_SCOPE("cmsDoTransform");
+            cmsDoTransform(htransform, src.data(), dst.data(), static_cast<cmsUInt32Number>(npixels));
+        }
+    }
+    cmsDeleteTransform(htransform);
+    for (const auto& stats : Bench::get_stats()) {
+        if (std::strcmp(stats.name, "cms_apply_lut 33") == 0 || std::strcmp(stats.name, "cmsDoTransform") == 0) {
+            std::cerr << stats.name << ": " << npixels * 4 * sizeof(float) / (stats.median * 1e6) << " GB/s\n";
+        }
+    }
+}
+
+// The vectorized rows have to match the single pixel path bit for bit, including the tails, ties, edges and NaN.
+bool check_cms_apply_lut()
+{
+    const std::unique_ptr<std::remove_pointer_t<cmsHPROFILE>, decltype(&cmsCloseProfile)> profile_in(cms_create_profile_aces_cg(), cmsCloseProfile);
+    const std::unique_ptr<std::remove_pointer_t<cmsHPROFILE>, decltype(&cmsCloseProfile)> profile_out(cmsCreate_sRGBProfile(), cmsCloseProfile);
+    bool is_ok = true;
+    for (const auto lut_size : WIV_CMS_LUT_SIZES) {
+        const auto lut = cms_create_lut(profile_in.get(), profile_out.get(), INTENT_PERCEPTUAL, false, lut_size);
+        constexpr int width = 997;
+        constexpr int height = 67;
+        std::vector<float> src(static_cast<size_t>(width) * height * 4);
+        std::minstd_rand rng(42);
+        std::uniform_real_distribution<float> dist(-0.1f, 1.1f);
+        for (auto& val : src) {
+            val = rng() % 4 ? dist(rng) : static_cast<float>(rng() % lut_size) / (lut_size - 1);
+        }
+        src[0] = std::numeric_limits<float>::quiet_NaN();
+        std::vector<float> dst(src.size());
+        cms_apply_lut(lut.get(), lut_size, src.data(), dst.data(), width, height);
+        size_t mismatches = 0;
+        for (size_t i = 0; i < src.size(); i += 4) {
+            std::array<float, 4> expected;
+            cms_apply_lut(lut.get(), lut_size, src.data() + i, expected.data());
+            expected[3] = src[i + 3];
+            mismatches += std::memcmp(expected.data(), dst.data() + i, sizeof(expected)) != 0;
+        }
+        std::cerr << "cms_apply_lut " << lut_size << ": " << mismatches << " mismatches\n";
+        is_ok = is_ok && mismatches == 0;
+    }
+    return is_ok;
+}
+
+// Compares the matrix-shaper transform against lcms, errors are printed in 16 bit code values.
+bool check_matrix_shaper()
+{
+    using Profile = std::unique_ptr<std::remove_pointer_t<cmsHPROFILE>, decltype(&cmsCloseProfile)>;
+    const std::array<std::tuple<const char*, cmsHPROFILE (*)(), cmsHPROFILE (*)()>, 5> pairs = { {
+        { "sRGB -> AdobeRGB", cmsCreate_sRGBProfile, cms_create_profile_adobe_rgb },
+        { "AdobeRGB -> sRGB", cms_create_profile_adobe_rgb, cmsCreate_sRGBProfile },
+        { "ACEScg -> sRGB", cms_create_profile_aces_cg, cmsCreate_sRGBProfile },
+        { "linear sRGB -> sRGB", cms_create_profile_linear_srgb, cmsCreate_sRGBProfile },
+        { "sRGB -> sRGB", cmsCreate_sRGBProfile, cmsCreate_sRGBProfile },
+    } };
+    Bench_check check("matrix-shaper");
+    for (const auto& [name, create_in, create_out] : pairs) {
+        const Profile profile_in(create_in(), cmsCloseProfile);
+        const Profile profile_out(create_out(), cmsCloseProfile);
+        const auto transform = cms_create_matrix_shaper(profile_in.get(), profile_out.get(), INTENT_RELATIVE_COLORIMETRIC, false);
+        if (!check.expect(transform.has_value(), std::string(name) + " is not a matrix-shaper transform")) {
+            continue;
+        }
+        const auto htransform = cmsCreateTransform(profile_in.get(), TYPE_RGB_FLT, profile_out.get(), TYPE_RGB_FLT, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE);
+        constexpr int grid = 33;
+        double error_max = 0.0;
+        double error_sum = 0.0;
+        for (int r = 0; r < grid; ++r) {
+            for (int g = 0; g < grid; ++g) {
+                for (int b = 0; b < grid; ++b) {
+                    const std::array<float, 3> rgb = { r / (grid - 1.0f), g / (grid - 1.0f), b / (grid - 1.0f) };
+                    std::array<float, 3> expected;
+                    std::array<float, 3> result;
+                    cmsDoTransform(htransform, rgb.data(), expected.data(), 1);
+                    cms_apply_matrix_shaper(*transform, rgb.data(), result.data());
+                    for (int c = 0; c < 3; ++c) {
+                        const double error = std::abs(std::clamp(expected[c], 0.0f, 1.0f) - result[c]) * 65535.0;
+                        error_max = std::max(error_max, error);
+                        error_sum += error;
+                    }
+                }
+            }
+        }
+        cmsDeleteTransform(htransform);
+        std::cerr << name << ": identity " << transform->is_identity << ", max error " << error_max << ", mean error " << error_sum / (grid * grid * grid * 3) << '\n';
+        check.expect(error_max <= WIV_BENCH_MATRIX_SHAPER_MAX_ERROR, std::string(name) + " is off by more than " + std::to_string(WIV_BENCH_MATRIX_SHAPER_MAX_ERROR) + " 16 bit steps");
+    }
+
+    // lcms uses the CLUT of a profile that also has the matrix-shaper tags, so the transform has to be left to it.
+    const Profile profile_clut(cmsCreate_sRGBProfile(), cmsCloseProfile);
+    const Profile profile_srgb(cmsCreate_sRGBProfile(), cmsCloseProfile);
+    const auto pipeline = cmsPipelineAlloc(nullptr, 3, 3);
+    cmsPipelineInsertStage(pipeline, cmsAT_BEGIN, cmsStageAllocCLut16bit(nullptr, 2, 3, 3, nullptr));
+    cmsWriteTag(profile_clut.get(), cmsSigAToB0Tag, pipeline);
+    cmsWriteTag(profile_clut.get(), cmsSigBToA0Tag, pipeline);
+    cmsPipelineFree(pipeline);
+    check.expect(!cms_create_matrix_shaper(profile_clut.get(), profile_srgb.get(), INTENT_RELATIVE_COLORIMETRIC, false), "used the matrix-shaper of an input profile with a CLUT");
+    check.expect(!cms_create_matrix_shaper(profile_srgb.get(), profile_clut.get(), INTENT_PERCEPTUAL, false), "used the matrix-shaper of an output profile with a CLUT");
+    return check.finish();
+}
+
+// Opens the image and builds its CMS transform to the display like the renderer does,
+// with the matrix-shaper fast path and with the LUT the renderer would build instead.
+void bench_cms_open(const std::filesystem::path& path, int iterations)
+{
+    const std::unique_ptr<std::remove_pointer_t<cmsHPROFILE>, decltype(&cmsCloseProfile)> profile_display(cms_create_profile_adobe_rgb(), cmsCloseProfile);
+    const auto open = [&](bool is_matrix_shaper) {
+        Image image;
+        if (!image.open(path)) {
+            std::cerr << "Failed to open " << path << '\n';
+            return;
+        }
+        if (!image.profile) {
+            image.profile.reset(cmsCreate_sRGBProfile());
+        }
+        if (is_matrix_shaper && cms_create_matrix_shaper(image.profile.get(), profile_display.get(), g_config.cms_intent.val, g_config.cms_bpc_use.val)) {
+            return;
+        }
+        if (g_config.cms_lut_size.val == 0) {
+            unsigned int lut_size;
+            float error;
+            cms_create_lut_adaptive(image.profile.get(), profile_display.get(), g_config.cms_intent.val, g_config.cms_bpc_use.val, g_config.cms_lut_max_error.val, lut_size, error);
+        }
+        else {
+            cms_create_lut(image.profile.get(), profile_display.get(), g_config.cms_intent.val, g_config.cms_bpc_use.val, g_config.cms_lut_size.val);
+        }
+    };
+    for (int i = 0; i < iterations; ++i) {
+        {
+            WIV_BENCH_SCOPE("cms open matrix-shaper");
+            open(true);
+        }
+        {
+            WIV_BENCH_SCOPE("cms open LUT");
+            open(false);
+        }
+    }
+}
+
+// The auto sized LUT meets the error budget unless it's the largest one, also on colors it wasn't sized on,
+// and the cached size gives the same LUT.
+bool check_adaptive_lut()
+{
+    Bench_check check("adaptive LUT");
+    using Profile = std::unique_ptr<std::remove_pointer_t<cmsHPROFILE>, decltype(&cmsCloseProfile)>;
+    const std::array<std::tuple<const char*, cmsHPROFILE (*)(), cmsHPROFILE (*)()>, 4> pairs = { {
+        { "sRGB -> AdobeRGB", cmsCreate_sRGBProfile, cms_create_profile_adobe_rgb },
+        { "AdobeRGB -> sRGB", cms_create_profile_adobe_rgb, cmsCreate_sRGBProfile },
+        { "ACEScg -> sRGB", cms_create_profile_aces_cg, cmsCreate_sRGBProfile },
+        { "linear sRGB -> sRGB", cms_create_profile_linear_srgb, cmsCreate_sRGBProfile },
+    } };
+    for (const auto& [name, create_in, create_out] : pairs) {
+        const Profile profile_in(create_in(), cmsCloseProfile);
+        const Profile profile_out(create_out(), cmsCloseProfile);
+        for (const float max_error : { g_config.cms_lut_max_error.val, 1.0f, 0.25f }) {
+            unsigned int lut_size;
+            float error;
+            const auto lut = cms_create_lut_adaptive(profile_in.get(), profile_out.get(), INTENT_RELATIVE_COLORIMETRIC, false, max_error, lut_size, error);
+            if (!check.expect(lut != nullptr, std::string(name) + " has no LUT")) {
+                continue;
+            }
+            const auto error_random = get_lut_error(profile_in.get(), profile_out.get(), INTENT_RELATIVE_COLORIMETRIC, lut.get(), lut_size);
+            std::cerr << name << ": max dE2000 " << max_error << ", LUT size " << lut_size << ", error " << error << ", error on random colors " << error_random << '\n';
+            const bool is_largest = lut_size == WIV_CMS_LUT_SIZES.back();
+            check.expect(error <= max_error || is_largest, std::string(name) + " LUT doesn't meet the budget");
+
+            // Random colors can land where the validation set has none, so they get some slack.
+            check.expect(error_random <= max_error * 1.5 || is_largest, std::string(name) + " LUT doesn't meet the budget on random colors");
+
+            unsigned int lut_size_cached;
+            float error_cached;
+            const auto lut_cached = cms_create_lut_adaptive(profile_in.get(), profile_out.get(), INTENT_RELATIVE_COLORIMETRIC, false, max_error, lut_size_cached, error_cached);
+            check.expect(lut_cached && lut_size_cached == lut_size && error_cached == error && std::equal(lut.get(), lut.get() + cube(lut_size) * 4, lut_cached.get()), std::string(name) + " cached LUT differs");
+        }
+    }
+    return check.finish();
+}
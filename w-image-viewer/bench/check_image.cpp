@@ -0,0 +1,228 @@
+#include "pch.h"
+#include "image.h"
+#include "include/global.h"
+#include "include/metrics.h"
+#include "include/bench.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+#include <OpenImageIO/imagebufalgo.h>
+#include <iostream>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+void bench_decode(const std::filesystem::path& path, int iterations)
+{
+    for (int i = 0; i < iterations; ++i) {
+        Image image;
+        if (!image.open(path)) {
+            std::cerr << "Failed to open " << path << '\n';
+            return;
+        }
+        decode(image);
+    }
+}
+
+// The moved from image is no longer valid and can be opened again, the moved to image decodes like the original.
+bool check_image_move(const std::filesystem::path& directory)
+{
+    Bench_check check("image move");
+    Image image;
+    if (!check.expect(image.open(directory / "rgb8.png"), "failed to open")) {
+        return check.finish();
+    }
+    Image moved(std::move(image));
+    check.expect(!image.is_valid() && moved.is_valid() && moved.get_width<int>() == WIV_BENCH_WIDTH && decode(moved), "move construction");
+    Image assigned;
+    assigned.open(directory / "grey16.png");
+    assigned = std::move(moved);
+    check.expect(!moved.is_valid() && assigned.is_valid() && assigned.get_basetype() == OIIO::TypeDesc::UINT8 && decode(assigned), "move assignment");
+    check.expect(image.open(directory / "rgba16.tif") && decode(image), "reopening a moved from image failed");
+    return check.finish();
+}
+
+void bench_expand_channels(int iterations)
+{
+    const int npixels = WIV_BENCH_WIDTH * WIV_BENCH_HEIGHT;
+    std::vector<uint16_t> data(static_cast<size_t>(npixels) * 4);
+    for (int i = 0; i < iterations; ++i) {
+        WIV_BENCH_SCOPE("Image::expand_channels");
+        Image::expand_channels(data.data(), npixels, 2);
+    }
+}
+
+// Back and forth between two images, like pressing Next and Previous, from the files and through the image cache.
+// The image cache should serve the revisits from memory, its hits, misses and bytes read are printed to stderr.
+void bench_navigation(const std::filesystem::path& directory, int iterations)
+{
+    const std::array paths = { directory / "rgb8.png", directory / "rgba16.tif" };
+    for (const bool is_image_cache : { false, true }) {
+        g_config.image_cache.val = is_image_cache;
+        for (int i = 0; i < 2 * iterations; ++i) {
+            WIV_BENCH_SCOPE(is_image_cache ? "navigation image cache" : "navigation");
+            Image image;
+            if (!image.open(paths[i % 2]) || !decode(image)) {
+                std::cerr << "Failed to open " << paths[i % 2] << '\n';
+                break;
+            }
+        }
+    }
+    g_config.image_cache.val = false;
+    std::cerr << "navigation image cache: " << Metrics::image_cache_hits.get() << " hits, " << Metrics::image_cache_misses.get() << " misses, "
+        << Metrics::image_cache_bytes_read.get() / (1024.0 * 1024.0) << " MB read, " << Metrics::image_cache_memory_used.get() / (1024.0 * 1024.0) << " MB used\n";
+}
+
+// Reducing an image with MIP levels through the image cache reads a small MIP level instead of the full image.
+bool check_image_cache_mip(const std::filesystem::path& directory)
+{
+    Bench_check check("image cache MIP");
+    const auto path = directory / "rgb8_mip.tif";
+    if (!check.expect(OIIO::ImageBufAlgo::make_texture(OIIO::ImageBufAlgo::MakeTxTexture, (directory / "rgb8.png").string(), path.string(), OIIO::ImageSpec()), "failed to write the MIP levels")) {
+        return check.finish();
+    }
+    g_config.image_cache.val = true;
+    const auto bytes_read = Metrics::image_cache_bytes_read.get();
+    Image image;
+    int width = 0;
+    int height = 0;
+    const bool is_reduced = image.open(path) && image.get_reduced_data(256, width, height) != nullptr;
+    g_config.image_cache.val = false;
+    check.expect(is_reduced && width == 256 && height == 192, "reduced to the wrong dims");
+
+    // The full image is 36 MB, the 500 x 375 level it gets reduced from less than 1 MB.
+    check.expect(Metrics::image_cache_bytes_read.get() - bytes_read < 1 << 20, "read more than the small MIP level");
+    check.expect(image.get_width<int>() == WIV_BENCH_WIDTH, "the spec of the full image wasn't restored");
+    return check.finish();
+}
+
+// Opens and decodes a RAW file through each path the viewer uses: the embedded thumbnail, the half size development
+// shown when fit to the window, the full size development once zoomed in, and the half size development from the RAW cache.
+void bench_raw(const std::filesystem::path& path, int iterations)
+{
+    const bool raw_thumb = g_config.raw_thumb.val;
+    const bool raw_half_size = g_config.raw_half_size.val;
+    const int raw_cache_size = g_config.raw_cache_size.val;
+    g_config.raw_thumb.val = false;
+    g_config.raw_half_size.val = true;
+    const auto read = [&](bool is_raw_full, bool is_thumbnail) {
+        Image image;
+        return image.open(path, is_raw_full, is_thumbnail) && decode(image);
+    };
+
+    // Demosaic runs on the OpenMP threads of LibRaw, more CPU time than wall time shows they are used.
+    std::chrono::nanoseconds full_cpu(0);
+    std::chrono::nanoseconds full_wall(0);
+    for (int i = 0; i < iterations; ++i) {
+        g_config.raw_cache_size.val = 0;
+        {
+            WIV_BENCH_SCOPE("raw thumbnail");
+            if (!read(false, true)) {
+                std::cerr << "Failed to read the thumbnail of " << path << '\n';
+            }
+        }
+        {
+            WIV_BENCH_SCOPE("raw half size");
+            if (!read(false, false)) {
+                std::cerr << "Failed to develop " << path << " at half size\n";
+                break;
+            }
+        }
+        {
+            WIV_BENCH_SCOPE("raw full size");
+            const auto cpu_start = get_cpu_time();
+            const auto start = std::chrono::steady_clock::now();
+            if (!read(true, false)) {
+                std::cerr << "Failed to develop " << path << " at full size\n";
+                break;
+            }
+            full_wall += std::chrono::steady_clock::now() - start;
+            full_cpu += get_cpu_time() - cpu_start;
+        }
+
+        // The first read puts the development into the cache.
+        g_config.raw_cache_size.val = raw_cache_size;
+        read(false, false);
+        {
+            WIV_BENCH_SCOPE("raw half size cached");
+            read(false, false);
+        }
+    }
+    if (full_wall.count() > 0) {
+        std::cerr << "raw: " << path.filename() << " full size CPU time " << std::chrono::duration<double, std::milli>(full_cpu).count() << " ms in " << std::chrono::duration<double, std::milli>(full_wall).count() << " ms, "
+            << static_cast<double>(full_cpu.count()) / full_wall.count() << " of " << std::thread::hardware_concurrency() << " cores busy on average\n";
+    }
+    g_config.raw_thumb.val = raw_thumb;
+    g_config.raw_half_size.val = raw_half_size;
+    g_config.raw_cache_size.val = raw_cache_size;
+}
+
+#ifdef __linux__
+namespace
+{
+    // Read syscalls of the process so far, and the bytes they read.
+    std::pair<int64_t, int64_t> get_read_io()
+    {
+        std::ifstream io("/proc/self/io");
+        std::string name;
+        int64_t value;
+        int64_t syscr = 0;
+        int64_t rchar = 0;
+        while (io >> name >> value) {
+            if (name == "syscr:") {
+                syscr = value;
+            }
+            else if (name == "rchar:") {
+                rchar = value;
+            }
+        }
+        return { syscr, rchar };
+    }
+}
+
+// Opening and decoding a non-RAW file (with RAW thumbnails enabled, so RAW detection runs) should open the file once
+// and read it only through the mapping, so neither LibRaw nor a decoder opens it again or reads it with read().
+// Opens are counted with inotify, read syscalls from /proc/self/io.
+bool check_read_syscalls(const std::filesystem::path& directory)
+{
+    Bench_check check("read syscalls");
+    const bool raw_thumb = g_config.raw_thumb.val;
+    g_config.raw_thumb.val = true;
+    for (const auto name : { "rgb8.png", "grey16.png", "rgba16.tif", "rgba32f.exr" }) {
+        const auto path = directory / name;
+        const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (!check.expect(fd != -1 && inotify_add_watch(fd, path.c_str(), IN_OPEN | IN_ACCESS) != -1, "inotify isn't available")) {
+            if (fd != -1) {
+                close(fd);
+            }
+            break;
+        }
+        const auto [syscr_before, rchar_before] = get_read_io();
+        bool is_decoded;
+        {
+            Image image;
+            is_decoded = image.open(path) && decode(image);
+        }
+        const auto [syscr_after, rchar_after] = get_read_io();
+        int nopens = 0;
+        int naccesses = 0;
+        alignas(inotify_event) std::array<char, 4096> events;
+        ssize_t size;
+        while ((size = read(fd, events.data(), events.size())) > 0) {
+            for (ssize_t i = 0; i < size; i += sizeof(inotify_event) + reinterpret_cast<const inotify_event*>(events.data() + i)->len) {
+                const auto mask = reinterpret_cast<const inotify_event*>(events.data() + i)->mask;
+                nopens += (mask & IN_OPEN) != 0;
+                naccesses += (mask & IN_ACCESS) != 0;
+            }
+        }
+        close(fd);
+        std::cerr << "read syscalls: " << name << ' ' << nopens << " opens, " << naccesses << " reads of the file, "
+            << syscr_after - syscr_before << " read syscalls of " << rchar_after - rchar_before << " bytes in the process\n";
+        check.expect(is_decoded, std::string(name) + " failed to decode");
+        check.expect(nopens == 1, std::string(name) + " got opened " + std::to_string(nopens) + " times");
+        check.expect(naccesses == 0, std::string(name) + " got read with read syscalls");
+    }
+    g_config.raw_thumb.val = raw_thumb;
+    return check.finish();
+}
+#endif
@@ -0,0 +1,78 @@
+#include "pch.h"
+#include "ipc.h"
+#include "include/bench.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+#include <iostream>
+
+namespace
+{
+    // Clients sending to the single instance server at once.
+    constexpr int WIV_BENCH_IPC_CLIENTS = 8;
+}
+
+// Round trips through the single instance channel, under a name of its own so a running viewer isn't hit.
+bool check_ipc(int iterations)
+{
+    const std::string name = "wiv_bench";
+    std::vector<std::string> received;
+    Ipc_server server;
+    if (!server.start(name, [&received](std::string message) { received.push_back(std::move(message)); })) {
+        std::cerr << "ipc: failed to start the server\n";
+        return false;
+    }
+    bool is_ok = true;
+    if (Ipc_server second; second.start(name, [](std::string) {})) {
+        std::cerr << "ipc: a second server started on the same name\n";
+        is_ok = false;
+    }
+    std::vector<std::string> sent;
+    for (int i = 0; i < iterations * 100; ++i) {
+        sent.push_back("/tmp/\xc3\xa9" + std::to_string(i) + ".png");
+        WIV_BENCH_SCOPE("ipc send");
+        if (!ipc_send(name, sent.back())) {
+            std::cerr << "ipc: send " << i << " failed\n";
+            is_ok = false;
+            break;
+        }
+    }
+    sent.push_back(std::string(WIV_IPC_MESSAGE_MAX, 'x'));
+    is_ok &= ipc_send(name, sent.back());
+    is_ok &= !ipc_send(name, std::string(WIV_IPC_MESSAGE_MAX + 1, 'x'));
+    server.stop();
+    is_ok &= !ipc_send(name, "after stop");
+
+    // Concurrent clients, each one gets through once the server is done with the others.
+    std::atomic<int> nreceived = 0;
+    if (!server.start(name, [&nreceived](std::string) { ++nreceived; })) {
+        std::cerr << "ipc: failed to restart the server\n";
+        return false;
+    }
+    std::atomic<int> nacknowledged = 0;
+    {
+        std::vector<std::jthread> clients;
+        for (int i = 0; i < WIV_BENCH_IPC_CLIENTS; ++i) {
+            clients.emplace_back([&nacknowledged, &name, iterations] {
+                for (int j = 0; j < iterations * 10; ++j) {
+                    if (ipc_send(name, "concurrent")) {
+                        ++nacknowledged;
+                    }
+                }
+            });
+        }
+    }
+    server.stop();
+    if (nacknowledged != WIV_BENCH_IPC_CLIENTS * iterations * 10 || nreceived != nacknowledged) {
+        std::cerr << "ipc: " << nacknowledged << " of " << WIV_BENCH_IPC_CLIENTS * iterations * 10 << " concurrent messages acknowledged, " << nreceived << " received\n";
+        is_ok = false;
+    }
+
+    // Messages are acknowledged after the callback, so all of them are in by now.
+    if (received != sent) {
+        std::cerr << "ipc: received " << received.size() << " of " << sent.size() << " messages, or not in order\n";
+        is_ok = false;
+    }
+    std::cerr << "ipc: " << (is_ok ? "ok" : "failed") << '\n';
+    return is_ok;
+}
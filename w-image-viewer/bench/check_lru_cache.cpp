@@ -0,0 +1,34 @@
+#include "pch.h"
+#include "include/lru_cache.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+
+// Cost budget eviction in LRU order, with get() and put() marking values as used.
+bool check_lru_cache()
+{
+    Bench_check check("lru cache");
+    Lru_cache<int, int> cache(3);
+    cache.put(1, 10, 1);
+    cache.put(2, 20, 1);
+    cache.put(3, 30, 1);
+    check.expect(cache.get(1) && *cache.get(1) == 10, "missed a cached value");
+    cache.put(4, 40, 1);
+    check.expect(!cache.contains(2) && cache.contains(1) && cache.contains(3) && cache.contains(4), "evicted not the least recently used value");
+    cache.put(3, 31, 2);
+    check.expect(cache.get_cost() == 3 && *cache.get(3) == 31 && !cache.contains(1), "replacing didn't update the cost");
+
+    // The most recently used value is kept even over the budget.
+    cache.put(5, 50, 8);
+    check.expect(cache.size() == 1 && cache.get(5) && cache.get_cost() == 8, "evicted the most recent value");
+    cache.set_budget(16);
+    cache.put(6, 60, 4);
+    cache.put(7, 70, 4);
+    cache.erase(6);
+    check.expect(!cache.contains(6) && cache.get_cost() == 12, "erase didn't release the cost");
+    cache.set_budget(4);
+    check.expect(cache.size() == 1 && cache.contains(7), "shrinking the budget kept too much");
+    cache.clear();
+    check.expect(!cache.size() && !cache.get_cost(), "clear kept values");
+    return check.finish();
+}
@@ -0,0 +1,74 @@
+#include "pch.h"
+#include "mapped_file.h"
+#include "include/bench.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+#include <iostream>
+
+// Decodes the inputs with OIIO reading the file itself through stdio, then reading the mapped file.
+void bench_mapped_file(const std::filesystem::path& directory, int iterations)
+{
+    const auto read = [](const std::filesystem::path& path, OIIO::Filesystem::IOProxy* io_proxy) {
+        const auto input = OIIO::ImageInput::open(path, nullptr, io_proxy);
+        if (!input) {
+            std::cerr << "Failed to open " << path << '\n';
+            return;
+        }
+        const auto& spec = input->spec();
+        std::vector<uint8_t> pixels(spec.image_bytes());
+        input->read_image(0, 0, 0, spec.nchannels, spec.format, pixels.data());
+    };
+    for (int i = 0; i < iterations; ++i) {
+        for (const auto name : { "rgb8.png", "grey16.png", "rgba16.tif", "rgba32f.exr" }) {
+            const auto path = directory / name;
+            {
+                WIV_BENCH_SCOPE("decode stdio");
+                read(path, nullptr);
+            }
+            {
+                WIV_BENCH_SCOPE("decode mapped file");
+                Mapped_file file;
+                if (file.open(path)) {
+                    Mapped_file_reader reader(file);
+                    read(path, &reader);
+                }
+            }
+        }
+    }
+}
+
+// Reading a mapped file that lost its pages fails instead of crashing,
+// and the file can be changed by others while it's mapped.
+bool check_mapped_file(const std::filesystem::path& directory)
+{
+    Bench_check check("mapped file");
+    const auto path = directory / "mapped.bin";
+    constexpr size_t size = 1 << 20;
+    std::ofstream(path, std::ios::binary) << std::string(size, 'w');
+    Mapped_file file;
+    if (!check.expect(file.open(path), "failed to open")) {
+        return check.finish();
+    }
+    std::array<char, 4096> data;
+    check.expect(file.read(size - data.size(), data.data(), data.size()) == data.size() && data.back() == 'w', "read the wrong data");
+    check.expect(file.read(size - 16, data.data(), data.size()) == 16, "read past the end");
+#ifdef _WIN32
+    // Mapped files can't be truncated on Windows, but they can be renamed.
+    std::error_code ec;
+    std::filesystem::rename(path, directory / "mapped_renamed.bin", ec);
+    check.expect(!ec, "a mapped file can't be renamed");
+#else
+    std::filesystem::resize_file(path, 4096);
+    check.expect(file.read(0, data.data(), data.size()) == data.size(), "reading the remaining pages failed");
+    check.expect(file.read(size - data.size(), data.data(), data.size()) == 0, "reading truncated pages didn't fail");
+    Mapped_file_reader reader(file);
+    check.expect(reader.pread(data.data(), data.size(), size - data.size()) == 0, "the reader read truncated pages");
+    Mapped_file_raw_stream raw_stream(file);
+    raw_stream.seek(size - data.size(), SEEK_SET);
+    check.expect(raw_stream.read(data.data(), 1, data.size()) == 0 && raw_stream.get_char() == -1, "the RAW stream read truncated pages");
+    raw_stream.seek(0, SEEK_SET);
+    check.expect(raw_stream.read(data.data(), 1, data.size()) == static_cast<int>(data.size()), "the RAW stream failed reading the remaining pages");
+#endif
+    return check.finish();
+}
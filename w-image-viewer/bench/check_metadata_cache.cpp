@@ -0,0 +1,70 @@
+#include "pch.h"
+#include "metadata_cache.h"
+#include "include/bench.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+
+namespace
+{
+    // Half of them small images, half empty files that can't be opened.
+    constexpr int WIV_BENCH_METADATA_FILES = 1000;
+}
+
+// Probes a directory with a new cache (cold), then looks the files up after reopening it (warm).
+// Checks the probed validity and dims, that the records survive the reopen and that a changed file misses.
+bool check_metadata_cache(const std::filesystem::path& directory)
+{
+    Bench_check check("metadata cache");
+    const auto probe_directory = directory / "metadata";
+    std::filesystem::create_directories(probe_directory);
+    for (int i = 0; i < WIV_BENCH_METADATA_FILES; ++i) {
+        const auto path = probe_directory / (std::to_string(i) + (i % 2 ? ".png" : ".jpg"));
+        if (i % 2) {
+            write_pattern(path, 64, 64, OIIO::TypeDesc::UINT8, [i](int x, int y, int c) { return static_cast<float>((x + y + c + i) % 256) / 255.0f; });
+        }
+        else {
+            std::ofstream(path).put('\0');
+        }
+    }
+    const std::vector<std::filesystem::directory_entry> entries(std::filesystem::directory_iterator(probe_directory), {});
+
+    const auto cache_path = directory / "metadata.dat";
+    Metadata_cache cache;
+    cache.open(cache_path);
+    const auto is_cached = [&] {
+        return std::ranges::all_of(entries, [&](const std::filesystem::directory_entry& entry) { return cache.get(entry).has_value(); });
+    };
+    {
+        WIV_BENCH_SCOPE("metadata cache cold");
+        cache.probe_directory(probe_directory);
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+        while (!is_cached() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    size_t nmismatches = 0;
+    for (const auto& entry : entries) {
+        const auto metadata = cache.get(entry);
+        const bool is_png = entry.path().extension() == ".png";
+        nmismatches += !metadata || metadata->is_valid != is_png || (is_png && (metadata->width != 64 || metadata->height != 64 || metadata->basetype != OIIO::TypeDesc::UINT8));
+    }
+    check.expect(!nmismatches, std::to_string(nmismatches) + " files probed wrong");
+
+    cache.close();
+    cache.open(cache_path);
+    size_t nhits = 0;
+    {
+        WIV_BENCH_SCOPE("metadata cache warm");
+        for (const auto& entry : entries) {
+            nhits += cache.get(entry).has_value();
+        }
+    }
+    check.expect(nhits == entries.size(), "records got lost on reopen");
+
+    const auto changed = probe_directory / "1.png";
+    write_pattern(changed, 32, 32, OIIO::TypeDesc::UINT8, [](int, int, int) { return 0.5f; });
+    check.expect(!cache.get(std::filesystem::directory_entry(changed)), "hit a changed file");
+    cache.close();
+    return check.finish();
+}
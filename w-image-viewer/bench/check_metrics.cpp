@@ -0,0 +1,61 @@
+#include "pch.h"
+#include "image.h"
+#include "include/metrics.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+
+// Metrics register with unique indices, snapshots read them, histograms bucket samples and
+// compute percentiles, snapshots get written as one JSON line, and a decode counts its bytes once.
+bool check_metrics(const std::filesystem::path& directory)
+{
+    Bench_check check("metrics");
+
+    // Metrics stay registered, so they have to be static.
+    static Metric_gauge gauge{ "bench_gauge" };
+    static Metric_counter counter{ "bench_counter" };
+    static Metric_histogram histogram{ "bench_histogram" };
+    static Metric_histogram histogram_empty{ "bench_histogram_empty" };
+    gauge.set(2.5);
+    counter.add();
+    counter.add(41);
+    for (const double sample : { 0.1, 0.25, 0.3, 1.0, 100.0, 1e9 }) {
+        histogram.record(sample);
+    }
+    const auto snapshot = Metrics::snapshot();
+    std::vector<std::string_view> names;
+    for (const auto& value : snapshot.values) {
+        if (!check.expect(value.name != nullptr, "a snapshot value has no metric")) {
+            return check.finish();
+        }
+        names.push_back(value.name);
+    }
+    std::ranges::sort(names);
+    check.expect(std::ranges::adjacent_find(names) == names.end(), "a metric is in the snapshot twice");
+    check.expect(std::string_view(snapshot[Metrics::decode_time].name) == "decode_time" && snapshot[Metrics::decode_time].kind == Metric_kind::histogram, "a metric isn't at its index");
+    check.expect(snapshot.get(gauge) == 2.5 && snapshot.get<int>(counter) == 42 && snapshot[counter].kind == Metric_kind::counter, "wrong gauge or counter");
+
+    // Bucket i counts samples <= 0.25 * 2^i.
+    const auto& value = snapshot[histogram];
+    std::array<uint64_t, WIV_METRICS_HISTOGRAM_BUCKETS> buckets = {};
+    buckets[0] = 2;
+    buckets[1] = 1;
+    buckets[2] = 1;
+    buckets[9] = 1;
+    buckets.back() = 1;
+    check.expect(value.count == 6 && value.buckets == buckets && std::abs(value.value - 1000000101.65) < 1e-3, "wrong histogram");
+    check.expect(value.get_percentile(0.0) == 0.25 && value.get_percentile(0.5) == 0.5 && value.get_percentile(0.8) == 128.0 && value.get_percentile(0.99) == 8192.0, "wrong histogram percentiles");
+    check.expect(snapshot[histogram_empty].count == 0 && snapshot[histogram_empty].get_percentile(0.5) == 0.0, "wrong empty histogram");
+
+    std::ostringstream json;
+    Metrics::write_json(json, snapshot);
+    const auto line = json.str();
+    check.expect(line.starts_with("{\"time\":") && line.ends_with("}\n") && std::ranges::count(line, '\n') == 1, "the snapshot isn't a single JSON object line");
+    check.expect(line.find(",\"bench_gauge\":2.5,") != std::string::npos && line.find(",\"bench_counter\":42,") != std::string::npos, "wrong gauge or counter JSON");
+    check.expect(line.find(",\"bench_histogram\":{\"count\":6,\"sum\":") != std::string::npos && line.find(",\"p50\":0.5,\"p99\":8192,\"buckets\":[2,1,1,0,0,0,0,0,0,1,0,0,0,0,0,1]}") != std::string::npos, "wrong histogram JSON");
+
+    const auto bytes_decoded = Metrics::bytes_decoded.get();
+    Image image;
+    check.expect(image.open(directory / "rgb8.png") && decode(image) && Metrics::bytes_decoded.get() - bytes_decoded == static_cast<int64_t>(WIV_BENCH_WIDTH) * WIV_BENCH_HEIGHT * 4, "wrong decoded bytes");
+    return check.finish();
+}
@@ -0,0 +1,51 @@
+#include "pch.h"
+#include "quality_governor.h"
+#include "include/shader_config.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+#include <iostream>
+
+// Feeds the quality governor GPU times of a simulated GPU that takes a fixed time per tap,
+// then checks the decisions for an expensive profile on a large view.
+bool check_quality_governor()
+{
+    Bench_check check("quality governor");
+    Config_scale configured = {};
+    configured.kernel_index.val = WIV_KERNEL_FUNCTION_KAISER;
+    configured.kernel_support.val = 4.0f;
+    configured.kernel_cylindrical_use.val = true;
+    configured.sigmoid_use.val = true;
+    configured.unsharp_use.val = true;
+    configured.unsharp_radius.val = 2;
+    const Render_view fit = { { WIV_BENCH_WIDTH, WIV_BENCH_HEIGHT }, { 1440, 1080 }, 0.36f, true };
+    const Render_view zoomed = { { WIV_BENCH_WIDTH, WIV_BENCH_HEIGHT }, { WIV_BENCH_WIDTH * 2, WIV_BENCH_HEIGHT * 2 }, 2.0f, true };
+    double ms_per_tap = 1e-6;
+    Quality_governor governor;
+    check.expect(&governor.choose(configured, zoomed, 50.0) == &configured, "degraded before anything was measured");
+
+    for (int i = 0; i < 8; ++i) {
+        governor.record(get_render_work(configured, fit), get_render_work(configured, fit) * ms_per_tap);
+    }
+    const double configured_ms = *governor.predict(get_render_work(configured, zoomed));
+    check.expect(std::abs(configured_ms - get_render_work(configured, zoomed) * ms_per_tap) < 1e-6, "mispredicted the zoomed view");
+    check.expect(&governor.choose(configured, zoomed, configured_ms + 1.0) == &configured, "degraded within the budget");
+
+    const auto& interim = governor.choose(configured, zoomed, configured_ms / 8.0);
+    const double interim_ms = *governor.predict(get_render_work(interim, zoomed));
+    check.expect(&interim != &configured && interim_ms <= configured_ms / 8.0, "interim misses the budget");
+
+    const auto& cheapest = governor.choose(configured, zoomed, 0.0);
+    check.expect(cheapest.kernel_index.val == WIV_KERNEL_FUNCTION_LINEAR && !cheapest.kernel_cylindrical_use.val && !cheapest.sigmoid_use.val && !cheapest.unsharp_use.val, "cheapest interim is not linear");
+
+    // The GPU got twice as slow (for example it clocked down), predictions follow within a few renders.
+    ms_per_tap *= 2.0;
+    int nrenders = 0;
+    while (std::abs(*governor.predict(get_render_work(configured, zoomed)) / (get_render_work(configured, zoomed) * ms_per_tap) - 1.0) > 0.05 && nrenders < 32) {
+        governor.record(get_render_work(configured, fit), get_render_work(configured, fit) * ms_per_tap);
+        ++nrenders;
+    }
+    check.expect(nrenders <= 12, "predictions didn't follow the GPU");
+    std::cerr << "quality governor: configured " << configured_ms << " ms, interim " << interim_ms << " ms, followed the GPU in " << nrenders << " renders\n";
+    return check.finish();
+}
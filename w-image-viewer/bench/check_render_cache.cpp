@@ -0,0 +1,58 @@
+#include "pch.h"
+#include "render_cache.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+
+// Walks the rendered view cache through zooming in and back to fit, with ints standing in for the rendered views.
+// Checks views are hit on return, that the least recently used view gets evicted by the budget,
+// and that anything the output depends on misses.
+bool check_render_cache()
+{
+    Bench_check check("render cache");
+    const Config_scale profile = {};
+    const Render_key fit = { 1, 1920, 1080, 0.5f, 0, get_scale_profile_hash(profile), 0, false };
+    auto zoomed = fit;
+    zoomed.width = 3840;
+    zoomed.height = 2160;
+    zoomed.scale = 1.0f;
+    Render_cache<int> cache;
+    cache.set_budget(Render_cache<int>::get_cost(fit) + Render_cache<int>::get_cost(zoomed));
+    cache.put(fit, 1);
+    cache.put(zoomed, 2);
+    const auto hit = cache.get(fit);
+    check.expect(hit && *hit == 1, "return to fit missed");
+
+    // Fit was used last, so the zoomed view is the one evicted.
+    auto zoomed_more = zoomed;
+    zoomed_more.scale = 1.0f + 1.0f / 1024.0f;
+    cache.put(zoomed_more, 3);
+    check.expect(!cache.get(zoomed) && cache.get(fit) && cache.get(zoomed_more), "evicted the wrong view");
+    check.expect(cache.get_cost() <= Render_cache<int>::get_cost(fit) + Render_cache<int>::get_cost(zoomed), "budget exceeded");
+
+    auto other = fit;
+    other.image_id = 2;
+    check.expect(!cache.get(other), "hit a view of another image");
+    other = fit;
+    other.rotation = 180;
+    check.expect(!cache.get(other), "hit a view with another rotation");
+    other = fit;
+    other.cms = 1;
+    check.expect(!cache.get(other), "hit a view with another CMS pass");
+    auto profile_changed = profile;
+    profile_changed.kernel_blur.val += 0.01f;
+    other = fit;
+    other.scale_profile_hash = get_scale_profile_hash(profile_changed);
+    check.expect(other.scale_profile_hash != fit.scale_profile_hash && !cache.get(other), "hit a view with another scale profile");
+
+    // Views larger than the budget are not kept, budget 0 disables the cache.
+    auto huge = fit;
+    huge.width = 16384;
+    huge.height = 16384;
+    cache.put(huge, 4);
+    check.expect(!cache.get(huge) && cache.get(fit), "kept a view larger than the budget");
+    cache.set_budget(0);
+    cache.put(fit, 1);
+    check.expect(!cache.size(), "kept a view with the cache disabled");
+    return check.finish();
+}
@@ -0,0 +1,111 @@
+#include "pch.h"
+#include "file_manager.h"
+#include "frame_scheduler.h"
+#include "slideshow_schedule.h"
+#include "include/global.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+#include <iostream>
+
+namespace
+{
+    // Slideshow of the large inputs, each gets decoded within the interval.
+    constexpr auto WIV_BENCH_SLIDESHOW_INTERVAL = std::chrono::milliseconds(500);
+    constexpr int WIV_BENCH_SLIDESHOW_PERIODS = 8;
+    constexpr double WIV_BENCH_SLIDESHOW_MAX_ERROR = 5.0; // In ms.
+}
+
+// Runs the slideshow like the message loop does, with the file manager, its loader and the slideshow schedule:
+// at the deadline the preloaded image gets shown like User_interface::slideshow() does,
+// the loader's on_decoded stands in for posting WIV_WM_OPEN_FILE, and once the swap is presented the next image gets preloaded.
+// The period is measured at the present, drawing is not part of it.
+// The large inputs are copied into their own directory, so the slideshow cycles through them.
+bool check_slideshow(const std::filesystem::path& directory)
+{
+    Bench_check check("slideshow");
+    const auto slideshow_directory = directory / "slideshow";
+    std::filesystem::create_directories(slideshow_directory);
+    for (const char* name : { "rgb8.png", "rgba16.tif" }) {
+        std::filesystem::copy_file(directory / name, slideshow_directory / name, std::filesystem::copy_options::overwrite_existing);
+    }
+    const bool cycle_files = std::exchange(g_config.cycle_files.val, true);
+    const bool metadata_cache = std::exchange(g_config.metadata_cache.val, false);
+
+    // Declared before the file manager, so they outlive its loader.
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool is_decoded = false;
+    File_manager file_manager;
+    file_manager.loader.set_on_decoded([&] {
+        {
+            std::scoped_lock lock(mutex);
+            is_decoded = true;
+        }
+        cv.notify_one();
+    });
+
+    Frame_scheduler frame_scheduler;
+    Slideshow_schedule schedule;
+    const auto interval = std::chrono::duration_cast<Slideshow_schedule::Clock::duration>(WIV_BENCH_SLIDESHOW_INTERVAL);
+    bool is_started = false;
+    int nshown = 0;
+    const auto timeout = Frame_scheduler::Clock::now() + WIV_BENCH_SLIDESHOW_INTERVAL * WIV_BENCH_SLIDESHOW_PERIODS + std::chrono::seconds(30);
+    file_manager.file_open_startup(slideshow_directory / "rgb8.png");
+    while (schedule.get_periods() < WIV_BENCH_SLIDESHOW_PERIODS) {
+        if (!check.expect(Frame_scheduler::Clock::now() < timeout, "timed out")) {
+            break;
+        }
+
+        // Sleep until the image is decoded or until the next frame.
+        bool is_message;
+        {
+            std::unique_lock lock(mutex);
+            cv.wait_for(lock, frame_scheduler.get_wait(Frame_scheduler::Clock::now()).value_or(std::chrono::seconds(1)), [&] { return is_decoded; });
+            is_message = std::exchange(is_decoded, false);
+        }
+
+        // Like WIV_WM_OPEN_FILE.
+        if (is_message) {
+            auto decoded_image = file_manager.loader.take();
+            if (decoded_image && decoded_image->path == file_manager.file_current) {
+                check.expect(!decoded_image->is_failed && decoded_image->image && decoded_image->data, "failed to decode");
+                if (decoded_image->image) {
+                    file_manager.image = std::move(*decoded_image->image);
+                }
+                file_manager.file_shown = decoded_image->path;
+                schedule.created();
+                ++nshown;
+            }
+            frame_scheduler.invalidate(Frame_scheduler::Clock::now());
+        }
+        if (!frame_scheduler.should_draw(Frame_scheduler::Clock::now())) {
+            continue;
+        }
+
+        // Started once the startup image is shown.
+        if (!is_started) {
+            if (file_manager.file_shown.empty()) {
+                continue;
+            }
+            schedule.start(Frame_scheduler::Clock::now(), interval);
+            file_manager.preload_next();
+            is_started = true;
+        }
+        if (schedule.should_swap(Frame_scheduler::Clock::now(), interval)) {
+            check.expect(file_manager.show_preloaded(), "the next image wasn't preloaded");
+        }
+        frame_scheduler.schedule(schedule.get_deadline());
+
+        // Like slideshow_presented().
+        if (schedule.presented(Frame_scheduler::Clock::now(), interval)) {
+            file_manager.preload_next();
+        }
+    }
+    g_config.cycle_files.val = cycle_files;
+    g_config.metadata_cache.val = metadata_cache;
+    std::cerr << "slideshow: " << nshown << " images shown, period error mean " << schedule.get_error_mean() << " ms, max " << schedule.get_error_max() << " ms\n";
+    check.expect(nshown == WIV_BENCH_SLIDESHOW_PERIODS + 1, "shown " + std::to_string(nshown) + " images");
+    check.expect(schedule.get_error_max() < WIV_BENCH_SLIDESHOW_MAX_ERROR, "a period was off by " + std::to_string(schedule.get_error_max()) + " ms");
+    return check.finish();
+}
@@ -0,0 +1,139 @@
+#include "pch.h"
+#include "thumbnail_store.h"
+#include "include/helpers.h"
+#include "include/supported_extensions.h"
+#include "include/bench.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+#include <iostream>
+
+// Makes thumbnails of the test images into a one block store, checks they read back after reopening it,
+// that a block holds them at their size, that the least recently used ones get replaced once it's full,
+// and that get() never returns a thumbnail torn by a concurrent put().
+bool check_thumbnail_store(const std::filesystem::path& directory, int iterations)
+{
+    const auto path = directory / "thumbnails.dat";
+    std::vector<std::pair<Thumbnail_key, std::vector<uint8_t>>> made;
+    bool is_ok = true;
+    {
+        Thumbnail_store store;
+        if (!store.open(path, Thumbnail_store::BLOCK_SIZE)) {
+            std::cerr << "thumbnail store: failed to open\n";
+            return false;
+        }
+        if (Thumbnail_store second; second.open(path, Thumbnail_store::BLOCK_SIZE)) {
+            std::cerr << "thumbnail store: opened twice\n";
+            is_ok = false;
+        }
+        for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+            if (!entry.is_regular_file() || !path_match_spec(entry.path(), WIV_SUPPORTED_EXTENSIONS)) {
+                continue;
+            }
+            int width;
+            int height;
+            int orientation;
+            Pixel_buffer data;
+            for (int i = 0; i < iterations; ++i) {
+                data = Thumbnail_store::make(entry.path(), width, height, orientation);
+            }
+            if (!data || std::max(width, height) != WIV_THUMBNAIL_SIZE) {
+                std::cerr << "thumbnail store: no thumbnail for " << entry.path().filename() << '\n';
+                is_ok = false;
+                continue;
+            }
+            const auto key = Thumbnail_store::get_key(entry);
+            store.put(key, data.get(), width, height, orientation);
+            made.emplace_back(key, std::vector<uint8_t>(data.get(), data.get() + static_cast<size_t>(width) * height * 4));
+        }
+    }
+
+    Thumbnail_store store;
+    if (!store.open(path, Thumbnail_store::BLOCK_SIZE)) {
+        std::cerr << "thumbnail store: failed to reopen\n";
+        return false;
+    }
+    for (int i = 0; i < iterations * 10000; ++i) {
+        WIV_BENCH_SCOPE("thumbnail store get");
+        const auto thumbnail = store.get(made[i % made.size()].first);
+        if (!thumbnail || thumbnail->data.empty()) {
+            is_ok = false;
+            break;
+        }
+    }
+    for (const auto& [key, pixels] : made) {
+        const auto thumbnail = store.get(key);
+        if (!thumbnail || thumbnail->data != pixels) {
+            std::cerr << "thumbnail store: thumbnail didn't read back\n";
+            is_ok = false;
+        }
+    }
+
+    // Failed files take a unit, they fill the rest of the block.
+    int nunits = 0;
+    for (const auto& [key, pixels] : made) {
+        nunits += Thumbnail_store::get_units(static_cast<int>(pixels.size() / 4), 1);
+    }
+    uint64_t failed_next = 1;
+    for (; nunits < WIV_THUMBNAIL_BLOCK_UNITS; ++nunits) {
+        store.put({ failed_next++, 0, 0 }, nullptr, 0, 0, 0);
+    }
+
+    // Only the first thumbnail is used again, so the others are the least recently used ones,
+    // filling their units replaces exactly them.
+    store.touch(made.front().first);
+    int nreplaced = 0;
+    for (size_t i = 1; i < made.size(); ++i) {
+        nreplaced += Thumbnail_store::get_units(static_cast<int>(made[i].second.size() / 4), 1);
+    }
+    for (int i = 0; i < nreplaced; ++i) {
+        store.put({ failed_next++, 0, 0 }, nullptr, 0, 0, 0);
+    }
+    const auto first_kept = store.get(made.front().first);
+    if (!first_kept || first_kept->data != made.front().second) {
+        std::cerr << "thumbnail store: the most recently used thumbnail got replaced\n";
+        is_ok = false;
+    }
+    for (size_t i = 1; i < made.size(); ++i) {
+        if (store.touch(made[i].first)) {
+            std::cerr << "thumbnail store: a least recently used thumbnail was kept\n";
+            is_ok = false;
+        }
+    }
+    for (uint64_t i = 1; i < failed_next; ++i) {
+        const auto failed = store.get({ i, 0, 0 });
+        if (!failed || !failed->data.empty()) {
+            std::cerr << "thumbnail store: failed file " << i << " got replaced out of order\n";
+            is_ok = false;
+            break;
+        }
+    }
+
+    // Two versions of the same thumbnail, every read should be one of them whole.
+    {
+        const std::vector<uint8_t> a(static_cast<size_t>(WIV_THUMBNAIL_SIZE) * WIV_THUMBNAIL_SIZE * 4, 1);
+        const std::vector<uint8_t> b(a.size(), 2);
+        const Thumbnail_key key = { 0, 0, 0 };
+        store.put(key, a.data(), WIV_THUMBNAIL_SIZE, WIV_THUMBNAIL_SIZE, 0);
+        std::atomic_bool is_torn = false;
+        {
+            std::jthread writer([&](std::stop_token stop_token) {
+                for (int i = 0; !stop_token.stop_requested(); ++i) {
+                    store.put(key, (i % 2 ? b : a).data(), WIV_THUMBNAIL_SIZE, WIV_THUMBNAIL_SIZE, 0);
+                }
+            });
+            for (int i = 0; i < iterations * 1000; ++i) {
+                const auto thumbnail = store.get(key);
+                if (thumbnail && thumbnail->data != a && thumbnail->data != b) {
+                    is_torn = true;
+                }
+            }
+        }
+        if (is_torn) {
+            std::cerr << "thumbnail store: read a torn thumbnail\n";
+            is_ok = false;
+        }
+    }
+    std::cerr << "thumbnail store: " << (is_ok ? "ok" : "failed") << '\n';
+    return is_ok;
+}
@@ -0,0 +1,157 @@
+#include "pch.h"
+#include "tiled_image.h"
+#include "include/half.h"
+#include "bench_common.h"
+#include "bench_checks.h"
+#include "bench_check.h"
+
+namespace
+{
+    // Compares a composed region with the level 0 pixels, or with their box filtered level 1 pixels.
+    template<typename T>
+    bool is_region_equal(const uint8_t* data, const Tile_region& region, const std::vector<T>& pixels, int width, int height, bool is_half)
+    {
+        const auto dst = reinterpret_cast<const T*>(data);
+        for (int y = region.y0; y < region.y1; ++y) {
+            for (int x = region.x0; x < region.x1; ++x) {
+                for (int c = 0; c < 4; ++c) {
+                    T expected;
+                    if (region.level == 0) {
+                        expected = pixels[(static_cast<size_t>(y) * width + x) * 4 + c];
+                    }
+                    else {
+                        const auto at = [&](int xx, int yy) { return pixels[(static_cast<size_t>(std::min(yy, height - 1)) * width + std::min(xx, width - 1)) * 4 + c]; };
+                        if (is_half) {
+                            expected = float_to_half((half_to_float(at(2 * x, 2 * y)) + half_to_float(at(2 * x + 1, 2 * y)) + half_to_float(at(2 * x, 2 * y + 1)) + half_to_float(at(2 * x + 1, 2 * y + 1))) / 4.0f);
+                        }
+                        else {
+                            expected = static_cast<T>((at(2 * x, 2 * y) + at(2 * x + 1, 2 * y) + at(2 * x, 2 * y + 1) + at(2 * x + 1, 2 * y + 1) + 2u) / 4u);
+                        }
+                    }
+                    if (dst[(static_cast<size_t>(y - region.y0) * (region.x1 - region.x0) + x - region.x0) * 4 + c] != expected) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+}
+
+// Builds the pyramids of an 8 bit and a float image into a tile cache directory, composes regions across tiles
+// and compares them with the decoded pixels. Also checks that float images keep values above 1, that complete pyramids
+// are reused while truncated ones are rebuilt, that compose fails on tiles truncated while open,
+// that the regions picked for a view cover it and are kept while panning within the margin,
+// and that pruning removes the least recently opened pyramids first.
+bool check_tiled_image(const std::filesystem::path& directory)
+{
+    Bench_check check("tiled image");
+    const auto tiles_directory = directory / "tiles";
+    constexpr uintmax_t cache_size = 1ull << 30;
+    constexpr size_t memory_budget = 16 << 20;
+
+    const auto path8 = directory / "tiled8.png";
+    const auto pathf = directory / "tiledf.exr";
+    constexpr int width = 1000;
+    constexpr int height = 600;
+    if (!check.expect(write_pattern(path8, width, height, OIIO::TypeDesc::UINT8, [](int x, int y, int c) { return static_cast<float>((x * 7 + y * 13 + c * 29) % 256) / 255.0f; }), "failed to write the 8 bit image")
+        || !check.expect(write_pattern(pathf, width, height, OIIO::TypeDesc::FLOAT, [](int x, int y, int c) { return static_cast<float>(x + y + c) / 100.0f; }), "failed to write the float image")) {
+        return check.finish();
+    }
+
+    // Regions crossing tile borders at both levels, the second one reaches the bottom right edge.
+    const std::array<Tile_region, 3> regions = { {
+        { 0, 100, 50, 700, 400 },
+        { 0, 700, 500, width, height },
+        { 1, 10, 20, 400, 300 },
+    } };
+    for (const auto& [path, is_half] : { std::pair(path8, false), std::pair(pathf, true) }) {
+        Image image;
+        if (!check.expect(image.open(path), "failed to open the image")) {
+            continue;
+        }
+        Tiled_image tiled;
+        if (!check.expect(tiled.open(image, path, tiles_directory, cache_size, memory_budget), "failed to build the pyramid")) {
+            continue;
+        }
+        check.expect(tiled.get_format() == (is_half ? OIIO::TypeDesc::HALF : OIIO::TypeDesc::UINT8), "wrong tile format");
+        check.expect(tiled.get_level(1.0f) == 0 && tiled.get_level(0.5f) == 1 && tiled.get_level(0.01f) == 2 && tiled.get_level_width(1) == width / 2, "wrong levels");
+        bool is_equal = true;
+        if (is_half) {
+            std::vector<uint16_t> pixels(static_cast<size_t>(width) * height * 4);
+            image.read_scanlines(0, height, pixels.data(), OIIO::TypeDesc::HALF);
+            check.expect(half_to_float(pixels[(static_cast<size_t>(height - 1) * width + width - 1) * 4]) > 1.0f, "float image got clipped");
+            for (const auto& region : regions) {
+                const auto data = tiled.compose(region);
+                is_equal = is_equal && data && is_region_equal(data.get(), region, pixels, width, height, true);
+            }
+        }
+        else {
+            std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+            image.read_scanlines(0, height, pixels.data());
+            for (const auto& region : regions) {
+                const auto data = tiled.compose(region);
+                is_equal = is_equal && data && is_region_equal(data.get(), region, pixels, width, height, false);
+            }
+        }
+        check.expect(is_equal, "composed region differs from the image");
+    }
+
+    // Reopening reuses the complete pyramid, the level files keep their last write time.
+    const auto level0 = [&] {
+        for (const auto& dir : std::filesystem::directory_iterator(tiles_directory)) {
+            if (std::filesystem::exists(dir.path() / "0.bin") && std::filesystem::file_size(dir.path() / "0.bin") == static_cast<uintmax_t>(WIV_TILE_SIZE) * WIV_TILE_SIZE * 4 * 4 * 3) {
+                return dir.path() / "0.bin";
+            }
+        }
+        return std::filesystem::path();
+    }();
+    if (check.expect(!level0.empty(), "the 8 bit pyramid is missing")) {
+        const auto old_time = std::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+        std::filesystem::last_write_time(level0, old_time);
+        Image image;
+        Tiled_image tiled;
+        check.expect(image.open(path8) && tiled.open(image, path8, tiles_directory, cache_size, memory_budget) && std::filesystem::last_write_time(level0) == old_time, "rebuilt a complete pyramid");
+
+        // Truncated while open, tiles already in memory can still be composed.
+        check.expect(tiled.compose(regions[0]) != nullptr, "failed to compose");
+        std::filesystem::resize_file(level0, std::filesystem::file_size(level0) / 2);
+        check.expect(!tiled.compose(regions[1]) && tiled.compose(regions[0]), "composed truncated tiles");
+        tiled.close();
+        check.expect(tiled.open(image, path8, tiles_directory, cache_size, memory_budget) && tiled.compose(regions[1]), "didn't rebuild a truncated pyramid");
+    }
+
+    // Regions for a 200 x 100 view, centered at scale 1, panned within the margin, rotated, and zoomed out to level 2.
+    {
+        Image image;
+        Tiled_image tiled;
+        if (check.expect(image.open(path8) && tiled.open(image, path8, tiles_directory, cache_size, memory_budget), "failed to open the pyramid")) {
+            const Tile_region none = { -1, 0, 0, 0, 0 };
+            const auto region = tiled.get_region(1.0f, 200, 100, 0.0f, 0.0f, 0, none);
+            check.expect(region == Tile_region{ 0, 500 - 100 - WIV_TILED_KERNEL_MARGIN - 256, 0, 500 + 100 + WIV_TILED_KERNEL_MARGIN + 256, height }, "wrong centered region");
+            check.expect(tiled.get_region(1.0f, 200, 100, -50.0f, 20.0f, 0, region) == region, "a pan within the margin changed the region");
+
+            // Rotated by 90 degrees the view covers 100 x 200 image pixels around the center.
+            const auto rotated = tiled.get_region(1.0f, 200, 100, 0.0f, 0.0f, 90, none);
+            check.expect(rotated.x0 <= 450 - WIV_TILED_KERNEL_MARGIN && rotated.x1 >= 550 + WIV_TILED_KERNEL_MARGIN && rotated.y0 <= 200 - WIV_TILED_KERNEL_MARGIN && rotated.y1 >= 400 + WIV_TILED_KERNEL_MARGIN
+                && rotated.x1 - rotated.x0 < region.x1 - region.x0, "wrong rotated region");
+            check.expect(tiled.get_region(0.25f, 200, 100, 0.0f, 0.0f, 0, region) == Tile_region{ 2, 0, 0, tiled.get_level_width(2), tiled.get_level_height(2) }, "wrong region at level 2");
+        }
+    }
+
+    // Pyramids of 1 MB each, the least recently opened get removed, but never the one kept.
+    const auto prune_directory = directory / "prune";
+    const auto now = std::filesystem::file_time_type::clock::now();
+    for (int i = 0; i < 4; ++i) {
+        const auto pyramid = prune_directory / std::to_string(i);
+        std::filesystem::create_directories(pyramid);
+        std::ofstream(pyramid / "0.bin", std::ios::binary).write(std::vector<char>(1 << 20).data(), 1 << 20);
+        std::ofstream(pyramid / "complete") << "header";
+        std::filesystem::last_write_time(pyramid / "complete", now - std::chrono::minutes(10 - i));
+    }
+    Tiled_image::prune(prune_directory, (2u << 20) + 1024, prune_directory / "0");
+    check.expect(std::filesystem::exists(prune_directory / "0") && !std::filesystem::exists(prune_directory / "1") && !std::filesystem::exists(prune_directory / "2") && std::filesystem::exists(prune_directory / "3"), "pruned the wrong pyramids");
+    Tiled_image::prune(prune_directory, 0);
+    check.expect(std::filesystem::is_empty(prune_directory), "pruning to 0 kept pyramids");
+    return check.finish();
+}
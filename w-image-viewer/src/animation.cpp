@@ -0,0 +1,170 @@
+#include "pch.h"
+#include "animation.h"
+#include "include/metrics.h"
+
+Animation::~Animation()
+{
+    stop();
+}
+
+bool Animation::start(const std::filesystem::path& path, std::shared_ptr<const uint8_t[]> first_frame, int width, int height, size_t memory_budget, Clock::time_point now, std::function<void()> on_late_frame)
+{
+    stop();
+
+    // Frames are read one after another from the decoder, never from the image cache.
+    image = Image();
+    if (!first_frame || !image.open(path, false, true) || !image.is_animated() || image.get_basetype() != OIIO::TypeDesc::UINT8 || image.get_width<int>() != width || image.get_height<int>() != height) {
+        image.close();
+        return false;
+    }
+    this->width = width;
+    this->height = height;
+    frame_size = static_cast<size_t>(width) * height * 4;
+    this->memory_budget = memory_budget;
+    cache.clear();
+    cache_size = 0;
+    is_caching = frame_size <= memory_budget;
+    if (is_caching) {
+        cache.push_back({ std::move(first_frame), 0, image.get_frame_delay() });
+        cache_size = frame_size;
+    }
+    ring.clear();
+    is_done = false;
+    ring_capacity = std::clamp<size_t>(memory_budget / frame_size, 2, WIV_ANIMATION_RING_FRAMES);
+    deadline = now + image.get_frame_delay();
+    Metrics::animation_frame.set(0);
+    is_late = false;
+    this->on_late_frame = std::move(on_late_frame);
+    thread = std::jthread(std::bind_front(&Animation::run, this));
+    return true;
+}
+
+void Animation::stop()
+{
+    // Cancels the frame being decoded.
+    if (thread.joinable()) {
+        thread.request_stop();
+        thread.join();
+    }
+    image.close();
+    cache.clear();
+}
+
+std::optional<Animation_frame> Animation::update(Clock::time_point now)
+{
+    std::unique_lock lock(mutex);
+    if (now < deadline) {
+        return std::nullopt;
+    }
+    if (ring.empty()) {
+        if (!is_late && !is_done) {
+            is_late = true;
+            Metrics::animation_frames_late.add();
+        }
+        return std::nullopt;
+    }
+    auto frame = std::move(ring.front());
+    ring.pop_front();
+
+    // Late frames restart the timing, on time frames keep it, so the delays don't drift.
+    if (is_late) {
+        is_late = false;
+        deadline = now + frame.delay;
+    }
+    else {
+        Metrics::animation_frame_error.record(std::chrono::duration<double, std::milli>(now - deadline).count());
+        deadline += frame.delay;
+        if (deadline <= now) {
+            deadline = now + frame.delay;
+        }
+    }
+    lock.unlock();
+    cv.notify_one();
+    Metrics::animation_frame.set(frame.index);
+    return frame;
+}
+
+std::optional<Animation::Clock::time_point> Animation::get_deadline() const
+{
+    std::scoped_lock lock(mutex);
+    if (is_late || (is_done && ring.empty())) {
+        return std::nullopt;
+    }
+    return deadline;
+}
+
+void Animation::run(std::stop_token stop_token)
+{
+    image.set_stop_token(stop_token);
+    int nframes = 0; // Known once the last frame is found.
+    int index = 0;
+    while (true) {
+        index = index + 1 == nframes ? 0 : index + 1;
+        Animation_frame frame;
+        if (!get_frame(index, frame)) {
+
+            // Past the last frame, loop from the first one.
+            // Otherwise the image has a single frame, the read got cancelled or failed.
+            if (nframes || index < 2 || stop_token.stop_requested()) {
+                break;
+            }
+            nframes = index;
+            index = 0;
+            if (!get_frame(index, frame)) {
+                break;
+            }
+        }
+
+        std::unique_lock lock(mutex);
+        if (!cv.wait(lock, stop_token, [this] { return ring.size() < ring_capacity; })) {
+            break;
+        }
+        const bool is_late_frame = is_late && ring.empty();
+        ring.push_back(std::move(frame));
+        lock.unlock();
+        if (is_late_frame) {
+            on_late_frame();
+        }
+    }
+
+    // The shown frames stay.
+    std::scoped_lock lock(mutex);
+    is_done = true;
+}
+
+bool Animation::get_frame(int index, Animation_frame& frame)
+{
+    if (index < static_cast<int>(cache.size()) && cache[index].data) {
+        frame = cache[index];
+        return true;
+    }
+    WIV_PROFILE_SCOPE("Animation frame decode");
+
+    // Composited frames have the size of the whole animation.
+    if (!image.seek_subimage(index) || image.get_width<int>() != width || image.get_height<int>() != height || image.get_basetype() != OIIO::TypeDesc::UINT8) {
+        return false;
+    }
+    auto data = make_pixel_buffer(frame_size);
+
+    // Frames without alpha only write the color channels.
+    std::memset(data.get(), 0xFF, frame_size);
+    if (!image.read_scanlines(0, height, data.get())) {
+        return false;
+    }
+    frame.data = std::move(data);
+    frame.index = index;
+    frame.delay = image.get_frame_delay();
+    if (is_caching) {
+        cache_size += frame_size;
+        if (cache_size > memory_budget) {
+            is_caching = false;
+            cache.clear();
+            cache.shrink_to_fit();
+        }
+        else {
+            cache.resize(std::max<size_t>(cache.size(), index + 1));
+            cache[index] = frame;
+        }
+    }
+    return true;
+}
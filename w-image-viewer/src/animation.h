@@ -0,0 +1,71 @@
+#pragma once
+
+#include "pch.h"
+#include "image.h"
+
+// Frames decoded ahead of the shown one at most, fewer if they don't fit in the memory budget.
+inline constexpr int WIV_ANIMATION_RING_FRAMES = 8;
+
+struct Animation_frame
+{
+    std::shared_ptr<const uint8_t[]> data; // 8 bit 4 channel pixels.
+    int index;
+    std::chrono::microseconds delay; // How long the frame is shown.
+};
+
+// Plays animated images (GIF, WebP), the first frame is shown as a normal image.
+// A decoder thread keeps a bounded ring of frames decoded ahead of the shown one.
+// While all frames fit in the memory budget they are also kept, so the following loops don't decode again.
+// Frames are due at the sum of the previous delays, a late frame is shown once decoded and the timing continues from it.
+// Doesn't depend on the platform, time is always passed in.
+class Animation
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    ~Animation();
+
+    // Starts playing after the first frame, which is shown at time now.
+    // first_frame are the shown 8 bit 4 channel pixels of width x height, they get cached like the decoded frames.
+    // on_late_frame gets called from the decoder thread once a late frame is decoded.
+    // Returns false if the image is not animated, or its frames don't have the dims of the first frame.
+    bool start(const std::filesystem::path& path, std::shared_ptr<const uint8_t[]> first_frame, int width, int height, size_t memory_budget, Clock::time_point now, std::function<void()> on_late_frame);
+    void stop();
+
+    bool is_playing() const noexcept
+    {
+        return thread.joinable();
+    }
+
+    // Returns the frame to show, if the next frame is due and decoded.
+    std::optional<Animation_frame> update(Clock::time_point now);
+
+    // When the next frame is due, empty while waiting for a late frame or if there are no more frames.
+    std::optional<Clock::time_point> get_deadline() const;
+
+private:
+    void run(std::stop_token stop_token);
+    bool get_frame(int index, Animation_frame& frame);
+
+    // Used only by the decoder thread.
+    Image image;
+    int width;
+    int height;
+    size_t frame_size;
+    size_t memory_budget;
+    std::vector<Animation_frame> cache; // Empty once the frames don't fit in the memory budget.
+    size_t cache_size;
+    bool is_caching;
+
+    mutable std::mutex mutex;
+    std::condition_variable_any cv;
+    std::deque<Animation_frame> ring;
+    size_t ring_capacity;
+    Clock::time_point deadline;
+    bool is_late;
+    bool is_done; // The decoder has no more frames.
+    std::function<void()> on_late_frame;
+
+    // Should be the last member, so it stops first.
+    std::jthread thread;
+};
@@ -0,0 +1,232 @@
+#include "pch.h"
+#include "include/bench.h"
+
+namespace
+{
+    // Timestamps are relative to the start of the program.
+    const Bench::Clock::time_point epoch = Bench::Clock::now();
+
+    struct Event
+    {
+        const char* name;
+        int64_t start; // In nanoseconds since epoch, unused for counters.
+        int64_t value; // Duration in nanoseconds, or the count for counters.
+        bool is_counter;
+    };
+
+    // Owned by a single thread, the mutex is only contended while results are being collected.
+    struct Thread_buffer
+    {
+        std::mutex mutex;
+        std::vector<Event> events;
+        int thread_id;
+    };
+
+    struct Registry
+    {
+        std::mutex mutex;
+
+        // Buffers are shared, so they outlive threads that already exited.
+        std::vector<std::shared_ptr<Thread_buffer>> buffers;
+    };
+
+    Registry& get_registry()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    Thread_buffer& get_thread_buffer()
+    {
+        thread_local const auto buffer = [] {
+            auto buffer = std::make_shared<Thread_buffer>();
+            auto& registry = get_registry();
+            std::scoped_lock lock(registry.mutex);
+            buffer->thread_id = static_cast<int>(registry.buffers.size()) + 1;
+            registry.buffers.push_back(buffer);
+            return buffer;
+        }();
+        return *buffer;
+    }
+
+    void push(const Event& event) noexcept
+    {
+        try {
+            auto& buffer = get_thread_buffer();
+            std::scoped_lock lock(buffer.mutex);
+            buffer.events.push_back(event);
+        }
+
+        // Losing an event is better than failing the timed code.
+        catch (...) {}
+    }
+
+    // Calls fn(event, thread_id) for every recorded event.
+    template<typename F>
+    void for_each_event(F&& fn)
+    {
+        auto& registry = get_registry();
+        std::scoped_lock lock(registry.mutex);
+        for (const auto& buffer : registry.buffers) {
+            std::scoped_lock buffer_lock(buffer->mutex);
+            for (const auto& event : buffer->events) {
+                fn(event, buffer->thread_id);
+            }
+        }
+    }
+
+    int64_t to_ns(Bench::Clock::duration duration) noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    }
+
+    // Names are string literals, but they still need escaping for JSON.
+    void write_json_string(std::ostream& os, const char* str)
+    {
+        os << '"';
+        for (; *str; ++str) {
+            if (*str == '"' || *str == '\\') {
+                os << '\\';
+            }
+            os << *str;
+        }
+        os << '"';
+    }
+
+    bool compare_names(const char* a, const char* b) noexcept
+    {
+        return std::strcmp(a, b) < 0;
+    }
+}
+
+void Bench::record(const char* name, Clock::time_point start, Clock::time_point end) noexcept
+{
+    push({ name, to_ns(start - epoch), to_ns(end - start), false });
+}
+
+void Bench::count(const char* name, int64_t value) noexcept
+{
+    if (is_enabled.load(std::memory_order_relaxed)) {
+        push({ name, to_ns(Clock::now() - epoch), value, true });
+    }
+}
+
+std::vector<Bench_stats> Bench::get_stats()
+{
+    std::map<const char*, std::vector<int64_t>, decltype(&compare_names)> durations(compare_names);
+    for_each_event([&](const Event& event, int) {
+        if (!event.is_counter) {
+            durations[event.name].push_back(event.value);
+        }
+    });
+
+    std::vector<Bench_stats> stats;
+    for (auto& [name, values] : durations) {
+        std::sort(values.begin(), values.end());
+
+        // Nearest rank percentile.
+        const auto percentile = [&values](double p) {
+            const auto rank = static_cast<size_t>(std::ceil(p * values.size()));
+            return values[std::clamp<size_t>(rank, 1, values.size()) - 1] / 1e6;
+        };
+        stats.push_back({
+            .name = name,
+            .count = values.size(),
+            .total = std::accumulate(values.begin(), values.end(), int64_t()) / 1e6,
+            .min = values.front() / 1e6,
+            .median = percentile(0.5),
+            .p99 = percentile(0.99),
+            .max = values.back() / 1e6
+        });
+    }
+    return stats;
+}
+
+std::vector<Bench_counter> Bench::get_counters()
+{
+    std::map<const char*, int64_t, decltype(&compare_names)> sums(compare_names);
+    for_each_event([&](const Event& event, int) {
+        if (event.is_counter) {
+            sums[event.name] += event.value;
+        }
+    });
+    std::vector<Bench_counter> counters;
+    for (const auto& [name, value] : sums) {
+        counters.push_back({ name, value });
+    }
+    return counters;
+}
+
+void Bench::write_csv(std::ostream& os)
+{
+    os << "name,count,total_ms,min_ms,median_ms,p99_ms,max_ms\n";
+    for (const auto& stats : get_stats()) {
+        os << stats.name << ',' << stats.count << ',' << stats.total << ',' << stats.min << ',' << stats.median << ',' << stats.p99 << ',' << stats.max << '\n';
+    }
+
+    // Counters only have a count.
+    for (const auto& counter : get_counters()) {
+        os << counter.name << ',' << counter.value << ",,,,,\n";
+    }
+}
+
+void Bench::write_json(std::ostream& os)
+{
+    os << "{\"timers\":[";
+    const char* separator = "";
+    for (const auto& stats : get_stats()) {
+        os << separator << "{\"name\":";
+        write_json_string(os, stats.name);
+        os << ",\"count\":" << stats.count << ",\"total_ms\":" << stats.total << ",\"min_ms\":" << stats.min << ",\"median_ms\":" << stats.median << ",\"p99_ms\":" << stats.p99 << ",\"max_ms\":" << stats.max << '}';
+        separator = ",";
+    }
+    os << "],\"counters\":[";
+    separator = "";
+    for (const auto& counter : get_counters()) {
+        os << separator << "{\"name\":";
+        write_json_string(os, counter.name);
+        os << ",\"value\":" << counter.value << '}';
+        separator = ",";
+    }
+    os << "]}\n";
+}
+
+void Bench::write_trace(std::ostream& os)
+{
+    // Timestamps are in microseconds.
+    os << "{\"traceEvents\":[";
+    const char* separator = "";
+    for_each_event([&](const Event& event, int thread_id) {
+        os << separator << "{\"name\":";
+        write_json_string(os, event.name);
+        os << ",\"pid\":1,\"tid\":" << thread_id << ",\"ts\":" << event.start / 1e3;
+        if (event.is_counter) {
+            os << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+        }
+        else {
+            os << ",\"ph\":\"X\",\"dur\":" << event.value / 1e3 << '}';
+        }
+        separator = ",";
+    });
+    os << "]}\n";
+}
+
+void Bench::write_files(const std::filesystem::path& directory)
+{
+    std::ofstream csv(directory / "bench.csv");
+    write_csv(csv);
+    std::ofstream json(directory / "bench.json");
+    write_json(json);
+    std::ofstream trace(directory / "bench_trace.json");
+    write_trace(trace);
+}
+
+void Bench::reset() noexcept
+{
+    auto& registry = get_registry();
+    std::scoped_lock lock(registry.mutex);
+    for (const auto& buffer : registry.buffers) {
+        std::scoped_lock buffer_lock(buffer->mutex);
+        buffer->events.clear();
+    }
+}
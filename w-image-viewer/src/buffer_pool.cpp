@@ -0,0 +1,181 @@
+#include "pch.h"
+#include "buffer_pool.h"
+#include "include/global.h"
+
+namespace
+{
+    // Smaller buffers are cheap enough, they don't get pooled.
+    constexpr size_t WIV_POOL_MIN_SIZE = 1024 * 1024;
+
+    // Pooled buffers are rounded up to this, it's also the usual large page size.
+    constexpr size_t WIV_POOL_GRANULARITY = 2 * 1024 * 1024;
+
+#ifdef _WIN32
+
+    // Large pages need SeLockMemoryPrivilege, which has to be enabled first.
+    bool enable_lock_memory_privilege() noexcept
+    {
+        HANDLE token;
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+            return false;
+        }
+        TOKEN_PRIVILEGES privileges = {};
+        privileges.PrivilegeCount = 1;
+        privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        bool result = false;
+        if (LookupPrivilegeValueW(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid)) {
+
+            // Succeeds even if the privilege wasn't assigned, in that case last error is ERROR_NOT_ALL_ASSIGNED.
+            result = AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) && GetLastError() == ERROR_SUCCESS;
+        }
+        CloseHandle(token);
+        return result;
+    }
+
+    uint8_t* allocate_pages(size_t size)
+    {
+        if (g_config.buffer_pool_large_pages.val) {
+            static const bool has_large_pages = enable_lock_memory_privilege() && GetLargePageMinimum() > 0;
+            if (has_large_pages && size % GetLargePageMinimum() == 0) {
+                if (const auto data = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE)) {
+                    return static_cast<uint8_t*>(data);
+                }
+            }
+        }
+        const auto data = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (!data) {
+            throw std::bad_alloc();
+        }
+        return static_cast<uint8_t*>(data);
+    }
+
+    void free_pages(uint8_t* data, size_t) noexcept
+    {
+        VirtualFree(data, 0, MEM_RELEASE);
+    }
+
+#else
+
+    uint8_t* allocate_pages(size_t size)
+    {
+        // Explicit huge pages have to be reserved by the system, if they are not fall back to transparent huge pages.
+        if (g_config.buffer_pool_large_pages.val) {
+            if (const auto data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0); data != MAP_FAILED) {
+                return static_cast<uint8_t*>(data);
+            }
+        }
+        const auto data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        if (g_config.buffer_pool_large_pages.val) {
+            madvise(data, size, MADV_HUGEPAGE);
+        }
+        return static_cast<uint8_t*>(data);
+    }
+
+    void free_pages(uint8_t* data, size_t size) noexcept
+    {
+        munmap(data, size);
+    }
+
+#endif
+
+    class Buffer_pool
+    {
+    public:
+        ~Buffer_pool()
+        {
+            trim();
+        }
+
+        // A reused buffer can be larger than requested, size gets updated to its size.
+        uint8_t* acquire(size_t& size)
+        {
+            {
+                std::scoped_lock lock(mutex);
+
+                // Reuse the smallest free buffer that is large enough, but not wastefully large.
+                const auto it = free_buffers.lower_bound(size);
+                if (it != free_buffers.end() && it->first <= size + size / 8) {
+                    const auto data = it->second;
+                    size = it->first;
+                    free_bytes -= it->first;
+                    free_buffers.erase(it);
+                    return data;
+                }
+            }
+            return allocate_pages(size);
+        }
+
+        void release(uint8_t* data, size_t size) noexcept
+        {
+            {
+                std::scoped_lock lock(mutex);
+                if (free_bytes + size <= static_cast<size_t>(g_config.buffer_pool_size.val) * 1024 * 1024) {
+                    free_buffers.emplace(size, data);
+                    free_bytes += size;
+                    return;
+                }
+            }
+            free_pages(data, size);
+        }
+
+        void trim() noexcept
+        {
+            std::scoped_lock lock(mutex);
+            for (const auto& [size, data] : free_buffers) {
+                free_pages(data, size);
+            }
+            free_buffers.clear();
+            free_bytes = 0;
+        }
+
+        size_t get_free_bytes() noexcept
+        {
+            std::scoped_lock lock(mutex);
+            return free_bytes;
+        }
+
+    private:
+        std::mutex mutex;
+        std::multimap<size_t, uint8_t*> free_buffers; // By size.
+        size_t free_bytes = 0;
+    };
+
+    Buffer_pool& get_buffer_pool()
+    {
+        static Buffer_pool buffer_pool;
+        return buffer_pool;
+    }
+}
+
+void Pixel_buffer_deleter::operator()(uint8_t* data) const noexcept
+{
+    if (size) {
+        get_buffer_pool().release(data, size);
+    }
+    else {
+        delete[] data;
+    }
+}
+
+Pixel_buffer make_pixel_buffer(size_t size)
+{
+    if (size < WIV_POOL_MIN_SIZE) {
+        return Pixel_buffer(new uint8_t[size], { 0 });
+    }
+    size = (size + WIV_POOL_GRANULARITY - 1) / WIV_POOL_GRANULARITY * WIV_POOL_GRANULARITY;
+    const auto data = get_buffer_pool().acquire(size);
+    return Pixel_buffer(data, { size });
+}
+
+void trim_pixel_buffers() noexcept
+{
+    get_buffer_pool().trim();
+}
+
+size_t get_pooled_pixel_buffers_size() noexcept
+{
+    return get_buffer_pool().get_free_bytes();
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "pch.h"
+
+// Returns the buffer to the buffer pool, buffers with size 0 are not pooled.
+struct Pixel_buffer_deleter
+{
+    void operator()(uint8_t* data) const noexcept;
+    size_t size; // Size of the allocation, might be larger than requested.
+};
+
+using Pixel_buffer = std::unique_ptr<uint8_t[], Pixel_buffer_deleter>;
+
+// Allocates an uninitialized buffer, large buffers get recycled by the buffer pool.
+// Decoding same size images (like camera frames) then doesn't have to fault in and zero fresh pages every time.
+Pixel_buffer make_pixel_buffer(size_t size);
+
+// Frees all buffers kept by the buffer pool.
+void trim_pixel_buffers() noexcept;
+
+// Total size of the buffers kept by the buffer pool, in bytes.
+size_t get_pooled_pixel_buffers_size() noexcept;
@@ -196,8 +196,29 @@ void Config::read_top_level(const std::string& key, const std::string& val)
         return;
     }
     read(cms_lut_size)
+    read(cms_lut_max_error)
     read(cms_dither)
+    read(cms_matrix_shaper)
     read(raw_thumb)
+    read(raw_half_size)
+    read(raw_cache_size)
+    read(float_to_half)
+    read(tile_cache_size)
+    read(tile_disk_cache_size)
+    read(image_cache)
+    read(image_cache_size)
+    read(image_cache_max_open_files)
+    read(metadata_cache)
+    read(buffer_pool_size)
+    read(buffer_pool_large_pages)
+    read(metrics_dump)
+    read(metrics_dump_interval)
+    read(font_atlas_cache)
+    read(single_instance)
+    read(thumbnail_cache_size)
+    read(animation_cache_size)
+    read(render_cache_size)
+    read(render_time_budget)
     read(overlay_show)
     read(overlay_position)
     read(overlay_config)
@@ -276,8 +297,29 @@ void Config::write_top_level(std::ofstream& file)
     write(cms_display_profile)
     file << cms_display_profile_custom.key << '=' << cms_display_profile_custom.val.string() << '\n';
     write(cms_lut_size)
+    write(cms_lut_max_error)
     write(cms_dither)
+    write(cms_matrix_shaper)
     write(raw_thumb)
+    write(raw_half_size)
+    write(raw_cache_size)
+    write(float_to_half)
+    write(tile_cache_size)
+    write(tile_disk_cache_size)
+    write(image_cache)
+    write(image_cache_size)
+    write(image_cache_max_open_files)
+    write(metadata_cache)
+    write(buffer_pool_size)
+    write(buffer_pool_large_pages)
+    write(metrics_dump)
+    write(metrics_dump_interval)
+    write(font_atlas_cache)
+    write(single_instance)
+    write(thumbnail_cache_size)
+    write(animation_cache_size)
+    write(render_cache_size)
+    write(render_time_budget)
     write(overlay_show)
     write(overlay_position)
     write(overlay_config)
@@ -313,7 +355,12 @@ void Config::write_scale(std::ofstream& file, const Config_scale& scale)
 
 std::filesystem::path Config::get_path()
 {
+#ifdef _WIN32
     wchar_t path[MAX_PATH];
     GetModuleFileNameW(nullptr, path, MAX_PATH);
     return std::filesystem::path(path).parent_path();
+#else
+    std::error_code ec;
+    return std::filesystem::read_symlink("/proc/self/exe", ec).parent_path();
+#endif
 }
@@ -1,8 +1,8 @@
 #pragma once
 
 #include "pch.h"
-#include "include\range.h"
-#include "include\helpers.h"
+#include "include/range.h"
+#include "include/helpers.h"
 
 template<typename T, Char_array str>
 struct Config_pair
@@ -45,6 +45,7 @@ public:
     void write();
     void read_slideshow();
     void write_slideshow();
+    std::filesystem::path get_path();
 
     // Client area.
     Config_pair<int, "ww"> window_width = { 1300 };
@@ -67,9 +68,30 @@ public:
     Config_pair<bool, "cmda"> cms_default_to_aces;
     Config_pair<int, "cmdp"> cms_display_profile;
     Config_pair<std::filesystem::path, "cmdpc"> cms_display_profile_custom;
-    Config_pair<unsigned int, "cmlsz"> cms_lut_size = { 33 };
+    Config_pair<unsigned int, "cmlsz"> cms_lut_size = { 0 }; // 0 - auto
+    Config_pair<float, "cmle"> cms_lut_max_error = { 0.5f };
     Config_pair<bool, "cmd"> cms_dither { true };
+    Config_pair<bool, "cmms"> cms_matrix_shaper { true };
     Config_pair<bool, "rwt"> raw_thumb = { true };
+    Config_pair<bool, "rhs"> raw_half_size = { true };
+    Config_pair<int, "rcs"> raw_cache_size = { 512 };
+    Config_pair<bool, "fth"> float_to_half = { true };
+    Config_pair<int, "tcs"> tile_cache_size = { 512 };
+    Config_pair<int, "tdcs"> tile_disk_cache_size = { 8192 };
+    Config_pair<bool, "icu"> image_cache = { false };
+    Config_pair<int, "ics"> image_cache_size = { 1024 };
+    Config_pair<int, "icmf"> image_cache_max_open_files = { 100 };
+    Config_pair<bool, "mdc"> metadata_cache = { true };
+    Config_pair<int, "bps"> buffer_pool_size = { 1024 };
+    Config_pair<bool, "bplp"> buffer_pool_large_pages = { false };
+    Config_pair<bool, "mtd"> metrics_dump = { false };
+    Config_pair<int, "mtdi"> metrics_dump_interval = { 60 };
+    Config_pair<bool, "fac"> font_atlas_cache = { true };
+    Config_pair<bool, "sin"> single_instance = { false };
+    Config_pair<int, "thcs"> thumbnail_cache_size = { 1280 };
+    Config_pair<int, "ancs"> animation_cache_size = { 256 };
+    Config_pair<int, "rvcs"> render_cache_size = { 256 };
+    Config_pair<float, "rtb"> render_time_budget = { 50.0f };
     std::vector<Scale_profile> scale_profiles;
     Config_pair<bool, "oshw"> overlay_show;
     Config_pair<int, "opos"> overlay_position;
@@ -83,5 +105,4 @@ private:
     void read_scale(const std::string& key, const std::string& val, Config_scale& scale);
     void write_top_level(std::ofstream& file);
     void write_scale(std::ofstream& file, const Config_scale& scale);
-    std::filesystem::path get_path();
 };
@@ -1,51 +1,32 @@
 #include "pch.h"
 #include "file_manager.h"
 #include "config.h"
-#include "include\helpers.h"
-#include "include\supported_extensions.h"
-#include "include\global.h"
+#include "include/helpers.h"
+#include "include/supported_extensions.h"
+#include "include/global.h"
+#ifdef _WIN32
 #include "window.h"
 #include "include\ensure.h"
+#endif
 
 bool File_manager::file_open(const wchar_t* path)
 {
-    if (image.open(path)) {
-        file_current = path;
-        return true;
-    }
-    return false;
+    return request(path);
 }
 
-void File_manager::file_next()
+void File_manager::file_open_startup(const std::filesystem::path& path)
 {
-    // Iterate directory for next files.
-    std::vector<std::filesystem::path> files;
-    for (const auto& file : std::filesystem::directory_iterator(file_current.parent_path())) {
-        if (!file.is_directory() && PathMatchSpecExW(file.path().c_str(), WIV_SUPPORTED_EXTENSIONS, PMSF_MULTIPLE) == S_OK) {
-            if (file.path() > file_current) {
-                files.push_back(file.path());
-            }
-        }
-    }
-
-    if (files.empty()) {
-        if (g_config.cycle_files.val) {
-            for (const auto& file : std::filesystem::directory_iterator(file_current.parent_path())) {
-                if (!file.is_directory() && PathMatchSpecExW(file.path().c_str(), WIV_SUPPORTED_EXTENSIONS, PMSF_MULTIPLE) == S_OK) {
-                    files.push_back(file.path());
-                }
-            }
-        }
-        else {
-            return;
-        }
-    }
+    // The directory gets probed on the next request, so it doesn't compete with the decode.
+    file_current = path;
+    page = 0;
+    loader.request(path);
+}
 
+void File_manager::file_next()
+{
     // Get next valid file.
-    std::sort(files.begin(), files.end());
-    for (const auto& file : files) {
-        if (image.open(file)) {
-            file_current = file;
+    for (const auto& file : get_files(true)) {
+        if (request(file)) {
             break;
         }
     }
@@ -53,60 +34,67 @@ void File_manager::file_next()
 
 void File_manager::file_previous()
 {
-    // Iterate directory for previous files.
-    std::vector<std::filesystem::path> files;
-    for (const auto& file : std::filesystem::directory_iterator(file_current.parent_path())) {
-        if (!file.is_directory() && PathMatchSpecExW(file.path().c_str(), WIV_SUPPORTED_EXTENSIONS, PMSF_MULTIPLE) == S_OK) {
-            if (file.path() < file_current) {
-                files.push_back(file.path());
-            }
+    // Get previous valid file.
+    for (const auto& file : get_files(false)) {
+        if (request(file)) {
+            break;
         }
     }
+}
 
-    if (files.empty()) {
-        if (g_config.cycle_files.val) {
-            for (const auto& file : std::filesystem::directory_iterator(file_current.parent_path())) {
-                if (!file.is_directory() && PathMatchSpecExW(file.path().c_str(), WIV_SUPPORTED_EXTENSIONS, PMSF_MULTIPLE) == S_OK) {
-                    files.push_back(file.path());
-                }
-            }
-        }
-        else {
-            return;
-        }
+void File_manager::page_next()
+{
+    request_page(page + 1);
+}
+
+void File_manager::page_previous()
+{
+    if (page > 0) {
+        request_page(page - 1);
     }
-    
-    // Get previous valid file.
-    std::sort(files.begin(), files.end());
-    for (const auto& file : std::ranges::views::reverse(files)) {
-        if (image.open(file)) {
-            file_current = file;
+}
+
+void File_manager::preload_next()
+{
+    for (const auto& file : get_files(true)) {
+        Image image_next;
+        if (open(file, image_next)) {
+            file_preloaded = file;
+            loader.preload(file, std::move(image_next));
             break;
         }
     }
 }
 
+bool File_manager::show_preloaded()
+{
+    if (file_preloaded.empty() || !loader.show_preloaded(file_preloaded)) {
+        return false;
+    }
+    file_current = file_preloaded;
+    page = 0;
+    file_preloaded.clear();
+    return true;
+}
+
+#ifdef _WIN32
 bool File_manager::drag_and_drop(HDROP hdrop)
 {
     wchar_t path[MAX_PATH];
     ensure(DragQueryFileW(hdrop, 0, path, MAX_PATH), != 0);
     DragFinish(hdrop);
-    if (image.open(path)) {
-        file_current = path;
-        return true;
-    }
-    return false;
+    return request(path);
 }
 
-// Sends file to the recycle bin!
+// Sends the shown file to the recycle bin!
 void File_manager::delete_file()
 {
-    if (!image.close())
+    if (file_shown.empty() || !image.close())
         return;
 
     // SHFILEOPSTRUCTW::pFrom must be double null terminated.
     wchar_t path[MAX_PATH + 1];
-    wcscpy(path, file_current.c_str());
+    wcscpy(path, file_shown.c_str());
     path[std::char_traits<wchar_t>::length(path) + 1] = '\0';
 
     // Configured to send file to the recycle bin.
@@ -116,7 +104,12 @@ void File_manager::delete_file()
     fileopenstruct.fFlags = FOF_ALLOWUNDO;
 
     if (SHFileOperationW(&fileopenstruct) == 0) {
-        const auto deleted_file = file_current;
+        const auto deleted_file = std::exchange(file_shown, {});
+
+        // Another requested file replaces the deleted one once it's decoded.
+        if (file_current != deleted_file) {
+            return;
+        }
         file_next();
         if (file_current == deleted_file) // Do we have a next file?
             file_previous();
@@ -124,7 +117,125 @@ void File_manager::delete_file()
             file_current.clear();
             ensure(PostMessageW(g_hwnd, WIV_WM_RESET_RESOURCES, 0, 0), != 0);
         }
-        else
-            ensure(PostMessageW(g_hwnd, WIV_WM_OPEN_FILE, 0, 0), != 0);
     }
 }
+#endif
+
+void File_manager::develop_raw_full()
+{
+    // Only the shown image gets developed, a pending request replaces it anyway.
+    if (file_shown != file_current) {
+        return;
+    }
+    Image image_full;
+    if (image_full.open(file_current, true)) {
+        loader.request(file_current, std::move(image_full), true);
+    }
+}
+
+// Only opens the image here, the loader will decode it and call its on_decoded.
+bool File_manager::request(const std::filesystem::path& path)
+{
+    Image image_next;
+    if (!open(path, image_next)) {
+        return false;
+    }
+    file_current = path;
+    page = 0;
+    file_preloaded.clear();
+    loader.request(path, std::move(image_next));
+    if (g_config.metadata_cache.val) {
+        metadata_cache.probe_directory(path.parent_path());
+    }
+    return true;
+}
+
+// Pages get decoded like other images, but the directory is not probed again.
+bool File_manager::request_page(int val)
+{
+    if (file_current.empty()) {
+        return false;
+    }
+
+    // Checked on the opened file, the shown image may still be the previous file.
+    Image image_page;
+    if (!image_page.open(file_current) || image_page.is_animated() || !image_page.seek_subimage(val)) {
+        return false;
+    }
+    page = val;
+    file_preloaded.clear();
+    loader.request(file_current, std::move(image_page));
+    return true;
+}
+
+std::optional<Image_metadata> File_manager::get_metadata(const std::filesystem::path& path)
+{
+    if (!g_config.metadata_cache.val) {
+        return std::nullopt;
+    }
+    if (!metadata_cache.is_open()) {
+        metadata_cache.open(g_config.get_path() / L"metadata.dat");
+    }
+    std::error_code ec;
+    return metadata_cache.get(std::filesystem::directory_entry(path, ec));
+}
+
+bool File_manager::open(const std::filesystem::path& path, Image& image_next)
+{
+    std::error_code ec;
+    const std::filesystem::directory_entry entry(path, ec);
+
+    // Skip files we already know can't be opened, without touching the codec.
+    if (const auto metadata = get_metadata(path); metadata && !metadata->is_valid) {
+        return false;
+    }
+
+    if (!image_next.open(path)) {
+        if (g_config.metadata_cache.val) {
+            metadata_cache.put(entry, {});
+        }
+        return false;
+    }
+    return true;
+}
+
+std::vector<std::filesystem::directory_entry> File_manager::get_directory_files() const
+{
+    std::vector<std::filesystem::directory_entry> files;
+    std::error_code ec;
+    for (const auto& file : std::filesystem::directory_iterator(file_current.parent_path(), ec)) {
+        if (!file.is_directory() && path_match_spec(file.path(), WIV_SUPPORTED_EXTENSIONS)) {
+            files.push_back(file);
+        }
+    }
+    std::ranges::sort(files, {}, [](const std::filesystem::directory_entry& file) -> const auto& { return file.path(); });
+    return files;
+}
+
+// Returns the files after (or before) the current file, in the order they should be tried.
+std::vector<std::filesystem::path> File_manager::get_files(bool is_next) const
+{
+    // Iterate directory for next (or previous) files.
+    std::vector<std::filesystem::path> files;
+    for (const auto& file : std::filesystem::directory_iterator(file_current.parent_path())) {
+        if (!file.is_directory() && path_match_spec(file.path(), WIV_SUPPORTED_EXTENSIONS)) {
+            if (is_next ? file.path() > file_current : file.path() < file_current) {
+                files.push_back(file.path());
+            }
+        }
+    }
+
+    if (files.empty() && g_config.cycle_files.val) {
+        for (const auto& file : std::filesystem::directory_iterator(file_current.parent_path())) {
+            if (!file.is_directory() && path_match_spec(file.path(), WIV_SUPPORTED_EXTENSIONS)) {
+                files.push_back(file.path());
+            }
+        }
+    }
+
+    std::sort(files.begin(), files.end());
+    if (!is_next) {
+        std::reverse(files.begin(), files.end());
+    }
+    return files;
+}
@@ -2,15 +2,54 @@
 
 #include "pch.h"
 #include "image.h"
+#include "image_loader.h"
+#include "metadata_cache.h"
 
+// The current file and navigation within its directory, images get decoded by the loader.
+// Drag and drop and deleting to the recycle bin are Windows only, the rest doesn't depend on the platform.
 class File_manager
 {
 public:
     bool file_open(const wchar_t* path);
+
+    // Opens the startup image, the loader opens and decodes it while the window gets created.
+    void file_open_startup(const std::filesystem::path& path);
     void file_next();
     void file_previous();
+
+    // Shows the next (or previous) page of a multipage image, animation frames are not pages.
+    void page_next();
+    void page_previous();
+#ifdef _WIN32
     bool drag_and_drop(HDROP hdrop);
     void delete_file();
-    std::filesystem::path file_current;
-    Image image;
+#endif
+
+    // Supported files in the directory of the current file, sorted.
+    std::vector<std::filesystem::directory_entry> get_directory_files() const;
+
+    // Develops the current RAW image at full size, in place of the draft.
+    void develop_raw_full();
+
+    // Decodes the next file ahead without showing it, used by the slideshow.
+    void preload_next();
+
+    // Cached metadata of the file, std::nullopt if it isn't cached or the metadata cache is disabled.
+    std::optional<Image_metadata> get_metadata(const std::filesystem::path& path);
+
+    // Shows the preloaded file, once it's decoded.
+    // Returns false if nothing was preloaded, file_next() should be used instead.
+    bool show_preloaded();
+    std::filesystem::path file_current; // The last requested file, it might still be loading.
+    std::filesystem::path file_shown; // File of the shown image, empty if none is shown.
+    int page; // Page of the current file.
+    Image image; // The currently shown image, file_current might still be loading.
+    Image_loader loader;
+    Metadata_cache metadata_cache;
+private:
+    bool request(const std::filesystem::path& path);
+    bool request_page(int val);
+    bool open(const std::filesystem::path& path, Image& image_next);
+    std::vector<std::filesystem::path> get_files(bool is_next) const;
+    std::filesystem::path file_preloaded;
 };
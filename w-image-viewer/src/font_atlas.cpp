@@ -0,0 +1,200 @@
+#include "pch.h"
+#include "font_atlas.h"
+#include "include/font.h"
+#include "include/profiler.h"
+
+namespace
+{
+    constexpr float WIV_FONT_SIZE = 16.0f;
+
+    // ImGui 1.92+ rasterizes the glyphs on demand, there is no atlas to cache.
+#if IMGUI_VERSION_NUM < 19200
+    constexpr uint32_t WIV_FONT_ATLAS_MAGIC = 0x46564957; // "WIVF"
+    constexpr uint32_t WIV_FONT_ATLAS_VERSION = 2;
+
+    // Followed by the glyphs and the alpha pixels.
+    struct Font_atlas_header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t imgui_version;
+        int32_t nglyphs;
+        uint64_t key;
+        uint64_t hash; // Of everything after the header.
+        int32_t tex_width;
+        int32_t tex_height;
+        ImVec2 tex_uv_white_pixel;
+        ImVec4 tex_uv_lines[IM_DRAWLIST_TEX_LINES_WIDTH_MAX + 1];
+        float font_size;
+        float ascent;
+        float descent;
+    };
+
+    struct Font_atlas_glyph
+    {
+        uint32_t codepoint;
+        float advance_x;
+        float x0;
+        float y0;
+        float x1;
+        float y1;
+        float u0;
+        float v0;
+        float u1;
+        float v1;
+    };
+
+    uint64_t hash(const void* data, size_t size) noexcept
+    {
+        return std::hash<std::string_view>()(std::string_view(static_cast<const char*>(data), size));
+    }
+
+    // Identifies what the atlas was built from, a cache with a different key is stale.
+    uint64_t get_key(const ImWchar* ranges, ImFontAtlasFlags flags) noexcept
+    {
+        size_t nranges = 0;
+        while (ranges[nranges]) {
+            ++nranges;
+        }
+        uint64_t key = hash(ranges, nranges * sizeof(ImWchar));
+        key = key * 31 + hash(&flags, sizeof(flags));
+        key = key * 31 + hash(&WIV_FONT_SIZE, sizeof(WIV_FONT_SIZE));
+        return key * 31 + hash(ROBOTO_MEDIUM_COMPRESSED_DATA, ROBOTO_MEDIUM_COMPRESSED_SIZE);
+    }
+
+    bool load(ImFontAtlas& atlas, const std::filesystem::path& path, uint64_t key)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        const std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        Font_atlas_header header;
+        if (data.size() < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, data.data(), sizeof(header));
+        if (header.magic != WIV_FONT_ATLAS_MAGIC || header.version != WIV_FONT_ATLAS_VERSION || header.imgui_version != IMGUI_VERSION_NUM || header.key != key) {
+            return false;
+        }
+        if (header.nglyphs <= 0 || header.tex_width <= 0 || header.tex_height <= 0 || header.tex_width > 16384 || header.tex_height > 16384) {
+            return false;
+        }
+        const size_t pixels_size = static_cast<size_t>(header.tex_width) * header.tex_height;
+        const size_t glyphs_size = header.nglyphs * sizeof(Font_atlas_glyph);
+        if (data.size() != sizeof(header) + glyphs_size + pixels_size || hash(data.data() + sizeof(header), glyphs_size + pixels_size) != header.hash) {
+            return false;
+        }
+
+        // Same state ImFontAtlas::Build() leaves behind.
+        auto font = IM_NEW(ImFont)();
+        font->ContainerAtlas = &atlas;
+        font->FontSize = header.font_size;
+        font->Ascent = header.ascent;
+        font->Descent = header.descent;
+        font->Glyphs.reserve(header.nglyphs);
+        for (int i = 0; i < header.nglyphs; ++i) {
+            Font_atlas_glyph glyph;
+            std::memcpy(&glyph, data.data() + sizeof(header) + i * sizeof(glyph), sizeof(glyph));
+            font->AddGlyph(nullptr, static_cast<ImWchar>(glyph.codepoint), glyph.x0, glyph.y0, glyph.x1, glyph.y1, glyph.u0, glyph.v0, glyph.u1, glyph.v1, glyph.advance_x);
+        }
+        font->BuildLookupTable();
+        atlas.Fonts.push_back(font);
+        atlas.TexWidth = header.tex_width;
+        atlas.TexHeight = header.tex_height;
+        atlas.TexUvScale = ImVec2(1.0f / header.tex_width, 1.0f / header.tex_height);
+        atlas.TexUvWhitePixel = header.tex_uv_white_pixel;
+        std::memcpy(atlas.TexUvLines, header.tex_uv_lines, sizeof(header.tex_uv_lines));
+        atlas.TexPixelsAlpha8 = static_cast<unsigned char*>(IM_ALLOC(pixels_size));
+        std::memcpy(atlas.TexPixelsAlpha8, data.data() + sizeof(header) + glyphs_size, pixels_size);
+        atlas.TexReady = true;
+        return true;
+    }
+
+    void save(const ImFontAtlas& atlas, const std::filesystem::path& path, uint64_t key)
+    {
+        if (atlas.Fonts.Size != 1 || !atlas.TexPixelsAlpha8) {
+            return;
+        }
+        const ImFont* font = atlas.Fonts[0];
+        std::vector<Font_atlas_glyph> glyphs;
+        glyphs.reserve(font->Glyphs.Size);
+        for (const auto& glyph : font->Glyphs) {
+
+            // Tab is made from the space by BuildLookupTable().
+            if (glyph.Codepoint != '\t') {
+                glyphs.push_back({ glyph.Codepoint, glyph.AdvanceX, glyph.X0, glyph.Y0, glyph.X1, glyph.Y1, glyph.U0, glyph.V0, glyph.U1, glyph.V1 });
+            }
+        }
+        const size_t glyphs_size = glyphs.size() * sizeof(Font_atlas_glyph);
+        const size_t pixels_size = static_cast<size_t>(atlas.TexWidth) * atlas.TexHeight;
+        std::vector<char> payload(glyphs_size + pixels_size);
+        std::memcpy(payload.data(), glyphs.data(), glyphs_size);
+        std::memcpy(payload.data() + glyphs_size, atlas.TexPixelsAlpha8, pixels_size);
+
+        Font_atlas_header header = {};
+        header.magic = WIV_FONT_ATLAS_MAGIC;
+        header.version = WIV_FONT_ATLAS_VERSION;
+        header.imgui_version = IMGUI_VERSION_NUM;
+        header.nglyphs = static_cast<int32_t>(glyphs.size());
+        header.key = key;
+        header.hash = hash(payload.data(), payload.size());
+        header.tex_width = atlas.TexWidth;
+        header.tex_height = atlas.TexHeight;
+        header.tex_uv_white_pixel = atlas.TexUvWhitePixel;
+        std::memcpy(header.tex_uv_lines, atlas.TexUvLines, sizeof(header.tex_uv_lines));
+        header.font_size = font->FontSize;
+        header.ascent = font->Ascent;
+        header.descent = font->Descent;
+
+        // Written aside and then renamed, so a concurrently starting instance never reads a partial file.
+        auto path_temp = path;
+        path_temp += L".tmp";
+        {
+            std::ofstream file(path_temp, std::ios::binary);
+            if (!file) {
+                return;
+            }
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(payload.data(), payload.size());
+            if (!file) {
+                return;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(path_temp, path, ec);
+    }
+#endif
+}
+
+bool font_atlas_create(ImFontAtlas& atlas, [[maybe_unused]] const std::filesystem::path& path, [[maybe_unused]] bool use_cache)
+{
+    ImFontGlyphRangesBuilder builder;
+    builder.AddRanges(atlas.GetGlyphRangesDefault());
+    builder.AddChar(0x0161); // š
+    ImVector<ImWchar> ranges;
+    builder.BuildRanges(&ranges);
+
+    // The software cursor shapes are only drawn with io.MouseDrawCursor, the viewer leaves the cursor to the OS.
+    atlas.Flags |= ImFontAtlasFlags_NoMouseCursors;
+
+#if IMGUI_VERSION_NUM < 19200
+    const auto key = get_key(ranges.Data, atlas.Flags);
+    if (use_cache) {
+        WIV_PROFILE_SCOPE("Font atlas load");
+        if (load(atlas, path, key)) {
+            return true;
+        }
+    }
+#endif
+
+    WIV_PROFILE_SCOPE("Font atlas build");
+    atlas.AddFontFromMemoryCompressedTTF(ROBOTO_MEDIUM_COMPRESSED_DATA, ROBOTO_MEDIUM_COMPRESSED_SIZE, WIV_FONT_SIZE, nullptr, ranges.Data);
+    atlas.Build();
+#if IMGUI_VERSION_NUM < 19200
+    if (use_cache) {
+        save(atlas, path, key);
+    }
+#endif
+    return false;
+}
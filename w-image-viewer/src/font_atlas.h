@@ -0,0 +1,13 @@
+#pragma once
+
+#include "pch.h"
+
+// Cache of the built ImGui font atlas, the glyph table and the alpha pixels.
+// Building the atlas needs decompressing the font and rasterizing every glyph, loading it is a single small read.
+// Compiled only for ImGui older than 1.92, later versions rasterize the glyphs on demand, so the atlas is always built.
+// Doesn't depend on the platform.
+
+// Adds the UI font to an empty atlas, from the cache at path if use_cache is true and the cache matches.
+// Otherwise builds the atlas, and writes the cache if use_cache is true.
+// Returns true if the atlas was loaded from the cache.
+bool font_atlas_create(ImFontAtlas& atlas, const std::filesystem::path& path, bool use_cache);
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "pch.h"
+
+// Frames drawn after every change, ImGui needs a few frames to settle.
+inline constexpr int WIV_DIRTY_FRAMES = 3;
+
+// One more frame is drawn this long after the last change, for delayed ImGui effects like tooltips.
+inline constexpr auto WIV_SETTLE_DELAY = std::chrono::milliseconds(600);
+
+// Decides when the next frame has to be drawn, so the render loop can sleep while nothing changes.
+// Frames get requested by changes (input, decoded images) or by timers (slideshow).
+// Doesn't depend on the platform, time is always passed in.
+class Frame_scheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Something changed, the frame is dirty.
+    void invalidate(Clock::time_point now) noexcept
+    {
+        dirty_frames = WIV_DIRTY_FRAMES;
+        settle = now + WIV_SETTLE_DELAY;
+    }
+
+    // Requests a frame at the time point, only the earliest request is kept.
+    void schedule(Clock::time_point time) noexcept
+    {
+        if (!deadline || time < *deadline) {
+            deadline = time;
+        }
+    }
+
+    // Returns true if a frame should be drawn now, consumes the request.
+    bool should_draw(Clock::time_point now) noexcept
+    {
+        if (deadline && now >= *deadline) {
+            deadline.reset();
+            dirty_frames = std::max(dirty_frames, 1);
+        }
+        if (settle && now >= *settle) {
+            settle.reset();
+            dirty_frames = std::max(dirty_frames, 1);
+        }
+        if (dirty_frames > 0) {
+            --dirty_frames;
+            return true;
+        }
+        return false;
+    }
+
+    // Returns how long we can wait for changes before the next frame is due,
+    // empty if no frame is due.
+    std::optional<Clock::duration> get_wait(Clock::time_point now) const noexcept
+    {
+        if (dirty_frames > 0) {
+            return Clock::duration::zero();
+        }
+        std::optional<Clock::time_point> next;
+        for (const auto& time : { deadline, settle }) {
+            if (time && (!next || *time < *next)) {
+                next = time;
+            }
+        }
+        if (!next) {
+            return std::nullopt;
+        }
+        return std::max<Clock::duration>(*next - now, Clock::duration::zero());
+    }
+
+private:
+    int dirty_frames = WIV_DIRTY_FRAMES;
+    std::optional<Clock::time_point> deadline;
+    std::optional<Clock::time_point> settle;
+};
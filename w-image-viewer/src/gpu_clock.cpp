@@ -0,0 +1,50 @@
+#include "pch.h"
+#include "gpu_clock.h"
+#include "include\ensure.h"
+
+Gpu_clock_d3d11::Gpu_clock_d3d11(ID3D11Device* device, ID3D11DeviceContext* ctx) noexcept :
+    ctx(ctx)
+{
+    D3D11_QUERY_DESC desc = {};
+    desc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+    for (auto& query : disjoint_queries) {
+        ensure(device->CreateQuery(&desc, query.put()), >= 0);
+    }
+    desc.Query = D3D11_QUERY_TIMESTAMP;
+    for (auto& frame : timestamp_queries) {
+        for (auto& query : frame) {
+            ensure(device->CreateQuery(&desc, query.put()), >= 0);
+        }
+    }
+}
+
+void Gpu_clock_d3d11::begin_frame(int frame)
+{
+    ctx->Begin(disjoint_queries[frame].get());
+}
+
+void Gpu_clock_d3d11::end_frame(int frame)
+{
+    ctx->End(disjoint_queries[frame].get());
+}
+
+void Gpu_clock_d3d11::timestamp(int frame, int query)
+{
+    ctx->End(timestamp_queries[frame][query].get());
+}
+
+bool Gpu_clock_d3d11::read_frame(int frame, int count, uint64_t* ticks, uint64_t& frequency)
+{
+    // Don't flush, the frame will get flushed by Present anyway.
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+    if (ctx->GetData(disjoint_queries[frame].get(), &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) {
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (ctx->GetData(timestamp_queries[frame][i].get(), &ticks[i], sizeof(uint64_t), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) {
+            return false;
+        }
+    }
+    frequency = disjoint.Disjoint ? 0 : disjoint.Frequency;
+    return true;
+}
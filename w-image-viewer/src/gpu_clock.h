@@ -0,0 +1,19 @@
+#pragma once
+
+#include "pch.h"
+#include "include\profiler.h"
+
+// Gpu_clock on top of D3D11 timestamp queries.
+class Gpu_clock_d3d11 : public Gpu_clock
+{
+public:
+    Gpu_clock_d3d11(ID3D11Device* device, ID3D11DeviceContext* ctx) noexcept;
+    void begin_frame(int frame) override;
+    void end_frame(int frame) override;
+    void timestamp(int frame, int query) override;
+    bool read_frame(int frame, int count, uint64_t* ticks, uint64_t& frequency) override;
+private:
+    ID3D11DeviceContext* ctx;
+    std::array<Com_ptr<ID3D11Query>, WIV_GPU_PROFILER_FRAMES> disjoint_queries;
+    std::array<std::array<Com_ptr<ID3D11Query>, WIV_GPU_PROFILER_QUERIES>, WIV_GPU_PROFILER_FRAMES> timestamp_queries;
+};
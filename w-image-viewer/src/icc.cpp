@@ -1,5 +1,419 @@
 #include "pch.h"
 #include "icc.h"
+#include "include/cms_lut.h"
+#include "include/helpers.h"
+#include "include/lru_cache.h"
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+    using Matrix = std::array<double, 9>;
+
+    // Returns false if the profile is not a matrix-shaper RGB profile,
+    // or if it also has a CLUT that lcms would use instead for the intent in the direction (LCMS_USED_AS_INPUT or LCMS_USED_AS_OUTPUT).
+    bool read_matrix_shaper(cmsHPROFILE profile, int intent, int direction, Matrix& matrix, std::array<cmsToneCurve*, 3>& curves) noexcept
+    {
+        if (!cmsIsMatrixShaper(profile) || cmsGetColorSpace(profile) != cmsSigRgbData) {
+            return false;
+        }
+
+        // Without a CLUT for the intent lcms falls back to the perceptual one, before the matrix-shaper.
+        if (cmsIsCLUT(profile, intent, direction) || cmsIsCLUT(profile, INTENT_PERCEPTUAL, direction)) {
+            return false;
+        }
+        static constexpr std::array colorant_tags = { cmsSigRedColorantTag, cmsSigGreenColorantTag, cmsSigBlueColorantTag };
+        static constexpr std::array trc_tags = { cmsSigRedTRCTag, cmsSigGreenTRCTag, cmsSigBlueTRCTag };
+        for (int i = 0; i < 3; ++i) {
+            const auto colorant = static_cast<const cmsCIEXYZ*>(cmsReadTag(profile, colorant_tags[i]));
+            curves[i] = static_cast<cmsToneCurve*>(cmsReadTag(profile, trc_tags[i]));
+            if (!colorant || !curves[i]) {
+                return false;
+            }
+
+            // Colorants are the columns of the RGB to XYZ (D50) matrix.
+            matrix[i] = colorant->X;
+            matrix[3 + i] = colorant->Y;
+            matrix[6 + i] = colorant->Z;
+        }
+        return true;
+    }
+
+    Matrix multiply(const Matrix& a, const Matrix& b) noexcept
+    {
+        Matrix result = {};
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                for (int k = 0; k < 3; ++k) {
+                    result[i * 3 + j] += a[i * 3 + k] * b[k * 3 + j];
+                }
+            }
+        }
+        return result;
+    }
+
+    // Returns false if the matrix is singular.
+    bool invert(const Matrix& m, Matrix& result) noexcept
+    {
+        const double det = m[0] * (m[4] * m[8] - m[5] * m[7]) - m[1] * (m[3] * m[8] - m[5] * m[6]) + m[2] * (m[3] * m[7] - m[4] * m[6]);
+        if (std::abs(det) < 1e-12) {
+            return false;
+        }
+        result = {
+            (m[4] * m[8] - m[5] * m[7]) / det, (m[2] * m[7] - m[1] * m[8]) / det, (m[1] * m[5] - m[2] * m[4]) / det,
+            (m[5] * m[6] - m[3] * m[8]) / det, (m[0] * m[8] - m[2] * m[6]) / det, (m[2] * m[3] - m[0] * m[5]) / det,
+            (m[3] * m[7] - m[4] * m[6]) / det, (m[1] * m[6] - m[0] * m[7]) / det, (m[0] * m[4] - m[1] * m[3]) / det
+        };
+        return true;
+    }
+
+    // The tetrahedral interpolation of cms_ps.hlsl on the CPU.
+    // All paths follow the shader's operation order, so the scalar and SIMD results are bit identical.
+    // Vertices past the LUT edge always have zero weight, the shader reads them as 0, we clamp them.
+    // See https://doi.org/10.2312/egp.20211031
+
+    // Tetrahedra in the order the shader tests them, as the axes sorted by their fractional part.
+    constexpr std::array<std::array<int, 3>, 6> WIV_CMS_TETRAHEDRA = { {
+        { 0, 1, 2 },
+        { 0, 2, 1 },
+        { 2, 0, 1 },
+        { 2, 1, 0 },
+        { 1, 2, 0 },
+        { 1, 0, 2 },
+    } };
+
+    // The shader's c_ab, ties are broken in favor of (x, y), (y, z) and (z, x).
+    constexpr bool is_tetrahedron_order(const std::array<float, 3>& r, int a, int b) noexcept
+    {
+        return b == (a + 1) % 3 ? r[a] >= r[b] : r[a] > r[b];
+    }
+
+    // saturate(), NaN becomes 0.
+    constexpr float saturate(float x) noexcept
+    {
+        return x > 0.0f ? std::min(x, 1.0f) : 0.0f;
+    }
+
+#ifdef _MSC_VER
+#define WIV_TARGET_SSE41
+#define WIV_TARGET_AVX2
+#else
+#define WIV_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define WIV_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+    bool cpu_has_sse41() noexcept
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        return info[2] & (1 << 19);
+#else
+        return __builtin_cpu_supports("sse4.1");
+#endif
+    }
+
+    bool cpu_has_avx2() noexcept
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        const bool osxsave = info[2] & (1 << 27);
+        const bool avx = info[2] & (1 << 28);
+        __cpuidex(info, 7, 0);
+        const bool avx2 = info[1] & (1 << 5);
+
+        // The OS also has to save the ymm registers.
+        return osxsave && avx && avx2 && (_xgetbv(0) & 6) == 6;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    // Applies the LUT to a row of RGBA pixels, alpha is copied.
+    using Cms_apply_lut_row = void (*)(const uint16_t* lut, int lut_size, const float* src, float* dst, int width);
+
+    void cms_apply_lut_row(const uint16_t* lut, int lut_size, const float* src, float* dst, int width) noexcept
+    {
+        for (int i = 0; i < width; ++i) {
+            cms_apply_lut(lut, lut_size, src + i * 4, dst + i * 4);
+            dst[i * 4 + 3] = src[i * 4 + 3];
+        }
+    }
+
+    // 4 pixels at a time, the weights are computed across pixels, the vertices are interpolated per pixel.
+    WIV_TARGET_SSE41 void cms_apply_lut_row_sse41(const uint16_t* lut, int lut_size, const float* src, float* dst, int width) noexcept
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 scale = _mm_set1_ps(lut_size - 1.0f);
+        const __m128 unorm = _mm_set1_ps(65535.0f);
+        const __m128i size = _mm_set1_epi32(lut_size);
+        const __m128i max_index = _mm_set1_epi32(lut_size - 1);
+        int i = 0;
+        for (; i + 4 <= width; i += 4) {
+            __m128 pixels[4];
+            for (int p = 0; p < 4; ++p) {
+                pixels[p] = _mm_loadu_ps(src + (i + p) * 4);
+            }
+            __m128 channels[4] = { pixels[0], pixels[1], pixels[2], pixels[3] };
+            _MM_TRANSPOSE4_PS(channels[0], channels[1], channels[2], channels[3]);
+
+            __m128 r[3];
+            __m128i i0[3];
+            __m128i i1[3];
+            for (int c = 0; c < 3; ++c) {
+                const __m128 coord = _mm_mul_ps(_mm_min_ps(_mm_max_ps(channels[c], zero), one), scale);
+                const __m128 base = _mm_floor_ps(coord);
+                r[c] = _mm_sub_ps(coord, base);
+                i0[c] = _mm_cvttps_epi32(base);
+                i1[c] = _mm_min_epi32(_mm_add_epi32(i0[c], _mm_set1_epi32(1)), max_index);
+            }
+            __m128 order[3][3];
+            for (int a = 0; a < 3; ++a) {
+                const int b = (a + 1) % 3;
+                order[a][b] = _mm_cmpge_ps(r[a], r[b]);
+                order[b][a] = _mm_cmpgt_ps(r[b], r[a]);
+            }
+            __m128 s[3] = { zero, zero, zero };
+            __m128 vert2[3] = { zero, zero, zero }; // Set lanes step to i1.
+            __m128 vert3[3] = { zero, zero, zero }; // Set lanes stay at i0.
+            for (const auto& [a, b, c] : WIV_CMS_TETRAHEDRA) {
+                const __m128 cond = _mm_and_ps(order[a][b], order[b][c]);
+                s[0] = _mm_blendv_ps(s[0], r[a], cond);
+                s[1] = _mm_blendv_ps(s[1], r[b], cond);
+                s[2] = _mm_blendv_ps(s[2], r[c], cond);
+                vert2[a] = _mm_or_ps(vert2[a], cond);
+                vert3[c] = _mm_or_ps(vert3[c], cond);
+            }
+            __m128i vertex[4][3];
+            for (int c = 0; c < 3; ++c) {
+                vertex[0][c] = i0[c];
+                vertex[1][c] = i1[c];
+                vertex[2][c] = _mm_blendv_epi8(i0[c], i1[c], _mm_castps_si128(vert2[c]));
+                vertex[3][c] = _mm_blendv_epi8(i1[c], i0[c], _mm_castps_si128(vert3[c]));
+            }
+            alignas(16) int indices[4][4];
+            for (int v = 0; v < 4; ++v) {
+                const __m128i index = _mm_add_epi32(_mm_mullo_epi32(_mm_add_epi32(_mm_mullo_epi32(vertex[v][2], size), vertex[v][1]), size), vertex[v][0]);
+                _mm_store_si128(reinterpret_cast<__m128i*>(indices[v]), index);
+            }
+            alignas(16) float weights[4][4];
+            _mm_store_ps(weights[0], _mm_sub_ps(one, s[0]));
+            _mm_store_ps(weights[1], s[2]);
+            _mm_store_ps(weights[2], _mm_sub_ps(s[0], s[1]));
+            _mm_store_ps(weights[3], _mm_sub_ps(s[1], s[2]));
+
+            for (int p = 0; p < 4; ++p) {
+                __m128 color;
+                for (int v = 0; v < 4; ++v) {
+                    const __m128i texel = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(lut + indices[v][p] * 4)));
+                    const __m128 val = _mm_mul_ps(_mm_div_ps(_mm_cvtepi32_ps(texel), unorm), _mm_set1_ps(weights[v][p]));
+                    color = v ? _mm_add_ps(color, val) : val;
+                }
+                _mm_storeu_ps(dst + (i + p) * 4, _mm_blend_ps(color, pixels[p], 0b1000));
+            }
+        }
+        cms_apply_lut_row(lut, lut_size, src + i * 4, dst + i * 4, width - i);
+    }
+
+    // 8 pixels at a time, the vertices are fetched with gathers.
+    WIV_TARGET_AVX2 void cms_apply_lut_row_avx2(const uint16_t* lut, int lut_size, const float* src, float* dst, int width) noexcept
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 scale = _mm256_set1_ps(lut_size - 1.0f);
+        const __m256 unorm = _mm256_set1_ps(65535.0f);
+        const __m256i size = _mm256_set1_epi32(lut_size);
+        const __m256i max_index = _mm256_set1_epi32(lut_size - 1);
+        const __m256i mask_low = _mm256_set1_epi32(0xffff);
+        const int* const lut_rg = reinterpret_cast<const int*>(lut);
+        const int* const lut_ba = reinterpret_cast<const int*>(lut + 2);
+        int i = 0;
+        for (; i + 8 <= width; i += 8) {
+            // Deinterleave, pixels 0 and 4, 1 and 5... share a vector, then every 128 bit lane is transposed.
+            const __m256 p01 = _mm256_loadu_ps(src + i * 4);
+            const __m256 p23 = _mm256_loadu_ps(src + i * 4 + 8);
+            const __m256 p45 = _mm256_loadu_ps(src + i * 4 + 16);
+            const __m256 p67 = _mm256_loadu_ps(src + i * 4 + 24);
+            const __m256 p04 = _mm256_permute2f128_ps(p01, p45, 0x20);
+            const __m256 p15 = _mm256_permute2f128_ps(p01, p45, 0x31);
+            const __m256 p26 = _mm256_permute2f128_ps(p23, p67, 0x20);
+            const __m256 p37 = _mm256_permute2f128_ps(p23, p67, 0x31);
+            const __m256 rg01 = _mm256_unpacklo_ps(p04, p15);
+            const __m256 rg23 = _mm256_unpacklo_ps(p26, p37);
+            const __m256 ba01 = _mm256_unpackhi_ps(p04, p15);
+            const __m256 ba23 = _mm256_unpackhi_ps(p26, p37);
+            const __m256 channels[3] = {
+                _mm256_shuffle_ps(rg01, rg23, _MM_SHUFFLE(1, 0, 1, 0)),
+                _mm256_shuffle_ps(rg01, rg23, _MM_SHUFFLE(3, 2, 3, 2)),
+                _mm256_shuffle_ps(ba01, ba23, _MM_SHUFFLE(1, 0, 1, 0)),
+            };
+            const __m256 alpha = _mm256_shuffle_ps(ba01, ba23, _MM_SHUFFLE(3, 2, 3, 2));
+
+            __m256 r[3];
+            __m256i i0[3];
+            __m256i i1[3];
+            for (int c = 0; c < 3; ++c) {
+                const __m256 coord = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(channels[c], zero), one), scale);
+                const __m256 base = _mm256_floor_ps(coord);
+                r[c] = _mm256_sub_ps(coord, base);
+                i0[c] = _mm256_cvttps_epi32(base);
+                i1[c] = _mm256_min_epi32(_mm256_add_epi32(i0[c], _mm256_set1_epi32(1)), max_index);
+            }
+            __m256 order[3][3];
+            for (int a = 0; a < 3; ++a) {
+                const int b = (a + 1) % 3;
+                order[a][b] = _mm256_cmp_ps(r[a], r[b], _CMP_GE_OQ);
+                order[b][a] = _mm256_cmp_ps(r[b], r[a], _CMP_GT_OQ);
+            }
+            __m256 s[3] = { zero, zero, zero };
+            __m256 vert2[3] = { zero, zero, zero }; // Set lanes step to i1.
+            __m256 vert3[3] = { zero, zero, zero }; // Set lanes stay at i0.
+            for (const auto& [a, b, c] : WIV_CMS_TETRAHEDRA) {
+                const __m256 cond = _mm256_and_ps(order[a][b], order[b][c]);
+                s[0] = _mm256_blendv_ps(s[0], r[a], cond);
+                s[1] = _mm256_blendv_ps(s[1], r[b], cond);
+                s[2] = _mm256_blendv_ps(s[2], r[c], cond);
+                vert2[a] = _mm256_or_ps(vert2[a], cond);
+                vert3[c] = _mm256_or_ps(vert3[c], cond);
+            }
+            __m256i vertex[4][3];
+            for (int c = 0; c < 3; ++c) {
+                vertex[0][c] = i0[c];
+                vertex[1][c] = i1[c];
+                vertex[2][c] = _mm256_blendv_epi8(i0[c], i1[c], _mm256_castps_si256(vert2[c]));
+                vertex[3][c] = _mm256_blendv_epi8(i1[c], i0[c], _mm256_castps_si256(vert3[c]));
+            }
+            const __m256 weights[4] = { _mm256_sub_ps(one, s[0]), s[2], _mm256_sub_ps(s[0], s[1]), _mm256_sub_ps(s[1], s[2]) };
+
+            __m256 color[3];
+            for (int v = 0; v < 4; ++v) {
+                const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_add_epi32(_mm256_mullo_epi32(vertex[v][2], size), vertex[v][1]), size), vertex[v][0]);
+                const __m256i rg = _mm256_i32gather_epi32(lut_rg, index, 8);
+                const __m256i ba = _mm256_i32gather_epi32(lut_ba, index, 8);
+                const __m256i texel[3] = { _mm256_and_si256(rg, mask_low), _mm256_srli_epi32(rg, 16), _mm256_and_si256(ba, mask_low) };
+                for (int c = 0; c < 3; ++c) {
+                    const __m256 val = _mm256_mul_ps(_mm256_div_ps(_mm256_cvtepi32_ps(texel[c]), unorm), weights[v]);
+                    color[c] = v ? _mm256_add_ps(color[c], val) : val;
+                }
+            }
+
+            // Interleave back, inverse of the above.
+            const __m256 rg_lo = _mm256_unpacklo_ps(color[0], color[1]);
+            const __m256 rg_hi = _mm256_unpackhi_ps(color[0], color[1]);
+            const __m256 ba_lo = _mm256_unpacklo_ps(color[2], alpha);
+            const __m256 ba_hi = _mm256_unpackhi_ps(color[2], alpha);
+            const __m256 q04 = _mm256_shuffle_ps(rg_lo, ba_lo, _MM_SHUFFLE(1, 0, 1, 0));
+            const __m256 q15 = _mm256_shuffle_ps(rg_lo, ba_lo, _MM_SHUFFLE(3, 2, 3, 2));
+            const __m256 q26 = _mm256_shuffle_ps(rg_hi, ba_hi, _MM_SHUFFLE(1, 0, 1, 0));
+            const __m256 q37 = _mm256_shuffle_ps(rg_hi, ba_hi, _MM_SHUFFLE(3, 2, 3, 2));
+            _mm256_storeu_ps(dst + i * 4, _mm256_permute2f128_ps(q04, q15, 0x20));
+            _mm256_storeu_ps(dst + i * 4 + 8, _mm256_permute2f128_ps(q26, q37, 0x20));
+            _mm256_storeu_ps(dst + i * 4 + 16, _mm256_permute2f128_ps(q04, q15, 0x31));
+            _mm256_storeu_ps(dst + i * 4 + 24, _mm256_permute2f128_ps(q26, q37, 0x31));
+        }
+        cms_apply_lut_row(lut, lut_size, src + i * 4, dst + i * 4, width - i);
+    }
+
+    Cms_apply_lut_row get_cms_apply_lut_row() noexcept
+    {
+        if (cpu_has_avx2()) {
+            return cms_apply_lut_row_avx2;
+        }
+        if (cpu_has_sse41()) {
+            return cms_apply_lut_row_sse41;
+        }
+        return cms_apply_lut_row;
+    }
+
+    // Points of the R3 low discrepancy sequence, so they don't line up with any LUT grid.
+    // Source http://extremelearning.com.au/unreasonable-effectiveness-of-quasirandom-sequences/
+    constexpr int WIV_CMS_VALIDATION_SIZE = 4096;
+
+    std::vector<std::array<float, 3>> get_validation_set()
+    {
+        constexpr double g = 1.2207440846057596; // Solution of x^4 = x + 1.
+        constexpr std::array a = { 1.0 / g, 1.0 / (g * g), 1.0 / (g * g * g) };
+        std::vector<std::array<float, 3>> points(WIV_CMS_VALIDATION_SIZE);
+        for (int i = 0; i < WIV_CMS_VALIDATION_SIZE; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                double integer;
+                points[i][c] = static_cast<float>(std::modf(0.5 + a[c] * (i + 1), &integer));
+            }
+        }
+        return points;
+    }
+
+    // Sizes chosen by cms_create_lut_adaptive(), so opening more images with the same profiles doesn't search again.
+    constexpr size_t WIV_CMS_ADAPTIVE_LUT_CACHE_SIZE = 64;
+
+    struct Adaptive_lut_key
+    {
+        bool operator==(const Adaptive_lut_key&) const = default;
+        std::array<cmsUInt8Number, 16> profile_in; // Profile IDs (MD5).
+        std::array<cmsUInt8Number, 16> profile_out;
+        int intent;
+        bool is_bpc;
+        float max_error;
+    };
+
+    struct Adaptive_lut_key_hash
+    {
+        size_t operator()(const Adaptive_lut_key& key) const noexcept
+        {
+            const std::string_view id_in(reinterpret_cast<const char*>(key.profile_in.data()), key.profile_in.size());
+            const std::string_view id_out(reinterpret_cast<const char*>(key.profile_out.data()), key.profile_out.size());
+            size_t hash = std::hash<std::string_view>()(id_in);
+            for (const auto val : { std::hash<std::string_view>()(id_out), std::hash<int>()(key.intent), std::hash<bool>()(key.is_bpc), std::hash<float>()(key.max_error) }) {
+                hash ^= val + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+            }
+            return hash;
+        }
+    };
+
+    struct Adaptive_lut
+    {
+        unsigned int lut_size;
+        float error;
+    };
+
+    struct Adaptive_lut_cache
+    {
+        std::mutex mutex;
+        Lru_cache<Adaptive_lut_key, Adaptive_lut, Adaptive_lut_key_hash> cache = { WIV_CMS_ADAPTIVE_LUT_CACHE_SIZE };
+    };
+
+    Adaptive_lut_cache& get_adaptive_lut_cache()
+    {
+        static Adaptive_lut_cache adaptive_lut_cache;
+        return adaptive_lut_cache;
+    }
+
+    // Profiles without an ID get it computed, returns false if it can't be.
+    bool get_profile_id(cmsHPROFILE profile, std::array<cmsUInt8Number, 16>& id) noexcept
+    {
+        cmsGetHeaderProfileID(profile, id.data());
+        if (std::ranges::all_of(id, [](cmsUInt8Number val) { return val == 0; })) {
+            if (!cmsMD5computeID(profile)) {
+                return false;
+            }
+            cmsGetHeaderProfileID(profile, id.data());
+        }
+        return true;
+    }
+
+    // Linear interpolation between the curve samples, same as in the shader.
+    float eval_curve(const float* curve, float x, int channel) noexcept
+    {
+        const float coord = std::clamp(x, 0.0f, 1.0f) * (WIV_CMS_CURVE_SIZE - 1);
+        const int i = std::min(static_cast<int>(coord), WIV_CMS_CURVE_SIZE - 2);
+        const float f = coord - i;
+        return std::lerp(curve[i * 4 + channel], curve[(i + 1) * 4 + channel], f);
+    }
+}
 
 // Source https://www.adobe.com/digitalimag/pdfs/AdobeRGB1998.pdf
 cmsHPROFILE cms_create_profile_adobe_rgb() noexcept
@@ -47,3 +461,257 @@ cmsHPROFILE cms_create_profile_aces_cg() noexcept
     cmsFreeToneCurve(tone_curve[0]);
     return profile;
 }
+
+std::unique_ptr<uint16_t[]> cms_create_lut(cmsHPROFILE profile_in, cmsHPROFILE profile_out, int intent, bool is_bpc, unsigned int lut_size)
+{
+    std::unique_ptr<uint16_t[]> lut;
+
+    // Set flags.
+    cmsUInt32Number flags = cmsFLAGS_HIGHRESPRECALC | cmsFLAGS_NOOPTIMIZE;
+    if (is_bpc) {
+        flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
+    }
+
+    auto htransform = cmsCreateTransform(profile_in, TYPE_RGB_16, profile_out, TYPE_RGBA_16, intent, flags);
+    if (htransform) {
+        lut = std::make_unique_for_overwrite<uint16_t[]>(cube(lut_size) * 4);
+
+        // Get the correct LUT.
+        const void* wiv_cms_lut = nullptr;
+        switch (lut_size) {
+            case 17:
+                wiv_cms_lut = WIV_CMS_LUT_17.data();
+                break;
+            case 25:
+                wiv_cms_lut = WIV_CMS_LUT_25.data();
+                break;
+            case 33:
+                wiv_cms_lut = WIV_CMS_LUT_33.data();
+                break;
+            case 49:
+                wiv_cms_lut = WIV_CMS_LUT_49.data();
+                break;
+            case 65:
+                wiv_cms_lut = WIV_CMS_LUT_65.data();
+        }
+
+        cmsDoTransform(htransform, wiv_cms_lut, lut.get(), cube(lut_size));
+        cmsDeleteTransform(htransform);
+    }
+    return lut;
+}
+
+std::optional<Cms_matrix_shaper> cms_create_matrix_shaper(cmsHPROFILE profile_in, cmsHPROFILE profile_out, int intent, bool is_bpc)
+{
+    // Matrix-shaper profiles have no perceptual or saturation tables, lcms uses relative colorimetric for them too.
+    // Absolute colorimetric would need white point scaling, so it's left to lcms.
+    if (intent == INTENT_ABSOLUTE_COLORIMETRIC) {
+        return std::nullopt;
+    }
+    Matrix matrix_in;
+    Matrix matrix_out;
+    std::array<cmsToneCurve*, 3> curves_in;
+    std::array<cmsToneCurve*, 3> curves_out;
+    if (!read_matrix_shaper(profile_in, intent, LCMS_USED_AS_INPUT, matrix_in, curves_in) || !read_matrix_shaper(profile_out, intent, LCMS_USED_AS_OUTPUT, matrix_out, curves_out)) {
+        return std::nullopt;
+    }
+
+    // Black point compensation is a no-op only if both black points are already black.
+    if (is_bpc) {
+        cmsCIEXYZ black_in;
+        cmsCIEXYZ black_out;
+        if (!cmsDetectBlackPoint(&black_in, profile_in, intent, 0) || !cmsDetectBlackPoint(&black_out, profile_out, intent, 0) || black_in.Y > 1e-4 || black_out.Y > 1e-4) {
+            return std::nullopt;
+        }
+    }
+
+    Matrix matrix_out_inverse;
+    if (!invert(matrix_out, matrix_out_inverse)) {
+        return std::nullopt;
+    }
+    const Matrix matrix = multiply(matrix_out_inverse, matrix_in);
+
+    std::array<std::unique_ptr<cmsToneCurve, decltype(&cmsFreeToneCurve)>, 3> curves_out_inverse = { {
+        { cmsReverseToneCurve(curves_out[0]), cmsFreeToneCurve },
+        { cmsReverseToneCurve(curves_out[1]), cmsFreeToneCurve },
+        { cmsReverseToneCurve(curves_out[2]), cmsFreeToneCurve }
+    } };
+    if (!curves_out_inverse[0] || !curves_out_inverse[1] || !curves_out_inverse[2]) {
+        return std::nullopt;
+    }
+
+    Cms_matrix_shaper transform;
+    transform.is_identity = true;
+    for (int i = 0; i < 9; ++i) {
+        transform.matrix[i] = static_cast<float>(matrix[i]);
+        transform.is_identity &= std::abs(matrix[i] - (i % 4 == 0 ? 1.0 : 0.0)) < 1e-5;
+    }
+    transform.curves = std::make_unique<float[]>(WIV_CMS_CURVE_SIZE * 2 * 4);
+    float* const curves_in_samples = transform.curves.get();
+    float* const curves_out_samples = curves_in_samples + WIV_CMS_CURVE_SIZE * 4;
+    for (int i = 0; i < WIV_CMS_CURVE_SIZE; ++i) {
+        const float x = static_cast<float>(i) / (WIV_CMS_CURVE_SIZE - 1);
+        for (int c = 0; c < 3; ++c) {
+            curves_in_samples[i * 4 + c] = cmsEvalToneCurveFloat(curves_in[c], x);
+            curves_out_samples[i * 4 + c] = cmsEvalToneCurveFloat(curves_out_inverse[c].get(), x * x);
+
+            // Identity also needs the output curves to undo the input curves.
+            if (transform.is_identity) {
+                transform.is_identity = std::abs(cmsEvalToneCurveFloat(curves_out_inverse[c].get(), curves_in_samples[i * 4 + c]) - x) < 1e-4f;
+            }
+        }
+    }
+    return transform;
+}
+
+void cms_apply_matrix_shaper(const Cms_matrix_shaper& transform, const float* rgb_in, float* rgb_out) noexcept
+{
+    const float* const curves_in = transform.curves.get();
+    const float* const curves_out = curves_in + WIV_CMS_CURVE_SIZE * 4;
+    std::array<float, 3> linear;
+    for (int c = 0; c < 3; ++c) {
+        linear[c] = eval_curve(curves_in, rgb_in[c], c);
+    }
+    for (int c = 0; c < 3; ++c) {
+        const float y = transform.matrix[c * 3] * linear[0] + transform.matrix[c * 3 + 1] * linear[1] + transform.matrix[c * 3 + 2] * linear[2];
+        rgb_out[c] = eval_curve(curves_out, std::sqrt(std::clamp(y, 0.0f, 1.0f)), c);
+    }
+}
+
+std::unique_ptr<uint16_t[]> cms_create_lut_adaptive(cmsHPROFILE profile_in, cmsHPROFILE profile_out, int intent, bool is_bpc, float max_error, unsigned int& lut_size, float& error)
+{
+    Adaptive_lut_key key;
+    key.intent = intent;
+    key.is_bpc = is_bpc;
+    key.max_error = max_error;
+    const bool has_key = get_profile_id(profile_in, key.profile_in) && get_profile_id(profile_out, key.profile_out);
+    auto& adaptive_lut_cache = get_adaptive_lut_cache();
+    if (has_key) {
+        std::optional<Adaptive_lut> cached;
+        {
+            std::scoped_lock lock(adaptive_lut_cache.mutex);
+            if (const auto adaptive_lut = adaptive_lut_cache.cache.get(key)) {
+                cached = *adaptive_lut;
+            }
+        }
+        if (cached) {
+            lut_size = cached->lut_size;
+            error = cached->error;
+            return cms_create_lut(profile_in, profile_out, intent, is_bpc, lut_size);
+        }
+    }
+
+    const cmsUInt32Number flags = cmsFLAGS_NOOPTIMIZE | (is_bpc ? cmsFLAGS_BLACKPOINTCOMPENSATION : 0);
+    const auto htransform = cmsCreateTransform(profile_in, TYPE_RGB_FLT, profile_out, TYPE_RGB_FLT, intent, flags);
+    if (!htransform) {
+        return nullptr;
+    }
+
+    // Reference output in Lab, computed by lcms.
+    const std::unique_ptr<std::remove_pointer_t<cmsHPROFILE>, decltype(&cmsCloseProfile)> profile_lab(cmsCreateLab4Profile(nullptr), cmsCloseProfile);
+    const auto htransform_lab = cmsCreateTransform(profile_out, TYPE_RGB_FLT, profile_lab.get(), TYPE_Lab_DBL, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE);
+    if (!htransform_lab) {
+        cmsDeleteTransform(htransform);
+        return nullptr;
+    }
+    const auto points = get_validation_set();
+    std::vector<std::array<float, 3>> rgb_out(points.size());
+    cmsDoTransform(htransform, points.data(), rgb_out.data(), static_cast<cmsUInt32Number>(points.size()));
+    cmsDeleteTransform(htransform);
+
+    // The LUT can't hold out of range values, so don't count that as interpolation error.
+    for (auto& rgb : rgb_out) {
+        for (auto& val : rgb) {
+            val = std::clamp(val, 0.0f, 1.0f);
+        }
+    }
+    std::vector<cmsCIELab> lab_reference(points.size());
+    cmsDoTransform(htransform_lab, rgb_out.data(), lab_reference.data(), static_cast<cmsUInt32Number>(points.size()));
+
+    std::unique_ptr<uint16_t[]> lut;
+    std::vector<cmsCIELab> lab(points.size());
+    for (const auto size : WIV_CMS_LUT_SIZES) {
+        lut = cms_create_lut(profile_in, profile_out, intent, is_bpc, size);
+        if (!lut) {
+            break;
+        }
+        for (size_t i = 0; i < points.size(); ++i) {
+            cms_apply_lut(lut.get(), size, points[i].data(), rgb_out[i].data());
+        }
+        cmsDoTransform(htransform_lab, rgb_out.data(), lab.data(), static_cast<cmsUInt32Number>(points.size()));
+        error = 0.0f;
+        for (size_t i = 0; i < points.size(); ++i) {
+            error = std::max(error, static_cast<float>(cmsCIE2000DeltaE(&lab_reference[i], &lab[i], 1.0, 1.0, 1.0)));
+        }
+        lut_size = size;
+        if (error <= max_error) {
+            break;
+        }
+    }
+    cmsDeleteTransform(htransform_lab);
+    if (lut && has_key) {
+        std::scoped_lock lock(adaptive_lut_cache.mutex);
+        adaptive_lut_cache.cache.put(key, { lut_size, error }, 1);
+    }
+    return lut;
+}
+
+void cms_clear_adaptive_lut_cache() noexcept
+{
+    auto& adaptive_lut_cache = get_adaptive_lut_cache();
+    std::scoped_lock lock(adaptive_lut_cache.mutex);
+    adaptive_lut_cache.cache.clear();
+}
+
+void cms_apply_lut(const uint16_t* lut, unsigned int lut_size, const float* rgb_in, float* rgb_out) noexcept
+{
+    const int size = static_cast<int>(lut_size);
+    std::array<float, 3> r;
+    std::array<int, 3> i0;
+    std::array<int, 3> i1;
+    for (int c = 0; c < 3; ++c) {
+        const float coord = saturate(rgb_in[c]) * (size - 1.0f);
+        const float base = std::floor(coord);
+        r[c] = coord - base;
+        i0[c] = static_cast<int>(base);
+        i1[c] = std::min(i0[c] + 1, size - 1);
+    }
+    std::array<float, 3> s = {};
+    std::array<bool, 3> vert2 = {}; // Steps to i1.
+    std::array<bool, 3> vert3 = {}; // Stays at i0.
+    for (const auto& [a, b, c] : WIV_CMS_TETRAHEDRA) {
+        if (is_tetrahedron_order(r, a, b) && is_tetrahedron_order(r, b, c)) {
+            s = { r[a], r[b], r[c] };
+            vert2[a] = true;
+            vert3[c] = true;
+        }
+    }
+    const auto texel = [&](int x, int y, int z) {
+        return lut + ((z * size + y) * size + x) * 4;
+    };
+    const std::array vertices = {
+        texel(i0[0], i0[1], i0[2]),
+        texel(i1[0], i1[1], i1[2]),
+        texel(vert2[0] ? i1[0] : i0[0], vert2[1] ? i1[1] : i0[1], vert2[2] ? i1[2] : i0[2]),
+        texel(vert3[0] ? i0[0] : i1[0], vert3[1] ? i0[1] : i1[1], vert3[2] ? i0[2] : i1[2]),
+    };
+    const std::array weights = { 1.0f - s[0], s[2], s[0] - s[1], s[1] - s[2] };
+    for (int c = 0; c < 3; ++c) {
+        float color = vertices[0][c] / 65535.0f * weights[0];
+        for (int v = 1; v < 4; ++v) {
+            color += vertices[v][c] / 65535.0f * weights[v];
+        }
+        rgb_out[c] = color;
+    }
+}
+
+void cms_apply_lut(const uint16_t* lut, unsigned int lut_size, const float* src, float* dst, int width, int height)
+{
+    static const Cms_apply_lut_row apply_row = get_cms_apply_lut_row();
+    std::vector<int> rows(height);
+    std::iota(rows.begin(), rows.end(), 0);
+    std::for_each(std::execution::par, rows.begin(), rows.end(), [&](int y) {
+        const size_t offset = static_cast<size_t>(y) * width * 4;
+        apply_row(lut, static_cast<int>(lut_size), src + offset, dst + offset, width);
+    });
+}
@@ -15,3 +15,53 @@ cmsHPROFILE cms_create_profile_linear_srgb() noexcept;
 
 // Needs to be freed with cmsCloseProfile().
 cmsHPROFILE cms_create_profile_aces_cg() noexcept;
+
+// LUT sizes cms_create_lut() supports, in increasing order.
+inline constexpr std::array WIV_CMS_LUT_SIZES = { 17u, 25u, 33u, 49u, 65u };
+
+// Transforms the identity LUT of lut_size (one of WIV_CMS_LUT_SIZES) from profile_in to profile_out.
+// Returns 16 bit RGBA LUT, or nullptr if the transform can't be created.
+std::unique_ptr<uint16_t[]> cms_create_lut(cmsHPROFILE profile_in, cmsHPROFILE profile_out, int intent, bool is_bpc, unsigned int lut_size);
+
+// Tetrahedral interpolation of a LUT from cms_create_lut(), same math and operation order as cms_ps.hlsl.
+void cms_apply_lut(const uint16_t* lut, unsigned int lut_size, const float* rgb_in, float* rgb_out) noexcept;
+
+// Applies the LUT to RGBA float pixels, alpha is copied. src and dst may be the same.
+// Rows are processed in parallel, vectorized with AVX2 or SSE4.1 if the CPU supports them.
+// Matches the single pixel overload bit for bit.
+void cms_apply_lut(const uint16_t* lut, unsigned int lut_size, const float* src, float* dst, int width, int height);
+
+// Creates the smallest LUT whose tetrahedral interpolation stays within max_error (max dE2000),
+// measured against lcms on a fixed validation set. If none does, the largest LUT is returned.
+// lut_size and error are set to the size and the max dE2000 of the returned LUT.
+// The chosen size is cached by the profile IDs, the intent, black point compensation and max_error,
+// profiles without an ID get it computed.
+std::unique_ptr<uint16_t[]> cms_create_lut_adaptive(cmsHPROFILE profile_in, cmsHPROFILE profile_out, int intent, bool is_bpc, float max_error, unsigned int& lut_size, float& error);
+
+// Forgets the sizes chosen by cms_create_lut_adaptive().
+void cms_clear_adaptive_lut_cache() noexcept;
+
+// Samples per curve of the matrix-shaper transform.
+inline constexpr int WIV_CMS_CURVE_SIZE = 4096;
+
+// Transform between two matrix-shaper RGB profiles, collapsed into
+// per channel input curves, a single 3x3 matrix and per channel output curves.
+struct Cms_matrix_shaper
+{
+    std::array<float, 9> matrix; // Row major, from linear input RGB to linear output RGB.
+
+    // Two rows of WIV_CMS_CURVE_SIZE RGBA samples, alpha is unused.
+    // The first row are the input curves (encoded to linear) sampled at x,
+    // the second row are the inverse output curves (linear to encoded) sampled at x^2, for more samples in the shadows.
+    std::unique_ptr<float[]> curves;
+
+    // Profiles are the same, the transform can be skipped.
+    bool is_identity;
+};
+
+// Returns empty if any of the profiles is not a matrix-shaper RGB profile, or has a CLUT lcms would use instead,
+// or if the intent or black point compensation can't be expressed with a matrix.
+std::optional<Cms_matrix_shaper> cms_create_matrix_shaper(cmsHPROFILE profile_in, cmsHPROFILE profile_out, int intent, bool is_bpc);
+
+// Same math as cms_matrix_ps.hlsl, for checking it against lcms.
+void cms_apply_matrix_shaper(const Cms_matrix_shaper& transform, const float* rgb_in, float* rgb_out) noexcept;
@@ -1,42 +1,262 @@
 #include "pch.h"
 #include "image.h"
-#include "include\global.h"
+#include "include/global.h"
 #include "icc.h"
-#include "include\shader_config.h"
+#include "include/shader_config.h"
+#include "include/half.h"
+#include "include/lru_cache.h"
+#include "include/supported_extensions.h"
+#include "include/bench.h"
+
+namespace
+{
+    // Files up to this size get prefetched whole as soon as they are opened,
+    // for larger files only the start is prefetched.
+    constexpr size_t WIV_PREFETCH_MAX_SIZE = 256 * 1024 * 1024;
+    constexpr size_t WIV_PREFETCH_HEADER_SIZE = 1024 * 1024;
+
+    // Frames without a delay, or with a delay up to 10 ms, are shown for 100 ms like browsers do.
+    constexpr auto WIV_FRAME_DELAY_MIN = std::chrono::milliseconds(10);
+    constexpr auto WIV_FRAME_DELAY_DEFAULT = std::chrono::milliseconds(100);
+
+    void set_image_cache_limits(const auto& image_cache) noexcept
+    {
+        image_cache->attribute("max_memory_MB", static_cast<float>(g_config.image_cache_size.val));
+        image_cache->attribute("max_open_files", g_config.image_cache_max_open_files.val);
+    }
+
+    // The image cache is shared by all images, so it persists across navigation.
+    // Configured once created, only the limits change later.
+    auto get_image_cache()
+    {
+        static const auto image_cache = [] {
+            auto image_cache = OIIO::ImageCache::create(true);
+            image_cache->attribute("autotile", 256);
+            image_cache->attribute("autoscanline", 1);
+            set_image_cache_limits(image_cache);
+            return image_cache;
+        }();
+        return image_cache;
+    }
+
+    // Developed RAW images, also shared by all images.
+    struct Raw_cache
+    {
+        std::mutex mutex;
+        Lru_cache<std::wstring, std::shared_ptr<libraw_processed_image_t>> cache;
+    };
+
+    Raw_cache& get_raw_cache()
+    {
+        static Raw_cache raw_cache;
+        return raw_cache;
+    }
+
+    // Detects RAW files from the magic bytes, TIFF based RAW formats can only be told apart by the extension.
+    // This way LibRaw doesn't have to open and identify every file.
+    bool is_raw_file(const std::filesystem::path& path, std::span<const uint8_t> header) noexcept
+    {
+        const auto starts_with = [header](std::string_view magic, size_t offset = 0) {
+            return header.size() >= offset + magic.size() && std::memcmp(header.data() + offset, magic.data(), magic.size()) == 0;
+        };
+
+        // Canon CR3, shares the container with HEIF and AVIF.
+        if (starts_with("ftyp", 4)) {
+            return starts_with("crx ", 8);
+        }
+
+        // Never RAW.
+        if (starts_with("\x89PNG") || starts_with("\xFF\xD8\xFF") || starts_with("GIF8") || starts_with("BM") || starts_with("\x76\x2F\x31\x01") || starts_with("8BPS") || starts_with("RIFF") || starts_with("#?") || starts_with({ "\0\0\x01\0", 4 })) {
+            return false;
+        }
+
+        // RAW formats with their own magic.
+        if (starts_with("FUJIFILM") || starts_with("IIRO") || starts_with("IIRS") || starts_with({ "IIU\0", 4 }) || starts_with("FOVb") || starts_with({ "\0MRM", 4 }) || starts_with("HEAPCCDR", 6)) {
+            return true;
+        }
+
+        return path_match_spec(path, WIV_RAW_EXTENSIONS);
+    }
+
+    // Dims of the image scaled to fit size x size, never upscaled.
+    void get_reduced_dims(int width, int height, int size, int& reduced_width, int& reduced_height) noexcept
+    {
+        const double scale = std::min(static_cast<double>(size) / std::max(width, height), 1.0);
+        reduced_width = std::max(static_cast<int>(std::lround(width * scale)), 1);
+        reduced_height = std::max(static_cast<int>(std::lround(height * scale)), 1);
+    }
+
+    // Adds rows [y, y + nrows) of a 8 bit 4 channel image to the reduced pixels they fall into.
+    // Every reduced pixel has 4 channel sums followed by the number of added pixels.
+    void box_filter_rows(const uint8_t* src, int width, int height, int y, int nrows, int reduced_width, int reduced_height, uint32_t* sums)
+    {
+        std::vector<int> columns(width);
+        for (int x = 0; x < width; ++x) {
+            columns[x] = static_cast<int>(static_cast<int64_t>(x) * reduced_width / width) * 5;
+        }
+        for (int i = 0; i < nrows; ++i) {
+            const auto row = sums + static_cast<int64_t>(y + i) * reduced_height / height * reduced_width * 5;
+            const auto pixels = src + static_cast<size_t>(i) * width * 4;
+            for (int x = 0; x < width; ++x) {
+                const auto sum = row + columns[x];
+                sum[0] += pixels[4 * x];
+                sum[1] += pixels[4 * x + 1];
+                sum[2] += pixels[4 * x + 2];
+                sum[3] += pixels[4 * x + 3];
+                ++sum[4];
+            }
+        }
+    }
+
+    Pixel_buffer box_filter_resolve(const std::vector<uint32_t>& sums, int width, int height)
+    {
+        const auto npixels = static_cast<size_t>(width) * height;
+        auto data = make_pixel_buffer(npixels * 4);
+        for (size_t i = 0; i < npixels; ++i) {
+            const auto sum = sums.data() + i * 5;
+            const auto count = std::max(sum[4], 1u);
+            for (int c = 0; c < 4; ++c) {
+                data[i * 4 + c] = static_cast<uint8_t>((sum[c] + count / 2) / count);
+            }
+        }
+        return data;
+    }
+
+    // Cancels LibRaw processing once stop is requested.
+    int raw_progress_callback(void* data, LibRaw_progress, int, int)
+    {
+        return static_cast<const std::stop_token*>(data)->stop_requested();
+    }
+}
+
+// LibRaw is not allocated just to be replaced.
+Image::Image(Image&& other) noexcept :
+    raw_input(nullptr)
+{
+    *this = std::move(other);
+}
+
+Image& Image::operator=(Image&& other) noexcept
+{
+    if (this == &other) {
+        return *this;
+    }
+
+    // In the order of the members, so the old image_input gets destroyed before what it reads from.
+    orientation = std::exchange(other.orientation, 0);
+    profile = std::move(other.profile);
+    trc = other.trc;
+    image_input = std::move(other.image_input);
+    io_proxy = std::move(other.io_proxy);
+    cache_filename = std::exchange(other.cache_filename, {});
+    is_raw_develop = std::exchange(other.is_raw_develop, false);
+    raw_key = std::exchange(other.raw_key, {});
+    raw_image = std::move(other.raw_image);
+    is_raw_draft_ = std::exchange(other.is_raw_draft_, false);
+    subimage = std::exchange(other.subimage, 0);
+    miplevel = std::exchange(other.miplevel, 0);
+    image_spec = std::exchange(other.image_spec, {});
+    raw_stream = std::move(other.raw_stream);
+    raw_input = std::move(other.raw_input);
+    stop_token = std::exchange(other.stop_token, {});
+    mapped_file = std::move(other.mapped_file);
+    other.mapped_file.close();
+    return *this;
+}
 
 bool Image::is_valid() const noexcept
 {
-    return image_input.get();
+    return image_input || !cache_filename.empty() || is_raw_develop;
 }
 
 bool Image::has_alpha() const noexcept
 {
-    return image_input->spec().alpha_channel != -1;
+    return get_spec().alpha_channel != -1;
 }
 
-bool Image::open(const std::filesystem::path& path)
+bool Image::open(const std::filesystem::path& path, bool is_raw_full, bool is_thumbnail, bool is_prefetch)
 {
-    // First try to open file with libraw, since OIIO cant read thumbnails.
-    // If Config::raw_thumb is enabled.
-    if (g_config.raw_thumb.val && raw_input.open_file(path.c_str()) == LIBRAW_SUCCESS && raw_input.unpack_thumb() == LIBRAW_SUCCESS) {
+    WIV_BENCH_SCOPE("Image::open");
+
+    // A moved from image no longer has its LibRaw instance.
+    if (!raw_input) {
+        raw_input = std::make_unique<LibRaw>();
+    }
+
+    // Both OIIO and LibRaw read from the mapped file, this also lets us detect the format
+    // from the first bytes without reading them twice.
+    if (!mapped_file.open(path)) {
+        return false;
+    }
+    const auto data = mapped_file.get_data();
+
+    // The image will be decoded right after, so start reading it in the background now.
+    if (is_prefetch) {
+        mapped_file.prefetch(0, data.size() <= WIV_PREFETCH_MAX_SIZE ? data.size() : WIV_PREFETCH_HEADER_SIZE);
+    }
+
+    // RAW files are opened with libraw, since OIIO cant read thumbnails.
+    std::array<uint8_t, 64> header;
+    const auto header_size = mapped_file.read(0, header.data(), header.size());
+    bool is_raw = is_raw_file(path, { header.data(), header_size });
+    if (is_raw) {
+        raw_stream = std::make_unique<Mapped_file_raw_stream>(mapped_file);
+        is_raw = raw_input->open_datastream(raw_stream.get()) == LIBRAW_SUCCESS;
+    }
+    if (is_raw && (g_config.raw_thumb.val || is_thumbnail) && !is_raw_full && raw_input->unpack_thumb() == LIBRAW_SUCCESS) {
         // We still want to open extracted thumbnail with OIIO.
-        OIIO::Filesystem::IOMemReader thumb(raw_input.imgdata.thumbnail.thumb, raw_input.imgdata.thumbnail.tlength);
-        if (raw_input.imgdata.thumbnail.tformat == LIBRAW_THUMBNAIL_JPEG) {
+        // The input reads from the proxy until the image is decoded, so it's kept in io_proxy.
+        io_proxy = std::make_unique<OIIO::Filesystem::IOMemReader>(raw_input->imgdata.thumbnail.thumb, raw_input->imgdata.thumbnail.tlength);
+        if (raw_input->imgdata.thumbnail.tformat == LIBRAW_THUMBNAIL_JPEG) {
             // The filename here is irelevant, we only need the extension.
-            image_input = OIIO::ImageInput::open(".jpg", nullptr, &thumb);
+            image_input = OIIO::ImageInput::open(".jpg", nullptr, io_proxy.get());
         }
         else { // BMP.
             // The filename here is irelevant, we only need the extension.
-            image_input = OIIO::ImageInput::open(".bmp", nullptr, &thumb);
+            image_input = OIIO::ImageInput::open(".bmp", nullptr, io_proxy.get());
         }
 
-        orientation = raw_input.imgdata.sizes.flip;
+        orientation = raw_input->imgdata.sizes.flip;
+        is_raw_draft_ = true;
+    }
+
+    // Develop RAW image with LibRaw.
+    else if (is_raw) {
+        return open_raw(path, is_raw_full);
+    }
+
+    // Pixels will be read from the shared image cache, we only need the spec here.
+    else if (g_config.image_cache.val && !is_thumbnail) {
+        image_input.reset();
+
+        // The image cache opens files by itself, the prefetch still warms the system file cache.
+        mapped_file.close();
+        const auto image_cache = get_image_cache();
+        cache_filename = OIIO::ustring(reinterpret_cast<const char*>(path.u8string().c_str()));
+
+        // Drop the cached tiles if the file was modified since it got cached.
+        image_cache->invalidate(cache_filename, false);
+
+        if (image_cache->get_imagespec(cache_filename, image_spec)) {
+            read_color_profile();
+            return true;
+        }
+        cache_filename.clear();
+        return false;
     }
     else {
         OIIO::ImageSpec config;
         config["bmp:monochrome_detect"] = 0;
-        image_input = OIIO::ImageInput::open(path, &config);
+        io_proxy = std::make_unique<Mapped_file_reader>(mapped_file);
+        image_input = OIIO::ImageInput::open(path, &config, io_proxy.get());
+
+        // Not every OIIO plugin can read through a proxy.
+        if (!image_input) {
+            io_proxy.reset();
+            image_input = OIIO::ImageInput::open(path, &config);
+        }
     }
+    cache_filename.clear();
     if (image_input) {
         read_color_profile();
         return true;
@@ -44,28 +264,376 @@ bool Image::open(const std::filesystem::path& path)
     return false;
 }
 
+/* static */ int Image::get_rotation(int orientation) noexcept
+{
+    switch (orientation) {
+        case 3:
+            return 180;
+        case 5:
+            return -90;
+        case 6:
+            return 90;
+        default:
+            return 0;
+    }
+}
+
 bool Image::close() noexcept
 {
-    if (!image_input) {
+    if (!cache_filename.empty()) {
+
+        // Also closes the file handle held by the image cache.
+        get_image_cache()->invalidate(cache_filename);
+        cache_filename.clear();
+        return true;
+    }
+    if (!is_valid()) {
         return false;
     }
     image_input.reset();
+    io_proxy.reset();
+    raw_input->recycle();
+    raw_stream.reset();
+    raw_image.reset();
+    is_raw_develop = false;
+
+    // Release the file, so it can be replaced or deleted right away.
+    mapped_file.close();
     return true;
 }
 
+bool Image::seek_subimage(int val)
+{
+    if (image_input) {
+        if (!image_input->seek_subimage(val, 0)) {
+            return false;
+        }
+    }
+    else if (!cache_filename.empty()) {
+        OIIO::ImageSpec spec;
+        if (!get_image_cache()->get_imagespec(cache_filename, spec, val)) {
+            return false;
+        }
+        image_spec = std::move(spec);
+    }
+
+    // Developed RAW image is a single image.
+    else if (val) {
+        return false;
+    }
+    subimage = val;
+    miplevel = 0;
+
+    // Animation frames are shown with the profile of the first frame.
+    if (!is_animated()) {
+        read_color_profile();
+    }
+    return true;
+}
+
+uint32_t Image::get_icc_hash() const noexcept
+{
+    const auto icc_profile = get_spec().find_attribute("ICCProfile");
+    if (!icc_profile || !icc_profile->datasize()) {
+        return 0;
+    }
+    const auto hash = std::hash<std::string_view>()({ static_cast<const char*>(icc_profile->data()), icc_profile->datasize() });
+    return std::max(static_cast<uint32_t>(hash), 1u);
+}
+
+std::chrono::microseconds Image::get_frame_delay() const noexcept
+{
+    // Per frame for GIF.
+    int fps[2];
+    if (get_spec().getattribute("FramesPerSecond", OIIO::TypeRational, fps) && fps[0] > 0 && fps[1] > 0) {
+        const std::chrono::microseconds delay(static_cast<int64_t>(fps[1]) * 1'000'000 / fps[0]);
+        if (delay > WIV_FRAME_DELAY_MIN) {
+            return delay;
+        }
+    }
+    return WIV_FRAME_DELAY_DEFAULT;
+}
+
+bool Image::open_raw(const std::filesystem::path& path, bool is_full)
+{
+    auto& params = raw_input->imgdata.params;
+    params.half_size = !is_full && g_config.raw_half_size.val;
+    params.use_camera_wb = 1;
+    params.output_bps = 16;
+    params.user_flip = 0; // Orientation gets applied by the renderer.
+    orientation = raw_input->imgdata.sizes.flip;
+
+    // We need the output dims before developing,
+    // LibRaw can only adjust sizes after which the file has to be opened again.
+    if (raw_input->adjust_sizes_info_only() != LIBRAW_SUCCESS) {
+        return false;
+    }
+    const int width = raw_input->imgdata.sizes.iwidth;
+    const int height = raw_input->imgdata.sizes.iheight;
+    const int nchannels = raw_input->imgdata.idata.colors == 1 ? 1 : 3;
+    raw_stream->seek(0, SEEK_SET);
+    if (raw_input->open_datastream(raw_stream.get()) != LIBRAW_SUCCESS) {
+        return false;
+    }
+
+    is_raw_develop = true;
+    is_raw_draft_ = params.half_size;
+    std::error_code ec;
+    raw_key = path.wstring() + (params.half_size ? L"|half|" : L"|full|") + std::to_wstring(std::filesystem::last_write_time(path, ec).time_since_epoch().count());
+    image_spec = OIIO::ImageSpec(width, height, nchannels, OIIO::TypeUInt16);
+
+    // LibRaw outputs sRGB primaries by default.
+    image_spec.attribute("oiio:ColorSpace", "sRGB");
+    read_color_profile();
+    return true;
+}
+
+bool Image::develop_raw()
+{
+    WIV_BENCH_SCOPE("Image::develop_raw");
+    auto& raw_cache = get_raw_cache();
+    const bool is_cache = g_config.raw_cache_size.val > 0;
+    if (is_cache) {
+        std::scoped_lock lock(raw_cache.mutex);
+        if (const auto cached = raw_cache.cache.get(raw_key)) {
+            raw_image = *cached;
+            return true;
+        }
+    }
+
+    // Demosaic is multithreaded by LibRaw (OpenMP), half size skips it.
+    raw_input->set_progress_handler(raw_progress_callback, &stop_token);
+    if (raw_input->unpack() != LIBRAW_SUCCESS || raw_input->dcraw_process() != LIBRAW_SUCCESS) {
+        return false;
+    }
+    int error;
+    raw_image.reset(raw_input->dcraw_make_mem_image(&error), LibRaw::dcraw_clear_mem);
+    raw_input->recycle();
+    if (!raw_image || raw_image->bits != 16 || raw_image->width != image_spec.width || raw_image->height != image_spec.height) {
+        raw_image.reset();
+        return false;
+    }
+
+    // The most recent development would be kept even with a budget of 0.
+    if (is_cache) {
+        std::scoped_lock lock(raw_cache.mutex);
+        raw_cache.cache.set_budget(static_cast<size_t>(g_config.raw_cache_size.val) * 1024 * 1024);
+        raw_cache.cache.put(raw_key, raw_image, raw_image->data_size);
+    }
+    return true;
+}
+
+/* static */ void Image::update_image_cache_limits() noexcept
+{
+    set_image_cache_limits(get_image_cache());
+}
+
+void Image::update_image_cache_stats() noexcept
+{
+    const auto image_cache = get_image_cache();
+    int64_t find_tile_calls = 0;
+    int find_tile_cache_misses = 0;
+    image_cache->getattribute("stat:find_tile_calls", OIIO::TypeInt64, &find_tile_calls);
+    image_cache->getattribute("stat:find_tile_cache_misses", OIIO::TypeInt, &find_tile_cache_misses);
+    int64_t bytes_read = 0;
+    int64_t cache_memory_used = 0;
+    image_cache->getattribute("stat:bytes_read", OIIO::TypeInt64, &bytes_read);
+    image_cache->getattribute("stat:cache_memory_used", OIIO::TypeInt64, &cache_memory_used);
+    Metrics::image_cache_hits.set(static_cast<double>(find_tile_calls - find_tile_cache_misses));
+    Metrics::image_cache_misses.set(find_tile_cache_misses);
+    Metrics::image_cache_bytes_read.set(static_cast<double>(bytes_read));
+    Metrics::image_cache_memory_used.set(static_cast<double>(cache_memory_used));
+}
+
+Pixel_buffer Image::get_image_data_half()
+{
+    WIV_BENCH_SCOPE("Image::get_image_data_half");
+    const auto& spec = get_spec();
+
+    // size = width * height * nchannels * bytedepth
+    auto data = make_pixel_buffer(static_cast<size_t>(spec.width) * spec.height * 4 * sizeof(uint16_t));
+
+    // Read the image in strips of scanlines and convert each strip to half while it's still in cache,
+    // so we never hold the whole 32 bit float image in memory.
+    // Strip height should be a multiple of tile height for tiled images.
+    constexpr int strip_size = 1 << 20; // In bytes.
+    int strip_height = std::max(strip_size / (spec.width * 4 * static_cast<int>(sizeof(float))), 1);
+    if (spec.tile_height > 0) {
+        strip_height = (strip_height + spec.tile_height - 1) / spec.tile_height * spec.tile_height;
+    }
+    auto strip = std::make_unique_for_overwrite<float[]>(spec.width * strip_height * 4);
+    auto dst = reinterpret_cast<uint16_t*>(data.get());
+    for (int y = 0; y < spec.height; y += strip_height) {
+        const int height = std::min(strip_height, spec.height - y);
+        if (!read_scanlines(y, y + height, strip.get())) {
+            return nullptr;
+        }
+        float_to_half(strip.get(), dst + y * spec.width * 4, spec.width * height * 4);
+    }
+
+    // At this point we dont need raw_input data anymore.
+    raw_input->recycle();
+    return data;
+}
+
+bool Image::read_pixels(int ybegin, int yend, OIIO::TypeDesc format, void* data)
+{
+    const auto& spec = get_spec();
+    const int nchannels = std::min(spec.nchannels, 4);
+    const auto xstride = static_cast<OIIO::stride_t>(4 * format.size());
+    const auto ystride = xstride * spec.width;
+
+    // Strip height should be a multiple of tile height for tiled images.
+    constexpr int strip_size = 4 << 20; // In bytes.
+    int strip_height = std::max(static_cast<int>(strip_size / ystride), 1);
+    if (spec.tile_height > 0) {
+        strip_height = (strip_height + spec.tile_height - 1) / spec.tile_height * spec.tile_height;
+    }
+
+    // Developed RAW image is already in memory.
+    if (is_raw_develop) {
+        if (!raw_image && !develop_raw()) {
+            return false;
+        }
+        const auto src = reinterpret_cast<const uint16_t*>(raw_image->data) + static_cast<size_t>(ybegin) * spec.width * raw_image->colors;
+        const auto src_xstride = static_cast<OIIO::stride_t>(raw_image->colors * sizeof(uint16_t));
+        return OIIO::convert_image(nchannels, spec.width, yend - ybegin, 1, src, OIIO::TypeUInt16, src_xstride, src_xstride * spec.width, OIIO::AutoStride, data, format, xstride, ystride, OIIO::AutoStride);
+    }
+
+    auto dst = static_cast<uint8_t*>(data);
+    for (int y = ybegin; y < yend; y += strip_height) {
+        if (stop_token.stop_requested()) {
+            return false;
+        }
+        const int y_end = std::min(y + strip_height, yend);
+        bool is_read;
+        if (image_input) {
+            is_read = image_input->read_scanlines(subimage, miplevel, spec.y + y, spec.y + y_end, 0, 0, nchannels, format, dst, xstride);
+        }
+        else {
+            is_read = get_image_cache()->get_pixels(cache_filename, subimage, miplevel, spec.x, spec.x + spec.width, spec.y + y, spec.y + y_end, 0, 1, 0, nchannels, format, dst, xstride);
+        }
+        if (!is_read) {
+            return false;
+        }
+        dst += (y_end - y) * ystride;
+    }
+    if (!image_input) {
+        update_image_cache_stats();
+    }
+    return true;
+}
+
+Pixel_buffer Image::get_thumbnail_data(int& width, int& height)
+{
+    if (!image_input && cache_filename.empty()) {
+        return nullptr;
+    }
+    OIIO::ImageBuf thumbnail;
+    const bool has_thumbnail = image_input ? image_input->get_thumbnail(thumbnail, subimage) : get_image_cache()->get_thumbnail(cache_filename, thumbnail, subimage);
+    if (!has_thumbnail || !thumbnail.initialized()) {
+        return nullptr;
+    }
+    const auto& spec = thumbnail.spec();
+    width = spec.width;
+    height = spec.height;
+    auto data = make_pixel_buffer(static_cast<size_t>(width) * height * 4);
+
+    // Opaque if the thumbnail has no alpha.
+    std::memset(data.get(), 0xFF, static_cast<size_t>(width) * height * 4);
+    thumbnail.get_pixels(OIIO::ROI(spec.x, spec.x + width, spec.y, spec.y + height, 0, 1, 0, std::min(spec.nchannels, 4)), OIIO::TypeUInt8, data.get(), 4);
+    expand_channels(data.get(), width * height, spec.nchannels);
+    return data;
+}
+
+Pixel_buffer Image::get_reduced_data(int size, int& width, int& height)
+{
+    WIV_BENCH_SCOPE("Image::get_reduced_data");
+
+    // Embedded thumbnail, if it's large enough.
+    int thumbnail_width;
+    int thumbnail_height;
+    if (const auto thumbnail = get_thumbnail_data(thumbnail_width, thumbnail_height); thumbnail && std::max(thumbnail_width, thumbnail_height) >= size) {
+        get_reduced_dims(thumbnail_width, thumbnail_height, size, width, height);
+        std::vector<uint32_t> sums(static_cast<size_t>(width) * height * 5);
+        box_filter_rows(thumbnail.get(), thumbnail_width, thumbnail_height, 0, thumbnail_height, width, height, sums.data());
+        return box_filter_resolve(sums, width, height);
+    }
+
+    // The smallest MIP level that is still not smaller than the reduced image.
+    if (image_input) {
+        while (true) {
+            const auto dims = image_input->spec_dimensions(subimage, miplevel + 1);
+            if (std::max(dims.width, dims.height) < size) {
+                break;
+            }
+            ++miplevel;
+        }
+        image_input->seek_subimage(subimage, miplevel);
+    }
+
+    // The image cache reads the MIP level itself, image_spec stands for it while it's read.
+    else if (!cache_filename.empty()) {
+        const auto image_cache = get_image_cache();
+        while (const auto spec_mip = image_cache->imagespec(cache_filename, subimage, miplevel + 1)) {
+            if (std::max(spec_mip->width, spec_mip->height) < size) {
+                break;
+            }
+            image_spec = *spec_mip;
+            ++miplevel;
+        }
+    }
+    const auto& spec = get_spec();
+    get_reduced_dims(spec.width, spec.height, size, width, height);
+    std::vector<uint32_t> sums(static_cast<size_t>(width) * height * 5);
+
+    // Strips get box filtered as they are read, so the full image is never in memory.
+    // Strip height should be a multiple of tile height for tiled images.
+    constexpr int strip_size = 4 << 20; // In bytes.
+    int strip_height = std::max(strip_size / (spec.width * 4), 1);
+    if (spec.tile_height > 0) {
+        strip_height = (strip_height + spec.tile_height - 1) / spec.tile_height * spec.tile_height;
+    }
+    const auto strip_bytes = static_cast<size_t>(spec.width) * std::min(strip_height, spec.height) * 4;
+    auto strip = std::make_unique_for_overwrite<uint8_t[]>(strip_bytes);
+
+    // Images without alpha only write the color channels, so they stay opaque.
+    std::memset(strip.get(), 0xFF, strip_bytes);
+    bool is_read = true;
+    for (int y = 0; y < spec.height && is_read; y += strip_height) {
+        const int nrows = std::min(strip_height, spec.height - y);
+        is_read = read_scanlines(y, y + nrows, strip.get());
+        if (is_read) {
+            box_filter_rows(strip.get(), spec.width, spec.height, y, nrows, width, height, sums.data());
+        }
+    }
+    if (miplevel) {
+        miplevel = 0;
+        if (image_input) {
+            image_input->seek_subimage(subimage, 0);
+        }
+        else if (const auto spec_full = get_image_cache()->imagespec(cache_filename, subimage, 0)) {
+            image_spec = *spec_full;
+        }
+    }
+
+    // At this point we dont need raw_input data anymore.
+    raw_input->recycle();
+    if (!is_read) {
+        return nullptr;
+    }
+    return box_filter_resolve(sums, width, height);
+}
+
 void Image::read_color_profile()
 {
-    const auto& spec = image_input->spec();
+    const auto& spec = get_spec();
 
     // First try to get an embended ICC profile.
-    //
-    
-    // Source https://www.color.org/technotes/ICC-Technote-ProfileEmbedding.pdf
-    constexpr auto size = 16'707'345;
-
-    auto buffer = std::make_unique_for_overwrite<uint8_t[]>(size);
-    if (spec.getattribute("ICCProfile", spec.getattributetype("ICCProfile"), buffer.get())) {
-        profile.reset(cmsOpenProfileFromMem(buffer.get(), size));
+    // Read straight from the attribute, it holds the whole profile.
+    const auto icc_profile = spec.find_attribute("ICCProfile");
+    profile.reset(icc_profile && icc_profile->datasize() ? cmsOpenProfileFromMem(icc_profile->data(), static_cast<cmsUInt32Number>(icc_profile->datasize())) : nullptr);
+    if (profile) {
         const auto gamma = static_cast<float>(cmsDetectRGBProfileGamma(profile.get(), 0.1));
         if (gamma > 0.0f) {
             trc = { WIV_CMS_TRC_GAMMA, gamma };
@@ -1,34 +1,54 @@
 #pragma once
 
 #include "pch.h"
-#include "include\shader_config.h"
-#include "include\info.h"
+#include "mapped_file.h"
+#include "buffer_pool.h"
+#include "include/shader_config.h"
+#include "include/metrics.h"
+#include "include/bench.h"
+#include "include/profiler.h"
 
 class Image
 {
 public:
+    Image() = default;
+
+    // The moved from image is left not valid, without the RAW state that refers to the LibRaw instance it no longer has.
+    Image(Image&& other) noexcept;
+    Image& operator=(Image&& other) noexcept;
+
+    // image_input may read through io_proxy from mapped_file, so it has to be destroyed first.
+    ~Image()
+    {
+        image_input.reset();
+    }
+
     bool is_valid() const noexcept;
     bool has_alpha() const noexcept;
-    bool open(const std::filesystem::path& path);
+    // If is_raw_full is true RAW images get developed at full size,
+    // otherwise only the embedded thumbnail or a half size development is used.
+    // If is_thumbnail is true RAW images always use the embedded thumbnail and the image cache isn't used.
+    // If is_prefetch is false the file isn't read ahead, for opens that only need the header.
+    bool open(const std::filesystem::path& path, bool is_raw_full = false, bool is_thumbnail = false, bool is_prefetch = true);
     bool close() noexcept;
     
     // Should return OIIO::TypeDesc::BASETYPE,
     // but it's returning unsigned char.
     auto get_basetype() const noexcept
     {
-        return image_input->spec().format.basetype;
+        return get_spec().format.basetype;
     }
     
     template<typename T>
     T get_width() const noexcept
     {
-        return static_cast<T>(image_input->spec().width);
+        return static_cast<T>(get_spec().width);
     }
     
     template<typename T>
     T get_height() const noexcept
     {
-        return static_cast<T>(image_input->spec().height);
+        return static_cast<T>(get_spec().height);
     }
     
     template<std::floating_point T>
@@ -36,44 +56,189 @@ public:
     {
         return get_width<T>() / get_height<T>();
     }
+
+    int get_nchannels() const noexcept
+    {
+        return get_spec().nchannels;
+    }
+
+    // Switches to another subimage (page or animation frame), the color profile is read again for pages.
+    // Returns false if there is no such subimage.
+    bool seek_subimage(int val);
+
+    int get_subimage() const noexcept
+    {
+        return subimage;
+    }
+
+    // Number of subimages if the format knows it upfront, 0 otherwise.
+    int get_nsubimages() const noexcept
+    {
+        return get_spec().get_int_attribute("oiio:subimages");
+    }
+
+    // Subimages are animation frames (GIF, WebP), not pages.
+    bool is_animated() const noexcept
+    {
+        return get_spec().get_int_attribute("oiio:Movie") != 0;
+    }
+
+    // Hash of the embedded ICC profile, 0 if there is none.
+    uint32_t get_icc_hash() const noexcept;
+
+    // How long the current animation frame is shown.
+    std::chrono::microseconds get_frame_delay() const noexcept;
+
+    // True for RAW images shown from the thumbnail or from a half size development.
+    bool is_raw_draft() const noexcept
+    {
+        return is_raw_draft_;
+    }
+
+    int get_bitdepth() const noexcept
+    {
+        return static_cast<int>(get_spec().channel_bytes() * 8);
+    }
     
+    // Returns nullptr if the read failed or got cancelled.
     template<typename T>
-    std::unique_ptr<uint8_t[]> get_image_data()
+    Pixel_buffer get_image_data()
     {
-        const auto& spec = image_input->spec();
+        WIV_BENCH_SCOPE("Image::get_image_data");
+        const auto& spec = get_spec();
         
         // size = width * height * nchannels * bytedepth
-        auto data = std::make_unique_for_overwrite<uint8_t[]>(spec.width * spec.height * 4 * sizeof(T));
+        auto data = make_pixel_buffer(static_cast<size_t>(spec.width) * spec.height * 4 * sizeof(T));
         
-        image_input->read_image(0, 0, 0, -1, spec.format, data.get(), 4 * sizeof(T));
+        if (!read_pixels(0, spec.height, spec.format, data.get())) {
+            return nullptr;
+        }
+        {
+            WIV_PROFILE_SCOPE("Channel expansion");
+            expand_channels(reinterpret_cast<T*>(data.get()), spec.width * spec.height, spec.nchannels);
+        }
         
-        // Convert a single channel greyscale image into multy channel greyscale image.
-        switch (spec.nchannels) {
+        // At this point we dont need raw_input data anymore.
+        raw_input->recycle();
+        Metrics::bytes_decoded.add(static_cast<int64_t>(spec.width) * spec.height * 4 * sizeof(T));
+        return data;
+    }
+
+    // Reads the thumbnail embedded in the file, if there is one, as 8 bit 4 channel pixels.
+    Pixel_buffer get_thumbnail_data(int& width, int& height);
+
+    // Reads the image reduced to fit size x size (never upscaled), as 8 bit 4 channel pixels.
+    // Uses the embedded thumbnail if it's large enough, otherwise the smallest large enough MIP level gets decoded.
+    // Returns nullptr if the read failed or got cancelled.
+    Pixel_buffer get_reduced_data(int size, int& width, int& height);
+
+    // Reads get cancelled once stop is requested on the stop_token.
+    void set_stop_token(std::stop_token token) noexcept
+    {
+        stop_token = token;
+    }
+
+    // Applies the image cache size and max open files from the config to the shared image cache.
+    static void update_image_cache_limits() noexcept;
+
+    // Updates the image cache stats in Metrics.
+    static void update_image_cache_stats() noexcept;
+
+    // Reads 32 bit float image as 16 bit float (half) image.
+    // Returns nullptr if the read failed or got cancelled.
+    Pixel_buffer get_image_data_half();
+
+    // Reads scanlines [ybegin, yend) as 4 channel pixels of type T.
+    // ybegin and yend are relative to the image origin.
+    // format is what the pixels get converted to, it should have the size of T (for example HALF with uint16_t).
+    template<typename T>
+    bool read_scanlines(int ybegin, int yend, T* data, OIIO::TypeDesc format = OIIO::TypeDescFromC<T>::value())
+    {
+        const auto& spec = get_spec();
+        if (!read_pixels(ybegin, yend, format, data)) {
+            return false;
+        }
+        expand_channels(data, spec.width * (yend - ybegin), spec.nchannels);
+        return true;
+    }
+    
+    // Convert a single channel greyscale image into multy channel greyscale image.
+    template<typename T>
+    static void expand_channels(T* data, int npixels, int nchannels) noexcept
+    {
+        switch (nchannels) {
             case 1: // (grey null null null) into (grey grey grey null).
-                for (int i = 0; i < spec.width * spec.height; ++i) {
-                    reinterpret_cast<T*>(data.get())[4 * i + 2] = reinterpret_cast<T*>(data.get())[4 * i + 1] = reinterpret_cast<T*>(data.get())[4 * i];
+                for (int i = 0; i < npixels; ++i) {
+                    data[4 * i + 2] = data[4 * i + 1] = data[4 * i];
                 }
             break;
             case 2: // (grey alpha null null) into (grey grey grey alpha)
-                for (int i = 0; i < spec.width * spec.height; ++i) {
-                    reinterpret_cast<T*>(data.get())[4 * i + 3] = reinterpret_cast<T*>(data.get())[4 * i + 1];
-                    reinterpret_cast<T*>(data.get())[4 * i + 2] = reinterpret_cast<T*>(data.get())[4 * i + 1] = reinterpret_cast<T*>(data.get())[4 * i];
+                for (int i = 0; i < npixels; ++i) {
+                    data[4 * i + 3] = data[4 * i + 1];
+                    data[4 * i + 2] = data[4 * i + 1] = data[4 * i];
                 }
         }
-        
-        // At this point we dont need raw_input data anymore.
-        raw_input.recycle();
-        
-        Info::image_bitdepth = spec.channel_bytes() * 8;
-        Info::image_nchannels = spec.nchannels;
-        return data;
     }
-    
-    int orientation;
+
+    // LibRaw flip, 0 for other images.
+    int orientation = 0;
+
+    // Clockwise rotation in degrees that shows an image with this orientation upright.
+    static int get_rotation(int orientation) noexcept;
+
     std::unique_ptr<std::remove_pointer_t<cmsHPROFILE>, decltype(&cmsCloseProfile)> profile = { nullptr, cmsCloseProfile };
     Tone_response_curve trc;
 private:
+    
+    const OIIO::ImageSpec& get_spec() const noexcept
+    {
+        return image_input ? image_input->spec() : image_spec;
+    }
+
+    // Reads scanlines [ybegin, yend) with up to 4 channels into 4 channel pixels.
+    // Reads in strips, so it can be cancelled between them.
+    bool read_pixels(int ybegin, int yend, OIIO::TypeDesc format, void* data);
+
+    bool open_raw(const std::filesystem::path& path, bool is_full);
+
+    // Develops RAW image on the first read, the result is cached.
+    bool develop_raw();
+
     void read_color_profile();
     std::unique_ptr<OIIO::ImageInput> image_input;
-    LibRaw raw_input;
+
+    // Should outlive image_input, since image_input may read through it.
+    // Declared after image_input so on move assignment the old image_input gets destroyed first.
+    std::unique_ptr<OIIO::Filesystem::IOProxy> io_proxy;
+
+    // If the image cache is used image_input is null,
+    // and pixels are read from the shared image cache instead.
+    OIIO::ustring cache_filename;
+
+    // If RAW image is developed by LibRaw image_input is null,
+    // and pixels are read from the developed image.
+    bool is_raw_develop = false;
+    std::wstring raw_key; // Key in the developed images cache.
+    std::shared_ptr<libraw_processed_image_t> raw_image;
+
+    bool is_raw_draft_ = false;
+
+    // Subimage and MIP level read by read_pixels(), also through the image cache.
+    // Only get_reduced_data() reads other than the first MIP level.
+    int subimage = 0;
+    int miplevel = 0;
+
+    // Used if there is no image_input.
+    OIIO::ImageSpec image_spec;
+
+    // LibRaw reads the mapped file through it, until the LibRaw instance gets recycled.
+    std::unique_ptr<Mapped_file_raw_stream> raw_stream;
+
+    // LibRaw is huge, and we want Image to be cheap to move.
+    std::unique_ptr<LibRaw> raw_input = std::make_unique<LibRaw>();
+
+    std::stop_token stop_token;
+
+    // Decoders read from the mapping, should be the last member so it outlives them.
+    Mapped_file mapped_file;
 };
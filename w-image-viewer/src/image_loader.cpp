@@ -0,0 +1,236 @@
+#include "pch.h"
+#include "image_loader.h"
+#include "include/global.h"
+
+namespace
+{
+    // Requests closer than this are treated as a burst, show thumbnails for them.
+    constexpr auto WIV_BURST_INTERVAL = std::chrono::milliseconds(250);
+
+    // D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION, larger images get tiled.
+    constexpr int WIV_MAX_TEXTURE_SIZE = 16384;
+
+    Pixel_buffer get_image_data(Image& image, OIIO::TypeDesc::BASETYPE& format, unsigned int& sys_mem_pitch)
+    {
+        WIV_PROFILE_SCOPE("Decode");
+        const auto start = std::chrono::steady_clock::now();
+        Pixel_buffer data;
+        switch (image.get_basetype()) {
+            case OIIO::TypeDesc::UINT8:
+                data = image.get_image_data<uint8_t>();
+                format = OIIO::TypeDesc::UINT8;
+                sys_mem_pitch = image.get_width<int>() * 4;
+                break;
+            case OIIO::TypeDesc::UINT16:
+                data = image.get_image_data<uint16_t>();
+                format = OIIO::TypeDesc::UINT16;
+                sys_mem_pitch = image.get_width<int>() * 4 * 2;
+                break;
+            case OIIO::TypeDesc::HALF:
+                data = image.get_image_data<uint16_t>();
+                format = OIIO::TypeDesc::HALF;
+                sys_mem_pitch = image.get_width<int>() * 4 * 2;
+                break;
+            case OIIO::TypeDesc::FLOAT:
+
+                // All passes are 16 bit, so by default we can upload 32 bit float images as 16 bit float.
+                if (g_config.float_to_half.val) {
+                    data = image.get_image_data_half();
+                    format = OIIO::TypeDesc::HALF;
+                    sys_mem_pitch = image.get_width<int>() * 4 * 2;
+                }
+                else {
+                    data = image.get_image_data<uint32_t>();
+                    format = OIIO::TypeDesc::FLOAT;
+                    sys_mem_pitch = image.get_width<int>() * 4 * 4;
+                }
+        }
+        if (data) {
+            Metrics::decode_time.record(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            Metrics::images_decoded.add();
+        }
+        return data;
+    }
+}
+
+Image_loader::Image_loader() :
+    thread(std::bind_front(&Image_loader::run, this))
+{}
+
+Image_loader::~Image_loader()
+{
+    // Don't wait for the decode in progress.
+    std::scoped_lock lock(mutex);
+    stop_source.request_stop();
+}
+
+void Image_loader::request(const std::filesystem::path& path, Image&& image, bool keep_view)
+{
+    const auto now = std::chrono::steady_clock::now();
+    {
+        std::scoped_lock lock(mutex);
+        request_pending = Request{ path, std::move(image), now - request_time < WIV_BURST_INTERVAL && !keep_view, keep_view, false };
+        stop_source.request_stop();
+    }
+    request_time = now;
+    cv.notify_one();
+}
+
+void Image_loader::request(const std::filesystem::path& path)
+{
+    request(path, Image());
+}
+
+void Image_loader::preload(const std::filesystem::path& path, Image&& image)
+{
+    {
+        std::scoped_lock lock(mutex);
+        preload_pending = Request{ path, std::move(image), false, false, true };
+        preloaded.reset();
+
+        // A shown preload is being decoded for the swap in progress, the new one waits behind it.
+        if (!preloading_path.empty() && !is_preload_shown) {
+            stop_source.request_stop();
+        }
+    }
+    cv.notify_one();
+}
+
+bool Image_loader::show_preloaded(const std::filesystem::path& path)
+{
+    std::function<void()> on_decoded_post;
+    {
+        std::scoped_lock lock(mutex);
+        if (preloading_path == path) {
+            is_preload_shown = true;
+            return true;
+        }
+        if (!preloaded || preloaded->path != path) {
+            return false;
+        }
+        decoded = std::move(preloaded);
+        on_decoded_post = on_decoded;
+    }
+    if (on_decoded_post) {
+        on_decoded_post();
+    }
+    return true;
+}
+
+std::unique_ptr<Decoded_image> Image_loader::take()
+{
+    std::scoped_lock lock(mutex);
+    return std::move(decoded);
+}
+
+void Image_loader::set_on_decoded(std::function<void()> val)
+{
+    bool is_decoded;
+    {
+        std::scoped_lock lock(mutex);
+        on_decoded = val;
+        is_decoded = decoded != nullptr;
+    }
+    if (is_decoded && val) {
+        val();
+    }
+}
+
+void Image_loader::run(std::stop_token stop_token)
+{
+    while (true) {
+        std::unique_lock lock(mutex);
+        if (!cv.wait(lock, stop_token, [this] { return request_pending || preload_pending; })) {
+            return;
+        }
+
+        // Requests go before preloads.
+        auto& pending = request_pending ? request_pending : preload_pending;
+        auto request = std::move(*pending);
+        pending.reset();
+        preloading_path = request.is_preload ? request.path : std::filesystem::path();
+        is_preload_shown = false;
+        stop_source = std::stop_source();
+        request.image.set_stop_token(stop_source.get_token());
+        lock.unlock();
+
+        // Startup requests are not opened yet.
+        if (!request.image.is_valid() && !request.image.open(request.path)) {
+            auto failed = std::make_unique<Decoded_image>();
+            failed->path = request.path;
+            failed->is_failed = true;
+            post(std::move(failed));
+            continue;
+        }
+
+        const Dims<int> dims = { request.image.get_width<int>(), request.image.get_height<int>() };
+
+        // While navigating fast the full decode will likely get cancelled,
+        // so first show the embedded thumbnail if there is one.
+        if (request.is_burst) {
+            auto preview = std::make_unique<Decoded_image>();
+            preview->data = request.image.get_thumbnail_data(preview->dims_data.width, preview->dims_data.height);
+            if (preview->data) {
+                preview->path = request.path;
+                preview->format = OIIO::TypeDesc::UINT8;
+                preview->sys_mem_pitch = preview->dims_data.width * 4;
+                preview->dims = dims;
+                preview->is_preview = true;
+                post(std::move(preview));
+            }
+        }
+
+        auto decoded_image = std::make_unique<Decoded_image>();
+        decoded_image->path = request.path;
+        decoded_image->dims = dims;
+        decoded_image->keep_view = request.keep_view;
+
+        // Images larger than the max texture size get tiled, the renderer uploads only the visible tiles.
+        bool is_decoded;
+        if (dims.width <= WIV_MAX_TEXTURE_SIZE && dims.height <= WIV_MAX_TEXTURE_SIZE) {
+            decoded_image->data = get_image_data(request.image, decoded_image->format, decoded_image->sys_mem_pitch);
+            decoded_image->dims_data = dims;
+            is_decoded = decoded_image->data != nullptr;
+        }
+        else {
+            WIV_PROFILE_SCOPE("Tile pyramid build");
+            decoded_image->tiled_image.emplace();
+            is_decoded = decoded_image->tiled_image->open(request.image, request.path, Tiled_image::get_cache_directory(), static_cast<uintmax_t>(std::max(g_config.tile_disk_cache_size.val, 0)) * 1024 * 1024, static_cast<size_t>(std::max(g_config.tile_cache_size.val, 0)) * 1024 * 1024);
+        }
+
+        // Cancelled or failed.
+        if (!is_decoded) {
+            std::scoped_lock lock(mutex);
+            preloading_path.clear();
+            continue;
+        }
+
+        // From now on reads should not get cancelled.
+        request.image.set_stop_token({});
+        decoded_image->image = std::move(request.image);
+        if (request.is_preload) {
+            std::scoped_lock lock(mutex);
+            preloading_path.clear();
+            if (!is_preload_shown) {
+                preloaded = std::move(decoded_image);
+                continue;
+            }
+        }
+        post(std::move(decoded_image));
+    }
+}
+
+void Image_loader::post(std::unique_ptr<Decoded_image> image)
+{
+    std::function<void()> on_decoded_post;
+    {
+        std::scoped_lock lock(mutex);
+        decoded = std::move(image);
+        on_decoded_post = on_decoded;
+    }
+
+    // Not set yet, set_on_decoded() will call it.
+    if (on_decoded_post) {
+        on_decoded_post();
+    }
+}
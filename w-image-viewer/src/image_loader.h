@@ -0,0 +1,83 @@
+#pragma once
+
+#include "pch.h"
+#include "image.h"
+#include "tiled_image.h"
+#include "include/dims.h"
+
+struct Decoded_image
+{
+    std::filesystem::path path;
+    std::optional<Image> image; // Empty for previews.
+    Pixel_buffer data; // Null if the image is too large for a single texture.
+    std::optional<Tiled_image> tiled_image; // Only for images too large for a single texture.
+    OIIO::TypeDesc::BASETYPE format; // Of the RGBA data.
+    unsigned int sys_mem_pitch;
+    Dims<int> dims; // Dims of the image.
+    Dims<int> dims_data; // Dims of the data, for previews these are the thumbnail dims.
+    bool is_preview; // Data is the thumbnail embedded in the image.
+    bool keep_view; // Replaces the same image, like the full size RAW development.
+    bool is_failed; // The startup file couldn't be opened, only the path is set.
+};
+
+// Decodes images on a worker thread.
+// Only the latest request matters, a new request replaces the pending one and cancels the decode in progress.
+// on_decoded gets called once the image is decoded, or once the startup file fails to open, use take() to get it.
+// Doesn't depend on the platform.
+class Image_loader
+{
+public:
+    Image_loader();
+    ~Image_loader();
+
+    // The image should be already opened.
+    // If keep_view is true the image replaces the shown one without resetting the view.
+    void request(const std::filesystem::path& path, Image&& image, bool keep_view = false);
+
+    // Same as above, but the image also gets opened on the worker thread.
+    // Used for the startup image, so its file I/O overlaps with the window creation.
+    // If the file can't be opened a failed Decoded_image gets posted.
+    void request(const std::filesystem::path& path);
+
+    // Decodes the image without posting it, after the pending request.
+    // Replaces the previous preload, but never cancels a request or a preload that is already shown.
+    void preload(const std::filesystem::path& path, Image&& image);
+
+    // Posts the preloaded image like a request, if it's still being decoded it gets posted once done.
+    // Returns false if the path wasn't preloaded.
+    bool show_preloaded(const std::filesystem::path& path);
+
+    // Returns nullptr if there is nothing new.
+    std::unique_ptr<Decoded_image> take();
+
+    // Called from the loader thread, or from show_preloaded(), like the window posting WIV_WM_OPEN_FILE to itself.
+    // If an image got decoded before it's set, it gets called once it is.
+    void set_on_decoded(std::function<void()> val);
+private:
+    void run(std::stop_token stop_token);
+    void post(std::unique_ptr<Decoded_image> image);
+
+    struct Request
+    {
+        std::filesystem::path path;
+        Image image;
+        bool is_burst; // Requested shortly after the previous request, like on key repeat.
+        bool keep_view;
+        bool is_preload;
+    };
+
+    std::mutex mutex;
+    std::condition_variable_any cv;
+    std::optional<Request> request_pending;
+    std::stop_source stop_source; // Cancels the decode in progress.
+    std::unique_ptr<Decoded_image> decoded;
+    std::optional<Request> preload_pending;
+    std::unique_ptr<Decoded_image> preloaded;
+    std::filesystem::path preloading_path; // Empty if no preload is being decoded.
+    bool is_preload_shown; // Post the preload being decoded once done.
+    std::chrono::steady_clock::time_point request_time;
+    std::function<void()> on_decoded;
+
+    // Should be the last member, so it starts last and stops first.
+    std::jthread thread;
+};
@@ -2,50 +2,86 @@
 
 #include "pch.h"
 
-// Helpers for benching execution time.
-// Bench::start() must be called first!
+// Instrumentation for benching execution time.
+// Scoped timers and counters record events into thread local buffers, so threads don't contend,
+// the buffers get merged only when the results are requested.
+// Names must be string literals, they are stored as pointers.
+// Doesn't depend on the platform, so it can also be used by headless builds.
+
+struct Bench_stats
+{
+    const char* name;
+    size_t count;
+    double total; // In milliseconds, same for all below.
+    double min;
+    double median;
+    double p99;
+    double max;
+};
+
+struct Bench_counter
+{
+    const char* name;
+    int64_t value; // Sum of all counts.
+};
 
 struct Bench
 {
     Bench() = delete;
-    
-    static inline void start() noexcept
-    {
-        bench_start_time = std::chrono::high_resolution_clock::now();
-    }
+    using Clock = std::chrono::steady_clock;
 
-    // Non blocking.
-    // The result will be in milliseconds (double).
-    static inline void end() noexcept
-    {
-        const auto bench_end_time = std::chrono::high_resolution_clock::now();
-        auto t = std::thread([=]() noexcept { MessageBoxW(nullptr, std::to_wstring(std::chrono::duration<double, std::chrono::milliseconds::period>(bench_end_time - bench_start_time).count()).c_str(), L"Bench result", 0); });
-        t.detach();
-    }
+    // Nothing gets recorded while disabled, timers only check the flag.
+    static inline std::atomic_bool is_enabled;
 
-    // Non blocking.
-    // The result will be in milliseconds (double).
-    static inline void end(const std::wstring what) noexcept
-    {
-        const auto bench_end_time = std::chrono::high_resolution_clock::now();
-        auto t = std::thread([=]() noexcept { MessageBoxW(nullptr, std::to_wstring(std::chrono::duration<double, std::chrono::milliseconds::period>(bench_end_time - bench_start_time).count()).c_str(), what.c_str(), 0); });
-        t.detach();
-    }
+    static void record(const char* name, Clock::time_point start, Clock::time_point end) noexcept;
+    static void count(const char* name, int64_t value = 1) noexcept;
+
+    // Sorted by name.
+    static std::vector<Bench_stats> get_stats();
+    static std::vector<Bench_counter> get_counters();
+
+    static void write_csv(std::ostream& os);
+    static void write_json(std::ostream& os);
 
-    // The result will be in milliseconds (double).
-    static inline void end_blocking() noexcept
+    // Chrome trace event format, can be opened in chrome://tracing or Perfetto.
+    static void write_trace(std::ostream& os);
+
+    // Writes bench.csv, bench.json and bench_trace.json into the directory.
+    static void write_files(const std::filesystem::path& directory);
+
+    // Drops all recorded events.
+    static void reset() noexcept;
+};
+
+// Records the time from construction to destruction.
+class Bench_timer
+{
+public:
+    explicit Bench_timer(const char* name) noexcept :
+        name(Bench::is_enabled.load(std::memory_order_relaxed) ? name : nullptr)
     {
-        const auto bench_end_time = std::chrono::high_resolution_clock::now();
-        MessageBoxW(nullptr, std::to_wstring(std::chrono::duration<double, std::chrono::milliseconds::period>(bench_end_time - bench_start_time).count()).c_str(), L"Bench result", 0);
+        if (this->name) {
+            start = Bench::Clock::now();
+        }
     }
 
-    // The result will be in milliseconds (double).
-    static inline void end_blocking(const std::wstring what) noexcept
+    ~Bench_timer()
     {
-        const auto bench_end_time = std::chrono::high_resolution_clock::now();
-        MessageBoxW(nullptr, std::to_wstring(std::chrono::duration<double, std::chrono::milliseconds::period>(bench_end_time - bench_start_time).count()).c_str(), what.c_str(), 0);
+        if (name) {
+            Bench::record(name, start, Bench::Clock::now());
+        }
     }
 
+    Bench_timer(const Bench_timer&) = delete;
+    Bench_timer& operator=(const Bench_timer&) = delete;
+
 private:
-    static inline std::chrono::high_resolution_clock::time_point bench_start_time;
+    const char* name;
+    Bench::Clock::time_point start;
 };
+
+#define WIV_BENCH_CONCAT_(a, b) a##b
+#define WIV_BENCH_CONCAT(a, b) WIV_BENCH_CONCAT_(a, b)
+
+// Times the rest of the current scope.
+#define WIV_BENCH_SCOPE(name) const Bench_timer WIV_BENCH_CONCAT(bench_timer_, __LINE__)(name)
@@ -19,6 +19,8 @@ consteval auto wiv_fill_lut()
 }
 
 // Precompute LUTs since this would be expensive at runtime.
+inline constexpr auto WIV_CMS_LUT_17 = wiv_fill_lut<17>();
+inline constexpr auto WIV_CMS_LUT_25 = wiv_fill_lut<25>();
 inline constexpr auto WIV_CMS_LUT_33 = wiv_fill_lut<33>();
 inline constexpr auto WIV_CMS_LUT_49 = wiv_fill_lut<49>();
 inline constexpr auto WIV_CMS_LUT_65 = wiv_fill_lut<65>();
\ No newline at end of file
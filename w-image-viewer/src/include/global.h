@@ -3,4 +3,6 @@
 #include "config.h"
 
 inline Config g_config;
-inline HWND g_hwnd; // Main window handle.
\ No newline at end of file
+#ifdef _WIN32
+inline HWND g_hwnd; // Main window handle.
+#endif
\ No newline at end of file
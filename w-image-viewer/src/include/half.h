@@ -0,0 +1,112 @@
+#pragma once
+
+#include "pch.h"
+#include <immintrin.h>
+
+// Float (binary32) to half (binary16) conversion and back.
+// Both paths round to nearest even, so results are identical.
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define WIV_TARGET_F16C
+#else
+#define WIV_TARGET_F16C __attribute__((target("avx,f16c")))
+#endif
+
+// Source https://gist.github.com/rygorous/2156668 (float_to_half_fast3_rtne)
+inline uint16_t float_to_half(float f) noexcept
+{
+    constexpr uint32_t f32_infinity = 255u << 23;
+    constexpr uint32_t f16_max = (127u + 16u) << 23;
+    constexpr uint32_t denorm_magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+    uint32_t u = std::bit_cast<uint32_t>(f);
+    const uint32_t sign = u & 0x80000000u;
+    u ^= sign;
+    uint32_t o;
+
+    // Inf or NaN (all exponent bits set). NaN becomes qNaN keeping the top of its payload, like F16C does, Inf stays Inf.
+    if (u >= f16_max) {
+        o = u > f32_infinity ? 0x7e00 | ((u >> 13) & 0x3ff) : 0x7c00;
+    }
+
+    // Subnormal or zero.
+    // Adding the magic value aligns the 10 mantissa bits at the bottom of the float,
+    // this relies on the float addition rounding to nearest even.
+    else if (u < (113u << 23)) {
+        o = std::bit_cast<uint32_t>(std::bit_cast<float>(u) + std::bit_cast<float>(denorm_magic)) - denorm_magic;
+    }
+
+    // Normalized number.
+    else {
+        const uint32_t mant_odd = (u >> 13) & 1;
+        u += ((15u - 127u) << 23) + 0xfff + mant_odd;
+        o = u >> 13;
+    }
+
+    return static_cast<uint16_t>(o | (sign >> 16));
+}
+
+// Source https://gist.github.com/rygorous/2156668 (half_to_float)
+// Exact, every half is a float.
+inline float half_to_float(uint16_t h) noexcept
+{
+    constexpr uint32_t shifted_exp = 0x7c00u << 13;
+    constexpr uint32_t magic = 113u << 23;
+    uint32_t o = (h & 0x7fffu) << 13;
+    const uint32_t exp = o & shifted_exp;
+    o += (127u - 15u) << 23;
+
+    // Inf or NaN.
+    if (exp == shifted_exp) {
+        o += (128u - 16u) << 23;
+    }
+
+    // Subnormal or zero, renormalized by the float subtraction.
+    else if (exp == 0) {
+        o += 1u << 23;
+        o = std::bit_cast<uint32_t>(std::bit_cast<float>(o) - std::bit_cast<float>(magic));
+    }
+
+    return std::bit_cast<float>(o | static_cast<uint32_t>(h & 0x8000u) << 16);
+}
+
+inline bool cpu_has_f16c() noexcept
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    const bool osxsave = info[2] & (1 << 27);
+    const bool avx = info[2] & (1 << 28);
+    const bool f16c = info[2] & (1 << 29);
+
+    // The OS also has to save the ymm registers.
+    return osxsave && avx && f16c && (_xgetbv(0) & 6) == 6;
+#else
+    return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+#endif
+}
+
+WIV_TARGET_F16C inline void float_to_half_f16c(const float* src, uint16_t* dst, size_t n) noexcept
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+    }
+    for (; i < n; ++i) {
+        dst[i] = float_to_half(src[i]);
+    }
+}
+
+// Converts n floats from src into n halfs in dst.
+// Uses F16C if the CPU supports it.
+inline void float_to_half(const float* src, uint16_t* dst, size_t n) noexcept
+{
+    static const bool has_f16c = cpu_has_f16c();
+    if (has_f16c) {
+        float_to_half_f16c(src, dst, n);
+        return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = float_to_half(src[i]);
+    }
+}
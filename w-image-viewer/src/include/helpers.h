@@ -70,9 +70,37 @@ inline constexpr auto cube(auto a) noexcept
 //
 //
 
+// Matches the filename against patterns like "*.jpg;*.png;", case insensitive.
+inline bool path_match_spec(const std::filesystem::path& path, const wchar_t* spec) noexcept
+{
+#ifdef _WIN32
+    return PathMatchSpecExW(path.c_str(), spec, PMSF_MULTIPLE) == S_OK;
+#else
+
+    // Only "*suffix" patterns are supported, that's all we use.
+    const auto to_lower = [](std::wstring str) {
+        std::transform(str.begin(), str.end(), str.begin(), [](wchar_t c) { return std::towlower(c); });
+        return str;
+    };
+    const auto filename = to_lower(path.filename().wstring());
+    std::wstring_view patterns = spec;
+    while (!patterns.empty()) {
+        const auto end = std::min(patterns.find(L';'), patterns.size());
+        const auto pattern = patterns.substr(0, end);
+        patterns.remove_prefix(std::min(end + 1, patterns.size()));
+        if (pattern.size() > 1 && pattern.front() == L'*' && filename.ends_with(to_lower(std::wstring(pattern.substr(1))))) {
+            return true;
+        }
+    }
+    return false;
+#endif
+}
+
 // Win32
 //
 
+#ifdef _WIN32
+
 // Get width from RECT.
 template<typename T>
 constexpr T rc_w(const RECT& rect) noexcept
@@ -114,6 +142,8 @@ inline int wiv_message_blocking(std::wstring text, std::wstring caption = L"WIV
     return MessageBoxW(nullptr, text.c_str(), caption.c_str(), type);
 }
 
+#endif
+
 //
 
 // Convert string to value.
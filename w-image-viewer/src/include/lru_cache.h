@@ -0,0 +1,101 @@
+#pragma once
+
+#include "pch.h"
+
+// Least recently used cache with a cost budget.
+// Every value has a cost (for example its size in bytes),
+// when the total cost exceeds the budget least recently used values get evicted.
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class Lru_cache
+{
+public:
+    Lru_cache(size_t budget = 0) noexcept :
+        budget(budget)
+    {}
+
+    void set_budget(size_t val)
+    {
+        budget = val;
+        evict();
+    }
+
+    // Returns nullptr if the key is not cached.
+    // Marks the value as the most recently used.
+    Value* get(const Key& key)
+    {
+        const auto it = map.find(key);
+        if (it == map.end()) {
+            return nullptr;
+        }
+        list.splice(list.begin(), list, it->second);
+        return &it->second->value;
+    }
+
+    // Doesn't mark the value as used.
+    bool contains(const Key& key) const
+    {
+        return map.contains(key);
+    }
+
+    // Inserts or replaces the value and marks it as the most recently used.
+    // The most recently used value never gets evicted, so the returned pointer is always valid.
+    Value* put(const Key& key, Value value, size_t cost)
+    {
+        erase(key);
+        list.push_front({ key, std::move(value), cost });
+        map.emplace(key, list.begin());
+        total_cost += cost;
+        evict();
+        return &list.front().value;
+    }
+
+    void erase(const Key& key)
+    {
+        const auto it = map.find(key);
+        if (it == map.end()) {
+            return;
+        }
+        total_cost -= it->second->cost;
+        list.erase(it->second);
+        map.erase(it);
+    }
+
+    void clear() noexcept
+    {
+        map.clear();
+        list.clear();
+        total_cost = 0;
+    }
+
+    size_t get_cost() const noexcept
+    {
+        return total_cost;
+    }
+
+    size_t size() const noexcept
+    {
+        return list.size();
+    }
+
+private:
+    struct Entry
+    {
+        Key key;
+        Value value;
+        size_t cost;
+    };
+
+    void evict()
+    {
+        while (total_cost > budget && list.size() > 1) {
+            total_cost -= list.back().cost;
+            map.erase(list.back().key);
+            list.pop_back();
+        }
+    }
+
+    std::list<Entry> list; // Front is the most recently used.
+    std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> map;
+    size_t budget;
+    size_t total_cost = 0;
+};
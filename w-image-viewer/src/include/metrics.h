@@ -0,0 +1,183 @@
+#pragma once
+
+#include "pch.h"
+
+// Metrics collected across the entire application, safe to update from any thread.
+// Updates are single atomic operations, metrics register themselves in a lock-free list on construction.
+// Readers take a snapshot, the overlay takes one per frame.
+// Doesn't depend on the platform.
+
+// Histogram bucket i counts samples <= WIV_METRICS_HISTOGRAM_MIN * 2^i, the last one counts the rest.
+inline constexpr int WIV_METRICS_HISTOGRAM_BUCKETS = 16;
+inline constexpr double WIV_METRICS_HISTOGRAM_MIN = 0.25;
+
+enum class Metric_kind
+{
+    gauge,
+    counter,
+    histogram
+};
+
+class Metric
+{
+public:
+    Metric(const char* name, Metric_kind kind) noexcept;
+    Metric(const Metric&) = delete;
+    Metric& operator=(const Metric&) = delete;
+    const char* const name;
+    const Metric_kind kind;
+    const int index; // Index in the snapshot.
+    const Metric* next; // Next registered metric.
+};
+
+// Last set value.
+class Metric_gauge : public Metric
+{
+public:
+    explicit Metric_gauge(const char* name) noexcept :
+        Metric(name, Metric_kind::gauge)
+    {}
+
+    void set(double val) noexcept
+    {
+        value.store(val, std::memory_order_relaxed);
+    }
+
+    double get() const noexcept
+    {
+        return value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<double> value = 0.0;
+};
+
+// Monotonic count.
+class Metric_counter : public Metric
+{
+public:
+    explicit Metric_counter(const char* name) noexcept :
+        Metric(name, Metric_kind::counter)
+    {}
+
+    void add(int64_t val = 1) noexcept
+    {
+        value.fetch_add(val, std::memory_order_relaxed);
+    }
+
+    int64_t get() const noexcept
+    {
+        return value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64_t> value = 0;
+};
+
+// Distribution of samples in exponential buckets.
+class Metric_histogram : public Metric
+{
+public:
+    explicit Metric_histogram(const char* name) noexcept :
+        Metric(name, Metric_kind::histogram)
+    {}
+
+    void record(double sample) noexcept;
+
+private:
+    friend struct Metrics;
+    std::array<std::atomic<uint64_t>, WIV_METRICS_HISTOGRAM_BUCKETS> buckets = {};
+    std::atomic<double> sum = 0.0;
+};
+
+struct Metric_value
+{
+    const char* name;
+    Metric_kind kind;
+    double value; // Gauge value, counter value or sum of the histogram samples.
+    uint64_t count; // Number of histogram samples.
+    std::array<uint64_t, WIV_METRICS_HISTOGRAM_BUCKETS> buckets;
+
+    // Upper bound of the bucket holding the percentile p, in [0, 1]. Histograms only.
+    double get_percentile(double p) const noexcept;
+};
+
+class Metrics_snapshot
+{
+public:
+    template<typename T = double>
+    T get(const Metric& metric) const noexcept
+    {
+        return static_cast<T>(values[metric.index].value);
+    }
+
+    const Metric_value& operator[](const Metric& metric) const noexcept
+    {
+        return values[metric.index];
+    }
+
+    std::chrono::system_clock::time_point time;
+    std::vector<Metric_value> values; // In the registration order.
+};
+
+struct Metrics
+{
+    Metrics() = delete;
+    static inline Metric_gauge image_width{ "image_width" }; // The original image width.
+    static inline Metric_gauge image_height{ "image_height" }; // The original image height.
+    static inline Metric_gauge image_bitdepth{ "image_bitdepth" }; // Image bitdepth per channel.
+    static inline Metric_gauge image_nchannels{ "image_nchannels" }; // Number of channels per pixel.
+    static inline Metric_gauge scale{ "scale" }; // Current image scale.
+    static inline Metric_gauge scaled_width{ "scaled_width" }; // Scaled image width.
+    static inline Metric_gauge scaled_height{ "scaled_height" }; // Scaled image height.
+    static inline Metric_gauge scale_filter{ "scale_filter" }; // Scale filter. 0 - orthogonal, 1 - cylindrical
+    static inline Metric_gauge kernel_index{ "kernel_index" }; // Currently used kernel function.
+    static inline Metric_gauge kernel_support{ "kernel_support" }; // Valid range of the kernel function.
+    static inline Metric_gauge kernel_radius{ "kernel_radius" }; // Currently used kernel radius: ceil(kernel_support / min(scale, 1)).
+
+    // Currently used scale kernel size.
+    // In case of orthogonal scaling: kernel_radius * 2.
+    // In case of cylindrical scaling: (kernel_radius * 2)^2.
+    static inline Metric_gauge kernel_size{ "kernel_size" };
+
+    static inline Metric_gauge image_cache_hits{ "image_cache_hits" }; // Image cache tile lookups that didn't have to read the file.
+    static inline Metric_gauge image_cache_misses{ "image_cache_misses" }; // Image cache tile lookups that had to read the file.
+    static inline Metric_gauge image_cache_bytes_read{ "image_cache_bytes_read" }; // Total bytes read by the image cache.
+    static inline Metric_gauge image_cache_memory_used{ "image_cache_memory_used" }; // Memory used by the image cache tiles.
+    static inline Metric_gauge slideshow_periods{ "slideshow_periods" }; // Images swapped since the slideshow started.
+    static inline Metric_gauge slideshow_period_error_mean{ "slideshow_period_error_mean" }; // Mean of |time between presented swaps - interval| in ms.
+    static inline Metric_gauge slideshow_period_error_max{ "slideshow_period_error_max" }; // Max of |time between presented swaps - interval| in ms.
+    static inline Metric_gauge cms_lut_size{ "cms_lut_size" }; // Size of the CMS LUT in use, 0 if the matrix-shaper transform is used.
+    static inline Metric_gauge cms_lut_error{ "cms_lut_error" }; // Measured max dE2000 of the auto sized CMS LUT, -1 if not measured.
+    static inline Metric_gauge startup_time{ "startup_time" }; // Time from the process creation until the window is created, in ms.
+    static inline Metric_gauge time_to_first_image{ "time_to_first_image" }; // Time from the process creation until the startup image is presented, in ms.
+    static inline Metric_gauge animation_frame{ "animation_frame" }; // Index of the shown animation frame.
+    static inline Metric_counter images_decoded{ "images_decoded" }; // Fully decoded images, previews not included.
+    static inline Metric_counter bytes_decoded{ "bytes_decoded" }; // Pixel bytes of the decoded images.
+    static inline Metric_counter renders{ "renders" }; // Times the passes were rendered.
+    static inline Metric_counter render_cache_hits{ "render_cache_hits" }; // Times the passes were skipped cause the view was cached.
+    static inline Metric_counter interim_renders{ "interim_renders" }; // Renders with a cheaper profile to meet the render time budget.
+    static inline Metric_counter animation_frames_late{ "animation_frames_late" }; // Animation frames not decoded by the time they were due.
+    static inline Metric_histogram decode_time{ "decode_time" }; // Image decode time in ms.
+    static inline Metric_histogram render_time{ "render_time" }; // CPU time of the passes in ms.
+    static inline Metric_histogram animation_frame_error{ "animation_frame_error" }; // |time shown - time due| of the animation frames in ms.
+
+    static Metrics_snapshot snapshot();
+
+    // One JSON object per snapshot, on a single line.
+    static void write_json(std::ostream& os, const Metrics_snapshot& snapshot);
+};
+
+// Periodically appends snapshots to a file, as JSON lines.
+class Metrics_dumper
+{
+public:
+    ~Metrics_dumper();
+
+    // Restarts the dumper if it's already running.
+    void start(const std::filesystem::path& path, std::chrono::seconds interval);
+    void stop();
+
+private:
+    std::jthread thread;
+};
@@ -0,0 +1,294 @@
+#pragma once
+
+#include "pch.h"
+#include "include/bench.h"
+
+// Per stage timings shown in the overlay, as rolling averages.
+// CPU stages are timed with Profiler_timer, GPU passes with Gpu_profiler.
+// Unlike Bench it's always on, it only keeps the last few samples of every stage.
+// While Bench is enabled CPU stages are also recorded by Bench, so they don't need a Bench timer too.
+// Doesn't depend on the platform, GPU time is read through Gpu_clock.
+
+// Number of samples averaged per stage.
+inline constexpr int WIV_PROFILER_WINDOW = 32;
+
+// Frames in flight, results are read back this many frames late at most.
+inline constexpr int WIV_GPU_PROFILER_FRAMES = 4;
+
+// Timestamps per frame, every scope uses two.
+inline constexpr int WIV_GPU_PROFILER_QUERIES = 32;
+
+// Average of the last WIV_PROFILER_WINDOW samples.
+class Rolling_average
+{
+public:
+    void add(double sample) noexcept
+    {
+        samples[index] = sample;
+        index = (index + 1) % WIV_PROFILER_WINDOW;
+        count = std::min(count + 1, WIV_PROFILER_WINDOW);
+    }
+
+    double get() const noexcept
+    {
+        return count ? std::accumulate(samples.begin(), samples.begin() + count, 0.0) / count : 0.0;
+    }
+
+    double get_last() const noexcept
+    {
+        return count ? samples[(index + WIV_PROFILER_WINDOW - 1) % WIV_PROFILER_WINDOW] : 0.0;
+    }
+
+private:
+    std::array<double, WIV_PROFILER_WINDOW> samples = {};
+    int index = 0;
+    int count = 0;
+};
+
+struct Profiler_timing
+{
+    const char* name;
+    double last; // In milliseconds.
+    double average; // In milliseconds.
+};
+
+// Thread safe, stages are kept in the order they were first recorded.
+// Names must be string literals, they are stored as pointers.
+class Profiler_timings
+{
+public:
+    void add(const char* name, double ms)
+    {
+        const std::scoped_lock lock(mutex);
+        auto it = std::find_if(stages.begin(), stages.end(), [name](const auto& stage) { return std::strcmp(stage.first, name) == 0; });
+        if (it == stages.end()) {
+            it = stages.insert(stages.end(), { name, {} });
+        }
+        it->second.add(ms);
+    }
+
+    std::vector<Profiler_timing> get() const
+    {
+        const std::scoped_lock lock(mutex);
+        std::vector<Profiler_timing> timings;
+        timings.reserve(stages.size());
+        for (const auto& [name, average] : stages) {
+            timings.push_back({ name, average.get_last(), average.get() });
+        }
+        return timings;
+    }
+
+    void clear()
+    {
+        const std::scoped_lock lock(mutex);
+        stages.clear();
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::vector<std::pair<const char*, Rolling_average>> stages;
+};
+
+struct Profiler
+{
+    Profiler() = delete;
+    static inline Profiler_timings cpu;
+    static inline Profiler_timings gpu;
+};
+
+// Records the time from construction to destruction into Profiler::cpu, and into Bench if it's enabled.
+class Profiler_timer
+{
+public:
+    explicit Profiler_timer(const char* name) noexcept :
+        name(name),
+        start(std::chrono::steady_clock::now())
+    {}
+
+    ~Profiler_timer()
+    {
+        const auto end = std::chrono::steady_clock::now();
+        Profiler::cpu.add(name, std::chrono::duration<double, std::milli>(end - start).count());
+        if (Bench::is_enabled.load(std::memory_order_relaxed)) {
+            Bench::record(name, start, end);
+        }
+    }
+
+    Profiler_timer(const Profiler_timer&) = delete;
+    Profiler_timer& operator=(const Profiler_timer&) = delete;
+
+private:
+    const char* name;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define WIV_PROFILE_SCOPE(name) const Profiler_timer WIV_BENCH_CONCAT(profiler_timer_, __LINE__)(name)
+
+// Source of GPU timestamps.
+// Every frame slot has WIV_GPU_PROFILER_QUERIES timestamps, they are written on the GPU timeline
+// and read back some frames later, once the GPU is done with them.
+class Gpu_clock
+{
+public:
+    virtual ~Gpu_clock() = default;
+    virtual void begin_frame(int frame) = 0;
+    virtual void end_frame(int frame) = 0;
+    virtual void timestamp(int frame, int query) = 0;
+
+    // Must not wait for the GPU, returns false if the results are not ready yet.
+    // frequency is in ticks per second, it's 0 if the timestamps are not reliable (for example the GPU clock changed).
+    virtual bool read_frame(int frame, int count, uint64_t* ticks, uint64_t& frequency) = 0;
+};
+
+// Times GPU scopes with a ring of WIV_GPU_PROFILER_FRAMES frame slots, results go into Profiler::gpu.
+// If all slots are still in flight the frame doesn't get timed, so we never stall on the GPU.
+// Scopes with the same name within a frame are summed.
+class Gpu_profiler
+{
+public:
+    void set_clock(std::unique_ptr<Gpu_clock> val) noexcept
+    {
+        clock = std::move(val);
+        frames = {};
+        head = 0;
+        tail = 0;
+        is_recording = false;
+    }
+
+    void begin_frame()
+    {
+        collect();
+        is_recording = clock && !frames[head].is_pending;
+        if (is_recording) {
+            frames[head].scopes.clear();
+            frames[head].nqueries = 0;
+            clock->begin_frame(head);
+        }
+    }
+
+    // work is passed to the frame callback together with the GPU time of the frame, once it's read back.
+    void end_frame(double work = 0.0)
+    {
+        if (!is_recording) {
+            return;
+        }
+        is_recording = false;
+        clock->end_frame(head);
+        frames[head].work = work;
+        frames[head].is_pending = true;
+        head = (head + 1) % WIV_GPU_PROFILER_FRAMES;
+    }
+
+    // Called from collect() with the work and the summed scopes of frames that had work.
+    void set_frame_callback(std::function<void(double work, double ms)> val)
+    {
+        frame_callback = std::move(val);
+    }
+
+    // Returns the scope index for end(), -1 if the scope isn't timed.
+    int begin(const char* name)
+    {
+        auto& frame = frames[head];
+        if (!is_recording || frame.nqueries + 2 > WIV_GPU_PROFILER_QUERIES) {
+            return -1;
+        }
+        clock->timestamp(head, frame.nqueries);
+        frame.scopes.push_back({ name, frame.nqueries, frame.nqueries + 1 });
+        frame.nqueries += 2;
+        return static_cast<int>(frame.scopes.size()) - 1;
+    }
+
+    void end(int scope)
+    {
+        if (scope >= 0 && is_recording) {
+            clock->timestamp(head, frames[head].scopes[scope].end);
+        }
+    }
+
+    // Reads back the finished frames, in order.
+    void collect()
+    {
+        while (frames[tail].is_pending) {
+            auto& frame = frames[tail];
+            std::array<uint64_t, WIV_GPU_PROFILER_QUERIES> ticks;
+            uint64_t frequency;
+            if (!clock->read_frame(tail, frame.nqueries, ticks.data(), frequency)) {
+                break;
+            }
+            if (frequency) {
+                std::vector<std::pair<const char*, double>> sums;
+                double total = 0.0;
+                for (const auto& scope : frame.scopes) {
+                    const double ms = static_cast<double>(ticks[scope.end] - ticks[scope.begin]) * 1000.0 / static_cast<double>(frequency);
+                    total += ms;
+                    auto it = std::find_if(sums.begin(), sums.end(), [&scope](const auto& sum) { return std::strcmp(sum.first, scope.name) == 0; });
+                    if (it == sums.end()) {
+                        sums.emplace_back(scope.name, ms);
+                    }
+                    else {
+                        it->second += ms;
+                    }
+                }
+                for (const auto& [name, ms] : sums) {
+                    Profiler::gpu.add(name, ms);
+                }
+                if (frame.work > 0.0 && frame_callback) {
+                    frame_callback(frame.work, total);
+                }
+            }
+            frame.is_pending = false;
+            tail = (tail + 1) % WIV_GPU_PROFILER_FRAMES;
+        }
+    }
+
+    // True if some frames are still waiting for the GPU.
+    bool is_pending() const noexcept
+    {
+        return frames[tail].is_pending;
+    }
+
+private:
+    struct Scope
+    {
+        const char* name;
+        int begin; // Query indices.
+        int end;
+    };
+
+    struct Frame
+    {
+        std::vector<Scope> scopes;
+        int nqueries = 0;
+        double work = 0.0;
+        bool is_pending = false;
+    };
+
+    std::unique_ptr<Gpu_clock> clock;
+    std::function<void(double work, double ms)> frame_callback;
+    std::array<Frame, WIV_GPU_PROFILER_FRAMES> frames;
+    int head = 0; // Frame being recorded.
+    int tail = 0; // Oldest frame in flight.
+    bool is_recording = false;
+};
+
+// Times the GPU work from construction to destruction.
+class Gpu_profiler_scope
+{
+public:
+    Gpu_profiler_scope(Gpu_profiler& profiler, const char* name) :
+        profiler(profiler),
+        scope(profiler.begin(name))
+    {}
+
+    ~Gpu_profiler_scope()
+    {
+        profiler.end(scope);
+    }
+
+    Gpu_profiler_scope(const Gpu_profiler_scope&) = delete;
+    Gpu_profiler_scope& operator=(const Gpu_profiler_scope&) = delete;
+
+private:
+    Gpu_profiler& profiler;
+    int scope;
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#define WIV_RAW_EXTENSIONS_LIST "*.bay;*.bmq;*.cr2;*.cr3;*.crw;*.cs1;*.dc2;*.dcr;*.dng;*.erf;*.fff;*.hdr;*.k25;*.kdc;*.mdc;*.mos;*.mrw;*.nef;*.orf;*.pef;*.pxn;*.raf;*.raw;*.rdc;*.sr2;*.srf;*.x3f;*.arw;*.3fr;*.cine;*.ia;*.kc2;*.mef;*.nrw;*.qtk;*.rw2;*.sti;*.rwl;*.srw;*.drf;*.dsc;*.ptx;*.cap;*.iiq;*.rwz;"
+
 inline constexpr auto WIV_SUPPORTED_EXTENSIONS{ L""
     "*.tif;*.tiff;*.tx;*.env;*.sm;*.vsm;" // Tagged Image File Format (TIFF) 
     "*.jpg;*jpeg;*.jpe;*.jif;*.jfif;*.jfi;" // Joint Photographic Experts group (JPEG)
@@ -11,7 +13,9 @@ inline constexpr auto WIV_SUPPORTED_EXTENSIONS{ L""
     "*.psd;*.pdd;*.psb;" // PSD
     "*.tga;*.icb;*.vda;*.vst;*.tpic;" // Truevision TGA (TARGA)
     "*.ico;" // Icon
-    "*.bay;*.bmq;*.cr2;*.cr3;*.crw;*.cs1;*.dc2;*.dcr;*.dng;*.erf;*.fff;*.hdr;*.k25;*.kdc;*.mdc;*.mos;*.mrw;*.nef;*.orf;*.pef;*.pxn;*.raf;*.raw;*.rdc;*.sr2;*.srf;*.x3f;*.arw;*.3fr;*.cine;*.ia;*.kc2;*.mef;*.nrw;*.qtk;*.rw2;*.sti;*.rwl;*.srw;*.drf;*.dsc;*.ptx;*.cap;*.iiq;*.rwz;" // RAW
+    WIV_RAW_EXTENSIONS_LIST // RAW
     "*.webp;" // WEBP
     "*.heic;*.heif;*.heics;*.hif;*.avif;" // High Efficiency Image File Format (HEIF)
-};
\ No newline at end of file
+};
+
+inline constexpr auto WIV_RAW_EXTENSIONS{ L"" WIV_RAW_EXTENSIONS_LIST };
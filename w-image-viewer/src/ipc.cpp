@@ -0,0 +1,368 @@
+#include "pch.h"
+#include "ipc.h"
+
+Ipc_server::~Ipc_server()
+{
+    stop();
+}
+
+#ifdef _WIN32
+
+namespace
+{
+    // Pipe names are machine wide, so the user name keeps instances of different users apart.
+    std::wstring get_pipe_name(const std::string& name)
+    {
+        wchar_t user[256 + 1];
+        DWORD size = static_cast<DWORD>(std::size(user));
+        if (!GetUserNameW(user, &size)) {
+            user[0] = L'\0';
+        }
+        return L"\\\\.\\pipe\\" + std::wstring(name.begin(), name.end()) + L"-" + user;
+    }
+
+    // Waits for the overlapped operation, cancels it on timeout or once stop_event is set.
+    bool wait_overlapped(HANDLE handle, OVERLAPPED& overlapped, BOOL result, HANDLE stop_event, DWORD timeout, DWORD* transferred = nullptr)
+    {
+        DWORD bytes = 0;
+        if (!result) {
+            if (GetLastError() != ERROR_IO_PENDING) {
+                return false;
+            }
+            const std::array handles = { overlapped.hEvent, stop_event };
+            if (WaitForMultipleObjects(stop_event ? 2 : 1, handles.data(), FALSE, timeout) != WAIT_OBJECT_0) {
+                CancelIoEx(handle, &overlapped);
+                GetOverlappedResult(handle, &overlapped, &bytes, TRUE);
+                return false;
+            }
+        }
+        if (!GetOverlappedResult(handle, &overlapped, &bytes, FALSE)) {
+            return false;
+        }
+        if (transferred) {
+            *transferred = bytes;
+        }
+        return true;
+    }
+
+    bool read_all(HANDLE handle, void* data, DWORD size, HANDLE stop_event)
+    {
+        auto bytes = static_cast<char*>(data);
+        while (size) {
+            OVERLAPPED overlapped = {};
+            std::unique_ptr<void, decltype(&CloseHandle)> event(CreateEventW(nullptr, TRUE, FALSE, nullptr), CloseHandle);
+            overlapped.hEvent = event.get();
+            DWORD transferred;
+            if (!wait_overlapped(handle, overlapped, ReadFile(handle, bytes, size, nullptr, &overlapped), stop_event, static_cast<DWORD>(WIV_IPC_TIMEOUT.count()), &transferred) || !transferred) {
+                return false;
+            }
+            bytes += transferred;
+            size -= transferred;
+        }
+        return true;
+    }
+
+    bool write_all(HANDLE handle, const void* data, DWORD size, HANDLE stop_event)
+    {
+        OVERLAPPED overlapped = {};
+        std::unique_ptr<void, decltype(&CloseHandle)> event(CreateEventW(nullptr, TRUE, FALSE, nullptr), CloseHandle);
+        overlapped.hEvent = event.get();
+        DWORD transferred;
+        return wait_overlapped(handle, overlapped, WriteFile(handle, data, size, nullptr, &overlapped), stop_event, static_cast<DWORD>(WIV_IPC_TIMEOUT.count()), &transferred) && transferred == size;
+    }
+}
+
+bool Ipc_server::start(const std::string& name, Callback on_message)
+{
+    stop();
+
+    // The first instance flag makes the creation fail if another process already owns the name.
+    pipe.reset(CreateNamedPipeW(get_pipe_name(name).c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1, WIV_IPC_MESSAGE_MAX, WIV_IPC_MESSAGE_MAX, 0, nullptr));
+    if (pipe.get() == INVALID_HANDLE_VALUE) {
+        pipe.release();
+        return false;
+    }
+    stop_event.reset(CreateEventW(nullptr, TRUE, FALSE, nullptr));
+    thread = std::jthread(std::bind_front(&Ipc_server::run, this), std::move(on_message));
+    return true;
+}
+
+void Ipc_server::stop()
+{
+    if (thread.joinable()) {
+        thread.request_stop();
+        SetEvent(stop_event.get());
+        thread.join();
+    }
+    pipe.reset();
+    stop_event.reset();
+}
+
+void Ipc_server::run(std::stop_token stop_token, Callback on_message)
+{
+    // Clients are served one at a time, on the single pipe instance.
+    while (!stop_token.stop_requested()) {
+        OVERLAPPED overlapped = {};
+        std::unique_ptr<void, decltype(&CloseHandle)> event(CreateEventW(nullptr, TRUE, FALSE, nullptr), CloseHandle);
+        overlapped.hEvent = event.get();
+        const BOOL result = ConnectNamedPipe(pipe.get(), &overlapped);
+
+        // The client connected between the creation and the connect call.
+        const bool is_connected = !result && GetLastError() == ERROR_PIPE_CONNECTED;
+        if (!is_connected && !wait_overlapped(pipe.get(), overlapped, result, stop_event.get(), INFINITE)) {
+            if (stop_token.stop_requested()) {
+                return;
+            }
+            DisconnectNamedPipe(pipe.get());
+            continue;
+        }
+
+        uint32_t size;
+        if (read_all(pipe.get(), &size, sizeof(size), stop_event.get()) && size <= WIV_IPC_MESSAGE_MAX) {
+            std::string message(size, '\0');
+            if (read_all(pipe.get(), message.data(), size, stop_event.get())) {
+                on_message(std::move(message));
+                constexpr char ack = 1;
+                if (write_all(pipe.get(), &ack, 1, stop_event.get())) {
+
+                    // Disconnecting discards unread data, so wait until the client closes its end.
+                    char eof;
+                    read_all(pipe.get(), &eof, 1, stop_event.get());
+                }
+            }
+        }
+        DisconnectNamedPipe(pipe.get());
+    }
+}
+
+bool ipc_send(const std::string& name, std::string_view message)
+{
+    if (message.size() > WIV_IPC_MESSAGE_MAX) {
+        return false;
+    }
+    const auto pipe_name = get_pipe_name(name);
+
+    // Fails right away if there is no server, waits while it's busy with another client.
+    // Another client can take the instance between the wait and the open, then wait again.
+    const auto deadline = std::chrono::steady_clock::now() + WIV_IPC_TIMEOUT;
+    std::unique_ptr<void, decltype(&CloseHandle)> pipe(nullptr, CloseHandle);
+    while (true) {
+        pipe.reset(CreateFileW(pipe_name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr));
+        if (pipe.get() != INVALID_HANDLE_VALUE) {
+            break;
+        }
+        pipe.release();
+        if (GetLastError() != ERROR_PIPE_BUSY) {
+            return false;
+        }
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0 || !WaitNamedPipeW(pipe_name.c_str(), static_cast<DWORD>(remaining))) {
+            return false;
+        }
+    }
+    const auto size = static_cast<uint32_t>(message.size());
+    char ack;
+    return write_all(pipe.get(), &size, sizeof(size), nullptr) && write_all(pipe.get(), message.data(), size, nullptr) && read_all(pipe.get(), &ack, 1, nullptr) && ack == 1;
+}
+
+#else
+
+namespace
+{
+    // Back off after a failed poll or accept, the listening socket may stay readable and the loop would spin.
+    constexpr auto WIV_IPC_RETRY_DELAY = std::chrono::milliseconds(100);
+
+    // The runtime directory is private to the user, /tmp is shared so the name gets the user id.
+    std::filesystem::path get_socket_path(const std::string& name)
+    {
+        if (const auto runtime_directory = std::getenv("XDG_RUNTIME_DIR"); runtime_directory && *runtime_directory) {
+            return std::filesystem::path(runtime_directory) / (name + ".sock");
+        }
+        return std::filesystem::temp_directory_path() / (name + "-" + std::to_string(getuid()) + ".sock");
+    }
+
+    // Returns -1 if the path doesn't fit into sockaddr_un.
+    int connect_socket(const std::filesystem::path& path) noexcept
+    {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (path.native().size() >= sizeof(address.sun_path)) {
+            return -1;
+        }
+        std::strcpy(address.sun_path, path.c_str());
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address))) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // Waits until fd is ready, or until stop_fd becomes readable.
+    bool wait_fd(int fd, short events, int stop_fd, int timeout) noexcept
+    {
+        std::array<pollfd, 2> fds = { { { fd, events, 0 }, { stop_fd, POLLIN, 0 } } };
+        int result;
+        do {
+            result = poll(fds.data(), stop_fd < 0 ? 1 : 2, timeout);
+        } while (result < 0 && errno == EINTR);
+        return result > 0 && fds[0].revents && !fds[1].revents;
+    }
+
+    bool read_all(int fd, void* data, size_t size, int stop_fd) noexcept
+    {
+        auto bytes = static_cast<char*>(data);
+        while (size) {
+            if (!wait_fd(fd, POLLIN, stop_fd, static_cast<int>(WIV_IPC_TIMEOUT.count()))) {
+                return false;
+            }
+            const auto result = recv(fd, bytes, size, 0);
+            if (result <= 0) {
+                if (result < 0 && errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            bytes += result;
+            size -= result;
+        }
+        return true;
+    }
+
+    bool write_all(int fd, const void* data, size_t size, int stop_fd) noexcept
+    {
+        auto bytes = static_cast<const char*>(data);
+        while (size) {
+            if (!wait_fd(fd, POLLOUT, stop_fd, static_cast<int>(WIV_IPC_TIMEOUT.count()))) {
+                return false;
+            }
+
+            // The peer may be gone, so don't get killed by SIGPIPE.
+            const auto result = send(fd, bytes, size, MSG_NOSIGNAL);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            bytes += result;
+            size -= result;
+        }
+        return true;
+    }
+}
+
+bool Ipc_server::start(const std::string& name, Callback on_message)
+{
+    stop();
+    const auto path = get_socket_path(name);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.native().size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+    socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket < 0) {
+        return false;
+    }
+    bool is_bound = bind(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+
+    // The socket file outlives a crashed server, it's stale if nobody accepts on it.
+    if (!is_bound && errno == EADDRINUSE) {
+        if (const int fd = connect_socket(path); fd >= 0) {
+            close(fd);
+        }
+        else {
+            unlink(path.c_str());
+            is_bound = bind(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+        }
+    }
+    if (!is_bound || listen(socket, 8) || pipe2(stop_pipe.data(), O_CLOEXEC)) {
+        if (is_bound) {
+            unlink(path.c_str());
+        }
+        close(socket);
+        socket = -1;
+        return false;
+    }
+    socket_path = path;
+    thread = std::jthread(std::bind_front(&Ipc_server::run, this), std::move(on_message));
+    return true;
+}
+
+void Ipc_server::stop()
+{
+    if (thread.joinable()) {
+        thread.request_stop();
+        constexpr char wake = 1;
+        while (::write(stop_pipe[1], &wake, 1) < 0 && errno == EINTR);
+        thread.join();
+    }
+    if (socket >= 0) {
+        close(socket);
+        socket = -1;
+        unlink(socket_path.c_str());
+        socket_path.clear();
+    }
+    for (auto& fd : stop_pipe) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+}
+
+void Ipc_server::run(std::stop_token stop_token, Callback on_message)
+{
+    // Returns right away once stopped.
+    const auto back_off = [this] {
+        wait_fd(stop_pipe[0], POLLIN, -1, static_cast<int>(WIV_IPC_RETRY_DELAY.count()));
+    };
+    while (!stop_token.stop_requested()) {
+        if (!wait_fd(socket, POLLIN, stop_pipe[0], -1)) {
+            back_off();
+            continue;
+        }
+
+        // Like running out of file descriptors, the pending connection stays queued.
+        const int fd = accept4(socket, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                back_off();
+            }
+            continue;
+        }
+        uint32_t size;
+        if (read_all(fd, &size, sizeof(size), stop_pipe[0]) && size <= WIV_IPC_MESSAGE_MAX) {
+            std::string message(size, '\0');
+            if (read_all(fd, message.data(), size, stop_pipe[0])) {
+                on_message(std::move(message));
+                constexpr char ack = 1;
+                write_all(fd, &ack, 1, stop_pipe[0]);
+            }
+        }
+        close(fd);
+    }
+}
+
+bool ipc_send(const std::string& name, std::string_view message)
+{
+    if (message.size() > WIV_IPC_MESSAGE_MAX) {
+        return false;
+    }
+    const int fd = connect_socket(get_socket_path(name));
+    if (fd < 0) {
+        return false;
+    }
+    const auto size = static_cast<uint32_t>(message.size());
+    char ack;
+    const bool is_acknowledged = write_all(fd, &size, sizeof(size), -1) && write_all(fd, message.data(), size, -1) && read_all(fd, &ack, 1, -1) && ack == 1;
+    close(fd);
+    return is_acknowledged;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "pch.h"
+
+// Local channel between processes of the same user, a named pipe on Windows and a Unix domain socket elsewhere.
+// A message is a size prefixed string, the server acknowledges it once it has been handled.
+// Only one server can listen on a name, so it also tells if another instance is running.
+
+// Maximum message size in bytes.
+inline constexpr uint32_t WIV_IPC_MESSAGE_MAX = 64 * 1024;
+
+// Per connection I/O timeout, a stuck client doesn't block the server for longer.
+inline constexpr auto WIV_IPC_TIMEOUT = std::chrono::milliseconds(2000);
+
+class Ipc_server
+{
+public:
+    using Callback = std::function<void(std::string message)>;
+
+    ~Ipc_server();
+
+    // Starts listening, on_message is called on the server thread.
+    // Returns false if another server already listens on the name, or if the channel can't be created.
+    bool start(const std::string& name, Callback on_message);
+    void stop();
+
+    bool is_running() const noexcept
+    {
+        return thread.joinable();
+    }
+
+private:
+    void run(std::stop_token stop_token, Callback on_message);
+
+#ifdef _WIN32
+    std::unique_ptr<void, decltype(&CloseHandle)> pipe = { nullptr, CloseHandle };
+    std::unique_ptr<void, decltype(&CloseHandle)> stop_event = { nullptr, CloseHandle };
+#else
+    int socket = -1;
+    std::array<int, 2> stop_pipe = { -1, -1 }; // Wakes up the server thread.
+    std::filesystem::path socket_path;
+#endif
+
+    // Should be the last member, so it starts last and stops first.
+    std::jthread thread;
+};
+
+// Sends the message to the server listening on the name and waits for the acknowledgement.
+// Returns false if no server listens on the name, or if it didn't acknowledge the message in time.
+bool ipc_send(const std::string& name, std::string_view message);
@@ -8,16 +8,37 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance
 {
     g_config.read();
     g_config.read_slideshow();
-    auto window = std::make_unique<Window>(hInstance, nCmdShow);
 
     // "direct" file open.
+    std::filesystem::path path;
     if (lpCmdLine[0] != '\0') {
         int argc;
         auto argv = CommandLineToArgvW(lpCmdLine, &argc);
-        window->renderer.ui.file_manager.file_open(argv[0]);
-        ensure(PostMessageW(g_hwnd, WIV_WM_OPEN_FILE, 0, 0), != 0);
+        path = argv[0];
         LocalFree(argv);
     }
 
+    // Hand the file to the running instance, it already has the device, the UI and the caches.
+    // The path has to be absolute, that instance has its own working directory.
+    if (g_config.single_instance.val && !path.empty()) {
+        std::error_code ec;
+        auto path_absolute = std::filesystem::absolute(path, ec);
+        if (ec) {
+            path_absolute = path;
+        }
+        const auto message = path_absolute.u8string();
+        AllowSetForegroundWindow(ASFW_ANY);
+        if (ipc_send(WIV_INSTANCE_NAME, std::string(message.begin(), message.end()))) {
+            return 0;
+        }
+    }
+
+    // Starts before the window, so the file gets read and decoded while the device and the UI are created.
+    auto window = std::make_unique<Window>();
+    if (!path.empty()) {
+        window->renderer.ui.file_manager.file_open_startup(path);
+    }
+
+    window->create(hInstance, nCmdShow);
     return window->message_loop();
 }
@@ -0,0 +1,156 @@
+#include "pch.h"
+#include "mapped_file.h"
+
+#ifdef _WIN32
+
+bool Mapped_file::open(const std::filesystem::path& path)
+{
+    close();
+
+    // Sequential scan hint makes the cache manager read ahead more aggressively.
+    // Other programs may still write, rename or delete the file while we show it.
+    const auto handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    file.reset(handle);
+
+    // Empty files can't be mapped.
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file.get(), &file_size) || file_size.QuadPart == 0) {
+        close();
+        return false;
+    }
+    mapping.reset(CreateFileMappingW(file.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+    if (!mapping) {
+        close();
+        return false;
+    }
+    view.reset(MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, 0));
+    if (!view) {
+        close();
+        return false;
+    }
+    size = static_cast<size_t>(file_size.QuadPart);
+    return true;
+}
+
+void Mapped_file::close() noexcept
+{
+    view.reset();
+    mapping.reset();
+    file.reset();
+    size = 0;
+}
+
+void Mapped_file::prefetch(size_t offset, size_t length) const noexcept
+{
+    if (offset >= size) {
+        return;
+    }
+    WIN32_MEMORY_RANGE_ENTRY range = { const_cast<uint8_t*>(get_data().data()) + offset, std::min(length, size - offset) };
+
+    // Only a hint, failing is fine.
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+/* static */ bool Mapped_file::guard(void (*function)(void*), void* context) noexcept
+{
+    __try {
+        function(context);
+        return true;
+    }
+    __except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+        return false;
+    }
+}
+
+#else
+
+namespace
+{
+    // Where the guard() running on this thread resumes after a fault.
+    thread_local sigjmp_buf* guard_resume = nullptr;
+
+    struct sigaction sigbus_previous;
+
+    void on_sigbus(int /* signal */, siginfo_t* /* info */, void* /* context */)
+    {
+        if (guard_resume) {
+            siglongjmp(*guard_resume, 1);
+        }
+
+        // Not ours, the fault repeats once we return, this time with the previous action.
+        sigaction(SIGBUS, &sigbus_previous, nullptr);
+    }
+}
+
+bool Mapped_file::open(const std::filesystem::path& path)
+{
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    // Empty files can't be mapped. The mapping keeps the file referenced, so the descriptor can be closed.
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    size = static_cast<size_t>(st.st_size);
+    view = { data, { size } };
+    madvise(data, size, MADV_SEQUENTIAL);
+    return true;
+}
+
+void Mapped_file::close() noexcept
+{
+    view.reset();
+    size = 0;
+}
+
+void Mapped_file::prefetch(size_t offset, size_t length) const noexcept
+{
+    if (offset >= size) {
+        return;
+    }
+
+    // madvise needs a page aligned address.
+    const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const auto begin = offset / page_size * page_size;
+    madvise(const_cast<uint8_t*>(get_data().data()) + begin, std::min(length, size - offset) + offset - begin, MADV_WILLNEED);
+}
+
+/* static */ bool Mapped_file::guard(void (*function)(void*), void* context) noexcept
+{
+    static std::once_flag once;
+    std::call_once(once, [] {
+        struct sigaction action = {};
+        action.sa_sigaction = on_sigbus;
+
+        // SA_NODEFER, so SIGBUS isn't left blocked after the jump, the signal mask doesn't have to be saved on every call.
+        action.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGBUS, &action, &sigbus_previous);
+    });
+
+    // Guards can nest, like a guarded read inside a guarded decode.
+    sigjmp_buf resume;
+    sigjmp_buf* const previous = guard_resume;
+    if (sigsetjmp(resume, 0)) {
+        guard_resume = previous;
+        return false;
+    }
+    guard_resume = &resume;
+    function(context);
+    guard_resume = previous;
+    return true;
+}
+
+#endif
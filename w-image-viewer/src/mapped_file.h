@@ -0,0 +1,224 @@
+#pragma once
+
+#include "pch.h"
+
+// Read only memory mapped file.
+// Decoders read straight from the mapping, so there is no extra copy through buffered reads.
+// The file may get truncated or its removable media removed while it's mapped, reading the lost pages then faults
+// (SIGBUS, EXCEPTION_IN_PAGE_ERROR), so reads from the mapping should go through read() or guard().
+// Doesn't depend on the platform.
+class Mapped_file
+{
+public:
+    bool open(const std::filesystem::path& path);
+    void close() noexcept;
+
+    std::span<const uint8_t> get_data() const noexcept
+    {
+        return { static_cast<const uint8_t*>(view.get()), size };
+    }
+
+    // Starts reading the range into memory in the background.
+    void prefetch(size_t offset, size_t length) const noexcept;
+
+    // Copies up to length bytes from offset, returns how many got copied, 0 if reading the mapping faulted.
+    size_t read(size_t offset, void* data, size_t length) const noexcept
+    {
+        if (offset >= size) {
+            return 0;
+        }
+        length = std::min(length, size - offset);
+        return guard([&] { std::memcpy(data, get_data().data() + offset, length); }) ? length : 0;
+    }
+
+    // Calls function, returns false if reading a mapping faulted in it.
+    // The function gets abandoned at the fault without unwinding, so it should only read the mapping into memory it doesn't own.
+    template<typename F>
+    static bool guard(F&& function) noexcept
+    {
+        return guard([](void* context) { (*static_cast<std::remove_reference_t<F>*>(context))(); }, &function);
+    }
+    static bool guard(void (*function)(void*), void* context) noexcept;
+
+private:
+#ifdef _WIN32
+    std::unique_ptr<void, decltype(&CloseHandle)> file = { nullptr, CloseHandle };
+    std::unique_ptr<void, decltype(&CloseHandle)> mapping = { nullptr, CloseHandle };
+    std::unique_ptr<const void, decltype(&UnmapViewOfFile)> view = { nullptr, UnmapViewOfFile };
+#else
+    struct Unmap
+    {
+        void operator()(const void* data) const noexcept
+        {
+            munmap(const_cast<void*>(data), size);
+        }
+        size_t size;
+    };
+    std::unique_ptr<const void, Unmap> view;
+#endif
+    size_t size = 0;
+};
+
+// Lets OIIO decoders read the mapped file, reads that fault fail like reads past the end.
+// Keeps the mapped data rather than the file, so it still reads the mapping after the file gets moved.
+class Mapped_file_reader : public OIIO::Filesystem::IOProxy
+{
+public:
+    explicit Mapped_file_reader(const Mapped_file& file) noexcept :
+        IOProxy("", Read),
+        data(file.get_data())
+    {}
+
+    const char* proxytype() const override
+    {
+        return "mapped file";
+    }
+
+    bool seek(int64_t offset) override
+    {
+        m_pos = offset;
+        return true;
+    }
+
+    size_t read(void* buf, size_t size) override
+    {
+        size = pread(buf, size, m_pos);
+        m_pos += size;
+        return size;
+    }
+
+    size_t pread(void* buf, size_t size, int64_t offset) override
+    {
+        if (offset < 0 || static_cast<size_t>(offset) >= data.size()) {
+            return 0;
+        }
+        size = std::min(size, data.size() - static_cast<size_t>(offset));
+        return Mapped_file::guard([&] { std::memcpy(buf, data.data() + offset, size); }) ? size : 0;
+    }
+
+    size_t size() const override
+    {
+        return data.size();
+    }
+private:
+    std::span<const uint8_t> data;
+};
+
+// Lets LibRaw read the mapped file, reads that fault fail like reads past the end.
+// Only the copies out of the mapping are guarded, so LibRaw fails a faulting read like an I/O error,
+// also on its OpenMP threads, instead of getting abandoned in the middle of a call.
+class Mapped_file_raw_stream : public LibRaw_abstract_datastream
+{
+public:
+    explicit Mapped_file_raw_stream(const Mapped_file& file) noexcept :
+        data(file.get_data())
+    {}
+
+    int valid() override
+    {
+        return 1;
+    }
+
+    int read(void* ptr, size_t size, size_t nmemb) override
+    {
+        if (size == 0 || pos >= data.size()) {
+            return 0;
+        }
+        const auto length = std::min(size * nmemb, data.size() - pos);
+        if (!Mapped_file::guard([&] { std::memcpy(ptr, data.data() + pos, length); })) {
+            return 0;
+        }
+        pos += length;
+        return static_cast<int>((length + size - 1) / size);
+    }
+
+    int seek(INT64 offset, int whence) override
+    {
+        switch (whence) {
+            case SEEK_CUR:
+                offset += static_cast<INT64>(pos);
+                break;
+            case SEEK_END:
+                offset += static_cast<INT64>(data.size());
+        }
+        pos = static_cast<size_t>(std::clamp<INT64>(offset, 0, static_cast<INT64>(data.size())));
+        return 0;
+    }
+
+    INT64 tell() override
+    {
+        return static_cast<INT64>(pos);
+    }
+
+    INT64 size() override
+    {
+        return static_cast<INT64>(data.size());
+    }
+
+    int get_char() override
+    {
+        unsigned char c;
+        return read(&c, 1, 1) ? c : -1;
+    }
+
+    // Reads up to a newline, like fgets().
+    char* gets(char* str, int size) override
+    {
+        if (size < 1 || pos >= data.size()) {
+            return nullptr;
+        }
+        int i = 0;
+        while (i < size - 1) {
+            const int c = get_char();
+            if (c == -1) {
+                break;
+            }
+            str[i++] = static_cast<char>(c);
+            if (c == '\n') {
+                break;
+            }
+        }
+        str[i] = 0;
+        return str;
+    }
+
+    // Scans a single value from a copy, sscanf() never reads the mapping.
+    int scanf_one(const char* format, void* val) override
+    {
+        std::array<char, 64> token = {};
+        const auto length = std::min(token.size() - 1, data.size() - std::min(pos, data.size()));
+        if (!length || !Mapped_file::guard([&] { std::memcpy(token.data(), data.data() + pos, length); })) {
+            return 0;
+        }
+        const int result = std::sscanf(token.data(), format, val);
+
+        // Skips the scanned token like LibRaw_buffer_datastream does.
+        if (result > 0) {
+            size_t i = 0;
+            while (i < length && (token[i] == ' ' || token[i] == '\t' || token[i] == '\n')) {
+                ++i;
+            }
+            while (i < length && token[i] && token[i] != ' ' && token[i] != '\t' && token[i] != '\n') {
+                ++i;
+            }
+            pos += i;
+        }
+        return result;
+    }
+
+    int eof() override
+    {
+        return pos >= data.size();
+    }
+
+#if LIBRAW_VERSION < LIBRAW_MAKE_VERSION(0, 21, 0) || defined(LIBRAW_OLD_VIDEO_SUPPORT)
+    // Only used for the old RED and Cine video formats, which we don't open.
+    void* make_jas_stream() override
+    {
+        return nullptr;
+    }
+#endif
+private:
+    std::span<const uint8_t> data;
+    size_t pos = 0;
+};
@@ -0,0 +1,199 @@
+#include "pch.h"
+#include "metadata_cache.h"
+#include "image.h"
+#include "include/helpers.h"
+#include "include/supported_extensions.h"
+
+namespace
+{
+    constexpr std::array<char, 4> WIV_METADATA_MAGIC = { 'W', 'I', 'V', 'M' };
+    constexpr uint32_t WIV_METADATA_VERSION = 3;
+
+    // Records of files not seen for this long are dropped, like the ones of deleted files.
+    constexpr int64_t WIV_METADATA_MAX_AGE = 90 * 24 * 60 * 60; // In seconds.
+
+    // Then the least recently used ones over this count.
+    constexpr size_t WIV_METADATA_MAX_RECORDS = 1 << 20;
+
+    // Mapped records get their last use updated only once this old, so lookups don't copy every record.
+    constexpr int64_t WIV_METADATA_TOUCH_INTERVAL = 24 * 60 * 60; // In seconds.
+
+    int64_t get_now() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+}
+
+Metadata_cache::~Metadata_cache()
+{
+    close();
+}
+
+void Metadata_cache::open(const std::filesystem::path& path)
+{
+    close();
+    this->path = path;
+    probe_thread = std::jthread(std::bind_front(&Metadata_cache::run, this));
+    if (!file.open(path)) {
+        return;
+    }
+
+    // Ignore the file if it's not ours or if it's truncated.
+    const auto data = file.get_data();
+    if (data.size() < sizeof(Header)) {
+        return;
+    }
+    const auto header = reinterpret_cast<const Header*>(data.data());
+    if (header->magic != WIV_METADATA_MAGIC || header->version != WIV_METADATA_VERSION || header->count > (data.size() - sizeof(Header)) / sizeof(Record)) {
+        return;
+    }
+    records = { reinterpret_cast<const Record*>(header + 1), static_cast<size_t>(header->count) };
+}
+
+void Metadata_cache::close()
+{
+    if (!is_open()) {
+        return;
+    }
+    probe_thread = {};
+    save();
+    records = {};
+    file.close();
+    records_new.clear();
+    probed_directories.clear();
+    probe_pending.clear();
+    path.clear();
+}
+
+std::optional<Image_metadata> Metadata_cache::get(const std::filesystem::directory_entry& entry)
+{
+    const auto key = get_key(entry);
+    std::scoped_lock lock(mutex);
+    if (const auto it = records_new.find(key.path_hash); it != records_new.end()) {
+        if (it->second.key == key) {
+            return it->second.metadata;
+        }
+        return std::nullopt;
+    }
+    const auto it = std::ranges::lower_bound(records, key.path_hash, {}, [](const Record& record) { return record.key.path_hash; });
+    if (it != records.end() && it->key == key) {
+        if (const auto now = get_now(); now - it->last_used > WIV_METADATA_TOUCH_INTERVAL) {
+            records_new.emplace(key.path_hash, Record{ key, now, it->metadata });
+        }
+        return it->metadata;
+    }
+    return std::nullopt;
+}
+
+void Metadata_cache::put(const std::filesystem::directory_entry& entry, const Image_metadata& metadata)
+{
+    const auto key = get_key(entry);
+    std::scoped_lock lock(mutex);
+    records_new.insert_or_assign(key.path_hash, Record{ key, get_now(), metadata });
+}
+
+void Metadata_cache::probe_directory(const std::filesystem::path& directory)
+{
+    {
+        std::scoped_lock lock(mutex);
+        if (!is_open() || std::ranges::find(probed_directories, directory) != probed_directories.end()) {
+            return;
+        }
+        probed_directories.push_back(directory);
+        probe_pending = directory;
+    }
+    cv.notify_one();
+}
+
+/* static */ Image_metadata Metadata_cache::probe(const std::filesystem::path& path)
+{
+    Image image;
+    if (!image.open(path, false, false, false)) {
+        return {};
+    }
+    return { image.get_width<int>(), image.get_height<int>(), static_cast<uint8_t>(image.get_nchannels()), image.get_basetype(), static_cast<uint8_t>(image.orientation), true, image.get_icc_hash() };
+}
+
+void Metadata_cache::run(std::stop_token stop_token)
+{
+    while (true) {
+        std::filesystem::path directory;
+        {
+            std::unique_lock lock(mutex);
+            if (!cv.wait(lock, stop_token, [this] { return !probe_pending.empty(); })) {
+                return;
+            }
+            directory = std::move(probe_pending);
+            probe_pending.clear();
+        }
+
+        // Serially, so probing doesn't compete with the decode of the shown image.
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+            if (stop_token.stop_requested()) {
+                return;
+            }
+
+            // Interrupted by another directory, this one gets probed again once requested again.
+            bool is_interrupted;
+            {
+                std::scoped_lock lock(mutex);
+                is_interrupted = !probe_pending.empty();
+                if (is_interrupted) {
+                    std::erase(probed_directories, directory);
+                }
+            }
+            if (is_interrupted) {
+                break;
+            }
+            if (!entry.is_directory(ec) && path_match_spec(entry.path(), WIV_SUPPORTED_EXTENSIONS) && !get(entry)) {
+                put(entry, probe(entry.path()));
+            }
+        }
+    }
+}
+
+/* static */ Metadata_cache::Key Metadata_cache::get_key(const std::filesystem::directory_entry& entry)
+{
+    // On Windows directory_iterator already fills size and last write time, so these should not hit the disk.
+    std::error_code ec;
+    Key key;
+    key.path_hash = std::filesystem::hash_value(entry.path());
+    key.size = entry.file_size(ec);
+    key.last_write_time = entry.last_write_time(ec).time_since_epoch().count();
+    return key;
+}
+
+void Metadata_cache::save()
+{
+    if (records_new.empty()) {
+        return;
+    }
+
+    // Merge new records into mapped ones, new records replace the old ones.
+    const auto now = get_now();
+    std::vector<Record> records_all;
+    records_all.reserve(records.size() + records_new.size());
+    for (const auto& record : records) {
+        if (!records_new.contains(record.key.path_hash) && now - record.last_used <= WIV_METADATA_MAX_AGE) {
+            records_all.push_back(record);
+        }
+    }
+    for (const auto& [path_hash, record] : records_new) {
+        records_all.push_back(record);
+    }
+    if (records_all.size() > WIV_METADATA_MAX_RECORDS) {
+        std::ranges::nth_element(records_all, records_all.begin() + WIV_METADATA_MAX_RECORDS, std::ranges::greater(), &Record::last_used);
+        records_all.resize(WIV_METADATA_MAX_RECORDS);
+    }
+    std::ranges::sort(records_all, {}, [](const Record& record) { return record.key.path_hash; });
+
+    // We have to unmap the file before we can overwrite it.
+    records = {};
+    file.close();
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    const Header header = { WIV_METADATA_MAGIC, WIV_METADATA_VERSION, records_all.size() };
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(records_all.data()), records_all.size() * sizeof(Record));
+}
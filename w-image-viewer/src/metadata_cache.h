@@ -0,0 +1,87 @@
+#pragma once
+
+#include "pch.h"
+#include "mapped_file.h"
+
+struct Image_metadata
+{
+    int width;
+    int height;
+    uint8_t nchannels;
+    uint8_t basetype; // OIIO::TypeDesc::BASETYPE
+    uint8_t orientation; // LibRaw flip, 0 for other images.
+    bool is_valid; // False if the file can't be opened, other members are then 0.
+    uint32_t icc_hash; // 0 if there is no embedded ICC profile.
+};
+
+// Persistent image metadata cache keyed by (path, size, last write time).
+// The file is a header followed by fixed size records sorted by the path hash, it gets memory mapped on open.
+// New entries are kept in memory and merged into the file on close,
+// records not used for a long time get dropped then, and so do the least recently used ones over the record limit.
+// get() and put() are thread safe.
+// Doesn't depend on the platform.
+class Metadata_cache
+{
+public:
+    ~Metadata_cache();
+
+    // Maps the file if there is one, otherwise it gets created on close.
+    void open(const std::filesystem::path& path);
+
+    // Stops probing and writes the new records.
+    void close();
+
+    bool is_open() const noexcept
+    {
+        return !path.empty();
+    }
+
+    // Returns std::nullopt if the file isn't cached or if it changed since.
+    std::optional<Image_metadata> get(const std::filesystem::directory_entry& entry);
+    void put(const std::filesystem::directory_entry& entry, const Image_metadata& metadata);
+
+    // Probes the supported files in the directory that are not cached yet, one by one on a background thread.
+    // Every directory gets probed once while the cache is open, a newly requested directory interrupts the one being probed.
+    void probe_directory(const std::filesystem::path& directory);
+
+    // Opens the image like Image::open() does, without reading ahead.
+    static Image_metadata probe(const std::filesystem::path& path);
+private:
+    struct Key
+    {
+        bool operator==(const Key&) const = default;
+        uint64_t path_hash;
+        uint64_t size;
+        int64_t last_write_time;
+    };
+
+    struct Record
+    {
+        Key key;
+        int64_t last_used; // Seconds since epoch.
+        Image_metadata metadata;
+    };
+
+    struct Header
+    {
+        std::array<char, 4> magic;
+        uint32_t version;
+        uint64_t count;
+    };
+
+    static Key get_key(const std::filesystem::directory_entry& entry);
+    void run(std::stop_token stop_token);
+    void save();
+
+    std::filesystem::path path;
+    Mapped_file file;
+    std::span<const Record> records; // Mapped records.
+    std::unordered_map<uint64_t, Record> records_new; // By the path hash.
+    std::mutex mutex;
+    std::condition_variable_any cv;
+    std::vector<std::filesystem::path> probed_directories;
+    std::filesystem::path probe_pending;
+
+    // Should be the last member, so it stops first.
+    std::jthread probe_thread;
+};
@@ -0,0 +1,116 @@
+#include "pch.h"
+#include "include/metrics.h"
+
+namespace
+{
+    // Constant initialized, so metrics can register themselves during static initialization.
+    constinit std::atomic<const Metric*> metrics_head = nullptr;
+    constinit std::atomic_int metrics_count = 0;
+}
+
+Metric::Metric(const char* name, Metric_kind kind) noexcept :
+    name(name),
+    kind(kind),
+    index(metrics_count.fetch_add(1)),
+    next(metrics_head.load())
+{
+    while (!metrics_head.compare_exchange_weak(next, this));
+}
+
+void Metric_histogram::record(double sample) noexcept
+{
+    int bucket = 0;
+    if (sample > WIV_METRICS_HISTOGRAM_MIN) {
+        bucket = std::min(static_cast<int>(std::ceil(std::log2(sample / WIV_METRICS_HISTOGRAM_MIN))), WIV_METRICS_HISTOGRAM_BUCKETS - 1);
+    }
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(sample, std::memory_order_relaxed);
+}
+
+double Metric_value::get_percentile(double p) const noexcept
+{
+    const auto target = static_cast<uint64_t>(std::ceil(p * count));
+    uint64_t total = 0;
+    for (int i = 0; i < WIV_METRICS_HISTOGRAM_BUCKETS; ++i) {
+        total += buckets[i];
+        if (total >= target && total > 0) {
+            return WIV_METRICS_HISTOGRAM_MIN * std::exp2(i);
+        }
+    }
+    return 0.0;
+}
+
+Metrics_snapshot Metrics::snapshot()
+{
+    Metrics_snapshot snapshot;
+    snapshot.time = std::chrono::system_clock::now();
+    snapshot.values.resize(metrics_count.load());
+    for (auto metric = metrics_head.load(); metric; metric = metric->next) {
+        auto& value = snapshot.values[metric->index];
+        value.name = metric->name;
+        value.kind = metric->kind;
+        switch (metric->kind) {
+            case Metric_kind::gauge:
+                value.value = static_cast<const Metric_gauge*>(metric)->get();
+                break;
+            case Metric_kind::counter:
+                value.value = static_cast<double>(static_cast<const Metric_counter*>(metric)->get());
+                break;
+            case Metric_kind::histogram:
+                const auto histogram = static_cast<const Metric_histogram*>(metric);
+                value.value = histogram->sum.load(std::memory_order_relaxed);
+                for (int i = 0; i < WIV_METRICS_HISTOGRAM_BUCKETS; ++i) {
+                    value.buckets[i] = histogram->buckets[i].load(std::memory_order_relaxed);
+                    value.count += value.buckets[i];
+                }
+        }
+    }
+    return snapshot;
+}
+
+void Metrics::write_json(std::ostream& os, const Metrics_snapshot& snapshot)
+{
+    os << "{\"time\":" << std::chrono::duration_cast<std::chrono::milliseconds>(snapshot.time.time_since_epoch()).count();
+    for (const auto& value : snapshot.values) {
+        os << ",\"" << value.name << "\":";
+        if (value.kind != Metric_kind::histogram) {
+            os << value.value;
+            continue;
+        }
+        os << "{\"count\":" << value.count << ",\"sum\":" << value.value;
+        os << ",\"p50\":" << value.get_percentile(0.5) << ",\"p99\":" << value.get_percentile(0.99) << ",\"buckets\":[";
+        for (int i = 0; i < WIV_METRICS_HISTOGRAM_BUCKETS; ++i) {
+            os << (i ? "," : "") << value.buckets[i];
+        }
+        os << "]}";
+    }
+    os << "}\n";
+}
+
+Metrics_dumper::~Metrics_dumper()
+{
+    stop();
+}
+
+void Metrics_dumper::start(const std::filesystem::path& path, std::chrono::seconds interval)
+{
+    stop();
+    thread = std::jthread([path, interval](std::stop_token stop_token) {
+        std::mutex mutex;
+        std::condition_variable_any cv;
+        std::unique_lock lock(mutex);
+        while (!cv.wait_for(lock, stop_token, interval, [&stop_token] { return stop_token.stop_requested(); })) {
+            if (auto file = std::ofstream(path, std::ios::app)) {
+                Metrics::write_json(file, Metrics::snapshot());
+            }
+        }
+    });
+}
+
+void Metrics_dumper::stop()
+{
+    if (thread.joinable()) {
+        thread.request_stop();
+        thread.join();
+    }
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+// Only the viewer itself needs windows, directx and imgui.
+// The portable core (image decoding, icc, config, bench) also builds without them, see bench/CMakeLists.txt.
+#ifdef _WIN32
+
 // windows
 #include "resources/targetver.h"
 #define NOMINMAX
@@ -21,9 +25,33 @@
 #include <imgui_impl_dx11.h>
 #include <imgui_impl_win32.h>
 
+#else
+
+// posix
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/file.h>
+#include <signal.h>
+#include <setjmp.h>
+
+// imgui, only for the font atlas cache, if the bench found it.
+#ifdef WIV_IMGUI
+#define IMGUI_USER_CONFIG "include/wiv_imconfig.h"
+#include <imgui.h>
+#endif
+
+#endif
+
 // oiio
 #define OIIO_STATIC_DEFINE
 #include <OpenImageIO/imageio.h>
+#include <OpenImageIO/imagecache.h>
+#include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/filesystem.h>
 
 // libraw
@@ -32,13 +60,23 @@
 // lcms
 #include <lcms2.h>
 
+#ifdef _WIN32
 #include "include\ComPtr.h"
+#endif
 
 // std
 #include <filesystem>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cwctype>
 #include <unordered_map>
+#include <list>
+#include <deque>
+#include <map>
 #include <string>
 #include <fstream>
+#include <sstream>
 #include <memory>
 #include <array>
 #include <vector>
@@ -46,3 +84,15 @@
 #include <numbers>
 #include <utility>
 #include <ranges>
+#include <bit>
+#include <chrono>
+#include <optional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stop_token>
+#include <functional>
+#include <span>
+#include <execution>
+#include <atomic>
+#include <numeric>
@@ -0,0 +1,135 @@
+#include "pch.h"
+#include "quality_governor.h"
+#include "include/helpers.h"
+#include "include/shader_config.h"
+
+namespace
+{
+    // Interims don't need a wider kernel than this.
+    constexpr float WIV_INTERIM_MAX_KERNEL_SUPPORT = 2.0f;
+}
+
+float get_kernel_support(const Config_scale& profile) noexcept
+{
+    switch (profile.kernel_index.val) {
+        case WIV_KERNEL_FUNCTION_NEAREST:
+            if (profile.kernel_cylindrical_use.val) {
+                return std::numbers::sqrt2_v<float> / 2.0f;
+            }
+            return 1.0f / 2.0f;
+        case WIV_KERNEL_FUNCTION_LINEAR:
+            if (profile.kernel_cylindrical_use.val) {
+                return std::numbers::sqrt2_v<float>;
+            }
+            return 1.0f;
+        case WIV_KERNEL_FUNCTION_BICUBIC:
+        case WIV_KERNEL_FUNCTION_BCSPLINE:
+            return 2.0f;
+        case WIV_KERNEL_FUNCTION_FSR:
+            if (profile.kernel_cylindrical_use.val) {
+                return 2.233131f; // Second Jinc zero.
+            }
+            return 2.0f;
+        default:
+            return profile.kernel_support.val;
+    }
+}
+
+double get_render_work(const Config_scale& profile, const Render_view& view) noexcept
+{
+    const double input = static_cast<double>(view.input.width) * view.input.height;
+    const double output = static_cast<double>(view.output.width) * view.output.height;
+    double work = 0.0;
+    if (!is_equal(view.scale, 1.0f)) {
+        const bool sigmoidize = view.scale > 1.0f && profile.sigmoid_use.val;
+        bool linearize = view.scale < 1.0f || sigmoidize || profile.blur_use.val;
+        if (linearize) {
+            work += input;
+        }
+        if (sigmoidize) {
+            work += input;
+        }
+
+        // Separable, both axes at the input dims.
+        if (view.scale < 1.0f && profile.blur_use.val) {
+            work += input * (2 * profile.blur_radius.val + 1) * 2;
+        }
+
+        // The same radius as the resample shaders, they take 2 * radius taps per axis.
+        const double taps = 2.0 * std::ceil(get_kernel_support(profile) / std::min(view.scale, 1.0f));
+        if (profile.kernel_cylindrical_use.val) {
+            work += output * taps * taps;
+        }
+        else {
+            work += static_cast<double>(view.input.width) * view.output.height * taps + output * taps;
+        }
+        if (sigmoidize) {
+            work += output;
+        }
+        if (profile.unsharp_use.val) {
+            if (!linearize) {
+                work += output;
+                linearize = true;
+            }
+            work += output * (2 * profile.unsharp_radius.val + 1) * 2;
+        }
+        if (linearize) {
+            work += output;
+        }
+    }
+    if (view.cms) {
+        work += output;
+    }
+    return work;
+}
+
+void Quality_governor::record(double work, double ms) noexcept
+{
+    if (work <= 0.0 || ms <= 0.0) {
+        return;
+    }
+    const double sample = ms / work;
+    ms_per_tap = is_measured ? ms_per_tap + (sample - ms_per_tap) * WIV_QUALITY_GOVERNOR_SMOOTHING : sample;
+    is_measured = true;
+}
+
+std::optional<double> Quality_governor::predict(double work) const noexcept
+{
+    if (!is_measured) {
+        return std::nullopt;
+    }
+    return work * ms_per_tap;
+}
+
+const Config_scale& Quality_governor::choose(const Config_scale& configured, const Render_view& view, double budget_ms)
+{
+    const double configured_work = get_render_work(configured, view);
+    const auto predicted = predict(configured_work);
+    if (!predicted || *predicted <= budget_ms) {
+        return configured;
+    }
+
+    // The same kernel, orthogonal.
+    interims[0] = configured;
+    interims[0].kernel_cylindrical_use.val = false;
+
+    // Also narrower and without the extra passes.
+    interims[1] = interims[0];
+    interims[1].kernel_support.val = std::min(interims[1].kernel_support.val, WIV_INTERIM_MAX_KERNEL_SUPPORT);
+    interims[1].sigmoid_use.val = false;
+    interims[1].blur_use.val = false;
+    interims[1].unsharp_use.val = false;
+
+    // Linear.
+    interims[2] = interims[1];
+    interims[2].kernel_index.val = WIV_KERNEL_FUNCTION_LINEAR;
+
+    for (const auto& interim : interims) {
+        if (*predict(get_render_work(interim, view)) <= budget_ms) {
+            return interim;
+        }
+    }
+
+    // An interim that isn't cheaper would only delay the configured render.
+    return get_render_work(interims.back(), view) < configured_work ? interims.back() : configured;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "pch.h"
+#include "config.h"
+#include "include/dims.h"
+
+// Weight of the newest measurement in the cost per tap.
+inline constexpr double WIV_QUALITY_GOVERNOR_SMOOTHING = 0.25;
+
+// What the cost of the passes depends on, besides the scale profile.
+struct Render_view
+{
+    Dims<int> input; // Dims of the source texture.
+    Dims<int> output;
+    float scale;
+    bool cms; // The cms pass runs.
+};
+
+// Support of the kernel the resample passes use.
+float get_kernel_support(const Config_scale& profile) noexcept;
+
+// Texture samples (taps) the passes take to render the view with the profile, the same pass chain as the renderer.
+double get_render_work(const Config_scale& profile, const Render_view& view) noexcept;
+
+// Picks a cheaper interim profile when the configured one is predicted to miss the render time budget.
+// The cost is predicted from the taps of the passes and the measured GPU time per tap of the recent renders.
+// Until something was measured it always picks the configured profile.
+// Doesn't depend on the platform.
+class Quality_governor
+{
+public:
+    // GPU time of rendering the work.
+    void record(double work, double ms) noexcept;
+
+    // Predicted GPU time in ms, nullopt if nothing was measured yet.
+    std::optional<double> predict(double work) const noexcept;
+
+    // Returns the configured profile if it's predicted to meet the budget, otherwise the best interim profile that does,
+    // or the cheapest one if none does. Interims are valid until the next call.
+    const Config_scale& choose(const Config_scale& configured, const Render_view& view, double budget_ms);
+private:
+    double ms_per_tap;
+    bool is_measured = false;
+
+    // From the best to the cheapest.
+    std::array<Config_scale, 3> interims;
+};
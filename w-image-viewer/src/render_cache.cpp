@@ -0,0 +1,55 @@
+#include "pch.h"
+#include "render_cache.h"
+
+namespace
+{
+    // FNV-1a.
+    constexpr uint64_t WIV_FNV_OFFSET = 14695981039346656037ull;
+    constexpr uint64_t WIV_FNV_PRIME = 1099511628211ull;
+
+    template<typename T>
+    void hash_append(uint64_t& hash, const T& val) noexcept
+    {
+        const auto bytes = std::bit_cast<std::array<uint8_t, sizeof(T)>>(val);
+        for (const auto byte : bytes) {
+            hash = (hash ^ byte) * WIV_FNV_PRIME;
+        }
+    }
+}
+
+size_t Render_key_hash::operator()(const Render_key& key) const noexcept
+{
+    uint64_t hash = WIV_FNV_OFFSET;
+    hash_append(hash, key.image_id);
+    hash_append(hash, key.width);
+    hash_append(hash, key.height);
+    hash_append(hash, key.scale);
+    hash_append(hash, key.rotation);
+    hash_append(hash, key.scale_profile_hash);
+    hash_append(hash, key.cms);
+    hash_append(hash, key.cms_dither);
+    return static_cast<size_t>(hash);
+}
+
+uint64_t get_scale_profile_hash(const Config_scale& config) noexcept
+{
+    uint64_t hash = WIV_FNV_OFFSET;
+    hash_append(hash, config.blur_use.val);
+    hash_append(hash, config.blur_radius.val);
+    hash_append(hash, config.blur_sigma.val);
+    hash_append(hash, config.sigmoid_use.val);
+    hash_append(hash, config.sigmoid_contrast.val);
+    hash_append(hash, config.sigmoid_midpoint.val);
+    hash_append(hash, config.kernel_index.val);
+    hash_append(hash, config.kernel_support.val);
+    hash_append(hash, config.kernel_blur.val);
+    hash_append(hash, config.kernel_parameter1.val);
+    hash_append(hash, config.kernel_parameter2.val);
+    hash_append(hash, config.kernel_antiringing.val);
+    hash_append(hash, config.kernel_cylindrical_use.val);
+    hash_append(hash, config.unsharp_use.val);
+    hash_append(hash, config.unsharp_radius.val);
+    hash_append(hash, config.unsharp_sigma.val);
+    hash_append(hash, config.unsharp_amount.val);
+    return hash;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "pch.h"
+#include "config.h"
+#include "include/lru_cache.h"
+
+// Everything the output of the render passes depends on, pan and the final pass are not included.
+struct Render_key
+{
+    bool operator==(const Render_key&) const = default;
+    uint64_t image_id; // Changes whenever the source texture gets new content.
+    int width; // Output dims.
+    int height;
+    float scale;
+    int rotation;
+    uint64_t scale_profile_hash;
+    int cms; // Which CMS pass runs, 0 if none.
+    bool cms_dither;
+};
+
+struct Render_key_hash
+{
+    size_t operator()(const Render_key& key) const noexcept;
+};
+
+// Hash of the scale profile values the passes use, so editing the profile misses the cache.
+uint64_t get_scale_profile_hash(const Config_scale& config) noexcept;
+
+// Outputs of recently rendered views, so going back to a view (like zoom to fit after a zoom) doesn't run the passes again.
+// Value is the output the renderer keeps, its cost is the size of a 16 bit 4 channel texture of the output dims.
+// Doesn't depend on the platform.
+template<typename Value>
+class Render_cache
+{
+public:
+    // In bytes, 0 disables the cache.
+    void set_budget(size_t val)
+    {
+        budget = val;
+        if (!budget) {
+            cache.clear();
+        }
+        cache.set_budget(budget);
+    }
+
+    // Returns nullptr if the view is not cached.
+    const Value* get(const Render_key& key)
+    {
+        return cache.get(key);
+    }
+
+    // Outputs larger than the budget are not cached.
+    void put(const Render_key& key, Value value)
+    {
+        const auto cost = get_cost(key);
+        if (cost <= budget) {
+            cache.put(key, std::move(value), cost);
+        }
+    }
+
+    // Outputs of other images can't be hit anymore.
+    void clear() noexcept
+    {
+        cache.clear();
+    }
+
+    size_t get_cost() const noexcept
+    {
+        return cache.get_cost();
+    }
+
+    size_t size() const noexcept
+    {
+        return cache.size();
+    }
+
+    static size_t get_cost(const Render_key& key) noexcept
+    {
+        return static_cast<size_t>(key.width) * key.height * 4 * sizeof(uint16_t);
+    }
+
+private:
+    Lru_cache<Render_key, Value, Render_key_hash> cache;
+    size_t budget = 0;
+};
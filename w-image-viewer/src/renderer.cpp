@@ -4,9 +4,11 @@
 #include "include\helpers.h"
 #include "include\shader_config.h"
 #include "icc.h"
-#include "include\cms_lut.h"
-#include "include\info.h"
+#include "include\metrics.h"
 #include "include\ensure.h"
+#include "include\bench.h"
+#include "include\profiler.h"
+#include "window.h"
 
 // Compiled shaders.
 #include "..\ps_sample_hlsl.h"
@@ -19,6 +21,7 @@
 #include "..\ps_linearize_hlsl.h"
 #include "..\ps_delinearize_hlsl.h"
 #include "..\ps_cms_hlsl.h"
+#include "..\ps_cms_matrix_hlsl.h"
 
 // Use for constant buffer data.
 struct Cb_data
@@ -41,6 +44,25 @@ namespace
 	// Max texture size will be determined by D3D_FEATURE_LEVEL_, but D3D11 and D3D12 _REQ_TEXTURE2D_U_OR_V_DIMENSION should be the same.
 	template<typename T>
 	constexpr T WIV_MAX_TEX_UV = D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION;
+
+	// Tiled images only.
+	// Max scale is limited so the rendered region always fits in a texture.
+	constexpr float WIV_TILED_MAX_SCALE = 128.0f;
+
+	// RGBA texture format of the decoded or composed data.
+	DXGI_FORMAT get_texture_format(OIIO::TypeDesc::BASETYPE format) noexcept
+	{
+		switch (format) {
+			case OIIO::TypeDesc::UINT8:
+				return DXGI_FORMAT_R8G8B8A8_UNORM;
+			case OIIO::TypeDesc::HALF:
+				return DXGI_FORMAT_R16G16B16A16_FLOAT;
+			case OIIO::TypeDesc::FLOAT:
+				return DXGI_FORMAT_R32G32B32A32_FLOAT;
+			default:
+				return DXGI_FORMAT_R16G16B16A16_UNORM;
+		}
+	}
 }
 
 void Renderer::init()
@@ -50,6 +72,8 @@ void Renderer::init()
 	create_rtv_back_buffer();
 	create_samplers();
 	create_vertex_shader();
+	gpu_profiler.set_clock(std::make_unique<Gpu_clock_d3d11>(device.get(), ctx.get()));
+	gpu_profiler.set_frame_callback([this](double work, double ms) { quality_governor.record(work, ms); });
 	if (g_config.cms_use.val) {
 		init_cms_profile_display();
 	}
@@ -58,57 +82,87 @@ void Renderer::init()
 
 void Renderer::update()
 {
-	if (srv_image && should_update) {
+	if ((srv_image || is_tiled) && should_update) {
 		update_scale_and_dims_output();
-		update_scale_profile();
-		if (!(ui.is_panning || ui.is_zooming || ui.is_rotating)) {
-			srv_pass = srv_image;
-			if (!is_equal(scale, 1.0f)) {
-				const bool sigmoidize = scale > 1.0f && p_scale_profile->sigmoid_use.val;
-				bool linearize = scale < 1.0f || sigmoidize || p_scale_profile->blur_use.val;
-				if (linearize) {
-					pass_linearize(image.get_width<UINT>(), image.get_height<UINT>());
-				}
-				if (sigmoidize) {
-					pass_sigmoidize();
-				}
-				if (scale < 1.0f && p_scale_profile->blur_use.val) {
-					pass_blur();
-				}
-				if (p_scale_profile->kernel_cylindrical_use.val) {
-					pass_cylindrical_resample();
+
+		// RAW draft is no longer enough once zoomed in past it.
+		if (scale > 1.0f && !is_preview && !is_raw_full_requested && image.is_raw_draft()) {
+			is_raw_full_requested = true;
+			ui.file_manager.develop_raw_full();
+		}
+		bool is_region_changed = false;
+		if (is_tiled) {
+			is_region_changed = update_tiled_region();
+		}
+
+		// The tiles of the first region couldn't be read, there is nothing to show.
+		if (is_tiled && tile_region.level < 0) {
+			reset_resources();
+			should_update = false;
+		}
+		else {
+			if (is_tiled) {
+				update_tiled_placement();
+			}
+
+			// Preview is smaller than the image, so make scale relative to it.
+			else if (is_preview) {
+				scale *= dims_source.get_width<float>() / dims_image.get_width<float>();
+			}
+			update_scale_profile();
+			if (!(ui.is_panning || ui.is_zooming || ui.is_rotating) || is_region_changed) {
+				render_cache.set_budget(static_cast<size_t>(std::max(g_config.render_cache_size.val, 0)) * 1024 * 1024);
+				const auto render_key = get_render_key();
+				if (const auto cached = render_cache.get(render_key)) {
+					srv_pass = *cached;
+					Metrics::render_cache_hits.add();
 				}
 				else {
-					pass_orthogonal_resample();
-				}
-				if (sigmoidize) {
-					pass_desigmoidize();
-				}
-				if (p_scale_profile->unsharp_use.val) {
-					if (!linearize) {
-						pass_linearize(dims_output.get_width<UINT>(), dims_output.get_height<UINT>());
-						linearize = true;
+					// A cheaper interim profile first if the configured one is predicted to take too long,
+					// unless this is the configured render that follows the interim of the same view.
+					const auto p_configured = p_scale_profile;
+					if (g_config.render_time_budget.val > 0.0f && interim_key != render_key) {
+						p_scale_profile = &quality_governor.choose(*p_configured, get_render_view(), g_config.render_time_budget.val);
+					}
+					render_passes();
+					if (p_scale_profile != p_configured) {
+						p_scale_profile = p_configured;
+						interim_key = render_key;
+						Metrics::interim_renders.add();
+					}
+					else {
+						interim_key.reset();
+
+						// Without any pass the output is the image itself.
+						if (srv_pass != srv_image) {
+							render_cache.put(render_key, srv_pass);
+						}
 					}
-					pass_unsharp();
-				}
-				if (linearize) {
-					pass_delinearize(dims_output.get_width<UINT>(), dims_output.get_height<UINT>());
 				}
 			}
-			if (g_config.cms_use.val && is_cms_valid) {
-				pass_cms();
+			update_final_pass();
+			if (ui.is_zooming) {
+				should_update = true;
+			}
+			else {
+				should_update = false;
+			}
+			ui.is_panning = false;
+			ui.is_zooming = false;
+			ui.is_rotating = false;
+
+			// The interim is shown, render the configured profile on the next frame.
+			if (interim_key) {
+				should_update = true;
+				ui.frame_scheduler.schedule(Frame_scheduler::Clock::now());
 			}
 		}
-		update_final_pass();
-		if (ui.is_zooming) {
-			should_update = true;
-		}
-		else {
-			should_update = false;
-		}
-		ui.is_panning = false;
-		ui.is_zooming = false;
-		ui.is_rotating = false;
+	}
+
+	// Timings of the passes are read back a few frames later, so keep drawing until we have them.
+	gpu_profiler.collect();
+	if (gpu_profiler.is_pending()) {
+		ui.frame_scheduler.schedule(Frame_scheduler::Clock::now());
 	}
 
 	// Always update ui.
@@ -124,33 +178,55 @@ void Renderer::draw() const
 	ensure(swapchain->Present(1, 0), >= 0);
 }
 
-// Creates the first texture from the loaded image.
-void Renderer::create_image()
+// Creates the first texture from the decoded image.
+void Renderer::create_image(Decoded_image& decoded_image)
 {
-	// Get data from the image.
-	DXGI_FORMAT format;
-	UINT sys_mem_pitch;
-	std::unique_ptr<uint8_t[]> data = get_image_data(format, sys_mem_pitch);
-	
-	Info::image_width = image.get_width<int>();
-	Info::image_height = image.get_height<int>();
+	Metrics::image_width.set(decoded_image.dims.width);
+	Metrics::image_height.set(decoded_image.dims.height);
+	ui.animation.stop();
+	texture_frame.reset();
+
+	// Without auto zoom the zoom is absolute, so keep the same view of a larger image.
+	if (decoded_image.keep_view && ui.image_no_scale && dims_source.width > 0) {
+		ui.image_zoom -= std::log2(decoded_image.dims.get_width<float>() / dims_source.get_width<float>());
+	}
+	dims_source = decoded_image.dims;
+	is_preview = decoded_image.is_preview;
+	if (!is_preview) {
+		is_raw_full_requested = false;
+	}
 
-	// Create texture.
-	D3D11_TEXTURE2D_DESC texture2d_desc = {};
-	texture2d_desc.Width = image.get_width<UINT>();
-	texture2d_desc.Height = image.get_height<UINT>();
-	texture2d_desc.MipLevels = 1;
-	texture2d_desc.ArraySize = 1;
-	texture2d_desc.Format = format;
-	texture2d_desc.SampleDesc.Count = 1;
-	texture2d_desc.Usage = D3D11_USAGE_IMMUTABLE;
-	texture2d_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-	D3D11_SUBRESOURCE_DATA subresource_data = {};
-	subresource_data.pSysMem = data.get();
-	subresource_data.SysMemPitch = sys_mem_pitch;
-	Com_ptr<ID3D11Texture2D> texture2d;
-	ensure(device->CreateTexture2D(&texture2d_desc, &subresource_data, texture2d.put()), >= 0);
-	ensure(device->CreateShaderResourceView(texture2d.get(), nullptr, srv_image.put()), >= 0);
+	// Previews are always small enough, keep the cms LUT and trc of the previous image.
+	if (is_preview) {
+		is_tiled = false;
+		tiled_image.close();
+		tiled_offset = ImVec2();
+		has_alpha = false;
+		dims_image = decoded_image.dims_data;
+		create_srv_image(decoded_image.data.get(), get_texture_format(decoded_image.format), decoded_image.sys_mem_pitch);
+		return;
+	}
+
+	Metrics::image_bitdepth.set(image.get_bitdepth());
+	Metrics::image_nchannels.set(image.get_nchannels());
+	has_alpha = image.has_alpha();
+
+	// Images larger than the max texture size get rendered from tiles,
+	// the loader already built the pyramid, textures for them get created in update_tiled_region().
+	is_tiled = decoded_image.tiled_image.has_value();
+	std::shared_ptr<const uint8_t[]> first_frame; // Kept by the animation, so it's not decoded again.
+	if (is_tiled) {
+		srv_image.reset();
+		tile_region.level = -1;
+		tiled_image = std::move(*decoded_image.tiled_image);
+	}
+	else {
+		tiled_image.close();
+		tiled_offset = ImVec2();
+		dims_image = decoded_image.dims_data;
+		first_frame = std::move(decoded_image.data);
+		create_srv_image(first_frame.get(), get_texture_format(decoded_image.format), decoded_image.sys_mem_pitch);
+	}
 
 	if (cms_profile_display) {
 		create_cms_lut();
@@ -160,6 +236,27 @@ void Renderer::create_image()
 	else {
 		trc = image.trc;
 	}
+
+	// The first frame is shown now, the animation continues from it.
+	if (!is_tiled && image.is_animated() && decoded_image.format == OIIO::TypeDesc::UINT8) {
+		ui.animation.start(decoded_image.path, std::move(first_frame), dims_image.width, dims_image.height, static_cast<size_t>(g_config.animation_cache_size.val) * 1024 * 1024, Animation::Clock::now(), [] {
+			PostMessageW(g_hwnd, WIV_WM_ANIMATION_FRAME, 0, 0);
+		});
+	}
+}
+
+void Renderer::animate()
+{
+	if (!ui.animation.is_playing()) {
+		return;
+	}
+	if (const auto frame = ui.animation.update(Animation::Clock::now())) {
+		update_srv_image_frame(frame->data.get());
+		should_update = true;
+	}
+	if (const auto deadline = ui.animation.get_deadline()) {
+		ui.frame_scheduler.schedule(*deadline);
+	}
 }
 
 void Renderer::on_window_resize() noexcept
@@ -181,7 +278,13 @@ void Renderer::on_window_resize() noexcept
 
 void Renderer::reset_resources() noexcept
 {
+	ui.animation.stop();
+	texture_frame.reset();
 	srv_image.reset();
+	invalidate_render_cache();
+	is_preview = false;
+	is_tiled = false;
+	tiled_image.close();
 	create_viewport(0.0f, 0.0f);
 }
 
@@ -192,37 +295,106 @@ void Renderer::fullscreen_hide_cursor() const
 		while (ShowCursor(FALSE) >= 0);
 }
 
-std::unique_ptr<uint8_t[]> Renderer::get_image_data(DXGI_FORMAT& format, UINT& sys_mem_pitch)
+void Renderer::create_srv_image(const void* data, DXGI_FORMAT format, UINT sys_mem_pitch)
 {
-	std::unique_ptr<uint8_t[]> data;
-	switch (image.get_basetype()) {
-		case OIIO::TypeDesc::UINT8:
-			data = image.get_image_data<uint8_t>();
-			format = DXGI_FORMAT_R8G8B8A8_UNORM;
-			sys_mem_pitch = image.get_width<int>() * 4;
-			break;
-		case OIIO::TypeDesc::UINT16:
-			data = image.get_image_data<uint16_t>();
-			format = DXGI_FORMAT_R16G16B16A16_UNORM;
-			sys_mem_pitch = image.get_width<int>() * 4 * 2;
-			break;
-		case OIIO::TypeDesc::HALF:
-			data = image.get_image_data<uint16_t>();
-			format = DXGI_FORMAT_R16G16B16A16_FLOAT;
-			sys_mem_pitch = image.get_width<int>() * 4 * 2;
-			break;
-		case OIIO::TypeDesc::FLOAT:
-			data = image.get_image_data<uint32_t>();
-			format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-			sys_mem_pitch = image.get_width<int>() * 4 * 4;
+	WIV_PROFILE_SCOPE("Upload");
+	invalidate_render_cache();
+	D3D11_TEXTURE2D_DESC texture2d_desc = {};
+	texture2d_desc.Width = dims_image.get_width<UINT>();
+	texture2d_desc.Height = dims_image.get_height<UINT>();
+	texture2d_desc.MipLevels = 1;
+	texture2d_desc.ArraySize = 1;
+	texture2d_desc.Format = format;
+	texture2d_desc.SampleDesc.Count = 1;
+	texture2d_desc.Usage = D3D11_USAGE_IMMUTABLE;
+	texture2d_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	D3D11_SUBRESOURCE_DATA subresource_data = {};
+	subresource_data.pSysMem = data;
+	subresource_data.SysMemPitch = sys_mem_pitch;
+	Com_ptr<ID3D11Texture2D> texture2d;
+	ensure(device->CreateTexture2D(&texture2d_desc, &subresource_data, texture2d.put()), >= 0);
+	ensure(device->CreateShaderResourceView(texture2d.get(), nullptr, srv_image.put()), >= 0);
+}
+
+// Outputs rendered from the previous content of srv_image can't be hit anymore, so free them.
+void Renderer::invalidate_render_cache() noexcept
+{
+	++image_id;
+	render_cache.clear();
+}
+
+// The first frame got uploaded into an immutable texture, the following frames reuse a default one.
+void Renderer::update_srv_image_frame(const uint8_t* data)
+{
+	WIV_PROFILE_SCOPE("Frame upload");
+	invalidate_render_cache();
+	const auto sys_mem_pitch = dims_image.get_width<UINT>() * 4;
+	if (texture_frame) {
+		ctx->UpdateSubresource(texture_frame.get(), 0, nullptr, data, sys_mem_pitch, 0);
+		return;
+	}
+	D3D11_TEXTURE2D_DESC texture2d_desc = {};
+	texture2d_desc.Width = dims_image.get_width<UINT>();
+	texture2d_desc.Height = dims_image.get_height<UINT>();
+	texture2d_desc.MipLevels = 1;
+	texture2d_desc.ArraySize = 1;
+	texture2d_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	texture2d_desc.SampleDesc.Count = 1;
+	texture2d_desc.Usage = D3D11_USAGE_DEFAULT;
+	texture2d_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	D3D11_SUBRESOURCE_DATA subresource_data = {};
+	subresource_data.pSysMem = data;
+	subresource_data.SysMemPitch = sys_mem_pitch;
+	ensure(device->CreateTexture2D(&texture2d_desc, &subresource_data, texture_frame.put()), >= 0);
+	ensure(device->CreateShaderResourceView(texture_frame.get(), nullptr, srv_image.put()), >= 0);
+}
+
+// Picks the pyramid level for the current scale and the region of it that covers the window.
+// Returns true if the region changed, in that case srv_image gets recreated from the region.
+bool Renderer::update_tiled_region()
+{
+	const auto region = tiled_image.get_region(scale, dims_swap_chain.width, dims_swap_chain.height, ui.image_pan.x, ui.image_pan.y, ui.image_rotation, tile_region);
+	if (region == tile_region) {
+		return false;
+	}
+	const auto data = tiled_image.compose(region);
+
+	// Tile files got removed or truncated, keep showing the current region.
+	if (!data) {
+		return false;
 	}
-	return data;
+	tile_region = region;
+	dims_image = { tile_region.x1 - tile_region.x0, tile_region.y1 - tile_region.y0 };
+	create_srv_image(data.get(), get_texture_format(tiled_image.get_format()), dims_image.width * tiled_image.get_bytes_per_pixel());
+	return true;
+}
+
+// Makes scale and dims_output relative to the tile region and places the region within the image.
+void Renderer::update_tiled_placement() noexcept
+{
+	const float level_size = static_cast<float>(1 << tile_region.level);
+
+	// Region center relative to the image center, in the scaled image space.
+	const float x = ((tile_region.x0 + tile_region.x1) / 2.0f * level_size - dims_source.get_width<float>() / 2.0f) * scale;
+	const float y = ((tile_region.y0 + tile_region.y1) / 2.0f * level_size - dims_source.get_height<float>() / 2.0f) * scale;
+
+	// Rotate the same way as the final pass does.
+	const float theta = ui.image_rotation * std::numbers::pi_v<float> / 180.0f;
+	const float cos_theta = std::cos(theta);
+	const float sin_theta = std::sin(theta);
+	tiled_offset = ImVec2(cos_theta * x - sin_theta * y, sin_theta * x + cos_theta * y);
+
+	scale *= level_size;
+	dims_output.width = static_cast<int>(std::ceil(dims_image.width * scale));
+	dims_output.height = static_cast<int>(std::ceil(dims_image.height * scale));
+	if (ui.image_rotation % 180)
+		std::swap(dims_output.width, dims_output.height);
 }
 
 void Renderer::update_scale_and_dims_output() noexcept
 {
-	auto image_w = image.get_width<float>();
-	auto image_h = image.get_height<float>();
+	auto image_w = dims_source.get_width<float>();
+	auto image_h = dims_source.get_height<float>();
 
 	// Check is the rotation angele divisible by 180, if it is we dont need to swap width and height.
 	if (ui.image_rotation % 180)
@@ -243,16 +415,18 @@ void Renderer::update_scale_and_dims_output() noexcept
 	// Limit scale so we don't exceed min or max texture dims, or stretch image.
 	const auto scaled_w = image_w * scale;
 	const auto scaled_h = image_h * scale;
-	if (scaled_w > WIV_MAX_TEX_UV<float> || scaled_h > WIV_MAX_TEX_UV<float>)
+	if (is_tiled && scale > WIV_TILED_MAX_SCALE)
+		scale = WIV_TILED_MAX_SCALE;
+	else if (!is_tiled && (scaled_w > WIV_MAX_TEX_UV<float> || scaled_h > WIV_MAX_TEX_UV<float>))
 		scale = std::min(WIV_MAX_TEX_UV<float> / image_w, WIV_MAX_TEX_UV<float> / image_h);
 	else if (scaled_w < 1.0f || scaled_h < 1.0f)
 		scale = std::max(1.0f / image_w, 1.0f / image_h);
 
 	dims_output.width = static_cast<int>(std::ceil(image_w * scale));
 	dims_output.height = static_cast<int>(std::ceil(image_h * scale));
-	Info::scale = scale;
-	Info::scaled_width = dims_output.width;
-	Info::scaled_height = dims_output.height;
+	Metrics::scale.set(scale);
+	Metrics::scaled_width.set(dims_output.width);
+	Metrics::scaled_height.set(dims_output.height);
 }
 
 void Renderer::update_scale_profile() noexcept
@@ -268,18 +442,98 @@ void Renderer::update_scale_profile() noexcept
 	p_scale_profile = &g_config.scale_profiles[0].config;
 
 info:
-	Info::kernel_index = p_scale_profile->kernel_index.val;
-	Info::kernel_support = get_kernel_support();
+	const float kernel_support = get_kernel_support();
 	const auto clamped_scale = std::min(scale, 1.0f);
-	Info::kernel_radius = std::ceil(Info::kernel_support / clamped_scale);
+	const int kernel_radius = std::ceil(kernel_support / clamped_scale);
+	Metrics::kernel_index.set(p_scale_profile->kernel_index.val);
+	Metrics::kernel_support.set(kernel_support);
+	Metrics::kernel_radius.set(kernel_radius);
 	if (p_scale_profile->kernel_cylindrical_use.val) {
-		const auto a = static_cast<int>(std::ceil(Info::kernel_support / clamped_scale));
-		Info::kernel_size = a * a;
+		const auto a = static_cast<int>(std::ceil(kernel_support / clamped_scale));
+		Metrics::kernel_size.set(a * a);
 	}
 	else {
-		Info::kernel_size = std::ceil(static_cast<float>(Info::kernel_radius) / std::min(scale, 1.0f)) * 2;
+		Metrics::kernel_size.set(std::ceil(static_cast<float>(kernel_radius) / std::min(scale, 1.0f)) * 2);
 	}
-	Info::scale_filter = p_scale_profile->kernel_cylindrical_use.val ? "Cylindrical" : "Orthogonal";
+	Metrics::scale_filter.set(p_scale_profile->kernel_cylindrical_use.val);
+}
+
+void Renderer::render_passes()
+{
+	const auto render_start = std::chrono::steady_clock::now();
+	gpu_profiler.begin_frame();
+	srv_pass = srv_image;
+	if (!is_equal(scale, 1.0f)) {
+		const bool sigmoidize = scale > 1.0f && p_scale_profile->sigmoid_use.val;
+		bool linearize = scale < 1.0f || sigmoidize || p_scale_profile->blur_use.val;
+		if (linearize) {
+			pass_linearize(dims_image.get_width<UINT>(), dims_image.get_height<UINT>());
+		}
+		if (sigmoidize) {
+			pass_sigmoidize();
+		}
+		if (scale < 1.0f && p_scale_profile->blur_use.val) {
+			pass_blur();
+		}
+		if (p_scale_profile->kernel_cylindrical_use.val) {
+			pass_cylindrical_resample();
+		}
+		else {
+			pass_orthogonal_resample();
+		}
+		if (sigmoidize) {
+			pass_desigmoidize();
+		}
+		if (p_scale_profile->unsharp_use.val) {
+			if (!linearize) {
+				pass_linearize(dims_output.get_width<UINT>(), dims_output.get_height<UINT>());
+				linearize = true;
+			}
+			pass_unsharp();
+		}
+		if (linearize) {
+			pass_delinearize(dims_output.get_width<UINT>(), dims_output.get_height<UINT>());
+		}
+	}
+	if (g_config.cms_use.val && is_cms_valid && !is_cms_identity) {
+		if (is_cms_matrix_shaper) {
+			pass_cms_matrix_shaper();
+		}
+		else {
+			pass_cms();
+		}
+	}
+	gpu_profiler.end_frame(get_render_work(*p_scale_profile, get_render_view()));
+	Metrics::render_time.record(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - render_start).count());
+	Metrics::renders.add();
+}
+
+Render_key Renderer::get_render_key() const noexcept
+{
+	int cms = 0;
+	if (g_config.cms_use.val && is_cms_valid && !is_cms_identity) {
+		cms = is_cms_matrix_shaper ? 2 : 1;
+	}
+	return {
+		.image_id = image_id,
+		.width = dims_output.width,
+		.height = dims_output.height,
+		.scale = scale,
+		.rotation = ui.image_rotation,
+		.scale_profile_hash = get_scale_profile_hash(*p_scale_profile),
+		.cms = cms,
+		.cms_dither = g_config.cms_dither.val,
+	};
+}
+
+Render_view Renderer::get_render_view() const noexcept
+{
+	return {
+		.input = dims_image,
+		.output = dims_output,
+		.scale = scale,
+		.cms = g_config.cms_use.val && is_cms_valid && !is_cms_identity,
+	};
 }
 
 void Renderer::init_cms_profile_display()
@@ -329,6 +583,15 @@ void Renderer::init_cms_profile_display()
 
 void Renderer::create_cms_lut()
 {
+	is_cms_identity = false;
+	is_cms_matrix_shaper = false;
+	if (g_config.cms_matrix_shaper.val && image.profile && create_cms_matrix_shaper()) {
+		Metrics::cms_lut_size.set(0);
+		Metrics::cms_lut_error.set(0);
+		is_cms_valid = true;
+		return;
+	}
+
 	const auto lut = cms_transform_lut();
 	if (!lut) {
 		is_cms_valid = false;
@@ -337,17 +600,17 @@ void Renderer::create_cms_lut()
 
 	// Bind lut as 3d texture.
 	D3D11_TEXTURE3D_DESC texture3d_desc = {};
-	texture3d_desc.Width = g_config.cms_lut_size.val;
-	texture3d_desc.Height = g_config.cms_lut_size.val;
-	texture3d_desc.Depth = g_config.cms_lut_size.val;
+	texture3d_desc.Width = cms_lut_size;
+	texture3d_desc.Height = cms_lut_size;
+	texture3d_desc.Depth = cms_lut_size;
 	texture3d_desc.MipLevels = 1;
 	texture3d_desc.Format = DXGI_FORMAT_R16G16B16A16_UNORM;
 	texture3d_desc.Usage = D3D11_USAGE_IMMUTABLE;
 	texture3d_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
 	D3D11_SUBRESOURCE_DATA subresource_data = {};
 	subresource_data.pSysMem = lut.get();
-	subresource_data.SysMemPitch = g_config.cms_lut_size.val * 4 * 2; // width * nchannals * byte_depth
-	subresource_data.SysMemSlicePitch = sq(g_config.cms_lut_size.val) * 4 * 2; // width * height * nchannals * byte_depth
+	subresource_data.SysMemPitch = cms_lut_size * 4 * 2; // width * nchannals * byte_depth
+	subresource_data.SysMemSlicePitch = sq(cms_lut_size) * 4 * 2; // width * height * nchannals * byte_depth
 	Com_ptr<ID3D11Texture3D> texture3d;
 	ensure(device->CreateTexture3D(&texture3d_desc, &subresource_data, texture3d.put()), >= 0);
 	Com_ptr<ID3D11ShaderResourceView> srv;
@@ -357,45 +620,70 @@ void Renderer::create_cms_lut()
 	is_cms_valid = true;
 }
 
+// Returns false if the profiles can't be collapsed into a matrix-shaper transform.
+bool Renderer::create_cms_matrix_shaper()
+{
+	WIV_PROFILE_SCOPE("CMS matrix-shaper build");
+	const auto transform = cms_create_matrix_shaper(image.profile.get(), cms_profile_display.get(), g_config.cms_intent.val, g_config.cms_bpc_use.val);
+	if (!transform) {
+		return false;
+	}
+	if (transform->is_identity) {
+		is_cms_identity = true;
+		return true;
+	}
+
+	// Bind curves as 2d texture, the first row are the input curves and the second row the output curves.
+	D3D11_TEXTURE2D_DESC texture2d_desc = {};
+	texture2d_desc.Width = WIV_CMS_CURVE_SIZE;
+	texture2d_desc.Height = 2;
+	texture2d_desc.MipLevels = 1;
+	texture2d_desc.ArraySize = 1;
+	texture2d_desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	texture2d_desc.SampleDesc.Count = 1;
+	texture2d_desc.Usage = D3D11_USAGE_IMMUTABLE;
+	texture2d_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	D3D11_SUBRESOURCE_DATA subresource_data = {};
+	subresource_data.pSysMem = transform->curves.get();
+	subresource_data.SysMemPitch = WIV_CMS_CURVE_SIZE * 4 * 4; // width * nchannals * byte_depth
+	Com_ptr<ID3D11Texture2D> texture2d;
+	ensure(device->CreateTexture2D(&texture2d_desc, &subresource_data, texture2d.put()), >= 0);
+	Com_ptr<ID3D11ShaderResourceView> srv;
+	ensure(device->CreateShaderResourceView(texture2d.get(), nullptr, srv.put()), >= 0);
+	ctx->PSSetShaderResources(2, 1, &srv);
+
+	cms_matrix = transform->matrix;
+	is_cms_matrix_shaper = true;
+	return true;
+}
+
 std::unique_ptr<uint16_t[]> Renderer::cms_transform_lut()
 {
-	std::unique_ptr<uint16_t[]> lut;
-	if (image.profile) {
-		
-		// Set flags.
-		cmsUInt32Number flags = cmsFLAGS_HIGHRESPRECALC | cmsFLAGS_NOOPTIMIZE;
-		if (g_config.cms_bpc_use.val) {
-			flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
-		}
-		
-		auto htransform = cmsCreateTransform(image.profile.get(), TYPE_RGB_16, cms_profile_display.get(), TYPE_RGBA_16, g_config.cms_intent.val, flags);
-		if (htransform) {
-			lut = std::make_unique_for_overwrite<uint16_t[]>(cube(g_config.cms_lut_size.val) * 4);
-
-			// Get the correct LUT.
-			const void* wiv_cms_lut = nullptr;
-			switch (g_config.cms_lut_size.val) {
-				case 33:
-					wiv_cms_lut = WIV_CMS_LUT_33.data();
-					break;
-				case 49:
-					wiv_cms_lut = WIV_CMS_LUT_49.data();
-					break;
-				case 65:
-					wiv_cms_lut = WIV_CMS_LUT_65.data();
-			}
+	WIV_PROFILE_SCOPE("CMS LUT build");
+	if (!image.profile) {
+		return nullptr;
+	}
 
-			cmsDoTransform(htransform, wiv_cms_lut, lut.get(), cube(g_config.cms_lut_size.val));
-			cmsDeleteTransform(htransform);
-		}
+	// Auto picks the smallest LUT that is accurate enough.
+	if (g_config.cms_lut_size.val == 0) {
+		float error = 0.0f;
+		auto lut = cms_create_lut_adaptive(image.profile.get(), cms_profile_display.get(), g_config.cms_intent.val, g_config.cms_bpc_use.val, g_config.cms_lut_max_error.val, cms_lut_size, error);
+		Metrics::cms_lut_size.set(cms_lut_size);
+		Metrics::cms_lut_error.set(error);
+		return lut;
 	}
-	return lut;
+	cms_lut_size = g_config.cms_lut_size.val;
+	Metrics::cms_lut_size.set(cms_lut_size);
+	Metrics::cms_lut_error.set(-1.0);
+	return cms_create_lut(image.profile.get(), cms_profile_display.get(), g_config.cms_intent.val, g_config.cms_bpc_use.val, cms_lut_size);
 }
 
 void Renderer::pass_cms()
 {
+	WIV_BENCH_SCOPE("Renderer::pass_cms");
+	const Gpu_profiler_scope gpu_profiler_scope(gpu_profiler, "CMS");
 	alignas(16) Cb_data data[1];
-	data[0].x.f = g_config.cms_lut_size.val; // lut_size
+	data[0].x.f = cms_lut_size; // lut_size
 	data[0].y.i = g_config.cms_dither.val && image.get_basetype() == OIIO::TypeDesc::UINT8; // dither
 
 	// Generate a random float between 0.0 and 1.0. For dithering.
@@ -410,8 +698,37 @@ void Renderer::pass_cms()
 	draw_pass(dims_output.get_width<UINT>(), dims_output.get_height<UINT>());
 }
 
+void Renderer::pass_cms_matrix_shaper()
+{
+	WIV_BENCH_SCOPE("Renderer::pass_cms_matrix_shaper");
+	const Gpu_profiler_scope gpu_profiler_scope(gpu_profiler, "CMS matrix-shaper");
+	alignas(16) Cb_data data[4];
+	data[0].x.f = WIV_CMS_CURVE_SIZE; // curve_size
+	data[0].y.i = g_config.cms_dither.val && image.get_basetype() == OIIO::TypeDesc::UINT8; // dither
+
+	// Generate a random float between 0.0 and 1.0. For dithering.
+	std::srand(std::time(nullptr));
+	data[0].z.f = static_cast<float>(static_cast<double>(std::rand()) / static_cast<double>(RAND_MAX)); // random_number
+
+	// rgb_to_rgb, a row per register.
+	for (int i = 0; i < 3; ++i) {
+		data[i + 1].x.f = cms_matrix[i * 3];
+		data[i + 1].y.f = cms_matrix[i * 3 + 1];
+		data[i + 1].z.f = cms_matrix[i * 3 + 2];
+	}
+
+	Com_ptr<ID3D11Buffer> cb0;
+	create_constant_buffer(sizeof(data), &data, cb0.put());
+	ctx->PSSetShaderResources(0, 1, &srv_pass);
+	create_pixel_shader(PS_CMS_MATRIX, sizeof(PS_CMS_MATRIX));
+	create_viewport(dims_output.get_width<float>(), dims_output.get_height<float>());
+	draw_pass(dims_output.get_width<UINT>(), dims_output.get_height<UINT>());
+}
+
 void Renderer::pass_linearize(UINT width, UINT height)
 {
+	WIV_BENCH_SCOPE("Renderer::pass_linearize");
+	const Gpu_profiler_scope gpu_profiler_scope(gpu_profiler, "Linearize");
 	if (trc.id == WIV_CMS_TRC_NONE || trc.id == WIV_CMS_TRC_LINEAR) {
 		return;
 	}
@@ -431,6 +748,8 @@ void Renderer::pass_linearize(UINT width, UINT height)
 
 void Renderer::pass_delinearize(UINT width, UINT height)
 {
+	WIV_BENCH_SCOPE("Renderer::pass_delinearize");
+	const Gpu_profiler_scope gpu_profiler_scope(gpu_profiler, "Delinearize");
 	if (trc.id == WIV_CMS_TRC_NONE || trc.id == WIV_CMS_TRC_LINEAR) {
 		return;
 	}
@@ -450,6 +769,8 @@ void Renderer::pass_delinearize(UINT width, UINT height)
 
 void Renderer::pass_sigmoidize()
 {
+	WIV_BENCH_SCOPE("Renderer::pass_sigmoidize");
+	const Gpu_profiler_scope gpu_profiler_scope(gpu_profiler, "Sigmoidize");
 	// Sigmoidize expects linear light input.
 	if (trc.id == WIV_CMS_TRC_NONE) {
 		return;
@@ -469,12 +790,14 @@ void Renderer::pass_sigmoidize()
 	create_constant_buffer(sizeof(data), &data, cb0.put());
 	ctx->PSSetShaderResources(0, 1, &srv_pass);
 	create_pixel_shader(PS_SIGMOIDIZE, sizeof(PS_SIGMOIDIZE));
-	create_viewport(image.get_width<float>(), image.get_height<float>());
-	draw_pass(image.get_width<UINT>(), image.get_height<UINT>());
+	create_viewport(dims_image.get_width<float>(), dims_image.get_height<float>());
+	draw_pass(dims_image.get_width<UINT>(), dims_image.get_height<UINT>());
 }
 
 void Renderer::pass_desigmoidize()
 {
+	WIV_BENCH_SCOPE("Renderer::pass_desigmoidize");
+	const Gpu_profiler_scope gpu_profiler_scope(gpu_profiler, "Desigmoidize");
 	// Sigmoidize expects linear light input.
 	if (trc.id == WIV_CMS_TRC_NONE) {
 		return;
@@ -495,6 +818,8 @@ void Renderer::pass_desigmoidize()
 
 void Renderer::pass_blur()
 {
+	WIV_BENCH_SCOPE("Renderer::pass_blur");
+	const Gpu_profiler_scope gpu_profiler_scope(gpu_profiler, "Blur");
 	// Pass y axis.
 	//
 
@@ -502,7 +827,7 @@ void Renderer::pass_blur()
 	data[0].x.i = p_scale_profile->blur_radius.val; // radius
 	data[0].y.f = p_scale_profile->blur_sigma.val; // sigma
 	data[0].z.f = 0.0f; // pt.x
-	data[0].w.f = 1.0f / image.get_height<float>(); // pt.y
+	data[0].w.f = 1.0f / dims_image.get_height<float>(); // pt.y
 
 	// Unsharp amount, has to be <= 0!
 	data[1].x.f = -1.0f; // amount
@@ -511,22 +836,24 @@ void Renderer::pass_blur()
 	create_constant_buffer(sizeof(data), &data, cb0.put());
 	create_pixel_shader(PS_BLUR, sizeof(PS_BLUR));
 	ctx->PSSetShaderResources(0, 1, &srv_pass);
-	create_viewport(image.get_width<float>(), image.get_height<float>());
-	draw_pass(image.get_width<UINT>(), image.get_height<UINT>());
+	create_viewport(dims_image.get_width<float>(), dims_image.get_height<float>());
+	draw_pass(dims_image.get_width<UINT>(), dims_image.get_height<UINT>());
 
 	//
 
 	// Pass x axis.
-	data[0].z.f = 1.0f / image.get_width<float>(); // pt.x
+	data[0].z.f = 1.0f / dims_image.get_width<float>(); // pt.x
 	data[0].w.f = 0.0f; // pt.y
 	update_constant_buffer(cb0.get(), data, sizeof(data));
 	ctx->PSSetShaderResources(0, 1, &srv_pass);
-	create_viewport(image.get_width<float>(), image.get_height<float>());
-	draw_pass(image.get_width<UINT>(), image.get_height<UINT>());
+	create_viewport(dims_image.get_width<float>(), dims_image.get_height<float>());
+	draw_pass(dims_image.get_width<UINT>(), dims_image.get_height<UINT>());
 }
 
 void Renderer::pass_unsharp()
 {
+	WIV_BENCH_SCOPE("Renderer::pass_unsharp");
+	const Gpu_profiler_scope gpu_profiler_scope(gpu_profiler, "Unsharp");
 	// Pass y axis.
 	//
 
@@ -569,6 +896,8 @@ void Renderer::pass_unsharp()
 
 void Renderer::pass_orthogonal_resample()
 {
+	WIV_BENCH_SCOPE("Renderer::pass_orthogonal_resample");
+	const Gpu_profiler_scope gpu_profiler_scope(gpu_profiler, "Orthogonal resample");
 	// Pass y axis.
 	//
 
@@ -586,18 +915,18 @@ void Renderer::pass_orthogonal_resample()
 	
 	data[1].z.f = clamped_scale; // scale
 	data[1].w.f = std::ceil(kernel_support / clamped_scale); // radius
-	data[2].x.f = image.get_width<float>(); // src_size.x
-	data[2].y.f = image.get_height<float>(); // src_size.y
-	data[2].z.f = 1.0f / image.get_width<float>(); // inv_src_size.x
-	data[2].w.f = 1.0f / image.get_height<float>(); // inv_src_size.y
+	data[2].x.f = dims_image.get_width<float>(); // src_size.x
+	data[2].y.f = dims_image.get_height<float>(); // src_size.y
+	data[2].z.f = 1.0f / dims_image.get_width<float>(); // inv_src_size.x
+	data[2].w.f = 1.0f / dims_image.get_height<float>(); // inv_src_size.y
 	data[3].x.f = 0.0f; // axis.x
 	data[3].y.f = 1.0f; // axis.y
 	Com_ptr<ID3D11Buffer> cb0;
 	create_constant_buffer(sizeof(data), &data, cb0.put());
 	create_pixel_shader(PS_ORTHO, sizeof(PS_ORTHO));
 	ctx->PSSetShaderResources(0, 1, &srv_pass);
-	create_viewport(image.get_width<float>(), dims_output.get_height<float>());
-	draw_pass(image.get_width<UINT>(), dims_output.height);
+	create_viewport(dims_image.get_width<float>(), dims_output.get_height<float>());
+	draw_pass(dims_image.get_width<UINT>(), dims_output.height);
 
 	//
 
@@ -612,6 +941,8 @@ void Renderer::pass_orthogonal_resample()
 
 void Renderer::pass_cylindrical_resample()
 {
+	WIV_BENCH_SCOPE("Renderer::pass_cylindrical_resample");
+	const Gpu_profiler_scope gpu_profiler_scope(gpu_profiler, "Cylindrical resample");
 	const float kernel_support = get_kernel_support();
 	const float clamped_scale = std::min(scale, 1.0f);
 	alignas(16) Cb_data data[3];
@@ -626,10 +957,10 @@ void Renderer::pass_cylindrical_resample()
 	
 	data[1].z.f = clamped_scale; // scale
 	data[1].w.f = std::ceil(kernel_support / clamped_scale); // radius
-	data[2].x.f = image.get_width<float>(); // src_size.x
-	data[2].y.f = image.get_height<float>(); // src_size.y
-	data[2].z.f = 1.0f / image.get_width<float>(); // inv_src_size.x
-	data[2].w.f = 1.0f / image.get_height<float>(); // inv_src_size.y
+	data[2].x.f = dims_image.get_width<float>(); // src_size.x
+	data[2].y.f = dims_image.get_height<float>(); // src_size.y
+	data[2].z.f = 1.0f / dims_image.get_width<float>(); // inv_src_size.x
+	data[2].w.f = 1.0f / dims_image.get_height<float>(); // inv_src_size.y
 	Com_ptr<ID3D11Buffer> cb0;
 	create_constant_buffer(sizeof(data), &data, cb0.put());
 	ctx->PSSetShaderResources(0, 1, &srv_pass);
@@ -641,7 +972,7 @@ void Renderer::pass_cylindrical_resample()
 void Renderer::update_final_pass()
 {
 	Com_ptr<ID3D11Buffer> cb0;
-	if (image.has_alpha()) {
+	if (has_alpha) {
 		alignas(16) Cb_data data[3];
 		data[0].x.f = dims_output.get_width<float>() / g_config.alpha_tile_size.val; // size.x
 		data[0].y.f = dims_output.get_height<float>() / g_config.alpha_tile_size.val; // size.y
@@ -707,8 +1038,8 @@ void Renderer::create_viewport(float width, float height, bool adjust) const noe
 
 	// Offset image in order to center it in the window + apply panning.
 	if (adjust) {
-		viewport.TopLeftX = (dims_swap_chain.width - viewport.Width) / 2.0f + ui.image_pan.x;
-		viewport.TopLeftY = (dims_swap_chain.height - viewport.Height) / 2.0f + ui.image_pan.y;
+		viewport.TopLeftX = (dims_swap_chain.width - viewport.Width) / 2.0f + ui.image_pan.x + tiled_offset.x;
+		viewport.TopLeftY = (dims_swap_chain.height - viewport.Height) / 2.0f + ui.image_pan.y + tiled_offset.y;
 	}
 	
 	ctx->RSSetViewports(1, &viewport);
@@ -716,26 +1047,5 @@ void Renderer::create_viewport(float width, float height, bool adjust) const noe
 
 float Renderer::get_kernel_support() const noexcept
 {
-	switch (p_scale_profile->kernel_index.val) {
-		case WIV_KERNEL_FUNCTION_NEAREST:
-			if (p_scale_profile->kernel_cylindrical_use.val) {
-				return std::numbers::sqrt2_v<float> / 2.0f;
-			}
-			return 1.0f / 2.0f;
-		case WIV_KERNEL_FUNCTION_LINEAR:
-			if (p_scale_profile->kernel_cylindrical_use.val) {
-				return std::numbers::sqrt2_v<float>;
-			}
-			return 1.0f;
-		case WIV_KERNEL_FUNCTION_BICUBIC:
-		case WIV_KERNEL_FUNCTION_BCSPLINE:
-			return 2.0f;
-		case WIV_KERNEL_FUNCTION_FSR:
-			if (p_scale_profile->kernel_cylindrical_use.val) {
-				return 2.233131f; // Second Jinc zero.
-			}
-			return 2.0f;
-		default:
-			return p_scale_profile->kernel_support.val;
-	}
+	return ::get_kernel_support(*p_scale_profile);
 }
@@ -6,6 +6,10 @@
 #include "include\dims.h"
 #include "renderer_base.h"
 #include "include\shader_config.h"
+#include "tiled_image.h"
+#include "gpu_clock.h"
+#include "render_cache.h"
+#include "quality_governor.h"
 
 enum WIV_CMS_PROFILE_DISPLAY_
 {
@@ -21,20 +25,32 @@ public:
     void init();
     void update();
     void draw() const;
-    void create_image();
+    void create_image(Decoded_image& decoded_image);
+
+    // Shows the next animation frame once it's due.
+    void animate();
     void on_window_resize() noexcept;
     void reset_resources() noexcept;
     void fullscreen_hide_cursor() const;
     bool should_update;
     User_interface ui;
 private:
-    std::unique_ptr<uint8_t[]> get_image_data(DXGI_FORMAT& format, UINT& sys_mem_pitch);
+    void create_srv_image(const void* data, DXGI_FORMAT format, UINT sys_mem_pitch);
+    void update_srv_image_frame(const uint8_t* data);
+    void invalidate_render_cache() noexcept;
+    bool update_tiled_region();
+    void update_tiled_placement() noexcept;
     void update_scale_and_dims_output() noexcept;
     void update_scale_profile() noexcept;
+    void render_passes();
+    Render_key get_render_key() const noexcept;
+    Render_view get_render_view() const noexcept;
     void init_cms_profile_display();
     void create_cms_lut();
+    bool create_cms_matrix_shaper();
     std::unique_ptr<uint16_t[]> cms_transform_lut();
     void pass_cms();
+    void pass_cms_matrix_shaper();
     void pass_linearize(UINT width, UINT height);
     void pass_delinearize(UINT width, UINT height);
     void pass_sigmoidize();
@@ -48,14 +64,33 @@ private:
     void create_viewport(float width, float height, bool adjust = false) const noexcept;
     float get_kernel_support() const noexcept;
     Com_ptr<ID3D11ShaderResourceView> srv_image;
+    Com_ptr<ID3D11Texture2D> texture_frame; // Animation frames get uploaded into it, null until the second frame.
     Com_ptr<ID3D11ShaderResourceView> srv_pass;
+    uint64_t image_id; // Bumped whenever srv_image gets new content.
+    Render_cache<Com_ptr<ID3D11ShaderResourceView>> render_cache; // Outputs of the passes of the current image.
+    Quality_governor quality_governor;
+    std::optional<Render_key> interim_key; // View shown with an interim profile, the configured one is rendered next.
     Image& image = ui.file_manager.image;
+    Dims<int> dims_source; // Dims of the image, srv_image may hold only a preview or a region of it.
+    Dims<int> dims_image; // Dims of the srv_image.
+    bool is_preview;
+    bool is_raw_full_requested; // Full size development of the RAW draft is already requested.
+    bool has_alpha;
+    bool is_tiled;
+    Tiled_image tiled_image;
+    Tile_region tile_region;
+    ImVec2 tiled_offset; // Offset of the tile region from the image center, after scale and rotation.
     Dims<int> dims_output;
     float scale;
     const Config_scale* p_scale_profile;
     std::unique_ptr<std::remove_pointer_t<cmsHPROFILE>, decltype(&cmsCloseProfile)> cms_profile_display = { nullptr, cmsCloseProfile };
     Tone_response_curve trc;
     bool is_cms_valid;
+    bool is_cms_identity; // Image and display profiles are the same, so the cms pass is skipped.
+    bool is_cms_matrix_shaper; // Using the matrix-shaper transform instead of the LUT.
+    unsigned int cms_lut_size; // Size of the current LUT, may differ from the config in auto mode.
+    std::array<float, 9> cms_matrix;
     float sigmoidize_offset;
     float sigmoidize_scale;
+    Gpu_profiler gpu_profiler;
 };
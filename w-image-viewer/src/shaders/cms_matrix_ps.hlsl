@@ -0,0 +1,45 @@
+// Color managment system (CMS).
+// Matrix-shaper profiles: input curves, 3x3 matrix, output curves.
+
+#include "include\tri_dither.hlsli"
+
+Texture2D tex : register(t0);
+
+// Row 0 input curves, row 1 inverse output curves sampled at sqrt(x).
+Texture2D curves : register(t2);
+
+cbuffer cb0 : register(b0)
+{
+    float curve_size;
+    bool dither;
+    float random_number;
+    row_major float3x3 rgb_to_rgb;
+}
+
+// Linear interpolation between the curve samples.
+float3 eval_curves(float3 x, int row)
+{
+    const float3 coord = saturate(x) * (curve_size - 1.0);
+    const int3 i = min(int3(coord), int(curve_size) - 2);
+    const float3 f = coord - i;
+    float3 result;
+    [unroll]
+    for (int c = 0; c < 3; ++c) {
+        result[c] = lerp(curves.Load(int3(i[c], row, 0))[c], curves.Load(int3(i[c] + 1, row, 0))[c], f[c]);
+    }
+    return result;
+}
+
+float4 main(float4 pos : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+    float4 color = tex.Load(int3(pos.xy, 0));
+    const float3 linear_rgb = mul(rgb_to_rgb, eval_curves(color.rgb, 0));
+    color.rgb = eval_curves(sqrt(saturate(linear_rgb)), 1);
+
+    // Optional dithering.
+    if (dither) {
+        color.rgb += tri_dither(color.rgb, texcoord, 8, random_number);
+    }
+
+    return color;
+}
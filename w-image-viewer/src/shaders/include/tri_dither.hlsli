@@ -0,0 +1,54 @@
+#ifndef __TRI_DITHER_HLSLI__
+#define __TRI_DITHER_HLSLI__
+
+// Tri dither
+// Source https://github.com/crosire/reshade-shaders/blob/slim/Shaders/TriDither.fxh
+//
+
+#define remap(v,a,b) (((v) - (a)) / ((b) - (a)))
+
+inline float rand21(float2 uv)
+{
+    const float2 noise = frac(sin(dot(uv, float2(12.9898, 78.233) * 2.0)) * 43758.5453);
+    return (noise.x + noise.y) * 0.5;
+}
+
+inline float rand11(float x)
+{
+    return frac(x * 0.024390243);
+}
+
+inline float permute(float x)
+{
+    return ((34.0 * x + 1.0) * x) % 289.0;
+}
+
+inline float3 tri_dither(float3 color, float2 uv, int bits, float random_number)
+{
+    const float bitstep = exp2(bits) - 1.0;
+    const float lsb = 1.0 / bitstep;
+    const float lobit = 0.5 / bitstep;
+    const float hibit = (bitstep - 0.5) / bitstep;
+    const float3 m = float3(uv, rand21(uv + random_number)) + 1.0;
+    float h = permute(permute(permute(m.x) + m.y) + m.z);
+    float3 noise1;
+    float3 noise2;
+    noise1.x = rand11(h);
+    h = permute(h);
+    noise2.x = rand11(h);
+    h = permute(h);
+    noise1.y = rand11(h);
+    h = permute(h);
+    noise2.y = rand11(h);
+    h = permute(h);
+    noise1.z = rand11(h);
+    h = permute(h);
+    noise2.z = rand11(h);
+    const float3 lo = saturate(remap(color.xyz, 0.0, lobit));
+    const float3 hi = saturate(remap(color.xyz, 1.0, hibit));
+    const float3 uni = noise1 - 0.5;
+    const float3 tri = noise1 - noise2;
+    return lerp(uni, tri, min(lo, hi)) * lsb;
+}
+
+#endif // __TRI_DITHER_HLSLI__
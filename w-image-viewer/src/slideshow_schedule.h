@@ -0,0 +1,96 @@
+#pragma once
+
+#include "pch.h"
+
+// Deadlines of the slideshow swaps, and the error of the periods between presented swaps.
+// Deadlines are on a fixed schedule, so the error doesn't accumulate.
+// Doesn't depend on the platform, time is always passed in.
+class Slideshow_schedule
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // The shown image is the first one, its period starts now.
+    void start(Clock::time_point now, Clock::duration interval) noexcept
+    {
+        deadline = now + interval;
+        last_present = now;
+        is_swap_pending = false;
+        is_swap_created = false;
+        periods = 0;
+        error_mean = 0.0;
+        error_max = 0.0;
+    }
+
+    // Returns true if the next image should be swapped in now.
+    // If we fell behind by more than an interval restart the schedule.
+    bool should_swap(Clock::time_point now, Clock::duration interval) noexcept
+    {
+        if (now < deadline) {
+            return false;
+        }
+        deadline += interval;
+        if (deadline <= now) {
+            deadline = now + interval;
+        }
+        is_swap_pending = true;
+        return true;
+    }
+
+    // The swapped in image got created, the next Present shows it.
+    void created() noexcept
+    {
+        if (is_swap_pending) {
+            is_swap_pending = false;
+            is_swap_created = true;
+        }
+    }
+
+    // Called after Present, returns true if it showed the swapped in image and its period got measured.
+    // Period error is how much the time between presented swaps differs from the interval,
+    // so it includes waiting for a late decode, creating the texture and rendering.
+    bool presented(Clock::time_point now, Clock::duration interval) noexcept
+    {
+        if (!is_swap_created) {
+            return false;
+        }
+        is_swap_created = false;
+        const auto error = std::abs(std::chrono::duration<double, std::milli>(now - last_present - interval).count());
+        ++periods;
+        error_mean += (error - error_mean) / periods;
+        error_max = std::max(error_max, error);
+        last_present = now;
+        return true;
+    }
+
+    Clock::time_point get_deadline() const noexcept
+    {
+        return deadline;
+    }
+
+    int get_periods() const noexcept
+    {
+        return periods;
+    }
+
+    // In ms.
+    double get_error_mean() const noexcept
+    {
+        return error_mean;
+    }
+
+    // In ms.
+    double get_error_max() const noexcept
+    {
+        return error_max;
+    }
+
+private:
+    Clock::time_point deadline;
+    Clock::time_point last_present;
+    bool is_swap_pending; // Swapped, the image isn't created yet.
+    bool is_swap_created; // Created, the next Present shows it.
+    int periods;
+    double error_mean;
+    double error_max;
+};
@@ -0,0 +1,265 @@
+#include "pch.h"
+#include "thumbnail_grid.h"
+#include "image.h"
+#include "include\global.h"
+#include "include\ensure.h"
+#include "include\profiler.h"
+#include "window.h"
+
+namespace
+{
+    // Space around the thumbnail in its cell.
+    constexpr float WIV_THUMBNAIL_PADDING = 6.0f;
+}
+
+void Thumbnail_grid::create(ID3D11Device* device, ID3D11DeviceContext* device_context)
+{
+    this->device = device;
+    ctx = device_context;
+}
+
+void Thumbnail_grid::open(std::vector<std::filesystem::directory_entry> files, const std::filesystem::path& file_current)
+{
+    close();
+    if (files.empty()) {
+        return;
+    }
+
+    // Another instance has the store open, use a temporary one then.
+    if (!store.is_open()) {
+        const auto max_size = static_cast<uint64_t>(std::max(g_config.thumbnail_cache_size.val, 0)) * 1024 * 1024;
+        if (!store.open(g_config.get_path() / L"thumbnails.dat", max_size)) {
+            std::error_code ec;
+            store.open(std::filesystem::temp_directory_path(ec) / (L"wiv_thumbnails_" + std::to_wstring(GetCurrentProcessId()) + L".dat"), max_size, true);
+        }
+    }
+    if (!atlas) {
+        D3D11_TEXTURE2D_DESC texture2d_desc = {};
+        texture2d_desc.Width = WIV_THUMBNAIL_ATLAS_COLUMNS * WIV_THUMBNAIL_SIZE;
+        texture2d_desc.Height = WIV_THUMBNAIL_ATLAS_ROWS * WIV_THUMBNAIL_SIZE;
+        texture2d_desc.MipLevels = 1;
+        texture2d_desc.ArraySize = 1;
+        texture2d_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        texture2d_desc.SampleDesc.Count = 1;
+        texture2d_desc.Usage = D3D11_USAGE_DEFAULT;
+        texture2d_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        ensure(device->CreateTexture2D(&texture2d_desc, nullptr, atlas.put()), >= 0);
+        ensure(device->CreateShaderResourceView(atlas.get(), nullptr, srv_atlas.put()), >= 0);
+    }
+
+    this->files = std::move(files);
+    file_cells.assign(this->files.size(), -1);
+    cells.fill({ -1, 0, 0, 0, 0 });
+    const auto it = std::ranges::find(this->files, file_current, [](const std::filesystem::directory_entry& file) -> const auto& { return file.path(); });
+    selected = it != this->files.end() ? static_cast<int>(it - this->files.begin()) : 0;
+    is_selected_scrolled = true;
+    first_visible = -1;
+    is_open_ = true;
+
+    // Coalesced, so the loader threads don't flood the message queue.
+    is_thumbnails_posted = false;
+    loader.start(store, this->files, [this] {
+        if (!is_thumbnails_posted.exchange(true)) {
+            PostMessageW(g_hwnd, WIV_WM_THUMBNAILS, 0, 0);
+        }
+    });
+}
+
+void Thumbnail_grid::close()
+{
+    loader.stop();
+    files.clear();
+    file_cells.clear();
+    is_open_ = false;
+    is_pending_ = false;
+}
+
+std::filesystem::path Thumbnail_grid::update()
+{
+    if (!is_open_) {
+        return {};
+    }
+    ++frame;
+    nuploads = 0;
+    is_pending_ = false;
+    int clicked = -1;
+
+    const auto viewport = ImGui::GetMainViewport();
+    ImGui::SetNextWindowPos(viewport->WorkPos);
+    ImGui::SetNextWindowSize(viewport->WorkSize);
+    ImGui::SetNextWindowBgAlpha(1.0f);
+    if (ImGui::Begin("##thumbnails", nullptr, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoBringToFrontOnFocus)) {
+        const auto& style = ImGui::GetStyle();
+        const ImVec2 cell_size(WIV_THUMBNAIL_SIZE + 2.0f * WIV_THUMBNAIL_PADDING, WIV_THUMBNAIL_SIZE + 3.0f * WIV_THUMBNAIL_PADDING + ImGui::GetTextLineHeight());
+        const float row_height = cell_size.y + style.ItemSpacing.y;
+        ncolumns = std::max(static_cast<int>((ImGui::GetContentRegionAvail().x + style.ItemSpacing.x) / (cell_size.x + style.ItemSpacing.x)), 1);
+        clicked = input();
+        const int nfiles = static_cast<int>(files.size());
+        const int nrows = (nfiles + ncolumns - 1) / ncolumns;
+
+        // Scroll just enough to show the selected thumbnail.
+        if (is_selected_scrolled) {
+            is_selected_scrolled = false;
+            const float top = ImGui::GetCursorPosY() + selected / ncolumns * row_height;
+            const float height = ImGui::GetWindowHeight() - style.WindowPadding.y;
+            if (top < ImGui::GetScrollY()) {
+                ImGui::SetScrollY(top - style.WindowPadding.y);
+            }
+            else if (top + cell_size.y > ImGui::GetScrollY() + height) {
+                ImGui::SetScrollY(top + cell_size.y - height);
+            }
+        }
+
+        ImGuiListClipper clipper;
+        clipper.Begin(nrows, row_height);
+        bool is_first_step = true;
+        while (clipper.Step()) {
+
+            // The visible thumbnails get made first.
+            if (is_first_step && clipper.DisplayStart * ncolumns != first_visible) {
+                first_visible = clipper.DisplayStart * ncolumns;
+                loader.prioritize(first_visible);
+            }
+            is_first_step = false;
+            for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+                for (int column = 0; column < ncolumns && row * ncolumns + column < nfiles; ++column) {
+                    if (column) {
+                        ImGui::SameLine();
+                    }
+                    if (draw_cell(row * ncolumns + column, cell_size)) {
+                        clicked = row * ncolumns + column;
+                    }
+                }
+            }
+        }
+    }
+    ImGui::End();
+    if (clicked < 0) {
+        return {};
+    }
+    auto path = files[clicked].path();
+    close();
+    return path;
+}
+
+// Returns the file to open, -1 if none.
+int Thumbnail_grid::input()
+{
+    if (ImGui::GetIO().WantTextInput) {
+        return -1;
+    }
+    int next = selected;
+    if (ImGui::IsKeyPressed(ImGuiKey_LeftArrow)) {
+        next -= 1;
+    }
+    if (ImGui::IsKeyPressed(ImGuiKey_RightArrow)) {
+        next += 1;
+    }
+    if (ImGui::IsKeyPressed(ImGuiKey_UpArrow)) {
+        next -= ncolumns;
+    }
+    if (ImGui::IsKeyPressed(ImGuiKey_DownArrow)) {
+        next += ncolumns;
+    }
+    if (ImGui::IsKeyPressed(ImGuiKey_Home, false)) {
+        next = 0;
+    }
+    if (ImGui::IsKeyPressed(ImGuiKey_End, false)) {
+        next = static_cast<int>(files.size()) - 1;
+    }
+    if (next != selected) {
+        selected = std::clamp(next, 0, static_cast<int>(files.size()) - 1);
+        is_selected_scrolled = true;
+    }
+    if (ImGui::IsKeyPressed(ImGuiKey_Enter, false) || ImGui::IsKeyPressed(ImGuiKey_KeypadEnter, false)) {
+        return selected;
+    }
+    return -1;
+}
+
+// Returns the atlas cell of the file, uploads the thumbnail if it's not uploaded yet.
+// Returns -1 if there is no thumbnail yet or if it can't be uploaded in this frame.
+int Thumbnail_grid::get_cell(int file)
+{
+    auto& cell = file_cells[file];
+    if (cell >= 0) {
+        cells[cell].frame = frame;
+        return cell;
+    }
+    const auto key = Thumbnail_store::get_key(files[file]);
+
+    // Without copying the pixels, only to know if another frame is needed.
+    if (nuploads == WIV_THUMBNAIL_UPLOADS_PER_FRAME) {
+        if (store.touch(key)) {
+            is_pending_ = true;
+        }
+        return -1;
+    }
+    const auto thumbnail = store.get(key);
+    if (!thumbnail || thumbnail->data.empty()) {
+        return -1;
+    }
+
+    // Free cells were never drawn, so they come first.
+    const auto it = std::ranges::min_element(cells, {}, &Cell::frame);
+    if (it->frame == frame) {
+        return -1;
+    }
+    if (it->file >= 0) {
+        file_cells[it->file] = -1;
+    }
+    cell = static_cast<int>(it - cells.begin());
+    *it = { file, frame, thumbnail->width, thumbnail->height, thumbnail->orientation };
+    D3D11_BOX box;
+    box.left = cell % WIV_THUMBNAIL_ATLAS_COLUMNS * WIV_THUMBNAIL_SIZE;
+    box.top = cell / WIV_THUMBNAIL_ATLAS_COLUMNS * WIV_THUMBNAIL_SIZE;
+    box.front = 0;
+    box.right = box.left + thumbnail->width;
+    box.bottom = box.top + thumbnail->height;
+    box.back = 1;
+    ctx->UpdateSubresource(atlas.get(), 0, &box, thumbnail->data.data(), thumbnail->width * 4, 0);
+    ++nuploads;
+    return cell;
+}
+
+// Returns true if the cell got clicked.
+bool Thumbnail_grid::draw_cell(int file, ImVec2 cell_size)
+{
+    ImGui::PushID(file);
+    const auto pos = ImGui::GetCursorScreenPos();
+    const bool is_clicked = ImGui::InvisibleButton("##cell", cell_size);
+    const bool is_hovered = ImGui::IsItemHovered();
+    ImGui::PopID();
+    const auto name = files[file].path().filename().u8string();
+    if (is_hovered) {
+        ImGui::SetTooltip("%s", reinterpret_cast<const char*>(name.c_str()));
+    }
+
+    auto draw_list = ImGui::GetWindowDrawList();
+    if (is_hovered || file == selected) {
+        draw_list->AddRectFilled(pos, pos + cell_size, ImGui::GetColorU32(is_hovered ? ImGuiCol_HeaderHovered : ImGuiCol_Header), ImGui::GetStyle().FrameRounding);
+    }
+
+    // Centered in its square, turned by the orientation.
+    if (const int index = get_cell(file); index >= 0) {
+        const auto& cell = cells[index];
+        const int turns = (Image::get_rotation(cell.orientation) / 90 + 4) % 4; // Clockwise quarter turns.
+        const ImVec2 dims = turns % 2 ? ImVec2(cell.height, cell.width) : ImVec2(cell.width, cell.height);
+        const auto p0 = pos + ImVec2(WIV_THUMBNAIL_PADDING, WIV_THUMBNAIL_PADDING) + (ImVec2(WIV_THUMBNAIL_SIZE, WIV_THUMBNAIL_SIZE) - dims) * 0.5f;
+        const auto p2 = p0 + dims;
+        constexpr ImVec2 atlas_size(WIV_THUMBNAIL_ATLAS_COLUMNS * WIV_THUMBNAIL_SIZE, WIV_THUMBNAIL_ATLAS_ROWS * WIV_THUMBNAIL_SIZE);
+        const ImVec2 uv0 = ImVec2(index % WIV_THUMBNAIL_ATLAS_COLUMNS * WIV_THUMBNAIL_SIZE, index / WIV_THUMBNAIL_ATLAS_COLUMNS * WIV_THUMBNAIL_SIZE) / atlas_size;
+        const ImVec2 uv2 = uv0 + ImVec2(cell.width, cell.height) / atlas_size;
+
+        // Corners clockwise from the top left, every turn shifts them by one.
+        std::array<ImVec2, 4> uvs = { uv0, { uv2.x, uv0.y }, uv2, { uv0.x, uv2.y } };
+        std::ranges::rotate(uvs, uvs.begin() + (4 - turns) % 4);
+        draw_list->AddImageQuad(reinterpret_cast<ImTextureID>(srv_atlas.get()), p0, { p2.x, p0.y }, p2, { p0.x, p2.y }, uvs[0], uvs[1], uvs[2], uvs[3]);
+    }
+
+    // File name, clipped to the cell.
+    draw_list->PushClipRect(pos, pos + cell_size, true);
+    draw_list->AddText(pos + ImVec2(WIV_THUMBNAIL_PADDING, WIV_THUMBNAIL_SIZE + 2.0f * WIV_THUMBNAIL_PADDING), ImGui::GetColorU32(ImGuiCol_Text), reinterpret_cast<const char*>(name.c_str()));
+    draw_list->PopClipRect();
+    return is_clicked;
+}
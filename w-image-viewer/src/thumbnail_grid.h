@@ -0,0 +1,80 @@
+#pragma once
+
+#include "pch.h"
+#include "thumbnail_store.h"
+#include "thumbnail_loader.h"
+
+// Size of the thumbnail atlas texture, in thumbnails.
+inline constexpr int WIV_THUMBNAIL_ATLAS_COLUMNS = 32;
+inline constexpr int WIV_THUMBNAIL_ATLAS_ROWS = 16;
+
+// Thumbnails uploaded per frame at most, the rest come on the next frames.
+inline constexpr int WIV_THUMBNAIL_UPLOADS_PER_FRAME = 64;
+
+// Grid of the thumbnails of a directory, drawn with ImGui over the whole window.
+// Thumbnails come from the persistent thumbnail store, missing ones are made by the thumbnail loader.
+// Only the visible thumbnails are kept on the GPU, in a texture atlas with least recently drawn replacement.
+class Thumbnail_grid
+{
+public:
+    void create(ID3D11Device* device, ID3D11DeviceContext* device_context);
+
+    // Shows the files, starts making the thumbnails that are not in the store yet.
+    void open(std::vector<std::filesystem::directory_entry> files, const std::filesystem::path& file_current);
+    void close();
+
+    bool is_open() const noexcept
+    {
+        return is_open_;
+    }
+
+    // Returns the clicked file, or an empty path.
+    std::filesystem::path update();
+
+    // True if not all visible thumbnails are uploaded yet, another frame should be drawn.
+    bool is_pending() const noexcept
+    {
+        return is_pending_;
+    }
+
+    // WIV_WM_THUMBNAILS got handled, new thumbnails post it again.
+    void on_thumbnails() noexcept
+    {
+        is_thumbnails_posted = false;
+    }
+
+private:
+    struct Cell
+    {
+        int file; // -1 if the cell is free.
+        uint64_t frame; // Frame the cell was last drawn in.
+        int width;
+        int height;
+        int orientation;
+    };
+
+    int input();
+    int get_cell(int file);
+    bool draw_cell(int file, ImVec2 cell_size);
+
+    Com_ptr<ID3D11Device> device;
+    Com_ptr<ID3D11DeviceContext> ctx;
+    Com_ptr<ID3D11Texture2D> atlas;
+    Com_ptr<ID3D11ShaderResourceView> srv_atlas;
+    std::vector<std::filesystem::directory_entry> files;
+    std::vector<int> file_cells; // Atlas cell of every file, -1 if not uploaded.
+    std::array<Cell, WIV_THUMBNAIL_ATLAS_COLUMNS * WIV_THUMBNAIL_ATLAS_ROWS> cells;
+    uint64_t frame = 0;
+    int nuploads; // This frame.
+    int ncolumns;
+    int selected;
+    bool is_selected_scrolled;
+    int first_visible;
+    bool is_open_ = false;
+    bool is_pending_ = false;
+    std::atomic_bool is_thumbnails_posted;
+    Thumbnail_store store;
+
+    // Should be declared after the store, so it stops before the store closes.
+    Thumbnail_loader loader;
+};
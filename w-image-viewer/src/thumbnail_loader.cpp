@@ -0,0 +1,64 @@
+#include "pch.h"
+#include "thumbnail_loader.h"
+
+Thumbnail_loader::~Thumbnail_loader()
+{
+    stop();
+}
+
+void Thumbnail_loader::start(Thumbnail_store& store, std::vector<std::filesystem::directory_entry> files, std::function<void()> on_thumbnail)
+{
+    stop();
+    if (files.empty()) {
+        return;
+    }
+    this->store = &store;
+    this->files = std::move(files);
+    this->on_thumbnail = std::move(on_thumbnail);
+    is_taken = std::make_unique<std::atomic_bool[]>(this->files.size());
+    cursor = 0;
+
+    // Leave some cores for the viewer, the decoders are partly multithreaded themselves.
+    const auto nthreads = std::max(std::thread::hardware_concurrency() / 2, 1u);
+    for (unsigned int i = 0; i < nthreads; ++i) {
+        threads.emplace_back(std::bind_front(&Thumbnail_loader::run, this));
+    }
+}
+
+void Thumbnail_loader::stop()
+{
+    for (auto& thread : threads) {
+        thread.request_stop();
+    }
+    threads.clear();
+}
+
+void Thumbnail_loader::run(std::stop_token stop_token)
+{
+    // Done once a whole round finds only taken files.
+    size_t ntaken = 0;
+    while (ntaken < files.size() && !stop_token.stop_requested()) {
+        const auto index = cursor.fetch_add(1, std::memory_order_relaxed) % files.size();
+        if (is_taken[index].exchange(true, std::memory_order_relaxed)) {
+            ++ntaken;
+            continue;
+        }
+        ntaken = 0;
+        const auto& file = files[index];
+        const auto key = Thumbnail_store::get_key(file);
+        if (store->touch(key)) {
+            continue;
+        }
+        int width;
+        int height;
+        int orientation;
+        const auto data = Thumbnail_store::make(file.path(), width, height, orientation, stop_token);
+
+        // A cancelled read is not a failed one.
+        if (stop_token.stop_requested()) {
+            break;
+        }
+        store->put(key, data.get(), width, height, orientation);
+        on_thumbnail();
+    }
+}
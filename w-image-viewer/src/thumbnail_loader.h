@@ -0,0 +1,35 @@
+#pragma once
+
+#include "pch.h"
+#include "thumbnail_store.h"
+
+// Makes the thumbnails that are not in the store yet, on a few background threads.
+// Files are taken in order starting from the prioritized one, so the visible thumbnails come first.
+// Doesn't depend on the platform.
+class Thumbnail_loader
+{
+public:
+    ~Thumbnail_loader();
+
+    // Restarts the loader. on_thumbnail gets called from the loader threads after every stored thumbnail.
+    void start(Thumbnail_store& store, std::vector<std::filesystem::directory_entry> files, std::function<void()> on_thumbnail);
+    void stop();
+
+    // Continues from this file, the skipped files are done after the ones behind it.
+    void prioritize(size_t index) noexcept
+    {
+        cursor.store(index, std::memory_order_relaxed);
+    }
+
+private:
+    void run(std::stop_token stop_token);
+
+    Thumbnail_store* store;
+    std::vector<std::filesystem::directory_entry> files;
+    std::unique_ptr<std::atomic_bool[]> is_taken;
+    std::atomic_size_t cursor;
+    std::function<void()> on_thumbnail;
+
+    // Should be the last member, so it stops first.
+    std::vector<std::jthread> threads;
+};
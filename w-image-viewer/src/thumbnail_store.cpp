@@ -0,0 +1,361 @@
+#include "pch.h"
+#include "thumbnail_store.h"
+#include "image.h"
+#include "include/bench.h"
+
+namespace
+{
+    constexpr std::array<char, 4> WIV_THUMBNAIL_MAGIC = { 'W', 'I', 'V', 'T' };
+    constexpr uint32_t WIV_THUMBNAIL_VERSION = 2;
+}
+
+Thumbnail_store::~Thumbnail_store()
+{
+    close();
+}
+
+bool Thumbnail_store::open(const std::filesystem::path& path, uint64_t max_size, bool is_temporary)
+{
+    static_assert(sizeof(Block_header) <= BLOCK_HEADER_SIZE);
+    close();
+    max_blocks = static_cast<int>(std::clamp<uint64_t>(max_size / BLOCK_SIZE, 1, std::numeric_limits<int>::max() / WIV_THUMBNAIL_BLOCK_UNITS));
+
+#ifdef _WIN32
+    // Not shared, so another instance can't write into the same file.
+    const auto handle = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, is_temporary ? FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE : FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    file.reset(handle);
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file.get(), &file_size)) {
+        close();
+        return false;
+    }
+    const auto size = static_cast<uint64_t>(file_size.QuadPart);
+#else
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+
+    // Another instance holding the lock has the file open.
+    struct stat st;
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1 || fstat(fd, &st) == -1) {
+        close();
+        return false;
+    }
+
+    // The file stays until the descriptor gets closed.
+    if (is_temporary) {
+        unlink(path.c_str());
+    }
+    const auto size = static_cast<uint64_t>(st.st_size);
+#endif
+
+    // Drop the blocks over the limit and a partially written last block.
+    int nblocks = static_cast<int>(std::min<uint64_t>(size / BLOCK_SIZE, max_blocks));
+    if (size != nblocks * BLOCK_SIZE && !truncate(nblocks * BLOCK_SIZE)) {
+        close();
+        return false;
+    }
+    for (int block = 0; block < nblocks; ++block) {
+        if (!map_block(block)) {
+            close();
+            return false;
+        }
+
+        // Written by another version, drop it and everything after it.
+        const auto& header = get_header(block);
+        if (header.magic != WIV_THUMBNAIL_MAGIC || header.version != WIV_THUMBNAIL_VERSION || header.unit_size != UNIT_SIZE) {
+            blocks.pop_back();
+            nblocks = block;
+            if (!truncate(nblocks * BLOCK_SIZE)) {
+                close();
+                return false;
+            }
+            break;
+        }
+    }
+
+    // Records that overlap others or don't fit in their block are dropped, like the ones of another version.
+    units.assign(static_cast<size_t>(nblocks) * WIV_THUMBNAIL_BLOCK_UNITS, -1);
+    unit_next = 0;
+    free_begin = 0;
+    free_end = 0;
+    last_used = 0;
+    for (int unit = 0; unit < static_cast<int>(units.size()); ++unit) {
+        auto& record = get_record(unit);
+        if (record.state == Record_state::empty) {
+            continue;
+        }
+        const int nunits = get_units(record.width, record.height);
+        const int block_end = (unit / WIV_THUMBNAIL_BLOCK_UNITS + 1) * WIV_THUMBNAIL_BLOCK_UNITS;
+        const bool is_valid = (record.state == Record_state::thumbnail || record.state == Record_state::failed) && record.width <= WIV_THUMBNAIL_SIZE && record.height <= WIV_THUMBNAIL_SIZE && unit + nunits <= block_end;
+        if (!is_valid || std::any_of(units.begin() + unit, units.begin() + unit + nunits, [](int first) { return first >= 0; }) || !lru.emplace(record.last_used, unit).second) {
+            record.state = Record_state::empty;
+            continue;
+        }
+        std::fill_n(units.begin() + unit, nunits, unit);
+
+        // Of the same file, the most recently used one is kept.
+        if (const auto [it, is_inserted] = thumbnails.try_emplace(record.key.path_hash, unit); !is_inserted) {
+            erase(get_record(it->second).last_used < record.last_used ? std::exchange(it->second, unit) : unit);
+        }
+        unit_next = std::max(unit_next, unit + nunits);
+        last_used = std::max(last_used, record.last_used);
+    }
+
+    // A new file starts with one block.
+    return !blocks.empty() || add_block();
+}
+
+void Thumbnail_store::close() noexcept
+{
+    units.clear();
+    thumbnails.clear();
+    lru.clear();
+    blocks.clear();
+#ifdef _WIN32
+    file.reset();
+#else
+
+    // Also releases the lock.
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+    }
+#endif
+}
+
+std::optional<Thumbnail> Thumbnail_store::get(const Thumbnail_key& key)
+{
+    std::scoped_lock lock(mutex);
+    const int unit = use(key);
+    if (unit < 0) {
+        return std::nullopt;
+    }
+    const auto& record = get_record(unit);
+    Thumbnail thumbnail = { {}, record.width, record.height, record.orientation };
+    if (record.state == Record_state::thumbnail) {
+        const auto pixels = get_pixels(unit);
+        thumbnail.data.assign(pixels, pixels + static_cast<size_t>(record.width) * record.height * 4);
+    }
+    return thumbnail;
+}
+
+bool Thumbnail_store::touch(const Thumbnail_key& key)
+{
+    std::scoped_lock lock(mutex);
+    return use(key) >= 0;
+}
+
+void Thumbnail_store::put(const Thumbnail_key& key, const uint8_t* data, int width, int height, int orientation)
+{
+    std::scoped_lock lock(mutex);
+    if (blocks.empty()) {
+        return;
+    }
+
+    // The same file gets replaced, it may need a different number of units.
+    if (const auto it = thumbnails.find(key.path_hash); it != thumbnails.end()) {
+        erase(it->second);
+    }
+    if (!data) {
+        width = 0;
+        height = 0;
+    }
+    const int unit = allocate(get_units(width, height));
+
+    // Pixels go before the record, so a record is never seen without them, even if the process crashes in between.
+    // The system may write the dirty pages back in any order, so after a system crash a record can point at stale pixels.
+    if (data) {
+        std::memcpy(get_pixels(unit), data, static_cast<size_t>(width) * height * 4);
+    }
+    auto& record = get_record(unit);
+    record.key = key;
+    record.last_used = ++last_used;
+    record.width = static_cast<uint16_t>(width);
+    record.height = static_cast<uint16_t>(height);
+    record.orientation = static_cast<uint8_t>(orientation);
+    std::atomic_signal_fence(std::memory_order_release);
+    record.state = data ? Record_state::thumbnail : Record_state::failed;
+    thumbnails.emplace(key.path_hash, unit);
+    lru.emplace(last_used, unit);
+}
+
+/* static */ Thumbnail_key Thumbnail_store::get_key(const std::filesystem::directory_entry& entry)
+{
+    // On Windows directory_iterator already fills size and last write time, so these should not hit the disk.
+    std::error_code ec;
+    Thumbnail_key key;
+    key.path_hash = std::hash<std::filesystem::path::string_type>()(entry.path().native());
+    key.size = entry.file_size(ec);
+    key.last_write_time = entry.last_write_time(ec).time_since_epoch().count();
+    return key;
+}
+
+/* static */ Pixel_buffer Thumbnail_store::make(const std::filesystem::path& path, int& width, int& height, int& orientation, std::stop_token stop_token)
+{
+    WIV_BENCH_SCOPE("Thumbnail_store::make");
+    Image image;
+    if (!image.open(path, false, true)) {
+        return nullptr;
+    }
+    image.set_stop_token(stop_token);
+    orientation = image.orientation;
+    return image.get_reduced_data(WIV_THUMBNAIL_SIZE, width, height);
+}
+
+// Returns the first unit of the thumbnail, -1 if it's not stored or if the file changed since.
+// The thumbnail becomes the most recently used one.
+int Thumbnail_store::use(const Thumbnail_key& key)
+{
+    const auto it = thumbnails.find(key.path_hash);
+    if (it == thumbnails.end()) {
+        return -1;
+    }
+    auto& record = get_record(it->second);
+    if (record.key != key) {
+        return -1;
+    }
+    lru.erase(record.last_used);
+    record.last_used = ++last_used;
+    lru.emplace(last_used, it->second);
+    return it->second;
+}
+
+// Returns the first of nunits free units in one block.
+// Units are taken from the free run, then from the blocks not written yet, growing the file, then the least recently used thumbnails get replaced.
+int Thumbnail_store::allocate(int nunits)
+{
+    while (free_end - free_begin < nunits) {
+        if (unit_next == static_cast<int>(units.size()) && !add_block()) {
+            replace(nunits);
+            break;
+        }
+        free_begin = unit_next;
+        free_end = (unit_next / WIV_THUMBNAIL_BLOCK_UNITS + 1) * WIV_THUMBNAIL_BLOCK_UNITS;
+        unit_next = free_end;
+    }
+    const int unit = free_begin;
+    free_begin += nunits;
+    std::fill_n(units.begin() + unit, nunits, unit);
+    return unit;
+}
+
+// Makes the free run the free units around the least recently used thumbnail,
+// while they are less than nunits the next thumbnails get replaced too.
+// Thumbnails take a few units, so only a few get replaced out of order.
+void Thumbnail_store::replace(int nunits)
+{
+    int begin = 0;
+    if (!lru.empty()) {
+        begin = lru.begin()->second;
+        erase(begin);
+    }
+    const int block_begin = begin / WIV_THUMBNAIL_BLOCK_UNITS * WIV_THUMBNAIL_BLOCK_UNITS;
+    const int block_end = block_begin + WIV_THUMBNAIL_BLOCK_UNITS;
+    while (begin > block_begin && units[begin - 1] < 0) {
+        --begin;
+    }
+    int end = begin;
+    while (end < block_end && (units[end] < 0 || end - begin < nunits)) {
+        if (units[end] >= 0) {
+            erase(units[end]);
+        }
+        ++end;
+    }
+    while (end - begin < nunits) {
+        erase(units[begin - 1]);
+        while (begin > block_begin && units[begin - 1] < 0) {
+            --begin;
+        }
+    }
+    free_begin = begin;
+    free_end = end;
+}
+
+// Frees the units of the thumbnail starting at unit.
+void Thumbnail_store::erase(int unit) noexcept
+{
+    auto& record = get_record(unit);
+    const auto it = thumbnails.find(record.key.path_hash);
+    if (it != thumbnails.end() && it->second == unit) {
+        thumbnails.erase(it);
+    }
+    lru.erase(record.last_used);
+    std::fill_n(units.begin() + unit, get_units(record.width, record.height), -1);
+    record.state = Record_state::empty;
+}
+
+bool Thumbnail_store::add_block()
+{
+    const int block = static_cast<int>(blocks.size());
+    if (block == max_blocks || !truncate((block + 1) * BLOCK_SIZE) || !map_block(block)) {
+        return false;
+    }
+
+    // The new part of the file reads as zeros, so all records are empty.
+    auto& header = get_header(block);
+    header.magic = WIV_THUMBNAIL_MAGIC;
+    header.version = WIV_THUMBNAIL_VERSION;
+    header.unit_size = UNIT_SIZE;
+    units.resize(units.size() + WIV_THUMBNAIL_BLOCK_UNITS, -1);
+    return true;
+}
+
+#ifdef _WIN32
+
+void Thumbnail_store::Unmap::operator()(void* data) const noexcept
+{
+    UnmapViewOfFile(data);
+}
+
+bool Thumbnail_store::truncate(uint64_t size) noexcept
+{
+    LARGE_INTEGER distance;
+    distance.QuadPart = static_cast<LONGLONG>(size);
+    return SetFilePointerEx(file.get(), distance, nullptr, FILE_BEGIN) && SetEndOfFile(file.get());
+}
+
+bool Thumbnail_store::map_block(int block)
+{
+    // The view keeps the mapping alive.
+    const uint64_t offset = static_cast<uint64_t>(block) * BLOCK_SIZE;
+    const uint64_t end = offset + BLOCK_SIZE;
+    const std::unique_ptr<void, decltype(&CloseHandle)> mapping(CreateFileMappingW(file.get(), nullptr, PAGE_READWRITE, static_cast<DWORD>(end >> 32), static_cast<DWORD>(end), nullptr), CloseHandle);
+    if (!mapping) {
+        return false;
+    }
+    const auto view = MapViewOfFile(mapping.get(), FILE_MAP_WRITE, static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset), BLOCK_SIZE);
+    if (!view) {
+        return false;
+    }
+    blocks.emplace_back(view);
+    return true;
+}
+
+#else
+
+void Thumbnail_store::Unmap::operator()(void* data) const noexcept
+{
+    munmap(data, BLOCK_SIZE);
+}
+
+bool Thumbnail_store::truncate(uint64_t size) noexcept
+{
+    return ftruncate(fd, static_cast<off_t>(size)) == 0;
+}
+
+bool Thumbnail_store::map_block(int block)
+{
+    const auto view = mmap(nullptr, BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, static_cast<off_t>(block) * BLOCK_SIZE);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    blocks.emplace_back(view);
+    return true;
+}
+
+#endif
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "pch.h"
+#include "buffer_pool.h"
+
+// Longest edge of a stored thumbnail, thumbnails are stored as 8 bit 4 channel pixels.
+inline constexpr int WIV_THUMBNAIL_SIZE = 128;
+
+// Units per block, the file grows by whole blocks.
+inline constexpr int WIV_THUMBNAIL_BLOCK_UNITS = 1024;
+
+struct Thumbnail_key
+{
+    bool operator==(const Thumbnail_key&) const = default;
+    uint64_t path_hash;
+    uint64_t size;
+    int64_t last_write_time;
+};
+
+struct Thumbnail
+{
+    std::vector<uint8_t> data; // Empty if the file can't be opened.
+    int width;
+    int height;
+    int orientation; // Same as Image::orientation.
+};
+
+// Persistent thumbnail atlas keyed by (path, size, last write time).
+// The file is a sequence of blocks, every block has a page of records followed by the pixels.
+// Thumbnails are stored at their size, rounded up to whole units, and every unit has a record for the thumbnail starting at it.
+// Blocks are memory mapped one by one, so the file can grow while thumbnails are read from the mapped blocks.
+// Once the size limit is reached the least recently used thumbnails get replaced.
+// get() and put() are thread safe, only one process can have the file open.
+// Doesn't depend on the platform.
+class Thumbnail_store
+{
+public:
+    ~Thumbnail_store();
+
+    // The max size is rounded down to whole blocks, but there is always at least one.
+    // If is_temporary is true the file gets deleted once closed.
+    bool open(const std::filesystem::path& path, uint64_t max_size, bool is_temporary = false);
+    void close() noexcept;
+
+    bool is_open() const noexcept
+    {
+        return !blocks.empty();
+    }
+
+    // Returns std::nullopt if the file isn't stored or if it changed since.
+    // The pixels are copied, so a concurrent put() can't change them.
+    std::optional<Thumbnail> get(const Thumbnail_key& key);
+
+    // Same as get() without copying the pixels, returns false if the file isn't stored or if it changed since.
+    bool touch(const Thumbnail_key& key);
+
+    // data is width * height 8 bit 4 channel pixels, nullptr stores that the file can't be opened.
+    void put(const Thumbnail_key& key, const uint8_t* data, int width, int height, int orientation);
+
+    static Thumbnail_key get_key(const std::filesystem::directory_entry& entry);
+
+    // Reads the embedded thumbnail or decodes the image reduced to WIV_THUMBNAIL_SIZE.
+    // Returns nullptr if the file can't be opened or if stop was requested.
+    static Pixel_buffer make(const std::filesystem::path& path, int& width, int& height, int& orientation, std::stop_token stop_token = {});
+
+    // Units it takes to store a thumbnail of these dims, files that can't be opened take one too.
+    static int get_units(int width, int height) noexcept
+    {
+        return std::max(static_cast<int>((static_cast<size_t>(width) * height * 4 + UNIT_SIZE - 1) / UNIT_SIZE), 1);
+    }
+
+    static constexpr size_t UNIT_SIZE = 4096;
+
+    // Records take a whole allocation granularity, so blocks can be mapped at their offsets.
+    static constexpr size_t BLOCK_HEADER_SIZE = 64 * 1024;
+    static constexpr size_t BLOCK_SIZE = BLOCK_HEADER_SIZE + UNIT_SIZE * WIV_THUMBNAIL_BLOCK_UNITS;
+private:
+    enum class Record_state : uint8_t
+    {
+        empty,
+        thumbnail,
+        failed
+    };
+
+    // State is written last, a record that isn't empty always has its pixels.
+    struct Record
+    {
+        Thumbnail_key key;
+        uint64_t last_used; // Order of use, the lowest gets replaced first.
+        uint16_t width;
+        uint16_t height;
+        Record_state state;
+        uint8_t orientation;
+    };
+
+    struct Block_header
+    {
+        std::array<char, 4> magic;
+        uint32_t version;
+        uint32_t unit_size;
+        std::array<Record, WIV_THUMBNAIL_BLOCK_UNITS> records;
+    };
+
+    struct Unmap
+    {
+        void operator()(void* data) const noexcept;
+    };
+
+    Block_header& get_header(int block) const noexcept
+    {
+        return *static_cast<Block_header*>(blocks[block].get());
+    }
+
+    Record& get_record(int unit) const noexcept
+    {
+        return get_header(unit / WIV_THUMBNAIL_BLOCK_UNITS).records[unit % WIV_THUMBNAIL_BLOCK_UNITS];
+    }
+
+    uint8_t* get_pixels(int unit) const noexcept
+    {
+        return static_cast<uint8_t*>(blocks[unit / WIV_THUMBNAIL_BLOCK_UNITS].get()) + BLOCK_HEADER_SIZE + unit % WIV_THUMBNAIL_BLOCK_UNITS * UNIT_SIZE;
+    }
+
+    int use(const Thumbnail_key& key);
+    int allocate(int nunits);
+    void replace(int nunits);
+    void erase(int unit) noexcept;
+    bool truncate(uint64_t size) noexcept;
+    bool map_block(int block);
+    bool add_block();
+
+#ifdef _WIN32
+    std::unique_ptr<void, decltype(&CloseHandle)> file = { nullptr, CloseHandle };
+#else
+    int fd = -1;
+#endif
+    std::vector<std::unique_ptr<void, Unmap>> blocks;
+    int max_blocks;
+    std::vector<int> units; // First unit of the thumbnail using every unit, -1 if free.
+    std::unordered_map<uint64_t, int> thumbnails; // First unit by the path hash.
+    std::map<uint64_t, int> lru; // First unit by the last use.
+    int unit_next; // Units from here on were not written since the store got opened.
+    int free_begin; // Free units new thumbnails are written to, within a block.
+    int free_end;
+    uint64_t last_used; // Of the most recently used thumbnail.
+    std::mutex mutex;
+};
@@ -0,0 +1,358 @@
+#include "pch.h"
+#include "tiled_image.h"
+#include "include/helpers.h"
+#include "include/half.h"
+
+namespace
+{
+    // Written once the pyramid is complete, its last write time is when the pyramid was last opened.
+    constexpr const char* WIV_TILES_COMPLETE = "complete";
+
+    std::filesystem::path get_level_path(const std::filesystem::path& directory, int level)
+    {
+        return directory / (std::to_string(level) + ".bin");
+    }
+}
+
+bool Tiled_image::open(Image& image, const std::filesystem::path& path, const std::filesystem::path& cache_directory, uintmax_t cache_size, size_t memory_budget)
+{
+    close();
+    width = image.get_width<int>();
+    height = image.get_height<int>();
+    switch (image.get_basetype()) {
+        case OIIO::TypeDesc::UINT8:
+            format = OIIO::TypeDesc::UINT8;
+            bytes_per_pixel = 4;
+            break;
+
+        // Float images keep values outside of [0, 1].
+        case OIIO::TypeDesc::HALF:
+        case OIIO::TypeDesc::FLOAT:
+        case OIIO::TypeDesc::DOUBLE:
+            format = OIIO::TypeDesc::HALF;
+            bytes_per_pixel = 8;
+            break;
+        default:
+            format = OIIO::TypeDesc::UINT16;
+            bytes_per_pixel = 8;
+    }
+    nlevels = 1;
+    while (get_level_width(nlevels - 1) > WIV_TILE_SIZE || get_level_height(nlevels - 1) > WIV_TILE_SIZE) {
+        ++nlevels;
+    }
+    cache.set_budget(memory_budget);
+
+    // The on-disk tile cache is keyed by the path, the file size and the last write time.
+    std::error_code ec;
+    const auto key = std::to_string(std::filesystem::hash_value(path)) + '|' + std::to_string(std::filesystem::file_size(path, ec)) + '|' + std::to_string(std::filesystem::last_write_time(path, ec).time_since_epoch().count());
+    std::stringstream name;
+    name << std::hex << std::hash<std::string>()(key);
+    directory = cache_directory / name.str();
+
+    // Build the pyramid only if we don't already have a complete one, with none of the level files truncated.
+    const auto header = std::to_string(width) + ' ' + std::to_string(height) + ' ' + std::to_string(format) + ' ' + std::to_string(bytes_per_pixel) + ' ' + std::to_string(WIV_TILE_SIZE);
+    std::string line;
+    std::ifstream complete(directory / WIV_TILES_COMPLETE);
+    bool is_complete = std::getline(complete, line) && line == header;
+    complete.close();
+    for (int i = 0; is_complete && i < nlevels; ++i) {
+        is_complete = std::filesystem::file_size(get_level_path(directory, i), ec) == static_cast<uintmax_t>(get_ntiles_x(i)) * get_ntiles_y(i) * get_tile_size();
+    }
+    if (!is_complete) {
+        std::filesystem::remove(directory / WIV_TILES_COMPLETE, ec);
+        std::filesystem::create_directories(directory, ec);
+        if (ec) {
+            return false;
+        }
+        const bool is_built = bytes_per_pixel == 4 ? build<uint8_t>(image) : build<uint16_t>(image);
+
+        // Don't leave partial levels behind.
+        if (!is_built || !(std::ofstream(directory / WIV_TILES_COMPLETE) << header)) {
+            std::filesystem::remove_all(directory, ec);
+            return false;
+        }
+    }
+    else {
+        std::filesystem::last_write_time(directory / WIV_TILES_COMPLETE, std::filesystem::file_time_type::clock::now(), ec);
+    }
+    prune(cache_directory, cache_size, directory);
+
+    for (int i = 0; i < nlevels; ++i) {
+        levels.emplace_back(get_level_path(directory, i), std::ios::binary);
+        if (!levels.back().is_open()) {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+std::filesystem::path Tiled_image::get_cache_directory()
+{
+    std::error_code ec;
+    return std::filesystem::temp_directory_path(ec) / "wiv_tiles";
+}
+
+void Tiled_image::prune(const std::filesystem::path& cache_directory, uintmax_t size, const std::filesystem::path& keep)
+{
+    struct Entry
+    {
+        std::filesystem::path path;
+        std::filesystem::file_time_type time;
+        uintmax_t size;
+    };
+    std::vector<Entry> entries;
+    uintmax_t total = 0;
+    std::error_code ec;
+    for (const auto& dir : std::filesystem::directory_iterator(cache_directory, ec)) {
+        if (!dir.is_directory(ec)) {
+            continue;
+        }
+
+        // Incomplete pyramids (interrupted builds) age from their last write.
+        Entry entry = { dir.path(), std::filesystem::last_write_time(dir.path() / WIV_TILES_COMPLETE, ec), 0 };
+        if (ec) {
+            entry.time = dir.last_write_time(ec);
+        }
+        for (const auto& file : std::filesystem::directory_iterator(dir.path(), ec)) {
+            entry.size += file.file_size(ec);
+            if (ec) {
+                ec.clear();
+            }
+        }
+        total += entry.size;
+        entries.push_back(std::move(entry));
+    }
+    std::ranges::sort(entries, std::ranges::less(), &Entry::time);
+    for (const auto& entry : entries) {
+        if (total <= size) {
+            break;
+        }
+        if (entry.path == keep) {
+            continue;
+        }
+
+        // Fails for pyramids still open in another instance.
+        if (std::filesystem::remove_all(entry.path, ec) != static_cast<uintmax_t>(-1)) {
+            total -= entry.size;
+        }
+    }
+}
+
+void Tiled_image::close() noexcept
+{
+    levels.clear();
+    cache.clear();
+}
+
+int Tiled_image::get_level(float scale) const noexcept
+{
+    if (scale >= 1.0f) {
+        return 0;
+    }
+    return std::min(static_cast<int>(std::floor(std::log2(1.0f / scale) + WIV_FLT_EPS)), nlevels - 1);
+}
+
+int Tiled_image::get_level_width(int level) const noexcept
+{
+    return (width + (1 << level) - 1) >> level;
+}
+
+int Tiled_image::get_level_height(int level) const noexcept
+{
+    return (height + (1 << level) - 1) >> level;
+}
+
+int Tiled_image::get_ntiles_x(int level) const noexcept
+{
+    return (get_level_width(level) + WIV_TILE_SIZE - 1) / WIV_TILE_SIZE;
+}
+
+int Tiled_image::get_ntiles_y(int level) const noexcept
+{
+    return (get_level_height(level) + WIV_TILE_SIZE - 1) / WIV_TILE_SIZE;
+}
+
+Tile_region Tiled_image::get_region(float scale, int view_width, int view_height, float pan_x, float pan_y, int rotation, const Tile_region& current) const noexcept
+{
+    const int level = get_level(scale);
+    const float level_size = static_cast<float>(1 << level);
+    const int level_width = get_level_width(level);
+    const int level_height = get_level_height(level);
+
+    // Transform view corners into the image space.
+    const float theta = rotation * std::numbers::pi_v<float> / 180.0f;
+    const float cos_theta = std::cos(theta);
+    const float sin_theta = std::sin(theta);
+    float x_min = std::numeric_limits<float>::max();
+    float y_min = std::numeric_limits<float>::max();
+    float x_max = std::numeric_limits<float>::lowest();
+    float y_max = std::numeric_limits<float>::lowest();
+    for (const auto sx : { -0.5f, 0.5f }) {
+        for (const auto sy : { -0.5f, 0.5f }) {
+            const float qx = sx * view_width - pan_x;
+            const float qy = sy * view_height - pan_y;
+            const float x = ((cos_theta * qx + sin_theta * qy) / scale + width / 2.0f) / level_size;
+            const float y = ((cos_theta * qy - sin_theta * qx) / scale + height / 2.0f) / level_size;
+            x_min = std::min(x_min, x);
+            y_min = std::min(y_min, y);
+            x_max = std::max(x_max, x);
+            y_max = std::max(y_max, y);
+        }
+    }
+
+    // Visible region + kernel margin, it should never be empty.
+    Tile_region visible;
+    visible.level = level;
+    visible.x0 = std::clamp(static_cast<int>(std::floor(x_min)) - WIV_TILED_KERNEL_MARGIN, 0, level_width - 1);
+    visible.y0 = std::clamp(static_cast<int>(std::floor(y_min)) - WIV_TILED_KERNEL_MARGIN, 0, level_height - 1);
+    visible.x1 = std::clamp(static_cast<int>(std::ceil(x_max)) + WIV_TILED_KERNEL_MARGIN, visible.x0 + 1, level_width);
+    visible.y1 = std::clamp(static_cast<int>(std::ceil(y_max)) + WIV_TILED_KERNEL_MARGIN, visible.y0 + 1, level_height);
+
+    // Keep the current region if it still covers the visible one.
+    if (current.level == level && current.x0 <= visible.x0 && current.y0 <= visible.y0 && current.x1 >= visible.x1 && current.y1 >= visible.y1) {
+        return current;
+    }
+
+    const int margin = static_cast<int>(std::ceil(WIV_TILED_PAN_MARGIN / (scale * level_size)));
+    Tile_region region;
+    region.level = level;
+    region.x0 = std::max(visible.x0 - margin, 0);
+    region.y0 = std::max(visible.y0 - margin, 0);
+    region.x1 = std::min(visible.x1 + margin, level_width);
+    region.y1 = std::min(visible.y1 + margin, level_height);
+    return region;
+}
+
+Pixel_buffer Tiled_image::compose(const Tile_region& region)
+{
+    const size_t width = region.x1 - region.x0;
+    auto data = make_pixel_buffer(width * (region.y1 - region.y0) * bytes_per_pixel);
+    for (int ty = region.y0 / WIV_TILE_SIZE; ty * WIV_TILE_SIZE < region.y1; ++ty) {
+        const int y0 = std::max(region.y0, ty * WIV_TILE_SIZE);
+        const int y1 = std::min(region.y1, (ty + 1) * WIV_TILE_SIZE);
+        for (int tx = region.x0 / WIV_TILE_SIZE; tx * WIV_TILE_SIZE < region.x1; ++tx) {
+            const int x0 = std::max(region.x0, tx * WIV_TILE_SIZE);
+            const int x1 = std::min(region.x1, (tx + 1) * WIV_TILE_SIZE);
+            const auto tile = get_tile({ region.level, tx, ty });
+            if (!tile) {
+                return nullptr;
+            }
+            for (int y = y0; y < y1; ++y) {
+                const auto src = tile + (static_cast<size_t>(y - ty * WIV_TILE_SIZE) * WIV_TILE_SIZE + x0 - tx * WIV_TILE_SIZE) * bytes_per_pixel;
+                const auto dst = data.get() + (static_cast<size_t>(y - region.y0) * width + x0 - region.x0) * bytes_per_pixel;
+                std::memcpy(dst, src, static_cast<size_t>(x1 - x0) * bytes_per_pixel);
+            }
+        }
+    }
+    return data;
+}
+
+template<typename T>
+bool Tiled_image::build(Image& image)
+{
+    build_levels.resize(nlevels);
+    for (int i = 0; i < nlevels; ++i) {
+        build_levels[i].file.open(get_level_path(directory, i), std::ios::binary | std::ios::trunc);
+        build_levels[i].band.resize(static_cast<size_t>(get_level_width(i)) * WIV_TILE_SIZE * bytes_per_pixel);
+        build_levels[i].rows = 0;
+    }
+
+    // Stream the image band by band, so we never hold the whole image in memory.
+    for (int y = 0; y < height; y += WIV_TILE_SIZE) {
+        const int rows = std::min(WIV_TILE_SIZE, height - y);
+        if (!image.read_scanlines(y, y + rows, reinterpret_cast<T*>(build_levels[0].band.data()), format)) {
+            build_levels.clear();
+            return false;
+        }
+        build_levels[0].rows = rows;
+        build_flush_band<T>(0);
+    }
+
+    // Flush what's left in the higher levels.
+    for (int i = 1; i < nlevels; ++i) {
+        if (build_levels[i].rows > 0) {
+            build_flush_band<T>(i);
+        }
+    }
+
+    bool is_good = true;
+    for (auto& level : build_levels) {
+        level.file.close();
+        is_good = is_good && level.file.good();
+    }
+    build_levels.clear();
+    return is_good;
+}
+
+// Writes the band as a row of tiles, then downsamples it by 2 (box filter) into the next level.
+// Half pixels get averaged as floats.
+template<typename T>
+void Tiled_image::build_flush_band(int level)
+{
+    auto& band = build_levels[level];
+    const int level_width = get_level_width(level);
+
+    // Tiles on the right and the bottom edge are padded with zeros.
+    std::vector<uint8_t> tile(get_tile_size());
+    for (int x = 0; x < level_width; x += WIV_TILE_SIZE) {
+        const size_t size = static_cast<size_t>(std::min(WIV_TILE_SIZE, level_width - x)) * bytes_per_pixel;
+        std::ranges::fill(tile, 0);
+        for (int r = 0; r < band.rows; ++r) {
+            std::memcpy(tile.data() + static_cast<size_t>(r) * WIV_TILE_SIZE * bytes_per_pixel, band.band.data() + (static_cast<size_t>(r) * level_width + x) * bytes_per_pixel, size);
+        }
+        band.file.write(reinterpret_cast<const char*>(tile.data()), tile.size());
+    }
+
+    if (level + 1 < nlevels) {
+        auto& next = build_levels[level + 1];
+        const int next_width = get_level_width(level + 1);
+        const auto src = reinterpret_cast<const T*>(band.band.data());
+        for (int r = 0; r < band.rows; r += 2) {
+            const T* row0 = src + static_cast<size_t>(r) * level_width * 4;
+            const T* row1 = src + static_cast<size_t>(std::min(r + 1, band.rows - 1)) * level_width * 4;
+            T* dst = reinterpret_cast<T*>(next.band.data()) + static_cast<size_t>(next.rows) * next_width * 4;
+            for (int x = 0; x < next_width; ++x) {
+                const int x0 = 2 * x * 4;
+                const int x1 = std::min(2 * x + 1, level_width - 1) * 4;
+                if (format == OIIO::TypeDesc::HALF) {
+                    for (int c = 0; c < 4; ++c) {
+                        dst[4 * x + c] = static_cast<T>(float_to_half((half_to_float(row0[x0 + c]) + half_to_float(row0[x1 + c]) + half_to_float(row1[x0 + c]) + half_to_float(row1[x1 + c])) / 4.0f));
+                    }
+                }
+                else {
+                    for (int c = 0; c < 4; ++c) {
+                        dst[4 * x + c] = static_cast<T>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2u) / 4u);
+                    }
+                }
+            }
+            if (++next.rows == WIV_TILE_SIZE) {
+                build_flush_band<T>(level + 1);
+            }
+        }
+    }
+    band.rows = 0;
+}
+
+const uint8_t* Tiled_image::get_tile(const Tile_key& key)
+{
+    if (const auto tile = cache.get(key)) {
+        return tile->get();
+    }
+    auto tile = std::make_unique_for_overwrite<uint8_t[]>(get_tile_size());
+    auto& file = levels[key.level];
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(static_cast<size_t>(key.y) * get_ntiles_x(key.level) + key.x) * get_tile_size());
+    file.read(reinterpret_cast<char*>(tile.get()), get_tile_size());
+
+    // Tile files got removed or truncated, don't cache the failure.
+    if (file.gcount() != static_cast<std::streamsize>(get_tile_size())) {
+        return nullptr;
+    }
+    return cache.put(key, std::move(tile), get_tile_size())->get();
+}
+
+size_t Tiled_image::get_tile_size() const noexcept
+{
+    return static_cast<size_t>(WIV_TILE_SIZE) * WIV_TILE_SIZE * bytes_per_pixel;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "pch.h"
+#include "image.h"
+#include "include/lru_cache.h"
+
+inline constexpr int WIV_TILE_SIZE = 256;
+inline constexpr int WIV_TILED_KERNEL_MARGIN = 16; // In level pixels, enough for kernel support up to 8.
+inline constexpr float WIV_TILED_PAN_MARGIN = 256.0f; // In screen pixels, so we dont have to update region on every pan.
+
+struct Tile_key
+{
+    bool operator==(const Tile_key&) const = default;
+    int level;
+    int x;
+    int y;
+};
+
+struct Tile_key_hash
+{
+    size_t operator()(const Tile_key& key) const noexcept
+    {
+        return std::hash<uint64_t>()(static_cast<uint64_t>(key.level) << 48 ^ static_cast<uint64_t>(key.y) << 24 ^ static_cast<uint64_t>(key.x));
+    }
+};
+
+// Pixels [x0, x1) x [y0, y1) of a single level.
+struct Tile_region
+{
+    bool operator==(const Tile_region&) const = default;
+    int level;
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+// Image pyramid split into fixed size tiles, used for images larger than the max texture size.
+// Level 0 is the original image, every next level is downsampled by 2.
+// The pyramid gets built once per file into the on-disk tile cache,
+// from there tiles get loaded on demand into the memory budgeted LRU cache (the page table).
+// Doesn't depend on the platform.
+class Tiled_image
+{
+public:
+    // Builds the pyramid into its own directory in cache_directory, unless a complete one is already there.
+    // Then the least recently opened pyramids get removed until cache_directory fits in cache_size bytes.
+    // The build is cancelled through the stop token of the image, returns false if it failed or got cancelled.
+    // memory_budget is the size of the tiles kept in memory, in bytes.
+    bool open(Image& image, const std::filesystem::path& path, const std::filesystem::path& cache_directory, uintmax_t cache_size, size_t memory_budget);
+    void close() noexcept;
+
+    // The default on-disk tile cache, in the temporary directory.
+    static std::filesystem::path get_cache_directory();
+
+    // Removes the least recently opened pyramids until cache_directory fits in size bytes, keep never gets removed.
+    static void prune(const std::filesystem::path& cache_directory, uintmax_t size, const std::filesystem::path& keep = {});
+
+    // Returns the highest level that is still not smaller than the image scaled by scale.
+    int get_level(float scale) const noexcept;
+
+    int get_level_width(int level) const noexcept;
+    int get_level_height(int level) const noexcept;
+    int get_ntiles_x(int level) const noexcept;
+    int get_ntiles_y(int level) const noexcept;
+
+    // Picks the level for scale and the region of it that covers a view of view_width x view_height,
+    // with the image centered in the view, moved by pan and rotated clockwise by rotation degrees.
+    // Returns current if it still covers the visible part, otherwise the visible part with a pan margin, so small pans keep the region.
+    Tile_region get_region(float scale, int view_width, int view_height, float pan_x, float pan_y, int rotation, const Tile_region& current) const noexcept;
+
+    // UINT8 for 8 bit images, HALF for float images and UINT16 for all other images.
+    OIIO::TypeDesc::BASETYPE get_format() const noexcept
+    {
+        return format;
+    }
+
+    // 4 for 8 bit images and 8 for all other images.
+    int get_bytes_per_pixel() const noexcept
+    {
+        return bytes_per_pixel;
+    }
+
+    // Copies the region from the tiles into a single buffer.
+    // The region should be inside the level dims.
+    // Returns nullptr if a tile couldn't be read, like when the tile files got removed or truncated.
+    Pixel_buffer compose(const Tile_region& region);
+
+private:
+    template<typename T>
+    bool build(Image& image);
+
+    template<typename T>
+    void build_flush_band(int level);
+
+    // Returns nullptr if the tile couldn't be read.
+    const uint8_t* get_tile(const Tile_key& key);
+    size_t get_tile_size() const noexcept;
+
+    // Only used while building the pyramid.
+    struct Build_level
+    {
+        std::ofstream file;
+        std::vector<uint8_t> band; // WIV_TILE_SIZE rows.
+        int rows;
+    };
+    std::vector<Build_level> build_levels;
+
+    std::filesystem::path directory;
+    std::vector<std::ifstream> levels;
+    Lru_cache<Tile_key, std::unique_ptr<uint8_t[]>, Tile_key_hash> cache;
+    int width;
+    int height;
+    OIIO::TypeDesc::BASETYPE format;
+    int bytes_per_pixel;
+    int nlevels;
+};
@@ -1,13 +1,17 @@
 #include "pch.h"
 #include "user_interface.h"
 #include "include\global.h"
-#include "include\font.h"
+#include "font_atlas.h"
 #include "include\helpers.h"
 #include "include\shader_config.h"
 #include "resources\version.h"
 #include "include\supported_extensions.h"
 #include "window.h"
-#include "include\info.h"
+#include "buffer_pool.h"
+#include "icc.h"
+#include "include\bench.h"
+#include "include\profiler.h"
+#include "include\metrics.h"
 #include "include\ensure.h"
 
 enum WIV_OVERLAY_SHOW_ : uint64_t
@@ -21,7 +25,12 @@ enum WIV_OVERLAY_SHOW_ : uint64_t
     WIV_OVERLAY_SHOW_IMAGE_BITDEPTH = 1ull << 6,
     WIV_OVERLAY_SHOW_IMAGE_NCHANNELS = 1ull << 7,
     WIV_OVERLAY_SHOW_SCALE_FILTER = 1ull << 8,
-    WIV_OVERLAY_SHOW_KERNEL_SUPPORT = 1ull << 9
+    WIV_OVERLAY_SHOW_KERNEL_SUPPORT = 1ull << 9,
+    WIV_OVERLAY_SHOW_IMAGE_CACHE = 1ull << 10,
+    WIV_OVERLAY_SHOW_SLIDESHOW = 1ull << 11,
+    WIV_OVERLAY_SHOW_TIMINGS = 1ull << 12,
+    WIV_OVERLAY_SHOW_CMS_LUT = 1ull << 13,
+    WIV_OVERLAY_SHOW_FRAMES = 1ull << 14
 };
 
 namespace
@@ -63,13 +72,8 @@ void User_interface::create(ID3D11Device* device, ID3D11DeviceContext* device_co
     ImGui::CreateContext();
 
     // Font.
-    ImFontGlyphRangesBuilder builder;
-    builder.AddRanges(ImGui::GetIO().Fonts->GetGlyphRangesDefault());
-    builder.AddChar(0x0161); // š
-    ImVector<ImWchar> ranges;
-    builder.BuildRanges(&ranges);
-    ImGui::GetIO().Fonts->AddFontFromMemoryCompressedTTF(ROBOTO_MEDIUM_COMPRESSED_DATA, ROBOTO_MEDIUM_COMPRESSED_SIZE, 16, nullptr, ranges.Data);
-    ImGui::GetIO().Fonts->Build();
+    // The built atlas gets cached, building it is a good part of the startup.
+    font_atlas_create(*ImGui::GetIO().Fonts, g_config.get_path() / L"font_atlas.dat", g_config.font_atlas_cache.val);
     
     // Set imgui.ini path.
     // ImGui does not store the path!
@@ -80,6 +84,14 @@ void User_interface::create(ID3D11Device* device, ID3D11DeviceContext* device_co
     
     ImGui_ImplWin32_Init(g_hwnd);
     ImGui_ImplDX11_Init(device, device_context);
+    thumbnail_grid.create(device, device_context);
+
+    if (g_config.metrics_dump.val) {
+        metrics_dumper.start(g_config.get_path() / L"metrics.jsonl", std::chrono::seconds(g_config.metrics_dump_interval.val));
+    }
+    if (g_config.single_instance.val) {
+        start_single_instance();
+    }
 }
 
 void User_interface::update()
@@ -90,6 +102,12 @@ void User_interface::update()
     ImGui::NewFrame();
 
     input();
+    if (const auto path = thumbnail_grid.update(); !path.empty()) {
+        file_manager.file_open(path.c_str());
+    }
+    if (thumbnail_grid.is_pending()) {
+        frame_scheduler.schedule(Frame_scheduler::Clock::now());
+    }
     overlay();
     context_menu();
     window_settings();
@@ -110,6 +128,11 @@ void User_interface::update()
     //
 
     ImGui::Render();
+
+    // Keep the text cursor blinking.
+    if (ImGui::GetIO().WantTextInput) {
+        frame_scheduler.schedule(Frame_scheduler::Clock::now() + std::chrono::milliseconds(500));
+    }
 }
 
 void User_interface::draw() const
@@ -117,7 +140,7 @@ void User_interface::draw() const
     ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
 }
 
-void User_interface::auto_window_size() const
+void User_interface::auto_window_size(int image_width, int image_height) const
 {
     if (is_fullscreen || IsZoomed(g_hwnd)) {
         return;
@@ -136,8 +159,6 @@ void User_interface::auto_window_size() const
     const double screen_height = GetSystemMetrics(SM_CYVIRTUALSCREEN);
     
     // If the image resolution is larger than the screen resolution * 0.9, downsize the window to screen resolution * 0.9 with the aspect ratio of the image.
-    const double image_width = file_manager.image.get_width<double>();
-    const double image_height = file_manager.image.get_height<double>();
     const double scale_factor = std::min(std::min(screen_width * 0.9 / image_width, (screen_height - rect.top) * 0.9 / image_height), 1.0);
     rect.right = std::lround(image_width * scale_factor);
     rect.bottom = std::lround(image_height * scale_factor);
@@ -168,26 +189,59 @@ void User_interface::slideshow()
 
         return;
     }
-    static std::chrono::high_resolution_clock::time_point start;
-    
+    const auto interval = std::chrono::duration_cast<Frame_scheduler::Clock::duration>(std::chrono::duration<float>(g_config.slideshow_interval.val));
+    const auto now = Frame_scheduler::Clock::now();
+
     // Upon slideshow start we need to set once duration for the first image (currently renderered image).
     if (is_slideshow_start) {
-        start = std::chrono::high_resolution_clock::now();
+        slideshow_schedule.start(now, interval);
+        Metrics::slideshow_periods.set(0);
+        Metrics::slideshow_period_error_mean.set(0.0);
+        Metrics::slideshow_period_error_max.set(0.0);
         is_slideshow_start = false;
+        file_manager.preload_next();
     }
 
-    if (std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count() < g_config.slideshow_interval.val) {
+    // The next image is decoded ahead, so swapping it in doesn't wait for the decode.
+    if (slideshow_schedule.should_swap(now, interval) && !file_manager.show_preloaded()) {
+        file_manager.file_next();
+    }
+
+    // Wake up the render loop for the next image.
+    frame_scheduler.schedule(slideshow_schedule.get_deadline());
+}
+
+void User_interface::slideshow_created() noexcept
+{
+    slideshow_schedule.created();
+}
+
+void User_interface::slideshow_presented()
+{
+    const auto interval = std::chrono::duration_cast<Frame_scheduler::Clock::duration>(std::chrono::duration<float>(g_config.slideshow_interval.val));
+    if (!slideshow_schedule.presented(Frame_scheduler::Clock::now(), interval)) {
         return;
     }
-    file_manager.file_next();
-    PostMessageW(g_hwnd, WIV_WM_OPEN_FILE, 0, 0);
+    Metrics::slideshow_periods.set(slideshow_schedule.get_periods());
+    Metrics::slideshow_period_error_mean.set(slideshow_schedule.get_error_mean());
+    Metrics::slideshow_period_error_max.set(slideshow_schedule.get_error_max());
 
-    // This doesen't account for image load times.
-    start = std::chrono::high_resolution_clock::now();
+    // Opening the next image takes a while, so it's done once the swap is shown and not at the deadline.
+    if (is_slideshow_playing) {
+        file_manager.preload_next();
+    }
 }
 
 void User_interface::input()
 {
+    // The thumbnail grid handles its own input, only closing it is handled here.
+    if (thumbnail_grid.is_open()) {
+        if (ImGui::IsKeyPressed(ImGuiKey_Escape, false) || (!ImGui::GetIO().WantTextInput && ImGui::IsKeyPressed(ImGuiKey_G, false))) {
+            thumbnail_grid.close();
+        }
+        return;
+    }
+
     // Workaround for IsMouseDoubleClicked(0) triggering IsMouseDragging(0).
     static bool is_double_click;
     if (ImGui::IsMouseReleased(0))
@@ -303,20 +357,30 @@ void User_interface::input()
             if (file_manager.file_current.empty())
                 return;
             file_manager.file_previous();
-            ensure(PostMessageW(g_hwnd, WIV_WM_OPEN_FILE, 0, 0), != 0);
             return;
         }
         if (ImGui::IsKeyPressed(ImGuiKey_RightArrow)) {
             if (file_manager.file_current.empty())
                 return;
             file_manager.file_next();
-            ensure(PostMessageW(g_hwnd, WIV_WM_OPEN_FILE, 0, 0), != 0);
+            return;
+        }
+        if (ImGui::IsKeyPressed(ImGuiKey_PageUp)) {
+            file_manager.page_previous();
+            return;
+        }
+        if (ImGui::IsKeyPressed(ImGuiKey_PageDown)) {
+            file_manager.page_next();
             return;
         }
         if (ImGui::IsKeyPressed(ImGuiKey_F11)) {
             toggle_fullscreen();
             return;
         }
+        if (ImGui::IsKeyPressed(ImGuiKey_G, false)) {
+            open_thumbnail_grid();
+            return;
+        }
         if (ImGui::IsKeyPressed(ImGuiKey_Delete, false)) {
             file_manager.delete_file();
             return;
@@ -357,40 +421,89 @@ void User_interface::overlay() const
 
     ImGui::SetNextWindowBgAlpha(0.35f);
     if (ImGui::Begin("##overlay", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoInputs | ImGuiWindowFlags_AlwaysAutoResize)) {
+        const auto metrics = Metrics::snapshot();
         if (!g_config.overlay_config.val) {
             ImGui::TextUnformatted("Overlay is not configured.");
         }
         if (g_config.overlay_config.val & WIV_OVERLAY_SHOW_IMAGE_DIMS) {
-            ImGui::Text("Image W: %i", Info::image_width);
-            ImGui::Text("Image H: %i", Info::image_height);
+            ImGui::Text("Image W: %i", metrics.get<int>(Metrics::image_width));
+            ImGui::Text("Image H: %i", metrics.get<int>(Metrics::image_height));
         }
         if (g_config.overlay_config.val & WIV_OVERLAY_SHOW_IMAGE_BITDEPTH) {
-            ImGui::Text("Image bitdepth: %i", Info::image_bitdepth);
+            ImGui::Text("Image bitdepth: %i", metrics.get<int>(Metrics::image_bitdepth));
         }
         if (g_config.overlay_config.val & WIV_OVERLAY_SHOW_IMAGE_NCHANNELS) {
-            ImGui::Text("Image nchannels: %i", Info::image_nchannels);
+            ImGui::Text("Image nchannels: %i", metrics.get<int>(Metrics::image_nchannels));
         }
         if (g_config.overlay_config.val & WIV_OVERLAY_SHOW_SCALED_DIMS) {
-            ImGui::Text("Scaled W: %i", Info::scaled_width);
-            ImGui::Text("Scaled H: %i", Info::scaled_height);
+            ImGui::Text("Scaled W: %i", metrics.get<int>(Metrics::scaled_width));
+            ImGui::Text("Scaled H: %i", metrics.get<int>(Metrics::scaled_height));
         }
         if (g_config.overlay_config.val & WIV_OVERLAY_SHOW_SCALE) {
-            ImGui::Text("Scale: %.6f", Info::scale);
+            ImGui::Text("Scale: %.6f", metrics.get(Metrics::scale));
         }
         if (g_config.overlay_config.val & WIV_OVERLAY_SHOW_SCALE_FILTER) {
-            ImGui::Text("Scale filter: %s", Info::scale_filter.c_str());
+            ImGui::Text("Scale filter: %s", metrics.get<int>(Metrics::scale_filter) ? "Cylindrical" : "Orthogonal");
         }
         if (g_config.overlay_config.val & WIV_OVERLAY_SHOW_KERNEL_INDEX) {
-            ImGui::Text("Kernel: %s", kernel_function_names[Info::kernel_index]);
+            ImGui::Text("Kernel: %s", kernel_function_names[metrics.get<int>(Metrics::kernel_index)]);
         }
         if (g_config.overlay_config.val & WIV_OVERLAY_SHOW_KERNEL_SUPPORT) {
-            ImGui::Text("Kernel support: %.6f", Info::kernel_support);
+            ImGui::Text("Kernel support: %.6f", metrics.get(Metrics::kernel_support));
         }
         if (g_config.overlay_config.val & WIV_OVERLAY_SHOW_KERNEL_RADIUS) {
-            ImGui::Text("Kernel radius: %i", Info::kernel_radius);
+            ImGui::Text("Kernel radius: %i", metrics.get<int>(Metrics::kernel_radius));
         }
         if (g_config.overlay_config.val & WIV_OVERLAY_SHOW_KERNEL_SIZE) {
-            ImGui::Text("Kernel size: %i", Info::kernel_size);
+            ImGui::Text("Kernel size: %i", metrics.get<int>(Metrics::kernel_size));
+        }
+        if (g_config.overlay_config.val & WIV_OVERLAY_SHOW_IMAGE_CACHE) {
+            ImGui::Text("Image cache hits: %lli", metrics.get<int64_t>(Metrics::image_cache_hits));
+            ImGui::Text("Image cache misses: %lli", metrics.get<int64_t>(Metrics::image_cache_misses));
+            ImGui::Text("Image cache read: %.2f MB", metrics.get(Metrics::image_cache_bytes_read) / (1024.0 * 1024.0));
+            ImGui::Text("Image cache used: %.2f MB", metrics.get(Metrics::image_cache_memory_used) / (1024.0 * 1024.0));
+        }
+        if (g_config.overlay_config.val & WIV_OVERLAY_SHOW_SLIDESHOW && is_slideshow_playing) {
+            ImGui::Text("Slideshow periods: %i", metrics.get<int>(Metrics::slideshow_periods));
+            ImGui::Text("Slideshow period error mean: %.3f ms", metrics.get(Metrics::slideshow_period_error_mean));
+            ImGui::Text("Slideshow period error max: %.3f ms", metrics.get(Metrics::slideshow_period_error_max));
+        }
+        if (g_config.overlay_config.val & WIV_OVERLAY_SHOW_CMS_LUT && g_config.cms_use.val) {
+            if (metrics.get<int>(Metrics::cms_lut_size)) {
+                ImGui::Text("CMS LUT size: %i", metrics.get<int>(Metrics::cms_lut_size));
+            }
+            else {
+                ImGui::TextUnformatted("CMS LUT size: matrix-shaper");
+            }
+            if (metrics.get(Metrics::cms_lut_error) >= 0.0) {
+                ImGui::Text("CMS LUT max error: %.3f dE2000", metrics.get(Metrics::cms_lut_error));
+            }
+        }
+        if (g_config.overlay_config.val & WIV_OVERLAY_SHOW_FRAMES) {
+            if (animation.is_playing()) {
+                ImGui::Text("Animation frame: %i", metrics.get<int>(Metrics::animation_frame));
+                ImGui::Text("Animation frames late: %lli", metrics.get<int64_t>(Metrics::animation_frames_late));
+                ImGui::Text("Animation frame error p99: <= %.2f ms", metrics[Metrics::animation_frame_error].get_percentile(0.99));
+            }
+            else if (const int npages = file_manager.image.get_nsubimages(); npages > 1) {
+                ImGui::Text("Page: %i / %i", file_manager.page + 1, npages);
+            }
+            else if (file_manager.page > 0) {
+                ImGui::Text("Page: %i", file_manager.page + 1);
+            }
+        }
+        if (g_config.overlay_config.val & WIV_OVERLAY_SHOW_TIMINGS) {
+            ImGui::Text("Startup: %.3f ms", metrics.get(Metrics::startup_time));
+            if (metrics.get(Metrics::time_to_first_image) > 0.0) {
+                ImGui::Text("Time to first image: %.3f ms", metrics.get(Metrics::time_to_first_image));
+            }
+            ImGui::Text("Renders: %lli (%lli from the rendered view cache, %lli interim)", metrics.get<int64_t>(Metrics::renders), metrics.get<int64_t>(Metrics::render_cache_hits), metrics.get<int64_t>(Metrics::interim_renders));
+            for (const auto& timing : Profiler::cpu.get()) {
+                ImGui::Text("CPU %s: %.3f ms (%.3f ms)", timing.name, timing.average, timing.last);
+            }
+            for (const auto& timing : Profiler::gpu.get()) {
+                ImGui::Text("GPU %s: %.3f ms (%.3f ms)", timing.name, timing.average, timing.last);
+            }
         }
     }
     ImGui::End();
@@ -409,14 +522,16 @@ void User_interface::context_menu()
             if (file_manager.file_current.empty())
                 goto end;
             file_manager.file_next();
-            ensure(PostMessageW(g_hwnd, WIV_WM_OPEN_FILE, 0, 0), != 0);
             goto end;
         }
         if (ImGui::Selectable("Previous")) {
             if (file_manager.file_current.empty())
                 goto end;
             file_manager.file_previous();
-            ensure(PostMessageW(g_hwnd, WIV_WM_OPEN_FILE, 0, 0), != 0);
+            goto end;
+        }
+        if (ImGui::Selectable("Thumbnails")) {
+            open_thumbnail_grid();
             goto end;
         }
         ImGui::Separator();
@@ -719,35 +834,26 @@ void User_interface::window_settings()
         ImGui::Checkbox("Black Point Compensation", &g_config.cms_bpc_use.val);
 
         // LUT size
+        // Index 0 is auto, the rest map to WIV_CMS_LUT_SIZES.
         static constexpr std::array cms_lut_size_items = {
+            "Auto",
+            "17",
+            "25",
             "33",
             "49",
             "65",
         };
-        int cms_lut_size_items_index;
-        switch (g_config.cms_lut_size.val) {
-            case 33:
-                cms_lut_size_items_index = 0;
-                break;
-            case 49:
-                cms_lut_size_items_index = 1;
-                break;
-            case 65:
-                cms_lut_size_items_index = 2;
-        }
+        static_assert(cms_lut_size_items.size() == WIV_CMS_LUT_SIZES.size() + 1);
+        const auto it = std::find(WIV_CMS_LUT_SIZES.begin(), WIV_CMS_LUT_SIZES.end(), g_config.cms_lut_size.val);
+        int cms_lut_size_items_index = it == WIV_CMS_LUT_SIZES.end() ? 0 : static_cast<int>(it - WIV_CMS_LUT_SIZES.begin()) + 1;
         ImGui::Combo("LUT size", &cms_lut_size_items_index, cms_lut_size_items.data(), cms_lut_size_items.size());
-        switch (cms_lut_size_items_index) {
-            case 0:
-                g_config.cms_lut_size.val = 33;
-                break;
-            case 1:
-                g_config.cms_lut_size.val = 49;
-                break;
-            case 2:
-                g_config.cms_lut_size.val = 65;
-        }
+        g_config.cms_lut_size.val = cms_lut_size_items_index == 0 ? 0 : WIV_CMS_LUT_SIZES[cms_lut_size_items_index - 1];
+        ImGui::BeginDisabled(g_config.cms_lut_size.val != 0);
+        ImGui::InputFloat("Max LUT error (dE2000)", &g_config.cms_lut_max_error.val, 0.0f, 0.0f, "%.2f");
+        ImGui::EndDisabled();
         
         ImGui::Checkbox("Dither 8 bit images", &g_config.cms_dither.val);
+        ImGui::Checkbox("Use matrix-shaper fast path", &g_config.cms_matrix_shaper.val);
         ImGui::EndDisabled();
         ImGui::Spacing();
         ImGui::SeparatorText("Color tags");
@@ -804,14 +910,94 @@ void User_interface::window_settings()
         if (ImGui::Selectable("Scale kernel size", g_config.overlay_config.val & WIV_OVERLAY_SHOW_KERNEL_SIZE)) {
             g_config.overlay_config.val ^= WIV_OVERLAY_SHOW_KERNEL_SIZE;
         }
+        if (ImGui::Selectable("Image cache stats", g_config.overlay_config.val & WIV_OVERLAY_SHOW_IMAGE_CACHE)) {
+            g_config.overlay_config.val ^= WIV_OVERLAY_SHOW_IMAGE_CACHE;
+        }
+        if (ImGui::Selectable("Slideshow stats", g_config.overlay_config.val & WIV_OVERLAY_SHOW_SLIDESHOW)) {
+            g_config.overlay_config.val ^= WIV_OVERLAY_SHOW_SLIDESHOW;
+        }
+        if (ImGui::Selectable("Stage timings", g_config.overlay_config.val & WIV_OVERLAY_SHOW_TIMINGS)) {
+            g_config.overlay_config.val ^= WIV_OVERLAY_SHOW_TIMINGS;
+        }
+        if (ImGui::Selectable("CMS LUT", g_config.overlay_config.val & WIV_OVERLAY_SHOW_CMS_LUT)) {
+            g_config.overlay_config.val ^= WIV_OVERLAY_SHOW_CMS_LUT;
+        }
+        if (ImGui::Selectable("Pages and animation frames", g_config.overlay_config.val & WIV_OVERLAY_SHOW_FRAMES)) {
+            g_config.overlay_config.val ^= WIV_OVERLAY_SHOW_FRAMES;
+        }
         ImGui::Spacing();
     }
     if (ImGui::CollapsingHeader("Other")) {
         ImGui::Spacing();
         ImGui::Checkbox("Read only thumbnails in RAW images", &g_config.raw_thumb.val);
+        ImGui::Checkbox("Develop RAW images at half size", &g_config.raw_half_size.val);
+        ImGui::InputInt("RAW cache size (MB)", &g_config.raw_cache_size.val, 0, 0);
+        ImGui::Spacing();
+        ImGui::Checkbox("Read 32 bit float images as 16 bit float", &g_config.float_to_half.val);
+        ImGui::Spacing();
+        ImGui::InputInt("Tile cache size (MB)", &g_config.tile_cache_size.val, 0, 0);
+        ImGui::InputInt("Tile disk cache size (MB)", &g_config.tile_disk_cache_size.val, 0, 0);
+        ImGui::Spacing();
+        ImGui::Checkbox("Read images through the image cache", &g_config.image_cache.val);
+        if (ImGui::InputInt("Image cache size (MB)", &g_config.image_cache_size.val, 0, 0)) {
+            Image::update_image_cache_limits();
+        }
+        if (ImGui::InputInt("Image cache max open files", &g_config.image_cache_max_open_files.val, 0, 0)) {
+            Image::update_image_cache_limits();
+        }
+        ImGui::Spacing();
+        ImGui::Checkbox("Cache image metadata", &g_config.metadata_cache.val);
+        ImGui::Spacing();
+        if (ImGui::InputInt("Buffer pool size (MB)", &g_config.buffer_pool_size.val, 0, 0)) {
+            trim_pixel_buffers();
+        }
+        ImGui::Checkbox("Use large pages for pooled buffers", &g_config.buffer_pool_large_pages.val);
         ImGui::Spacing();
         ImGui::Checkbox("Cycle files on Next/Previous", &g_config.cycle_files.val);
         ImGui::Spacing();
+        ImGui::InputInt("Thumbnail cache size (MB)", &g_config.thumbnail_cache_size.val, 0, 0);
+        ImGui::Spacing();
+        ImGui::InputInt("Animation cache size (MB)", &g_config.animation_cache_size.val, 0, 0);
+        ImGui::Spacing();
+        ImGui::InputInt("Rendered view cache size (MB)", &g_config.render_cache_size.val, 0, 0);
+        ImGui::Spacing();
+        ImGui::InputFloat("Render time budget (ms)", &g_config.render_time_budget.val, 0.0f, 0.0f, "%.1f");
+        ImGui::Spacing();
+        ImGui::Checkbox("Cache the font atlas", &g_config.font_atlas_cache.val);
+        ImGui::Spacing();
+        if (ImGui::Checkbox("Single instance", &g_config.single_instance.val)) {
+            if (g_config.single_instance.val) {
+                start_single_instance();
+            }
+            else {
+                ipc_server.stop();
+            }
+        }
+        ImGui::Spacing();
+        bool is_bench_enabled = Bench::is_enabled;
+        if (ImGui::Checkbox("Record bench timings", &is_bench_enabled)) {
+            Bench::is_enabled = is_bench_enabled;
+        }
+        if (ImGui::Button("Export bench results")) {
+            Bench::write_files(g_config.get_path());
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Reset bench results")) {
+            Bench::reset();
+        }
+        ImGui::Spacing();
+        bool is_metrics_changed = ImGui::Checkbox("Dump metrics periodically", &g_config.metrics_dump.val);
+        is_metrics_changed |= ImGui::InputInt("Metrics dump interval (s)", &g_config.metrics_dump_interval.val, 0, 0);
+        if (is_metrics_changed) {
+            g_config.metrics_dump_interval.val = std::max(g_config.metrics_dump_interval.val, 1);
+            if (g_config.metrics_dump.val) {
+                metrics_dumper.start(g_config.get_path() / L"metrics.jsonl", std::chrono::seconds(g_config.metrics_dump_interval.val));
+            }
+            else {
+                metrics_dumper.stop();
+            }
+        }
+        ImGui::Spacing();
     }
     ImGui::SeparatorText("Changes");
     if (ImGui::Button("Revert changes", button_size)) {
@@ -893,10 +1079,7 @@ void User_interface::dialog_file_open(WIV_OPEN_ file_type)
                 wchar_t* path;
                 if (SUCCEEDED(shell_item->GetDisplayName(SIGDN_FILESYSPATH, &path))) {
                     if (file_type == WIV_OPEN_IMAGE) {
-                        if (file_manager.file_open(path)) {
-                            ensure(PostMessageW(g_hwnd, WIV_WM_OPEN_FILE, 0, 0), != 0);
-                        }
-                        else {
+                        if (!file_manager.file_open(path)) {
                             ensure(PostMessageW(g_hwnd, WIV_WM_RESET_RESOURCES, 0, 0), != 0);
                         }
                     }
@@ -931,4 +1114,31 @@ void User_interface::toggle_fullscreen()
         ensure(SetWindowPos(g_hwnd, HWND_TOP, 0, 0, cx, cy, SWP_NOZORDER | SWP_FRAMECHANGED | SWP_SHOWWINDOW | SWP_NOCOPYBITS), != 0);
     }
     is_fullscreen = !is_fullscreen;
-}
\ No newline at end of file
+}
+
+// Fails if another instance is already the single instance, that one keeps getting the files then.
+void User_interface::start_single_instance()
+{
+    ipc_server.start(WIV_INSTANCE_NAME, [this](std::string message) {
+        {
+            std::scoped_lock lock(paths_received_mutex);
+            paths_received.emplace_back(std::u8string(message.begin(), message.end()));
+        }
+        PostMessageW(g_hwnd, WIV_WM_OPEN_PATH, 0, 0);
+    });
+}
+
+std::vector<std::filesystem::path> User_interface::take_paths_received()
+{
+    std::scoped_lock lock(paths_received_mutex);
+    return std::exchange(paths_received, {});
+}
+
+void User_interface::open_thumbnail_grid()
+{
+    if (file_manager.file_current.empty()) {
+        return;
+    }
+    WIV_PROFILE_SCOPE("Thumbnail grid open");
+    thumbnail_grid.open(file_manager.get_directory_files(), file_manager.file_current);
+}
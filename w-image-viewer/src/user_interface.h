@@ -2,6 +2,12 @@
 
 #include "pch.h"
 #include "file_manager.h"
+#include "frame_scheduler.h"
+#include "slideshow_schedule.h"
+#include "ipc.h"
+#include "thumbnail_grid.h"
+#include "animation.h"
+#include "include\metrics.h"
 #include "include\global.h"
 
 enum WIV_OPEN_
@@ -18,11 +24,32 @@ public:
     void create(ID3D11Device* device, ID3D11DeviceContext* device_context, bool* should_update);
     void update();
     void draw() const;
-    void auto_window_size() const;
+    // Sizes the window for an image of these dims.
+    void auto_window_size(int image_width, int image_height) const;
     void reset_image_panzoom() noexcept;
     void slideshow();
+
+    // The image swapped in by the slideshow got created, the next frame presents it.
+    void slideshow_created() noexcept;
+
+    // Called after Present, measures the slideshow period once the swapped in image got presented,
+    // then preloads the next image.
+    void slideshow_presented();
     void toggle_fullscreen();
+
+    // Takes the paths received from later launches since the last call, in the order they arrived.
+    std::vector<std::filesystem::path> take_paths_received();
     File_manager file_manager;
+    Frame_scheduler frame_scheduler;
+    Metrics_dumper metrics_dumper;
+
+    // Queued by ipc_server, WIV_WM_OPEN_PATH only wakes up the window to take them.
+    // Declared before ipc_server, so they outlive its thread.
+    std::mutex paths_received_mutex;
+    std::vector<std::filesystem::path> paths_received;
+    Ipc_server ipc_server; // Receives files from later launches in single instance mode.
+    Thumbnail_grid thumbnail_grid;
+    Animation animation; // Frames of the current image, if it's animated.
     bool is_fullscreen;
     bool is_dialog_file_open;
     ImVec2 image_pan;
@@ -43,6 +70,8 @@ private:
     void window_slideshow();
     void window_about();
     void dialog_file_open(WIV_OPEN_ file_type);
+    void start_single_instance();
+    void open_thumbnail_grid();
     bool is_overlay_open = g_config.overlay_show.val;
     bool is_window_settings_open;
     bool is_window_slideshow_open;
@@ -50,4 +79,5 @@ private:
     bool* prenderer_should_update;
     bool is_slideshow_start;
     bool is_slideshow_playing;
+    Slideshow_schedule slideshow_schedule;
 };
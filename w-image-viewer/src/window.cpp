@@ -4,6 +4,7 @@
 #include "include\helpers.h"
 #include "resources\Resource.h"
 #include "include\ensure.h"
+#include "include\profiler.h"
 
 enum WIV_WINDOW_NAME_
 {
@@ -15,10 +16,26 @@ enum WIV_WINDOW_NAME_
 namespace
 {
     constexpr auto WIV_WINDOW_NAME = L"W Image Viewer";
+
+    // Time since the process got created in ms, so the startup times also include loading the executable.
+    double get_process_uptime() noexcept
+    {
+        FILETIME creation;
+        FILETIME exit;
+        FILETIME kernel;
+        FILETIME user;
+        GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+        FILETIME now;
+        GetSystemTimePreciseAsFileTime(&now);
+        const auto to_uint64 = [](const FILETIME& filetime) { return static_cast<uint64_t>(filetime.dwHighDateTime) << 32 | filetime.dwLowDateTime; };
+        return static_cast<double>(to_uint64(now) - to_uint64(creation)) / 10'000.0; // FILETIME is in 100 ns units.
+    }
 }
 
-Window::Window(HINSTANCE hinstance, int ncmdshow)
+void Window::create(HINSTANCE hinstance, int ncmdshow)
 {
+    WIV_PROFILE_SCOPE("Window creation");
+
     // Register window class.
     WNDCLASSEXW wndclassexw = {};
     wndclassexw.cbSize = sizeof(WNDCLASSEXW);
@@ -41,26 +58,72 @@ Window::Window(HINSTANCE hinstance, int ncmdshow)
         renderer.ui.toggle_fullscreen();
     }
     renderer.init();
+
+    // Sized for the startup image from its cached dims, so the window doesn't get resized once the image is decoded.
+    const auto& file_startup = renderer.ui.file_manager.file_current;
+    if (g_config.window_autowh.val && !file_startup.empty()) {
+        if (const auto metadata = renderer.ui.file_manager.get_metadata(file_startup); metadata && metadata->is_valid) {
+            renderer.ui.auto_window_size(metadata->width, metadata->height);
+        }
+    }
     ShowWindow(g_hwnd, ncmdshow);
+
+    // The startup image may be already decoded.
+    is_first_image_pending = !renderer.ui.file_manager.file_current.empty();
+    renderer.ui.file_manager.loader.set_on_decoded([] {
+        PostMessageW(g_hwnd, WIV_WM_OPEN_FILE, 0, 0);
+    });
+    Metrics::startup_time.set(get_process_uptime());
 }
 
 int Window::message_loop()
 {
+    auto& frame_scheduler = renderer.ui.frame_scheduler;
     MSG msg = {};
     while (msg.message != WM_QUIT) {
         if (PeekMessageW(&msg, nullptr, 0, 0, PM_REMOVE)) {
             TranslateMessage(&msg);
             DispatchMessageW(&msg);
+
+            // Every message (input, decoded image, resize) may change the frame.
+            frame_scheduler.invalidate(Frame_scheduler::Clock::now());
+        }
+        else if (is_minimized) {
+            WaitMessage();
+        }
+        else if (frame_scheduler.should_draw(Frame_scheduler::Clock::now())) {
+            renderer.ui.slideshow();
+            renderer.animate();
+            renderer.update();
+            renderer.draw();
+            renderer.ui.slideshow_presented();
+            renderer.fullscreen_hide_cursor();
+            if (is_first_image_pending && renderer.ui.file_manager.image.is_valid()) {
+                is_first_image_pending = false;
+                Metrics::time_to_first_image.set(get_process_uptime());
+            }
+
+            // Still zooming.
+            if (renderer.should_update) {
+                frame_scheduler.invalidate(Frame_scheduler::Clock::now());
+            }
         }
+
+        // Nothing changed, sleep until a message arrives or until the next scheduled frame.
+        // The wait timeout has the system timer resolution (usually 15.6 ms),
+        // so the high resolution timer is used to wake up on time for the slideshow.
         else {
-            if (!is_minimized) {
-                renderer.ui.slideshow();
-                renderer.update();
-                renderer.draw();
-                renderer.fullscreen_hide_cursor();
+            const auto wait = frame_scheduler.get_wait(Frame_scheduler::Clock::now());
+            if (wait && frame_timer) {
+                LARGE_INTEGER due_time; // Negative is relative, in 100 ns units.
+                due_time.QuadPart = -std::max<LONGLONG>(std::chrono::duration_cast<std::chrono::nanoseconds>(*wait).count() / 100, 1);
+                const auto handle = frame_timer.get();
+                SetWaitableTimer(handle, &due_time, 0, nullptr, nullptr, FALSE);
+                MsgWaitForMultipleObjectsEx(1, &handle, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
             }
             else {
-                WaitMessage();
+                const auto timeout = wait ? static_cast<DWORD>(std::chrono::ceil<std::chrono::milliseconds>(*wait).count()) : INFINITE;
+                MsgWaitForMultipleObjectsEx(0, nullptr, timeout, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
             }
         }
     }
@@ -119,16 +182,45 @@ LRESULT Window::handle_message(HWND hwnd, UINT message, WPARAM wparam, LPARAM lp
             while (ShowCursor(TRUE) < 0);
             return 0;
 
-        case WIV_WM_OPEN_FILE:
-            renderer.create_image();
-            if (g_config.window_autowh.val) {
-                renderer.ui.auto_window_size();
+        case WIV_WM_OPEN_FILE: {
+            auto decoded_image = renderer.ui.file_manager.loader.take();
+
+            // Drop images we already navigated away from.
+            if (!decoded_image || decoded_image->path != renderer.ui.file_manager.file_current) {
+                return 0;
+            }
+
+            // The startup file couldn't be opened, show no image like a failed file_open() does.
+            if (decoded_image->is_failed) {
+                renderer.ui.file_manager.file_current.clear();
+                is_first_image_pending = false;
+                set_window_name();
+                renderer.should_update = true;
+                return 0;
+            }
+
+            // Keep the current view until the full image arrives.
+            if (decoded_image->is_preview) {
+                renderer.create_image(*decoded_image);
+                renderer.should_update = true;
+                return 0;
+            }
+
+            renderer.ui.file_manager.image = std::move(*decoded_image->image);
+            renderer.ui.file_manager.file_shown = decoded_image->path;
+            renderer.create_image(*decoded_image);
+            renderer.ui.slideshow_created();
+            if (!decoded_image->keep_view) {
+                if (g_config.window_autowh.val) {
+                    renderer.ui.auto_window_size(renderer.ui.file_manager.image.get_width<int>(), renderer.ui.file_manager.image.get_height<int>());
+                }
+                renderer.ui.reset_image_panzoom();
+                reset_image_rotation();
             }
-            renderer.ui.reset_image_panzoom();
-            reset_image_rotation();
             set_window_name();
             renderer.should_update = true;
             return 0;
+        }
         case WM_SIZING:
             if (g_config.window_keep_aspect.val && renderer.ui.file_manager.image.is_valid()) {
                 auto rect = reinterpret_cast<RECT*>(lparam);
@@ -169,16 +261,27 @@ LRESULT Window::handle_message(HWND hwnd, UINT message, WPARAM wparam, LPARAM lp
             return 0;
         case WM_DROPFILES:
             ensure(SetForegroundWindow(hwnd), != 0);
-            if (renderer.ui.file_manager.drag_and_drop(reinterpret_cast<HDROP>(wparam))) {
-                renderer.create_image();
-                if (g_config.window_autowh.val) {
-                    renderer.ui.auto_window_size();
-                }
-                renderer.ui.reset_image_panzoom();
-                reset_image_rotation();
-                set_window_name();
-                renderer.should_update = true;
+            renderer.ui.file_manager.drag_and_drop(reinterpret_cast<HDROP>(wparam));
+            return 0;
+        case WIV_WM_OPEN_PATH: {
+            // Paths received since the last wake up, only the last one would be shown anyway.
+            const auto paths = renderer.ui.take_paths_received();
+            if (paths.empty()) {
+                return 0;
+            }
+            if (IsIconic(hwnd)) {
+                ShowWindow(hwnd, SW_RESTORE);
             }
+            SetForegroundWindow(hwnd);
+            renderer.ui.file_manager.file_open(paths.back().c_str());
+            return 0;
+        }
+        case WIV_WM_THUMBNAILS:
+            renderer.ui.thumbnail_grid.on_thumbnails();
+            return 0;
+
+        // Only wakes up the message loop, the frame gets shown on the next draw.
+        case WIV_WM_ANIMATION_FRAME:
             return 0;
         case WIV_WM_RESET_RESOURCES:
             renderer.reset_resources();
@@ -210,24 +313,7 @@ void Window::set_window_name() const
 
 void Window::reset_image_rotation() noexcept
 {
-    // Rotated 180.
-    if (renderer.ui.file_manager.image.orientation == 2) {
-        renderer.ui.image_rotation = -180;
-    }
-
-    // Rotated 90 cw.
-    else if (renderer.ui.file_manager.image.orientation == 5) {
-        renderer.ui.image_rotation = -90;
-    }
-
-    // Rotated 90 ccw.
-    else if (renderer.ui.file_manager.image.orientation == 7) {
-        renderer.ui.image_rotation = 90;
-    }
-
-    else {
-        renderer.ui.image_rotation = 0;
-    }
+    renderer.ui.image_rotation = Image::get_rotation(renderer.ui.file_manager.image.orientation);
 
     // Reset orientation.
     renderer.ui.file_manager.image.orientation = 0;
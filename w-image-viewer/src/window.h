@@ -11,11 +11,18 @@ inline constexpr auto WIV_WINDOW_EX_STYLE = WS_EX_ACCEPTFILES;
 // Window messages.
 inline constexpr auto WIV_WM_OPEN_FILE = WM_USER + 0;
 inline constexpr auto WIV_WM_RESET_RESOURCES = WM_USER + 1;
+inline constexpr auto WIV_WM_OPEN_PATH = WM_USER + 2; // Paths from later launches got queued, see User_interface::take_paths_received().
+inline constexpr auto WIV_WM_THUMBNAILS = WM_USER + 3; // New thumbnails for the thumbnail grid.
+inline constexpr auto WIV_WM_ANIMATION_FRAME = WM_USER + 4; // A late animation frame got decoded.
+
+// IPC channel name of the single instance.
+inline constexpr auto WIV_INSTANCE_NAME = "w-image-viewer";
 
 class Window
 {
 public:
-    Window(HINSTANCE hinstance, int ncmdshow);
+    // Creates the window, the device and the UI.
+    void create(HINSTANCE hinstance, int ncmdshow);
     int message_loop();
     Renderer renderer;
     bool is_minimized;
@@ -24,4 +31,10 @@ private:
     LRESULT handle_message(HWND hwnd, UINT message, WPARAM wparam, LPARAM lparam);
     void set_window_name() const;
     void reset_image_rotation() noexcept;
+
+    // The startup image is not presented yet.
+    bool is_first_image_pending;
+
+    // Wakes up the message loop for scheduled frames, null if high resolution timers are not supported.
+    std::unique_ptr<void, decltype(&CloseHandle)> frame_timer = { CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS), CloseHandle };
 };